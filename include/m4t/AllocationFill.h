@@ -0,0 +1,77 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+/// @brief Filling of memory blocks returned by the global `operator new` with a pattern.
+/// @details The functions in this file are implemented in the separate library `common-cpp-testing::m4t_new` which
+/// also replaces the global allocation functions.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <optional>
+
+namespace m4t {
+
+/// @brief The default fill pattern which is the same as the one used by the debug heap of the Microsoft C runtime.
+inline constexpr unsigned char kDefaultFillPattern = 0xCD;
+
+/// @brief Start filling all memory blocks returned by the global `operator new` with a pattern.
+/// @details This allows `EXPECT_UNINITIALIZED_RANGE` to detect writes to fresh memory with any C runtime. Memory
+/// allocated by other means than `operator new` is not filled.
+/// @param pattern The value for all bytes of new memory blocks.
+void EnableAllocationFill(unsigned char pattern = kDefaultFillPattern) noexcept;
+
+/// @brief Stop filling new memory blocks.
+void DisableAllocationFill() noexcept;
+
+/// @brief Get the pattern used for filling new memory blocks.
+/// @return The pattern or `std::nullopt` if filling is disabled.
+[[nodiscard]] std::optional<unsigned char> GetAllocationFillPattern() noexcept;
+
+namespace internal {
+
+/// @brief The value of `g_fillPattern` if filling is disabled.
+inline constexpr int kNoFill = -1;
+
+/// @brief The fill pattern or `kNoFill`.
+/// @details Defined inline so that the global `operator new` only needs a single load if filling is disabled.
+inline constinit std::atomic<int> g_fillPattern = kNoFill;
+
+/// @brief Fill a new memory block with the pattern if filling is enabled.
+/// @param p The memory block.
+/// @param size The number of bytes to fill.
+inline void FillAllocation(void* const p, const std::size_t size) noexcept {
+	const int pattern = g_fillPattern.load(std::memory_order_relaxed);
+	if (pattern != kNoFill) {
+		[[unlikely]];
+		std::memset(p, pattern, size);
+	}
+}
+
+/// @brief Helper for `EXPECT_UNINITIALIZED_RANGE` which prefers the active fill pattern.
+/// @param fallback The pattern of the C runtime or `std::nullopt` if the runtime does not fill new memory.
+/// @return The result of `GetAllocationFillPattern` or @p fallback if filling is disabled.
+[[nodiscard]] inline std::optional<unsigned char> GetUninitializedPattern(const std::optional<unsigned char> fallback) noexcept {
+	const std::optional<unsigned char> pattern = GetAllocationFillPattern();
+	return pattern ? pattern : fallback;
+}
+
+}  // namespace internal
+
+}  // namespace m4t
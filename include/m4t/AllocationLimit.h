@@ -0,0 +1,90 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+/// @brief Counting of calls of the global `operator new` and `operator delete`.
+/// @details The functions and classes in this file are implemented together with the replacement of the global
+/// allocation functions in the separate library `common-cpp-testing::m4t_new`. Using them without linking this
+/// library is an error.
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+/// @brief Generates a failure if the following block calls the global `operator new` more than @p max_ times.
+/// @details Usage: `EXPECT_MAX_ALLOCATIONS(2) { ... }`. Only calls by the current thread are counted. This macro
+/// requires linking with `common-cpp-testing::m4t_new`.
+/// @param max_ The maximum number of allocations.
+#define EXPECT_MAX_ALLOCATIONS(max_) \
+	for (m4t::internal::AllocationLimitScope m4t_allocationLimitScope_((max_), __FILE__, __LINE__); m4t_allocationLimitScope_.Enter();)
+
+/// @brief Generates a failure if the following block calls the global `operator new`.
+/// @details Usage: `EXPECT_NO_ALLOCATIONS { ... }`. Only calls by the current thread are counted. This macro requires
+/// linking with `common-cpp-testing::m4t_new`.
+#define EXPECT_NO_ALLOCATIONS EXPECT_MAX_ALLOCATIONS(0)
+
+namespace m4t {
+
+/// @brief The number of calls of the global allocation functions by a thread.
+struct AllocationCounts {
+	std::size_t allocations = 0;    ///< @brief The number of calls of any `operator new`.
+	std::size_t bytes = 0;          ///< @brief The number of bytes requested from any `operator new`.
+	std::size_t deallocations = 0;  ///< @brief The number of calls of any `operator delete` for a pointer other than `nullptr`.
+};
+
+namespace internal {
+
+/// @brief Helper for `EXPECT_MAX_ALLOCATIONS` which counts allocations of the current thread while it exists.
+/// @details Scopes may be nested, allocations within an inner scope are also counted for all outer scopes.
+class AllocationLimitScope {
+public:
+	/// @brief Start counting.
+	/// @param maxAllocations The maximum number of allocations which do not generate a failure.
+	/// @param file The source file for reporting a failure.
+	/// @param line The source line for reporting a failure.
+	AllocationLimitScope(std::size_t maxAllocations, const char* file, int line) noexcept;
+	AllocationLimitScope(const AllocationLimitScope&) = delete;
+	AllocationLimitScope(AllocationLimitScope&&) = delete;
+	~AllocationLimitScope() noexcept;
+
+public:
+	AllocationLimitScope& operator=(const AllocationLimitScope&) = delete;
+	AllocationLimitScope& operator=(AllocationLimitScope&&) = delete;
+
+public:
+	/// @brief Allows to run the block of the `for` statement exactly once.
+	/// @return `true` on the first call, else `false`.
+	[[nodiscard]] bool Enter() noexcept {
+		return !std::exchange(m_entered, true);
+	}
+
+	/// @brief Get the number of calls since the start of the scope.
+	/// @return The counts.
+	[[nodiscard]] AllocationCounts GetCounts() const noexcept;
+
+private:
+	const std::size_t m_maxAllocations;  ///< @brief The maximum number of allocations.
+	const char* const m_file;            ///< @brief The source file.
+	const int m_line;                    ///< @brief The source line.
+	const AllocationCounts m_outer;      ///< @brief The counts of the enclosing scope at the start of this scope.
+	const bool m_outerArmed;             ///< @brief `true` if counting has been active at the start of this scope.
+	bool m_entered = false;              ///< @brief `true` if the block has been run.
+};
+
+}  // namespace internal
+
+}  // namespace m4t
@@ -0,0 +1,101 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+namespace m4t::internal {
+
+/// @brief Calculate the hash value for a memory address.
+/// @details Uses the finalizer of MurmurHash3 because the lower bits of addresses are mostly zero.
+/// @param key The address.
+/// @return The hash value.
+constexpr std::uint64_t HashAddress(const std::uintptr_t key) noexcept {
+	std::uint64_t hash = key;
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+/// @brief The data stored for each memory block.
+struct AllocationRecord {
+	std::size_t size;              ///< @brief The requested size of the memory block.
+	std::uint64_t generation = 0;  ///< @brief The sequence number of the allocation.
+	std::uint32_t stack = 0;       ///< @brief The id of the call stack of the allocation in a `StackTable`.
+	float weight = 0;              ///< @brief The number of allocations represented by a sampled block, 0 if not sampling.
+};
+
+/// @brief A concurrent map of memory block addresses to an `AllocationRecord`.
+/// @details The table is split into shards by the hash of the address. Each shard is an open-addressing table of atomic
+/// slots. `Insert`, `Erase` and `Find` only hold the lock of a single shard in shared mode and update the slots
+/// using compare-and-swap, so calls never block each other. The lock is acquired exclusively only for growing a shard.
+class AllocationTable {
+public:
+	AllocationTable();
+	AllocationTable(const AllocationTable&) = delete;
+	AllocationTable(AllocationTable&&) = delete;
+	~AllocationTable() noexcept;
+
+public:
+	AllocationTable& operator=(const AllocationTable&) = delete;
+	AllocationTable& operator=(AllocationTable&&) = delete;
+
+public:
+	/// @brief Add an address to the table.
+	/// @details The address MUST NOT be in the table already. `nullptr` is ignored.
+	/// @param p The address.
+	/// @param record The data of the memory block.
+	void Insert(const void* p, const AllocationRecord& record);
+
+	/// @brief Remove an address from the table.
+	/// @param p The address.
+	/// @return The data of the memory block or `std::nullopt` if the address was not in the table.
+	std::optional<AllocationRecord> Erase(const void* p) noexcept;
+
+	/// @brief Get the data of an address.
+	/// @details May run concurrently with erasing @p p. The record is copied again if the slot is reused meanwhile.
+	/// @param p The address.
+	/// @return The data of the memory block or `std::nullopt` if the address is not in the table.
+	[[nodiscard]] std::optional<AllocationRecord> Find(const void* p) const noexcept;
+
+	/// @brief Check if an address is in the table.
+	/// @param p The address.
+	/// @return `true` if the address is in the table.
+	[[nodiscard]] bool Contains(const void* p) const noexcept;
+
+	/// @brief Get the number of addresses in the table.
+	/// @return The number of addresses.
+	[[nodiscard]] std::size_t GetCount() const noexcept;
+
+private:
+	struct Shard;
+
+	static constexpr std::size_t kShardBits = 6;                  ///< @brief The number of hash bits used for selecting a shard.
+	static constexpr std::size_t kShardCount = 1u << kShardBits;  ///< @brief The number of shards.
+
+	std::unique_ptr<Shard[]> m_shards;  ///< @brief The shards of the table.
+};
+
+}  // namespace m4t::internal
@@ -0,0 +1,159 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <thread>
+#include <vector>
+
+namespace m4t {
+
+/// @brief The operation of a `TraceRecord`.
+enum class TraceOperation : std::uint8_t {
+	kAllocated = 0,  ///< @brief A memory block has been allocated.
+	kDeleted = 1,    ///< @brief A memory block has been deleted.
+};
+
+/// @brief A single call recorded in an allocation trace.
+struct TraceRecord {
+	std::uint64_t timestamp;   ///< @brief The time in nanoseconds since the start of the trace.
+	std::uintptr_t address;    ///< @brief The address of the memory block.
+	std::size_t size;          ///< @brief The requested size for `TraceOperation::kAllocated`, else 0.
+	std::uint32_t thread;      ///< @brief The index of the thread in the trace, starting at 0.
+	TraceOperation operation;  ///< @brief The operation.
+};
+
+/// @brief The peak usage within a part of the duration of a trace.
+struct TraceInterval {
+	std::uint64_t start;      ///< @brief The start of the interval in nanoseconds.
+	std::uint64_t end;        ///< @brief The end of the interval in nanoseconds, exclusive.
+	std::size_t peakBytes;    ///< @brief The maximum number of bytes allocated at any time within the interval.
+	std::size_t allocations;  ///< @brief The number of allocations within the interval.
+};
+
+/// @brief The number of allocations of a particular size.
+struct TraceSize {
+	std::size_t size;   ///< @brief The requested size.
+	std::size_t count;  ///< @brief The number of allocations.
+};
+
+/// @brief The result of analyzing an allocation trace.
+struct TraceSummary {
+	/// @brief The number of lifetime classes, i.e. the number of bits of `std::uint64_t` plus one for lifetime 0.
+	static constexpr std::size_t kLifetimeClassCount = std::numeric_limits<std::uint64_t>::digits + 1;
+
+	std::size_t allocationCount = 0;                           ///< @brief The number of allocations.
+	std::size_t deletionCount = 0;                             ///< @brief The number of deletions of blocks allocated in the trace.
+	std::size_t unknownDeletionCount = 0;                      ///< @brief The number of deletions of blocks allocated before the trace.
+	std::size_t peakBytes = 0;                                 ///< @brief The maximum number of bytes allocated at any time.
+	std::uint64_t peakTimestamp = 0;                           ///< @brief The time when `peakBytes` has been reached first.
+	std::size_t liveCount = 0;                                 ///< @brief The number of blocks still allocated at the end.
+	std::size_t liveBytes = 0;                                 ///< @brief The number of bytes still allocated at the end.
+	std::vector<TraceInterval> timeline;                       ///< @brief The peak usage over time.
+	std::array<std::size_t, kLifetimeClassCount> lifetimes{};  ///< @brief The number of deleted blocks per lifetime class `std::bit_width(nanoseconds)`.
+	std::vector<TraceSize> hottestSizes;                       ///< @brief The most frequently allocated sizes, most frequent first.
+};
+
+/// @brief Read an allocation trace from a file.
+/// @details The file is mapped into memory for reading.
+/// @param path The path of the trace file.
+/// @return All records ordered by time.
+/// @throws std::system_error if the file cannot be read.
+/// @throws std::runtime_error if the file is not a valid trace.
+std::vector<TraceRecord> ReadTrace(const std::filesystem::path& path);
+
+/// @brief Calculate the peak usage over time, the lifetimes and the hottest sizes of an allocation trace.
+/// @param records The records ordered by time.
+/// @param intervals The number of intervals for `TraceSummary::timeline`.
+/// @param sizes The maximum number of entries in `TraceSummary::hottestSizes`.
+/// @return The summary.
+TraceSummary AnalyzeTrace(std::span<const TraceRecord> records, std::size_t intervals = 20, std::size_t sizes = 10);
+
+namespace internal {
+
+/// @brief Writes allocation calls as a compact binary stream to a file.
+/// @details Each thread encodes its records into a buffer owned by the thread without any locks. Buffers are written
+/// to the file by a background thread when a thread has filled a chunk, and when calling `Flush` and when closing the
+/// trace. The file consists of blocks of records from a single thread. Each record holds the differences of its
+/// timestamp and address to the previous record of the same thread as variable-length integers.
+class TraceWriter {
+public:
+	/// @brief Create a trace file.
+	/// @param path The path of the file, an existing file is replaced.
+	/// @throws std::system_error if the file cannot be created.
+	explicit TraceWriter(const std::filesystem::path& path);
+	TraceWriter(const TraceWriter&) = delete;
+	TraceWriter(TraceWriter&&) = delete;
+	~TraceWriter() noexcept;
+
+public:
+	TraceWriter& operator=(const TraceWriter&) = delete;
+	TraceWriter& operator=(TraceWriter&&) = delete;
+
+public:
+	/// @brief Record a call.
+	/// @details Records for `nullptr` and all records after `Close` are ignored.
+	/// @param operation The operation.
+	/// @param address The address of the memory block.
+	/// @param size The requested size for `TraceOperation::kAllocated`.
+	void Write(TraceOperation operation, const void* address, std::size_t size) noexcept;
+
+	/// @brief Write all buffered records to the file.
+	void Flush();
+
+	/// @brief Write all buffered records and close the file.
+	void Close();
+
+private:
+	class ThreadBuffer;
+
+	/// @brief Get the buffer of the current thread, creating it if required.
+	/// @return The buffer.
+	ThreadBuffer& GetThreadBuffer();
+
+	/// @brief Write full chunks to the file until the file is closed, runs on the background thread.
+	void Run();
+
+	/// @brief Write all published records of all threads to the file, MUST be called while holding `m_mutex`.
+	void Drain();
+
+private:
+	const std::uint64_t m_id;                              ///< @brief The process-wide unique id of this writer.
+	const std::chrono::steady_clock::time_point m_start;   ///< @brief The start of the trace.
+	std::atomic<bool> m_closed = false;                    ///< @brief `true` if the trace has been closed.
+	std::mutex m_mutex;                                    ///< @brief Guards @p m_file and @p m_buffers.
+	std::ofstream m_file;                                  ///< @brief The trace file.
+	std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;  ///< @brief The buffers of all threads.
+	std::atomic<bool> m_pending = false;                   ///< @brief `true` if a chunk has been filled since the last write.
+	std::thread m_thread;                                  ///< @brief The background thread writing full chunks.
+};
+
+}  // namespace internal
+
+}  // namespace m4t
@@ -0,0 +1,295 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include "m4t/AllocationTable.h"
+#include "m4t/DeletedHistory.h"
+#include "m4t/GenerationSet.h"
+#include "m4t/StackTable.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace m4t {
+
+/// @brief Flags for configuring how allocations are tracked.
+enum class TrackingMode : std::uint8_t {
+	kImmediate = 0,   ///< @brief Update the tables in every callback.
+	kBuffered = 1,    ///< @brief Append events to a buffer per thread and merge them into the tables when the state is queried.
+	kAccounting = 2,  ///< @brief Maintain `AllocationStatistics` from the sizes of the memory blocks.
+	kStacks = 4,      ///< @brief Capture the call stack of each allocation.
+	kSampling = 8,    ///< @brief Only track a random sample of allocations and maintain a `SamplingEstimate`, overrides `kBuffered`.
+};
+
+constexpr TrackingMode operator|(const TrackingMode lhs, const TrackingMode rhs) noexcept {
+	return static_cast<TrackingMode>(static_cast<std::underlying_type_t<TrackingMode>>(lhs) | static_cast<std::underlying_type_t<TrackingMode>>(rhs));
+}
+
+constexpr TrackingMode operator&(const TrackingMode lhs, const TrackingMode rhs) noexcept {
+	return static_cast<TrackingMode>(static_cast<std::underlying_type_t<TrackingMode>>(lhs) & static_cast<std::underlying_type_t<TrackingMode>>(rhs));
+}
+
+/// @brief Byte counts of the tracked memory blocks.
+struct AllocationStatistics {
+	/// @brief The number of size classes, i.e. the number of bits of `std::size_t` plus one for size 0.
+	static constexpr std::size_t kSizeClassCount = std::numeric_limits<std::size_t>::digits + 1;
+
+	/// @brief Get the size class of a memory block.
+	/// @details Size class 0 holds blocks of size 0, size class `n` holds blocks with sizes in [2^(n-1), 2^n).
+	/// @param size The size of the memory block.
+	/// @return The index into `sizeClasses`.
+	[[nodiscard]] static constexpr std::size_t GetSizeClass(const std::size_t size) noexcept {
+		return std::bit_width(size);
+	}
+
+	std::size_t currentBytes = 0;                            ///< @brief The sum of the sizes of all blocks currently allocated.
+	std::size_t peakBytes = 0;                               ///< @brief The maximum value of `currentBytes`.
+	std::size_t totalBytes = 0;                              ///< @brief The sum of the sizes of all blocks ever allocated.
+	std::array<std::size_t, kSizeClassCount> sizeClasses{};  ///< @brief The number of blocks ever allocated per size class.
+};
+
+/// @brief Unbiased estimates calculated from sampled allocations.
+struct SamplingEstimate {
+	double liveBytes = 0;   ///< @brief The estimated sum of the sizes of all blocks currently allocated.
+	double liveCount = 0;   ///< @brief The estimated number of blocks currently allocated.
+	double totalBytes = 0;  ///< @brief The estimated sum of the sizes of all blocks ever allocated.
+	double totalCount = 0;  ///< @brief The estimated number of blocks ever allocated.
+};
+
+/// @brief A memory block which is currently allocated.
+struct AllocatedBlock {
+	const void* address;       ///< @brief The address of the memory block.
+	std::size_t size;          ///< @brief The requested size of the memory block.
+	std::uint64_t generation;  ///< @brief The sequence number of the allocation.
+	std::uint32_t stack;       ///< @brief The id of the call stack of the allocation, 0 if not available.
+};
+
+namespace internal {
+class AllocationTracker;
+}  // namespace internal
+
+/// @brief Marks a point in time for finding the memory blocks which have been allocated since then.
+/// @details While at least one checkpoint exists, the tracker records a journal of all allocations. The journal is
+/// discarded when the last checkpoint is destroyed.
+class AllocationCheckpoint {
+private:
+	AllocationCheckpoint(internal::AllocationTracker& tracker, std::uint64_t generation) noexcept;
+
+public:
+	AllocationCheckpoint(const AllocationCheckpoint&) = delete;
+	AllocationCheckpoint(AllocationCheckpoint&& checkpoint) noexcept;
+	~AllocationCheckpoint() noexcept;
+
+public:
+	AllocationCheckpoint& operator=(const AllocationCheckpoint&) = delete;
+	AllocationCheckpoint& operator=(AllocationCheckpoint&&) = delete;
+
+public:
+	/// @brief Get the generation of the first allocation after the checkpoint.
+	/// @return The generation.
+	[[nodiscard]] std::uint64_t GetGeneration() const noexcept {
+		return m_generation;
+	}
+
+private:
+	internal::AllocationTracker* m_tracker;  ///< @brief The tracker or `nullptr` if the object has been moved.
+	std::uint64_t m_generation;              ///< @brief The generation of the first allocation after the checkpoint.
+
+	friend class internal::AllocationTracker;
+};
+
+namespace internal {
+
+/// @brief The engine for tracking allocated and deleted memory blocks.
+/// @details In mode `TrackingMode::kBuffered`, `Allocated` and `Deleted` only append to a buffer of the calling thread.
+/// Buffers are merged in the order of the calls when the state is queried or `Flush` is called.
+class AllocationTracker {
+public:
+	/// @brief The default value for the maximum memory used for the history of deleted blocks.
+	static constexpr std::size_t kDefaultDeletedHistoryBytes = std::size_t{4} * 1024 * 1024;
+
+	/// @brief The default value for the average number of bytes between two sampled allocations.
+	static constexpr std::size_t kDefaultSamplingRate = std::size_t{512} * 1024;
+
+public:
+	/// @brief Create a new tracker.
+	/// @param mode The tracking mode.
+	/// @param maxDeletedHistoryBytes The maximum number of bytes used for the history of deleted blocks.
+	AllocationTracker(TrackingMode mode, std::size_t maxDeletedHistoryBytes);
+	AllocationTracker(const AllocationTracker&) = delete;
+	AllocationTracker(AllocationTracker&&) = delete;
+	~AllocationTracker() noexcept;
+
+public:
+	AllocationTracker& operator=(const AllocationTracker&) = delete;
+	AllocationTracker& operator=(AllocationTracker&&) = delete;
+
+public:
+	/// @brief Record that a memory block has been allocated.
+	/// @details Captures the call stack of the caller in mode `TrackingMode::kStacks`. In mode `TrackingMode::kSampling`,
+	/// most calls return after decrementing a counter of the current thread.
+	/// @param p The address of the memory block.
+	/// @param size The requested size of the memory block.
+	void Allocated(const void* p, std::size_t size) noexcept;
+
+	/// @brief Record that a memory block has been deleted.
+	/// @details In mode `TrackingMode::kSampling`, deleting a block which has not been sampled is ignored.
+	/// @param p The address of the memory block.
+	void Deleted(const void* p) noexcept;
+
+	/// @brief Merge all buffered events into the tables.
+	/// @details Does nothing in mode `TrackingMode::kImmediate`.
+	void Flush() const;
+
+	[[nodiscard]] bool IsAllocated(const void* p) const;
+	[[nodiscard]] DeletedState GetDeletedState(const void* p) const;
+	[[nodiscard]] std::size_t GetAllocatedCount() const;
+	[[nodiscard]] std::size_t GetDeletedCount() const;
+
+	/// @brief Get the memory block which is currently allocated at an address.
+	/// @param p The address of the memory block.
+	/// @return The memory block including its generation or `std::nullopt` if the address is not allocated.
+	[[nodiscard]] std::optional<AllocatedBlock> GetAllocation(const void* p) const;
+
+	/// @brief Check if an address still belongs to the same allocation.
+	/// @param p The address of the memory block.
+	/// @param generation The generation of the allocation from `GetAllocation`.
+	/// @return `true` if the memory block has not been deleted since.
+	[[nodiscard]] bool IsSameAllocation(const void* p, std::uint64_t generation) const;
+
+	/// @brief Check if the memory block of an allocation has been deleted.
+	/// @details Unlike `GetDeletedState`, the result is exact and not affected by reuse of the address.
+	/// @param generation The generation of the allocation.
+	/// @return `true` if the memory block has been deleted.
+	[[nodiscard]] bool IsGenerationDeleted(std::uint64_t generation) const;
+
+	/// @brief Get the byte counts of the memory blocks.
+	/// @return The statistics, all values are 0 if the tracker does not use mode `TrackingMode::kAccounting`.
+	[[nodiscard]] AllocationStatistics GetStatistics() const;
+
+	/// @brief Set the peak number of bytes to the number of bytes which are currently allocated.
+	void ResetPeakBytes();
+
+	/// @brief Set the average number of bytes between two sampled allocations.
+	/// @details Only used in mode `TrackingMode::kSampling`. The probability of sampling an allocation of size `s`
+	/// is `1 - exp(-s / bytes)`.
+	/// @param bytes The sampling interval in bytes, values less than 1 are treated as 1.
+	void SetSamplingRate(std::size_t bytes) noexcept;
+
+	/// @brief Turn sampling on or off.
+	/// @details Only used in mode `TrackingMode::kSampling`. When sampling is off, all allocations are tracked.
+	/// @param enabled `true` to track only a sample of allocations.
+	void SetSampling(bool enabled) noexcept;
+
+	/// @brief Get the estimates calculated from sampled allocations.
+	/// @return The estimates, all values are 0 if the tracker does not use mode `TrackingMode::kSampling`.
+	[[nodiscard]] SamplingEstimate GetSamplingEstimate() const;
+
+	/// @brief Create a checkpoint for use with `GetAllocatedSince`.
+	/// @return The checkpoint which MUST NOT outlive the tracker.
+	[[nodiscard]] AllocationCheckpoint Checkpoint();
+
+	/// @brief Get all memory blocks which have been allocated after a checkpoint and which are still allocated.
+	/// @details The cost is proportional to the number of allocations since the oldest existing checkpoint.
+	/// @param checkpoint The checkpoint.
+	/// @return The memory blocks ordered by generation.
+	[[nodiscard]] std::vector<AllocatedBlock> GetAllocatedSince(const AllocationCheckpoint& checkpoint) const;
+
+	/// @brief Get the call stack of an allocation with resolved symbols.
+	/// @details Symbols are only resolved when calling this function.
+	/// @param stack The id of the stack from `AllocatedBlock::stack`.
+	/// @return One line per frame, empty if no stack is available.
+	[[nodiscard]] std::string FormatStack(std::uint32_t stack) const;
+
+private:
+	enum class Operation : std::uint8_t;
+	struct Event;
+	class EventBuffer;
+	struct JournalShard;
+
+	static constexpr std::size_t kJournalShardBits = 4;                         ///< @brief The number of hash bits used for selecting a journal shard.
+	static constexpr std::size_t kJournalShardCount = 1u << kJournalShardBits;  ///< @brief The number of journal shards.
+
+	/// @brief Called when an `AllocationCheckpoint` is destroyed.
+	void ReleaseCheckpoint() noexcept;
+
+	/// @brief Get the event buffer of the current thread, create it if required.
+	/// @return The event buffer.
+	EventBuffer& GetEventBuffer();
+
+	/// @brief Decide if an allocation is sampled.
+	/// @param size The size of the memory block.
+	/// @return The weight of the allocation, 0 if it is not sampled.
+	[[nodiscard]] float Sample(std::size_t size) const noexcept;
+
+	/// @brief Either apply or buffer an event.
+	/// @param event The event, the sequence number is set by this method.
+	void Record(Event event) noexcept;
+
+	/// @brief Update the tables with an event.
+	/// @details The method is `const` because buffered events are merged when querying the state.
+	/// @param event The event.
+	void Apply(const Event& event) const noexcept;
+
+private:
+	const TrackingMode m_mode;  ///< @brief The tracking mode.
+	const std::uint64_t m_id;   ///< @brief A process-wide unique id used for finding the event buffer of a thread.
+
+	mutable AllocationTable m_allocated;         ///< @brief Currently allocated memory blocks.
+	mutable DeletedHistory m_deleted;            ///< @brief The history of deleted memory blocks.
+	StackTable m_stacks;                         ///< @brief The call stacks of allocations.
+	mutable GenerationSet m_deletedGenerations;  ///< @brief The generations of all deleted memory blocks.
+
+	mutable std::atomic<std::size_t> m_currentBytes = 0;                                                  ///< @brief The bytes currently allocated.
+	mutable std::atomic<std::size_t> m_peakBytes = 0;                                                     ///< @brief The maximum of @p m_currentBytes.
+	mutable std::atomic<std::size_t> m_totalBytes = 0;                                                    ///< @brief The bytes ever allocated.
+	mutable std::array<std::atomic<std::size_t>, AllocationStatistics::kSizeClassCount> m_sizeClasses{};  ///< @brief The number of blocks per size class.
+
+	std::atomic<std::size_t> m_samplingRate;                ///< @brief The average number of bytes between two samples.
+	std::atomic<bool> m_sampling;                           ///< @brief `true` if only a sample of allocations is tracked.
+	mutable std::atomic<double> m_estimatedLiveBytes = 0;   ///< @brief The estimate for `SamplingEstimate::liveBytes`.
+	mutable std::atomic<double> m_estimatedLiveCount = 0;   ///< @brief The estimate for `SamplingEstimate::liveCount`.
+	mutable std::atomic<double> m_estimatedTotalBytes = 0;  ///< @brief The estimate for `SamplingEstimate::totalBytes`.
+	mutable std::atomic<double> m_estimatedTotalCount = 0;  ///< @brief The estimate for `SamplingEstimate::totalCount`.
+
+	mutable std::atomic<std::uint64_t> m_generation = 0;  ///< @brief The generation of the next allocation.
+	std::atomic<std::size_t> m_checkpoints = 0;           ///< @brief The number of existing checkpoints.
+	std::mutex m_checkpointsMutex;                        ///< @brief Serializes creating and releasing checkpoints.
+	std::unique_ptr<JournalShard[]> m_journal;            ///< @brief The allocations while checkpoints exist.
+
+	std::atomic<std::uint64_t> m_sequence = 0;            ///< @brief The sequence number of the next buffered event.
+	mutable std::mutex m_buffersMutex;                    ///< @brief Guards @p m_buffers and merging.
+	std::vector<std::unique_ptr<EventBuffer>> m_buffers;  ///< @brief The event buffers of all threads.
+	mutable std::vector<Event> m_merge;                   ///< @brief Temporary storage for merging, guarded by @p m_buffersMutex.
+
+	friend class m4t::AllocationCheckpoint;
+};
+
+}  // namespace internal
+}  // namespace m4t
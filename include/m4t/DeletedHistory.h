@@ -0,0 +1,87 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace m4t {
+
+/// @brief The result of looking up an address in the history of deleted memory blocks.
+enum class DeletedState : std::uint8_t {
+	kNotDeleted = 0,       ///< @brief The address has never been deleted.
+	kDeleted = 1,          ///< @brief The address has been deleted recently.
+	kProbablyDeleted = 2,  ///< @brief The address is no longer kept exactly, but a probabilistic filter reports it as deleted.
+};
+
+namespace internal {
+
+/// @brief A history of deleted memory blocks with an upper limit for memory.
+/// @details The most recent addresses are kept exactly in a fixed-capacity ring with a counted hash map for lookup.
+/// Addresses which drop out of the ring are added to a bloom filter. So lookups return `DeletedState::kDeleted` for all
+/// recently deleted addresses and `DeletedState::kProbablyDeleted` for older ones and for false positives of the filter.
+/// `DeletedState::kNotDeleted` is always exact. All memory is allocated when the object is created.
+class DeletedHistory {
+public:
+	/// @brief Create a new history.
+	/// @param maxBytes The maximum number of bytes to use for the history. Three quarters are used for exact entries.
+	explicit DeletedHistory(std::size_t maxBytes);
+	DeletedHistory(const DeletedHistory&) = delete;
+	DeletedHistory(DeletedHistory&&) = delete;
+	~DeletedHistory() noexcept;
+
+public:
+	DeletedHistory& operator=(const DeletedHistory&) = delete;
+	DeletedHistory& operator=(DeletedHistory&&) = delete;
+
+public:
+	/// @brief Add an address to the history.
+	/// @details `nullptr` is ignored.
+	/// @param p The address.
+	void Insert(const void* p) noexcept;
+
+	/// @brief Look up an address.
+	/// @param p The address.
+	/// @return The state of the address.
+	[[nodiscard]] DeletedState Find(const void* p) const noexcept;
+
+	/// @brief Get the total number of addresses which have been added to the history.
+	/// @return The number of calls to `Insert`, always exact.
+	[[nodiscard]] std::size_t GetCount() const noexcept {
+		return m_count.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Get the number of most recent addresses which are kept exactly.
+	/// @return The capacity of the ring.
+	[[nodiscard]] std::size_t GetExactCapacity() const noexcept;
+
+private:
+	struct Shard;
+
+	static constexpr std::size_t kShardBits = 4;                  ///< @brief The number of hash bits used for selecting a shard.
+	static constexpr std::size_t kShardCount = 1u << kShardBits;  ///< @brief The number of shards.
+
+	std::unique_ptr<Shard[]> m_shards;     ///< @brief The shards of the history.
+	std::atomic<std::size_t> m_count = 0;  ///< @brief The total number of addresses.
+};
+
+}  // namespace internal
+}  // namespace m4t
@@ -0,0 +1,213 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace m4t {
+
+class EventArena;
+
+/// @brief A view of an event with its payload stored in an `EventArena`.
+/// @details The view is only valid until the arena is reset or destroyed.
+class CapturedEvent {
+private:
+	struct Arg;
+	struct Record;
+
+	explicit CapturedEvent(const Record* const record) noexcept
+	    : m_record(record) {
+		// empty
+	}
+
+public:
+	/// @brief Get the id from the event descriptor.
+	/// @return The event id.
+	[[nodiscard]] std::uint16_t GetEventId() const noexcept;
+
+	/// @brief Get the level from the event descriptor.
+	/// @return The level.
+	[[nodiscard]] std::uint8_t GetLevel() const noexcept;
+
+	/// @brief Get the keyword from the event descriptor.
+	/// @return The keyword.
+	[[nodiscard]] std::uint64_t GetKeyword() const noexcept;
+
+	/// @brief Get the number of arguments.
+	/// @return The number of arguments.
+	[[nodiscard]] std::uint32_t GetArgCount() const noexcept;
+
+	/// @brief Get the payload of an argument.
+	/// @param index The index of the argument.
+	/// @return The bytes of the argument which are owned by the arena.
+	/// @throws std::out_of_range if @p index is not less than `GetArgCount()`.
+	[[nodiscard]] std::span<const std::byte> GetArg(std::uint32_t index) const;
+
+	/// @brief Get the payload of an argument as a value.
+	/// @tparam T A trivially copyable type with the same size as the argument.
+	/// @param index The index of the argument.
+	/// @return A copy of the value.
+	/// @throws std::out_of_range if @p index is not less than `GetArgCount()`.
+	/// @throws std::invalid_argument if the size of the argument is not the size of @p T.
+	template <typename T>
+	    requires std::is_trivially_copyable_v<T>
+	[[nodiscard]] T GetArg(const std::uint32_t index) const {
+		const std::span<const std::byte> data = GetArg(index);
+		if (data.size() != sizeof(T)) {
+			throw std::invalid_argument("argument size mismatch");
+		}
+		T value;
+		std::memcpy(&value, data.data(), sizeof(T));
+		return value;
+	}
+
+private:
+	const Record* m_record;  ///< @brief The record in the arena.
+
+	friend class EventArena;
+};
+
+/// @brief A bump-pointer arena which stores copies of events and their payload.
+/// @details Memory is allocated in chunks which are kept when the arena is reset, so capturing events only allocates
+/// when more data is captured than ever before. Adding events is thread-safe. Iterating MUST NOT happen concurrently
+/// with adding events.
+class EventArena {
+private:
+	struct Chunk;
+
+public:
+	/// @brief The size of regular chunks, larger events get a chunk of their own.
+	static constexpr std::size_t kChunkSize = std::size_t{64} * 1024;
+
+	/// @brief Iterates all events in the order they have been added.
+	class Iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = CapturedEvent;
+		using difference_type = std::ptrdiff_t;
+		using pointer = void;
+		using reference = CapturedEvent;
+
+	public:
+		Iterator() noexcept = default;
+
+	private:
+		Iterator(const Chunk* chunk, const Chunk* end) noexcept;
+
+	public:
+		[[nodiscard]] CapturedEvent operator*() const noexcept;
+		Iterator& operator++() noexcept;
+		Iterator operator++(int) noexcept;
+		[[nodiscard]] bool operator==(const Iterator& other) const noexcept = default;
+
+	private:
+		/// @brief Move to the next chunk if the current one has no more events.
+		void SkipEmpty() noexcept;
+
+	private:
+		const Chunk* m_chunk = nullptr;  ///< @brief The current chunk.
+		const Chunk* m_end = nullptr;    ///< @brief The end of the chunks.
+		std::size_t m_offset = 0;        ///< @brief The offset of the current event in the chunk.
+
+		friend class EventArena;
+	};
+
+public:
+	EventArena();
+	EventArena(const EventArena&) = delete;
+	EventArena(EventArena&&) = delete;
+	~EventArena() noexcept;
+
+public:
+	EventArena& operator=(const EventArena&) = delete;
+	EventArena& operator=(EventArena&&) = delete;
+
+public:
+	/// @brief Add a copy of an event.
+	/// @tparam GetArg The type of the function returning the arguments.
+	/// @param eventId The id of the event.
+	/// @param level The level of the event.
+	/// @param keyword The keyword of the event.
+	/// @param argCount The number of arguments.
+	/// @param getArg A function which returns the payload of the argument at an index as a `std::span<const std::byte>`.
+	template <typename GetArg>
+	void Add(const std::uint16_t eventId, const std::uint8_t level, const std::uint64_t keyword, const std::uint32_t argCount, GetArg&& getArg) {
+		std::size_t payloadSize = 0;
+		for (std::uint32_t i = 0; i < argCount; ++i) {
+			payloadSize += getArg(i).size();
+		}
+		const std::scoped_lock lock(m_mutex);
+		std::byte* const record = Allocate(eventId, level, keyword, argCount, payloadSize);
+		std::size_t offset = 0;
+		for (std::uint32_t i = 0; i < argCount; ++i) {
+			const std::span<const std::byte> arg = getArg(i);
+			WriteArg(record, i, offset, arg);
+			offset += arg.size();
+		}
+	}
+
+	/// @brief Remove all events but keep the memory for reuse.
+	void Reset() noexcept;
+
+	/// @brief Get the number of events.
+	/// @return The number of events added since the last reset.
+	[[nodiscard]] std::size_t GetCount() const noexcept;
+
+	/// @brief Get the number of bytes reserved for events.
+	/// @return The sum of the capacity of all chunks.
+	[[nodiscard]] std::size_t GetCapacity() const noexcept;
+
+	[[nodiscard]] Iterator begin() const noexcept;
+	[[nodiscard]] Iterator end() const noexcept;
+
+private:
+	/// @brief Reserve memory for an event and write the event descriptor.
+	/// @details MUST be called while holding @p m_mutex.
+	/// @param eventId The id of the event.
+	/// @param level The level of the event.
+	/// @param keyword The keyword of the event.
+	/// @param argCount The number of arguments.
+	/// @param payloadSize The sum of the sizes of all arguments.
+	/// @return The record for use with `WriteArg`.
+	std::byte* Allocate(std::uint16_t eventId, std::uint8_t level, std::uint64_t keyword, std::uint32_t argCount, std::size_t payloadSize);
+
+	/// @brief Copy the payload of an argument into a record.
+	/// @param record The record returned by `Allocate`.
+	/// @param index The index of the argument.
+	/// @param offset The sum of the sizes of all previous arguments.
+	/// @param arg The payload.
+	static void WriteArg(std::byte* record, std::uint32_t index, std::size_t offset, std::span<const std::byte> arg) noexcept;
+
+private:
+	std::mutex m_mutex;           ///< @brief Serializes adding events.
+	std::vector<Chunk> m_chunks;  ///< @brief The chunks.
+	std::size_t m_current = 0;    ///< @brief The index of the chunk receiving new events.
+	std::size_t m_count = 0;      ///< @brief The number of events.
+};
+
+}  // namespace m4t
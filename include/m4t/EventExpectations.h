@@ -0,0 +1,200 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+namespace m4t {
+
+/// @brief A table of expected events which is checked with a single hash lookup per event.
+/// @details Unlike `EXPECT_CALL`, the cost of checking an event does not depend on the number of expectations. All
+/// events with an id in the table are counted and `Verify` reports all unmet expectations in a single result.
+/// Expectations MUST NOT be added while events are logged, events may be added from any thread.
+class EventExpectations {
+public:
+	/// @brief A non-owning reference to a function returning the bytes of an argument.
+	/// @details Unlike `std::function`, creating the reference never allocates. It MUST NOT be used after the function
+	/// has been destroyed.
+	class ArgAccessor {
+	public:
+		/// @brief Create a reference to a function.
+		/// @tparam F The type of the function.
+		/// @param getArg A function returning the bytes of an argument as a `std::span<const std::byte>`.
+		template <typename F>
+		    requires(!std::is_same_v<std::remove_cvref_t<F>, ArgAccessor>)
+		ArgAccessor(F& getArg) noexcept  // NOLINT(google-explicit-constructor): Allow implicit conversion from functions.
+		    : m_function(&getArg)
+		    , m_call([](const void* const function, const std::uint32_t index) {
+			    return std::span<const std::byte>((*static_cast<F*>(const_cast<void*>(function)))(index));
+		    }) {
+			// empty
+		}
+
+	public:
+		/// @brief Get the bytes of an argument.
+		/// @param index The index of the argument.
+		/// @return The bytes of the argument.
+		std::span<const std::byte> operator()(const std::uint32_t index) const {
+			return m_call(m_function, index);
+		}
+
+	private:
+		const void* m_function;                                            ///< @brief The address of the function.
+		std::span<const std::byte> (*m_call)(const void*, std::uint32_t);  ///< @brief Calls the function.
+	};
+
+public:
+	EventExpectations() = default;
+	EventExpectations(const EventExpectations&) = delete;
+	EventExpectations(EventExpectations&&) = delete;
+	~EventExpectations() noexcept = default;
+
+public:
+	EventExpectations& operator=(const EventExpectations&) = delete;
+	EventExpectations& operator=(EventExpectations&&) = delete;
+
+public:
+	/// @brief Expect an event id regardless of its arguments.
+	/// @param eventId The event id.
+	/// @param cardinality The number of events.
+	/// @return This table for chaining calls.
+	/// @throws std::invalid_argument if the table already contains @p eventId.
+	EventExpectations& Expect(std::uint16_t eventId, const testing::Cardinality& cardinality = testing::Exactly(1));
+
+	/// @brief Expect an event with arguments decoded using an `EventSchema`.
+	/// @details Usage: `Expect<MyEvent>(t::Exactly(2), t::FieldsAre(42, t::_))`. Events with arguments which cannot be
+	/// decoded or do not match are not counted for @p cardinality but reported by `Verify`.
+	/// @tparam Schema The `EventSchema` of the event.
+	/// @param cardinality The number of events.
+	/// @param matcher A matcher for the tuple of decoded arguments.
+	/// @return This table for chaining calls.
+	/// @throws std::invalid_argument if the table already contains the event id.
+	template <typename Schema>
+	EventExpectations& Expect(const testing::Cardinality& cardinality, const testing::Matcher<const typename Schema::Tuple&>& matcher = testing::_) {
+		return AddEntry(Schema::kEventId, cardinality, [matcher](const std::uint32_t argCount, const ArgAccessor getArg, std::string& explanation) {
+			const std::optional<typename Schema::Tuple> args = Schema::Decode(argCount, getArg);
+			if (!args) {
+				explanation = "arguments do not match the schema";
+				return false;
+			}
+			if (matcher.Matches(*args)) {
+				[[likely]];
+				return true;
+			}
+			// only build the description for the rare case of a mismatch
+			testing::StringMatchResultListener listener;
+			matcher.MatchAndExplain(*args, &listener);
+			std::ostringstream os;
+			os << "arguments " << testing::PrintToString(*args) << " do not match: ";
+			matcher.DescribeTo(&os);
+			if (!listener.str().empty()) {
+				os << ", " << listener.str();
+			}
+			explanation = os.str();
+			return false;
+		});
+	}
+
+	/// @brief Check if the table contains an event id.
+	/// @param eventId The event id.
+	/// @return `true` if the table contains @p eventId.
+	[[nodiscard]] bool Contains(const std::uint16_t eventId) const noexcept {
+		return m_entries.contains(eventId);
+	}
+
+	/// @brief Count an event.
+	/// @param eventId The event id.
+	/// @param argCount The number of arguments.
+	/// @param getArg A function returning the bytes of an argument as a `std::span<const std::byte>`.
+	/// @return `true` if the table contains @p eventId, else the event is ignored.
+	template <typename F>
+	bool Add(const std::uint16_t eventId, const std::uint32_t argCount, F&& getArg) {
+		const auto it = m_entries.find(eventId);
+		if (it == m_entries.end()) {
+			return false;
+		}
+		Entry& entry = it->second;
+		if (entry.matcher) {
+			std::string explanation;
+			if (!entry.matcher(argCount, ArgAccessor(getArg), explanation)) {
+				AddMismatch(entry, std::move(explanation));
+				return true;
+			}
+		}
+		entry.count.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	/// @brief Check all expectations.
+	/// @return A failure listing all event ids with an unmet cardinality or mismatched arguments.
+	[[nodiscard]] testing::AssertionResult Verify() const;
+
+private:
+	/// @brief A function checking the arguments and setting the description of the reason if they do not match.
+	using ArgMatcher = std::function<bool(std::uint32_t, ArgAccessor, std::string&)>;
+
+	/// @brief The expectation for a single event id.
+	struct Entry {
+		Entry(const testing::Cardinality& cardinality, ArgMatcher&& matcher)
+		    : cardinality(cardinality)
+		    , matcher(std::move(matcher)) {
+			// empty
+		}
+
+		testing::Cardinality cardinality;           ///< @brief The expected number of matching events.
+		ArgMatcher matcher;                         ///< @brief The optional matcher for the arguments.
+		std::atomic<std::uint64_t> count = 0;       ///< @brief The number of matching events.
+		std::atomic<std::uint64_t> mismatched = 0;  ///< @brief The number of events with arguments not matching.
+		std::string mismatch;                       ///< @brief The description of the first mismatch.
+	};
+
+	/// @brief Add an entry to the table.
+	/// @param eventId The event id.
+	/// @param cardinality The number of events.
+	/// @param matcher The optional matcher for the arguments.
+	/// @return This table for chaining calls.
+	/// @throws std::invalid_argument if the table already contains @p eventId.
+	EventExpectations& AddEntry(std::uint16_t eventId, const testing::Cardinality& cardinality, ArgMatcher&& matcher);
+
+	/// @brief Count an event with arguments not matching.
+	/// @param entry The entry of the event id.
+	/// @param explanation The description of the mismatch.
+	void AddMismatch(Entry& entry, std::string&& explanation);
+
+private:
+	std::unordered_map<std::uint16_t, Entry> m_entries;  ///< @brief The expectations by event id.
+	mutable std::mutex m_mutex;                          ///< @brief Protects the descriptions of mismatches.
+};
+
+}  // namespace m4t
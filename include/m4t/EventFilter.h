@@ -0,0 +1,107 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace m4t {
+
+/// @brief A filter on event id, level and keyword which is checked with a few bit operations.
+/// @details The event ids are stored as a flat bitmap with one bit per id. A new filter accepts all events.
+class EventFilter {
+public:
+	/// @brief The number of event ids.
+	static constexpr std::size_t kEventIdCount = std::size_t{1} << 16;
+
+	/// @brief The number of levels.
+	static constexpr std::size_t kLevelCount = std::size_t{1} << 8;
+
+public:
+	/// @brief Create a filter which accepts all events.
+	EventFilter() noexcept;
+
+public:
+	/// @brief Accept a range of event ids.
+	/// @details The first call of either `IncludeEventIds` or `IncludeEventId` removes all other event ids.
+	/// @param first The first event id.
+	/// @param last The last event id, inclusive.
+	/// @return This filter for chaining calls.
+	EventFilter& IncludeEventIds(std::uint16_t first, std::uint16_t last) noexcept;
+
+	/// @brief Accept a single event id.
+	/// @details The first call of either `IncludeEventIds` or `IncludeEventId` removes all other event ids.
+	/// @param eventId The event id.
+	/// @return This filter for chaining calls.
+	EventFilter& IncludeEventId(std::uint16_t eventId) noexcept {
+		return IncludeEventIds(eventId, eventId);
+	}
+
+	/// @brief Reject a range of event ids.
+	/// @param first The first event id.
+	/// @param last The last event id, inclusive.
+	/// @return This filter for chaining calls.
+	EventFilter& ExcludeEventIds(std::uint16_t first, std::uint16_t last) noexcept;
+
+	/// @brief Reject a single event id.
+	/// @param eventId The event id.
+	/// @return This filter for chaining calls.
+	EventFilter& ExcludeEventId(std::uint16_t eventId) noexcept {
+		return ExcludeEventIds(eventId, eventId);
+	}
+
+	/// @brief Set the accepted levels.
+	/// @param mask A mask with bit `n` set for accepting level `n`, events with a level of 64 or more are rejected.
+	/// @return This filter for chaining calls.
+	EventFilter& SetLevelMask(std::uint64_t mask) noexcept;
+
+	/// @brief Accept all levels up to a maximum like an ETW session.
+	/// @param maxLevel The maximum level, inclusive.
+	/// @return This filter for chaining calls.
+	EventFilter& SetMaxLevel(std::uint8_t maxLevel) noexcept;
+
+	/// @brief Set the accepted keywords using the same rules as ETW.
+	/// @details An event is accepted if its keyword is 0 or if it has at least one bit of @p any and all bits of @p all.
+	/// @param any The bits of which at least one must be set.
+	/// @param all The bits which all must be set.
+	/// @return This filter for chaining calls.
+	EventFilter& SetKeywordMask(std::uint64_t any, std::uint64_t all = 0) noexcept;
+
+	/// @brief Check if an event passes the filter.
+	/// @param eventId The event id.
+	/// @param level The level.
+	/// @param keyword The keyword.
+	/// @return `true` if the event is accepted.
+	[[nodiscard]] bool Matches(const std::uint16_t eventId, const std::uint8_t level, const std::uint64_t keyword) const noexcept {
+		return (m_eventIds[eventId / 64] & (std::uint64_t{1} << (eventId % 64)))
+		       && (m_levels[level / 64] & (std::uint64_t{1} << (level % 64)))
+		       && (!keyword || ((keyword & m_anyKeyword) && (keyword & m_allKeyword) == m_allKeyword));
+	}
+
+private:
+	std::array<std::uint64_t, kEventIdCount / 64> m_eventIds;                ///< @brief One bit per accepted event id.
+	std::array<std::uint64_t, kLevelCount / 64> m_levels;                    ///< @brief One bit per accepted level.
+	std::uint64_t m_anyKeyword = std::numeric_limits<std::uint64_t>::max();  ///< @brief At least one of these bits must be set.
+	std::uint64_t m_allKeyword = 0;                                          ///< @brief All of these bits must be set.
+	bool m_allEventIds = true;                                               ///< @brief `true` until an event id is included.
+};
+
+}  // namespace m4t
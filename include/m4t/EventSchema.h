@@ -0,0 +1,111 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace m4t {
+
+/// @brief Converts the payload of an event argument to a value of type @p T.
+/// @details The primary template copies the bytes of trivially copyable types. Specializations exist for string views.
+/// Other types can be supported by adding a specialization with a static function `Decode`.
+/// @tparam T The type of the argument.
+template <typename T>
+struct EventArgDecoder {
+	static_assert(std::is_trivially_copyable_v<T>, "No EventArgDecoder for type");
+
+	/// @brief Decode the payload of an argument.
+	/// @param data The payload.
+	/// @return The value or `std::nullopt` if the size of the payload does not match.
+	[[nodiscard]] static std::optional<T> Decode(const std::span<const std::byte> data) noexcept {
+		if (data.size() != sizeof(T)) {
+			return std::nullopt;
+		}
+		T value;
+		std::memcpy(&value, data.data(), sizeof(T));
+		return value;
+	}
+};
+
+/// @brief Decodes a string, a trailing null character is not part of the view.
+/// @details The view points into the payload and MUST NOT be used after the event has been dispatched.
+/// @tparam C The character type.
+template <typename C>
+struct EventArgDecoder<std::basic_string_view<C>> {
+	/// @brief Decode the payload of an argument.
+	/// @param data The payload.
+	/// @return The view or `std::nullopt` if the size of the payload is not a multiple of the character size.
+	[[nodiscard]] static std::optional<std::basic_string_view<C>> Decode(const std::span<const std::byte> data) noexcept {
+		if (data.size() % sizeof(C)) {
+			return std::nullopt;
+		}
+		std::basic_string_view<C> value(reinterpret_cast<const C*>(data.data()), data.size() / sizeof(C));
+		if (!value.empty() && value.back() == C{}) {
+			value.remove_suffix(1);
+		}
+		return value;
+	}
+};
+
+/// @brief The compile-time declaration of the arguments of an event.
+/// @details Usage: `using MyEvent = m4t::EventSchema<42, std::uint32_t, std::wstring_view, GUID>;`. The arguments do
+/// not include file name and line which are added by `m3c::Log` automatically.
+/// @tparam kId The event id.
+/// @tparam Args The types of the arguments.
+template <std::uint16_t kId, typename... Args>
+struct EventSchema {
+	static constexpr std::uint16_t kEventId = kId;             ///< @brief The event id.
+	static constexpr std::size_t kArgCount = sizeof...(Args);  ///< @brief The number of arguments.
+
+	using Tuple = std::tuple<Args...>;  ///< @brief The decoded arguments.
+	using Signature = void(Args...);    ///< @brief The signature of the function receiving the decoded arguments.
+
+	/// @brief Decode all arguments of an event.
+	/// @tparam GetArg The type of the function returning the payload.
+	/// @param argCount The number of arguments of the event.
+	/// @param getArg A function returning the payload of the argument at an index as a `std::span<const std::byte>`.
+	/// @return The decoded arguments or `std::nullopt` if the number or the size of the arguments does not match.
+	template <typename GetArg>
+	[[nodiscard]] static std::optional<Tuple> Decode(const std::uint32_t argCount, GetArg&& getArg) {
+		if (argCount != kArgCount) {
+			return std::nullopt;
+		}
+		return DecodeArgs(getArg, std::index_sequence_for<Args...>());
+	}
+
+private:
+	template <typename GetArg, std::size_t... kIndex>
+	[[nodiscard]] static std::optional<Tuple> DecodeArgs(GetArg& getArg, std::index_sequence<kIndex...> /* indexes */) {
+		std::tuple<std::optional<Args>...> args{EventArgDecoder<Args>::Decode(getArg(static_cast<std::uint32_t>(kIndex)))...};
+		if (!(std::get<kIndex>(args).has_value() && ...)) {
+			return std::nullopt;
+		}
+		return Tuple(*std::move(std::get<kIndex>(args))...);
+	}
+};
+
+}  // namespace m4t
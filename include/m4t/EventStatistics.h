@@ -0,0 +1,211 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace m4t {
+
+/// @brief A copy of the values recorded by a `LatencyHistogram`.
+class HistogramSnapshot {
+public:
+	/// @brief The number of bits of each value which are stored exactly.
+	static constexpr std::size_t kSubBucketBits = 4;
+
+	/// @brief The number of buckets for each power of 2.
+	static constexpr std::size_t kSubBucketCount = std::size_t{1} << kSubBucketBits;
+
+	/// @brief The total number of buckets covering all 64 bit values.
+	static constexpr std::size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBucketCount;
+
+public:
+	/// @brief Get the bucket of a value.
+	/// @details Values below `kSubBucketCount` have their own bucket, larger values share a bucket with all values
+	/// which have the same `kSubBucketBits + 1` most significant bits.
+	/// @param value The value.
+	/// @return The index of the bucket.
+	[[nodiscard]] static constexpr std::size_t GetBucket(const std::uint64_t value) noexcept {
+		if (value < kSubBucketCount) {
+			return static_cast<std::size_t>(value);
+		}
+		const std::size_t exponent = static_cast<std::size_t>(std::bit_width(value)) - 1;
+		return (exponent - kSubBucketBits + 1) * kSubBucketCount + static_cast<std::size_t>((value >> (exponent - kSubBucketBits)) - kSubBucketCount);
+	}
+
+	/// @brief Get the largest value of a bucket.
+	/// @param bucket The index of the bucket.
+	/// @return The largest value which is stored in the bucket.
+	[[nodiscard]] static constexpr std::uint64_t GetBucketLimit(const std::size_t bucket) noexcept {
+		if (bucket < kSubBucketCount) {
+			return bucket;
+		}
+		const std::size_t shift = bucket / kSubBucketCount - 1;
+		return ((std::uint64_t{kSubBucketCount + bucket % kSubBucketCount} + 1) << shift) - 1;
+	}
+
+public:
+	/// @brief Get the number of values.
+	/// @return The number of recorded values.
+	[[nodiscard]] std::uint64_t GetCount() const noexcept {
+		return m_count;
+	}
+
+	/// @brief Get the smallest value.
+	/// @return The smallest recorded value or 0 if no values have been recorded.
+	[[nodiscard]] std::uint64_t GetMin() const noexcept {
+		return m_count ? m_min : 0;
+	}
+
+	/// @brief Get the largest value.
+	/// @return The largest recorded value or 0 if no values have been recorded.
+	[[nodiscard]] std::uint64_t GetMax() const noexcept {
+		return m_max;
+	}
+
+	/// @brief Get the average value.
+	/// @return The mean of all recorded values or 0 if no values have been recorded.
+	[[nodiscard]] double GetMean() const noexcept {
+		return m_count ? static_cast<double>(m_sum) / static_cast<double>(m_count) : 0;
+	}
+
+	/// @brief Get the value below which a percentage of all values falls.
+	/// @details The result has a relative error of at most `1 / kSubBucketCount`.
+	/// @param percentile The percentile between 0 and 100.
+	/// @return The largest value of the bucket which contains the percentile, but not more than `GetMax()`.
+	[[nodiscard]] std::uint64_t GetValueAtPercentile(double percentile) const noexcept;
+
+private:
+	std::array<std::uint64_t, kBucketCount> m_buckets{};              ///< @brief The number of values in each bucket.
+	std::uint64_t m_count = 0;                                        ///< @brief The number of values.
+	std::uint64_t m_sum = 0;                                          ///< @brief The sum of all values.
+	std::uint64_t m_min = std::numeric_limits<std::uint64_t>::max();  ///< @brief The smallest value.
+	std::uint64_t m_max = 0;                                          ///< @brief The largest value.
+
+	friend class LatencyHistogram;
+};
+
+/// @brief A concurrent histogram using logarithmic buckets with linear sub-buckets like HdrHistogram.
+/// @details Recording a value updates a few atomic counters and never allocates memory.
+class LatencyHistogram {
+public:
+	LatencyHistogram() noexcept = default;
+	LatencyHistogram(const LatencyHistogram&) = delete;
+	LatencyHistogram(LatencyHistogram&&) = delete;
+	~LatencyHistogram() noexcept = default;
+
+public:
+	LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+	LatencyHistogram& operator=(LatencyHistogram&&) = delete;
+
+public:
+	/// @brief Add a value.
+	/// @param value The value.
+	void Record(std::uint64_t value) noexcept;
+
+	/// @brief Get a copy of the recorded values.
+	/// @details Values recorded concurrently might be missing from some of the statistics.
+	/// @return The values.
+	[[nodiscard]] HistogramSnapshot GetSnapshot() const noexcept;
+
+private:
+	std::array<std::atomic<std::uint64_t>, HistogramSnapshot::kBucketCount> m_buckets{};  ///< @brief The number of values in each bucket.
+	std::atomic<std::uint64_t> m_count = 0;                                               ///< @brief The number of values.
+	std::atomic<std::uint64_t> m_sum = 0;                                                 ///< @brief The sum of all values.
+	std::atomic<std::uint64_t> m_min = std::numeric_limits<std::uint64_t>::max();         ///< @brief The smallest value.
+	std::atomic<std::uint64_t> m_max = 0;                                                 ///< @brief The largest value.
+};
+
+/// @brief The number of occurrences and the time between them.
+struct EventCounter {
+	std::uint64_t count;             ///< @brief The number of occurrences.
+	HistogramSnapshot interArrival;  ///< @brief The time between two subsequent occurrences in nanoseconds.
+};
+
+/// @brief A copy of the values recorded by `EventStatistics`.
+struct EventStatisticsSnapshot {
+	std::map<std::uint16_t, EventCounter> events;            ///< @brief The counters of all event ids which have occurred.
+	std::map<std::string, EventCounter, std::less<>> debug;  ///< @brief The counters of all debug levels which have occurred.
+};
+
+/// @brief Concurrent counters and inter-arrival histograms for events and debug output.
+/// @details Events use a flat array with one slot per event id. Histograms are allocated when an event id occurs for
+/// the second time.
+class EventStatistics {
+public:
+	/// @brief The number of event ids.
+	static constexpr std::size_t kEventIdCount = std::size_t{1} << 16;
+
+public:
+	EventStatistics();
+	EventStatistics(const EventStatistics&) = delete;
+	EventStatistics(EventStatistics&&) = delete;
+	~EventStatistics() noexcept;
+
+public:
+	EventStatistics& operator=(const EventStatistics&) = delete;
+	EventStatistics& operator=(EventStatistics&&) = delete;
+
+public:
+	/// @brief Count an event.
+	/// @param eventId The event id.
+	/// @param now The time of the event.
+	void AddEvent(std::uint16_t eventId, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) noexcept;
+
+	/// @brief Count a line of debug output.
+	/// @details Allocates memory when a level occurs for the first time.
+	/// @param level The debug level.
+	/// @param now The time of the output.
+	void AddDebug(std::string_view level, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+	/// @brief Get a copy of all counters.
+	/// @details Values recorded concurrently might be missing from some of the statistics.
+	/// @return The counters of all event ids and debug levels which have occurred.
+	[[nodiscard]] EventStatisticsSnapshot GetSnapshot() const;
+
+private:
+	struct Slot;
+
+	/// @brief Hash for heterogeneous lookup of debug levels.
+	struct StringHash {
+		using is_transparent = void;
+
+		std::size_t operator()(const std::string_view value) const noexcept {
+			return std::hash<std::string_view>{}(value);
+		}
+	};
+
+	std::unique_ptr<Slot[]> m_events;                                                             ///< @brief One slot per event id.
+	std::unordered_map<std::string, std::unique_ptr<Slot>, StringHash, std::equal_to<>> m_debug;  ///< @brief The slots of the debug levels.
+	mutable std::shared_mutex m_debugMutex;                                                       ///< @brief Protects @p m_debug.
+};
+
+}  // namespace m4t
@@ -0,0 +1,121 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace m4t::internal {
+
+/// @brief Decides which allocations fail.
+/// @details `ShouldFail` only uses atomic operations, so the check does not block threads of the code under test.
+/// Only one rule is active at a time. Setting a rule restarts counting allocations and failures.
+class FaultInjector {
+public:
+	FaultInjector() noexcept = default;
+	FaultInjector(const FaultInjector&) = delete;
+	FaultInjector(FaultInjector&&) = delete;
+	~FaultInjector() noexcept = default;
+
+public:
+	FaultInjector& operator=(const FaultInjector&) = delete;
+	FaultInjector& operator=(FaultInjector&&) = delete;
+
+public:
+	/// @brief Fail a single allocation.
+	/// @param index The zero-based index of the allocation, counted from this call.
+	void FailNth(std::size_t index) noexcept;
+
+	/// @brief Fail all allocations which are larger than a limit.
+	/// @param size The largest size which does not fail.
+	void FailAbove(std::size_t size) noexcept;
+
+	/// @brief Fail allocations randomly.
+	/// @details The decision only depends on @p seed and the index of the allocation, so runs are repeatable.
+	/// @param probability The probability for failing an allocation in the range [0, 1].
+	/// @param seed The seed.
+	void FailRandomly(double probability, std::uint64_t seed) noexcept;
+
+	/// @brief Stop failing allocations.
+	void Reset() noexcept;
+
+	/// @brief Check if an allocation should fail and count it.
+	/// @param size The requested size.
+	/// @return `true` if the allocation should fail.
+	[[nodiscard]] bool ShouldFail(std::size_t size) noexcept;
+
+	/// @brief Get the number of allocations since the current rule has been set.
+	/// @return The number of calls to `ShouldFail` while a rule is active.
+	[[nodiscard]] std::size_t GetAllocationCount() const noexcept {
+		return m_allocations.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Get the number of failed allocations since the current rule has been set.
+	/// @return The number of calls to `ShouldFail` which returned `true`.
+	[[nodiscard]] std::size_t GetFailureCount() const noexcept {
+		return m_failures.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Run a function once for every allocation it makes, failing a different allocation in each run.
+	/// @details The first run fails the first allocation, the second run fails the second one and so on. Enumeration
+	/// stops after the first run in which no allocation has failed. All failing is stopped when this method returns.
+	/// @param function The function to run. It MUST make the same allocations in the same order in each run.
+	/// @return The number of failure points, i.e. the number of allocations in a run without failures.
+	template <typename Function>
+	std::size_t EnumerateFailures(Function&& function) {
+		std::size_t index = 0;
+		try {
+			for (;; ++index) {
+				FailNth(index);
+				std::invoke(function);
+				if (!GetFailureCount()) {
+					break;
+				}
+			}
+		} catch (...) {
+			Reset();
+			throw;
+		}
+		Reset();
+		return index;
+	}
+
+private:
+	enum class Rule : std::uint8_t {
+		kNone = 0,
+		kNth = 1,
+		kAbove = 2,
+		kRandomly = 3
+	};
+
+	/// @brief Activate a rule after its parameters have been set.
+	/// @param rule The rule.
+	void Activate(Rule rule) noexcept;
+
+private:
+	std::atomic<Rule> m_rule = Rule::kNone;      ///< @brief The active rule.
+	std::atomic<std::uint64_t> m_value = 0;      ///< @brief Index, size or probability threshold, depending on the rule.
+	std::atomic<std::uint64_t> m_seed = 0;       ///< @brief The seed for `Rule::kRandomly`.
+	std::atomic<std::size_t> m_allocations = 0;  ///< @brief The number of allocations since the rule has been set.
+	std::atomic<std::size_t> m_failures = 0;     ///< @brief The number of failures since the rule has been set.
+};
+
+}  // namespace m4t::internal
@@ -0,0 +1,79 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace m4t::internal {
+
+/// @brief A concurrent set of generation numbers stored as a flat bitmap with one bit per generation.
+/// @details The bitmap is split into chunks which are allocated when the first generation in their range is added. The
+/// directory of chunks is allocated on first use. A chunk is released as soon as all generations in its range have been
+/// added, because all of them are in the set from then on. `Insert` is O(1) and only uses atomic operations.
+class GenerationSet {
+public:
+	/// @brief The number of generations which can be stored.
+	static constexpr std::uint64_t kMaxGenerations = std::uint64_t{1} << 36;
+
+public:
+	GenerationSet() noexcept;
+	GenerationSet(const GenerationSet&) = delete;
+	GenerationSet(GenerationSet&&) = delete;
+	~GenerationSet() noexcept;
+
+public:
+	GenerationSet& operator=(const GenerationSet&) = delete;
+	GenerationSet& operator=(GenerationSet&&) = delete;
+
+public:
+	/// @brief Add a generation to the set.
+	/// @param generation The generation which MUST NOT have been added before.
+	/// @throws std::out_of_range if @p generation is not less than `kMaxGenerations`.
+	void Insert(std::uint64_t generation);
+
+	/// @brief Check if a generation is in the set.
+	/// @param generation The generation.
+	/// @return `true` if the generation has been added.
+	/// @throws std::out_of_range if @p generation is not less than `kMaxGenerations`.
+	[[nodiscard]] bool Contains(std::uint64_t generation) const;
+
+	/// @brief Get the number of chunks which are currently allocated.
+	/// @return The number of chunks.
+	[[nodiscard]] std::size_t GetChunkCount() const noexcept;
+
+private:
+	struct Chunk;
+
+	static constexpr std::size_t kChunkBits = 22;                                    ///< @brief The number of bits of a generation used for the index into a chunk.
+	static constexpr std::size_t kChunkWords = (std::size_t{1} << kChunkBits) / 64;  ///< @brief The number of 64-bit words per chunk.
+	static constexpr std::size_t kChunkCount = kMaxGenerations >> kChunkBits;        ///< @brief The maximum number of chunks.
+
+	/// @brief Get the directory of chunks, allocate it if required.
+	/// @return The directory.
+	std::atomic<Chunk*>* GetDirectory();
+
+	std::atomic<std::atomic<Chunk*>*> m_directory = nullptr;  ///< @brief The chunks, `nullptr` if not yet allocated.
+	mutable std::atomic<std::uint32_t> m_readers = 0;         ///< @brief The number of calls to `Contains` in progress.
+	std::atomic<std::size_t> m_chunks = 0;                    ///< @brief The number of allocated chunks.
+};
+
+}  // namespace m4t::internal
@@ -0,0 +1,74 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include "m4t/AllocationTracker.h"
+
+#include <utility>
+
+/// @brief Generates a failure if memory blocks allocated in the following block are still allocated at its end.
+/// @details Usage: `EXPECT_NO_LEAKS(spy) { ... }`. The failure lists all leaked blocks.
+/// @param spy_ A reference to the `m4t::MallocSpy` or `m4t::SpyMemoryResource` which is used by the code in the block.
+#define EXPECT_NO_LEAKS(spy_) \
+	for (m4t::internal::LeakScope m4t_leakScope_((spy_), __FILE__, __LINE__); m4t_leakScope_.Enter();)
+
+namespace m4t::internal {
+
+/// @brief Helper for `EXPECT_NO_LEAKS` which checks for leaked memory blocks when it is destroyed.
+class LeakScope {
+public:
+	/// @brief Create a checkpoint.
+	/// @param spy The `MallocSpy` or `SpyMemoryResource` to check.
+	/// @param file The source file for reporting a failure.
+	/// @param line The source line for reporting a failure.
+	template <typename Spy>
+	LeakScope(Spy& spy, const char* const file, const int line)
+	    : LeakScope(spy.m_tracker, file, line) {
+		// empty
+	}
+
+	/// @brief Create a checkpoint.
+	/// @param tracker The tracker to check.
+	/// @param file The source file for reporting a failure.
+	/// @param line The source line for reporting a failure.
+	LeakScope(AllocationTracker& tracker, const char* file, int line);
+	LeakScope(const LeakScope&) = delete;
+	LeakScope(LeakScope&&) = delete;
+	~LeakScope() noexcept;
+
+public:
+	LeakScope& operator=(const LeakScope&) = delete;
+	LeakScope& operator=(LeakScope&&) = delete;
+
+public:
+	/// @brief Allows to run the block of the `for` statement exactly once.
+	/// @return `true` on the first call, else `false`.
+	[[nodiscard]] bool Enter() noexcept {
+		return !std::exchange(m_entered, true);
+	}
+
+private:
+	const AllocationTracker& m_tracker;  ///< @brief The tracker to check.
+	const char* const m_file;            ///< @brief The source file.
+	const int m_line;                    ///< @brief The source line.
+	AllocationCheckpoint m_checkpoint;   ///< @brief The checkpoint at the start of the block.
+	bool m_entered = false;              ///< @brief `true` if the block has been run.
+};
+
+}  // namespace m4t::internal
@@ -0,0 +1,54 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace m4t::internal {
+
+/// @brief The parts of a line written by `m3c::Log` using `OutputDebugStringA`.
+/// @details All views point into the parsed text.
+struct LogLine {
+	std::string_view level;    ///< @brief The log level.
+	std::string_view message;  ///< @brief The message.
+	std::string_view causes;   ///< @brief The raw lines of all causes, use `NextCause` to get the messages.
+	const char* error;         ///< @brief A description of the first syntax error or `nullptr` if the line is valid.
+	std::size_t errorOffset;   ///< @brief The offset of the syntax error in the text.
+
+	/// @brief Check if the line has been parsed without errors.
+	/// @return `true` if the text matches the grammar.
+	[[nodiscard]] bool IsValid() const noexcept {
+		return error == nullptr;
+	}
+};
+
+/// @brief Parse a line written by `m3c::Log`.
+/// @details The grammar is `[level] [thread id] message\n\tat file(line) (function)\n` followed by any number of
+/// `\tcaused by: message\n\t\tat file(line) (function)\n`. The text is scanned once and no memory is allocated.
+/// @param text The text.
+/// @return The parts of the line or the position of the first syntax error.
+[[nodiscard]] LogLine ParseLogLine(std::string_view text) noexcept;
+
+/// @brief Get the message of the next cause.
+/// @param causes The remaining causes from `LogLine::causes` of a valid line, updated to skip the returned cause.
+/// @return The message of the cause or an empty view if there are no more causes.
+[[nodiscard]] std::string_view NextCause(std::string_view& causes) noexcept;
+
+}  // namespace m4t::internal
@@ -17,13 +17,30 @@ limitations under the License.
 /// @file
 #pragma once
 
+#include "m4t/EventArena.h"         // IWYU pragma: export
+#include "m4t/EventExpectations.h"  // IWYU pragma: export
+#include "m4t/EventFilter.h"        // IWYU pragma: export
+#include "m4t/EventSchema.h"        // IWYU pragma: export
+#include "m4t/EventStatistics.h"    // IWYU pragma: export
+#include "m4t/MpmcRing.h"           // IWYU pragma: export
+#include "m4t/SharedEventRing.h"    // IWYU pragma: export
+#include "m4t/TraceRecorder.h"      // IWYU pragma: export
+
 #include <gmock/gmock.h>
+#include <gtest/gtest.h>
 
 #include <windows.h>
+#include <evntprov.h>
 
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <tuple>
+#include <type_traits>
 
 namespace m4t {
 
@@ -31,22 +48,235 @@ enum class LogListenerMode : std::uint8_t {
 	kLazy = 0,
 	kStrictEvent = 1,
 	kStrictDebug = 2,
-	kStrictAll = kStrictEvent | kStrictDebug
+	kStrictAll = kStrictEvent | kStrictDebug,
+	kCapture = 4,   ///< @brief Copy all events including their payload for checking them after the code under test has finished.
+	kDeferred = 8,  ///< @brief Add all calls to a lock-free ring buffer and call the mock methods in `LogListener::Flush`.
+	kCount = 16     ///< @brief Only update counters and inter-arrival histograms without calling any mock methods.
+};
+
+/// @brief Defines how intercepted calls are passed to the real `OutputDebugStringA` and `EventWriteEx`.
+enum class ForwardPolicy : std::uint8_t {
+	kSync = 0,  ///< @brief Call the real function before returning to the caller.
+	kDrop = 1,  ///< @brief Never call the real function, e.g. for tests which only check the log content.
+	kBatch = 2  ///< @brief Copy the call and pass it to the real function on a background thread.
+};
+
+constexpr LogListenerMode operator|(const LogListenerMode lhs, const LogListenerMode rhs) noexcept {
+	return static_cast<LogListenerMode>(static_cast<std::underlying_type_t<LogListenerMode>>(lhs) | static_cast<std::underlying_type_t<LogListenerMode>>(rhs));
+}
+
+constexpr LogListenerMode operator&(const LogListenerMode lhs, const LogListenerMode rhs) noexcept {
+	return static_cast<LogListenerMode>(static_cast<std::underlying_type_t<LogListenerMode>>(lhs) & static_cast<std::underlying_type_t<LogListenerMode>>(rhs));
+}
+
+namespace internal {
+
+class LogListenerHooks;
+
+/// @brief Get the payload of a single user argument of an event.
+/// @param userData The user arguments as passed to `EventWriteEx`.
+/// @param index The 0-based index of the argument.
+/// @return The payload of the argument.
+[[nodiscard]] inline std::span<const std::byte> GetEventArg(const EVENT_DATA_DESCRIPTOR* const userData, const std::uint32_t index) noexcept {
+	return {reinterpret_cast<const std::byte*>(userData[index].Ptr), userData[index].Size};  // NOLINT(performance-no-int-to-ptr): API provides pointer as integer value.
+}
+
+/// @brief Receives the events of a single event id.
+class TypedEventHandler {
+public:
+	virtual ~TypedEventHandler() noexcept = default;
+
+public:
+	/// @brief Decode the arguments and call the mock function.
+	/// @param argCount The number of user arguments.
+	/// @param userData The user arguments.
+	virtual void Dispatch(std::uint32_t argCount, const EVENT_DATA_DESCRIPTOR* userData) = 0;
 };
 
+/// @brief Decodes the arguments of an event using an `EventSchema` and calls a mock function with typed arguments.
+/// @tparam Schema The `EventSchema`.
+template <typename Schema>
+class TypedEventHandlerFor final : public TypedEventHandler {
+public:
+	void Dispatch(const std::uint32_t argCount, const EVENT_DATA_DESCRIPTOR* const userData) override {
+		const std::optional<typename Schema::Tuple> args = Schema::Decode(argCount, [userData](const std::uint32_t index) noexcept {
+			return GetEventArg(userData, index);
+		});
+		if (!args) {
+			ADD_FAILURE() << "Arguments of event " << Schema::kEventId << " do not match the schema";
+			return;
+		}
+		std::apply([this](const auto&... arg) {
+			m_mock.Call(arg...);
+		},
+		           *args);
+	}
+
+	/// @brief Get the mock function.
+	/// @return The mock function.
+	testing::MockFunction<typename Schema::Signature>& GetMock() noexcept {
+		return m_mock;
+	}
+
+private:
+	testing::MockFunction<typename Schema::Signature> m_mock;  ///< @brief The mock function receiving the arguments.
+};
+
+}  // namespace internal
+
+/// @brief A mock receiving the debug output and events written by `m3c::Log`.
+/// @details The hooks for `OutputDebugStringA` and `EventWriteEx` are installed once per process. A listener receives
+/// the calls of the thread which created it until it is destroyed. Listeners on different threads are independent and
+/// the innermost listener wins if several listeners exist on the same thread.
 class LogListener {
 public:
-	LogListener(LogListenerMode mode = LogListenerMode::kLazy);  // NOLINT(google-explicit-constructor): Allow configuration in declaration in classes.
+	/// @brief Routes the calls on the current thread to a listener until the scope ends.
+	/// @details Use for threads which are created by the code under test. Scopes and listeners MUST be destroyed in
+	/// reverse order of their creation on each thread and before the listener.
+	class ThreadScope {
+	public:
+		/// @brief Make @p listener the innermost listener of the current thread.
+		/// @param listener The listener.
+		explicit ThreadScope(const LogListener& listener) noexcept;
+		ThreadScope(const ThreadScope&) = delete;
+		ThreadScope(ThreadScope&&) = delete;
+		~ThreadScope() noexcept;
+
+	public:
+		ThreadScope& operator=(const ThreadScope&) = delete;
+		ThreadScope& operator=(ThreadScope&&) = delete;
+
+	private:
+		const LogListener& m_listener;  ///< @brief The listener of this scope.
+		const LogListener* m_previous;  ///< @brief The previous innermost listener of the thread.
+	};
+
+public:
+	/// @brief The default capacity of the ring buffer in mode `LogListenerMode::kDeferred`.
+	static constexpr std::size_t kDefaultCapacity = 4096;
+
+public:
+	/// @brief Create a new listener.
+	/// @details In mode `LogListenerMode::kDeferred`, the intercepted calls only add a copy to a ring buffer which does
+	/// not use the global mutex of gmock. The mock methods are called in the order of the ring buffer when `Flush` is
+	/// called or the listener is destroyed. The pointer passed to `EventArg` then points to the copy.
+	/// @param mode The mode.
+	/// @param overflow The behavior if the ring buffer is full. Using `OverflowPolicy::kBlock` makes the calling thread
+	/// call the mock methods for all records in the buffer.
+	/// @param capacity The initial capacity of the ring buffer.
+	LogListener(LogListenerMode mode = LogListenerMode::kLazy, OverflowPolicy overflow = OverflowPolicy::kBlock, std::size_t capacity = kDefaultCapacity);  // NOLINT(google-explicit-constructor): Allow configuration in declaration in classes.
 	~LogListener();
 
 public:
 	MOCK_METHOD(void, Debug, (const std::string&, const std::string&), (const));
 	MOCK_METHOD(void, Event, (USHORT eventId, UCHAR level, ULONGLONG keyword, ULONG argCount), (const));
 	MOCK_METHOD(void, EventArg, (ULONG index, ULONG size, const void* ptr), (const));
+	MOCK_METHOD(void, ProcessDebug, (DWORD processId, const std::string&, const std::string&), (const));
+	MOCK_METHOD(void, ProcessEvent, (DWORD processId, USHORT eventId, UCHAR level, ULONGLONG keyword, ULONG argCount), (const));
+
+public:
+	/// @brief Get a mock function which receives all events of a schema with decoded arguments.
+	/// @details Usage: `EXPECT_CALL(log.OnEvent<MyEvent>(), Call(42, L"text", t::_));`. The arguments are decoded once
+	/// and events with the id of the schema do not call `Event` and `EventArg`. A failure is generated if the
+	/// arguments of an event do not match the schema. Calling the function again for the same schema returns the same
+	/// mock function. This function MUST NOT be called while events are logged.
+	/// @tparam Schema The `EventSchema` of the event.
+	/// @return The mock function which is owned by the listener.
+	/// @throws std::invalid_argument if a different schema for the event id already exists.
+	template <typename Schema>
+	testing::MockFunction<typename Schema::Signature>& OnEvent() {
+		if (internal::TypedEventHandler* const existing = FindTypedEventHandler(Schema::kEventId); existing) {
+			if (internal::TypedEventHandlerFor<Schema>* const typed = dynamic_cast<internal::TypedEventHandlerFor<Schema>*>(existing); typed) {
+				return typed->GetMock();
+			}
+			throw std::invalid_argument("event id already has a different schema");
+		}
+		std::unique_ptr<internal::TypedEventHandlerFor<Schema>> handler = std::make_unique<internal::TypedEventHandlerFor<Schema>>();
+		testing::MockFunction<typename Schema::Signature>& mock = handler->GetMock();
+		AddTypedEventHandler(Schema::kEventId, std::move(handler));
+		return mock;
+	}
+
+	/// @brief Get the table of expected events.
+	/// @details Usage: `log.ExpectEvents().Expect(1).Expect(2, t::Exactly(3)).Expect<MyEvent>(t::AtLeast(1), t::FieldsAre(42));`.
+	/// Events with an id in the table are checked with a single hash lookup and do not call any other mock method.
+	/// All unmet expectations are reported as a single failure when the listener is destroyed.
+	/// @return The table which is owned by the listener.
+	[[nodiscard]] EventExpectations& ExpectEvents() noexcept;
+
+	/// @brief Set a filter for events.
+	/// @details Events which do not pass the filter are only passed on according to the `ForwardPolicy` without calling
+	/// any mock method, being captured or being counted for the strict modes. The filter MUST NOT be changed while
+	/// events are logged.
+	/// @param filter The filter.
+	void SetEventFilter(const EventFilter& filter) noexcept;
+
+	/// @brief Set how intercepted calls are passed to the real functions.
+	/// @details The real functions are slow if a debugger or a trace session is attached. Calls on the background thread
+	/// of `ForwardPolicy::kBatch` keep their order and are completed when the listener is destroyed. The policy MUST NOT
+	/// be changed while events are logged.
+	/// @param policy The policy, the default is `ForwardPolicy::kSync`.
+	void SetForwardPolicy(ForwardPolicy policy) noexcept;
+
+	/// @brief Record all intercepted calls with timestamp, thread id and activity id.
+	/// @details Only events which pass the filter and debug output written by `m3c::Log` are recorded. The recorder
+	/// MUST NOT be changed while events are logged and MUST NOT be destroyed before the listener.
+	/// @param recorder The recorder or `nullptr` for stopping recording.
+	void SetTraceRecorder(TraceRecorder* recorder) noexcept;
+
+	/// @brief Get the events captured in mode `LogListenerMode::kCapture`.
+	/// @details Unlike the pointer passed to `EventArg`, the payload remains valid until `ClearCapturedEvents` is called
+	/// or the listener is destroyed. The result MUST NOT be used while events are logged.
+	/// @return The events in the order they have been logged, excluding file name and line.
+	[[nodiscard]] const EventArena& GetCapturedEvents() const noexcept;
+
+	/// @brief Remove all captured events but keep the memory for reuse.
+	void ClearCapturedEvents() noexcept;
+
+	/// @brief Call the mock methods for all records added in mode `LogListenerMode::kDeferred`.
+	/// @details The methods are called on the current thread. Does nothing in other modes.
+	void Flush() const;
+
+	/// @brief Get the number of records discarded because the ring buffer was full.
+	/// @return The number of records, always 0 unless using `OverflowPolicy::kDrop`.
+	[[nodiscard]] std::size_t GetDroppedCount() const noexcept;
+
+	/// @brief Call the mock methods for all records written by child processes.
+	/// @details Calls `ProcessDebug` for debug output and `ProcessEvent` followed by `EventArg` for events. The pointer
+	/// passed to `EventArg` is only valid during the call. The child processes use `ForwardLogToParent`.
+	/// @param collector The collector which receives the records.
+	void Receive(SharedEventCollector& collector) const;
+
+	/// @brief Get the counters of mode `LogListenerMode::kCount`.
+	/// @details The result may be requested while events are logged.
+	/// @return The counters for all event ids and debug levels, empty in other modes.
+	[[nodiscard]] EventStatisticsSnapshot GetStatistics() const;
+
+private:
+	/// @brief Register the handler for an event id.
+	/// @param eventId The event id.
+	/// @param handler The handler.
+	/// @throws std::invalid_argument if a handler for the event id already exists.
+	void AddTypedEventHandler(std::uint16_t eventId, std::unique_ptr<internal::TypedEventHandler> handler);
+
+	/// @brief Get the handler for an event id.
+	/// @param eventId The event id.
+	/// @return The handler or `nullptr` if no schema exists for the event id.
+	[[nodiscard]] internal::TypedEventHandler* FindTypedEventHandler(std::uint16_t eventId) const noexcept;
 
 private:
 	class Impl;
 	std::unique_ptr<Impl> m_impl;
+	ThreadScope m_scope;  ///< @brief Registers the listener for the thread which created it.
+
+	friend class internal::LogListenerHooks;
 };
 
+/// @brief Forward the debug output and events of all threads without a `LogListener` to a parent process.
+/// @details Call in a child process which has been started with the environment variable `kSharedEventRingVariable`
+/// set to the name of a `SharedEventCollector`. The parent receives the records using `LogListener::Receive`.
+/// @return `true` if the output is forwarded, `false` if the environment variable is not set.
+/// @throws std::system_error if the shared memory cannot be opened.
+bool ForwardLogToParent();
+
 }  // namespace m4t
@@ -18,20 +18,51 @@ limitations under the License.
 
 #pragma once
 
+#include "m4t/AllocationTrace.h"
+#include "m4t/AllocationTracker.h"
+#include "m4t/DeletedHistory.h"
+#include "m4t/FaultInjector.h"
+#include "m4t/LeakScope.h"  // IWYU pragma: export
+
 #include <windows.h>
 #include <objidl.h>
 
+#include <atomic>
 #include <cstddef>
-#include <set>
-#include <shared_mutex>
-#include <unordered_set>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace m4t {
 
 /// @brief Implementation of `IMallocSpy` for use in testing.
 class MallocSpy : public IMallocSpy {
 public:
-	MallocSpy() = default;
+	/// @brief The default value for the maximum memory used for the history of deleted blocks.
+	static constexpr std::size_t kDefaultDeletedHistoryBytes = internal::AllocationTracker::kDefaultDeletedHistoryBytes;
+
+public:
+	/// @brief Create a new object with the default limit for the history of deleted blocks.
+	MallocSpy();
+
+	/// @brief Create a new object.
+	/// @param maxDeletedHistoryBytes The maximum number of bytes used for the history of deleted blocks. If more blocks
+	/// are deleted than fit into this limit, `GetDeletedState` returns `DeletedState::kProbablyDeleted` for older blocks.
+	explicit MallocSpy(std::size_t maxDeletedHistoryBytes);
+
+	/// @brief Create a new object.
+	/// @details Use `TrackingMode::kBuffered` to make the callbacks cheap and free of contention. All buffered calls
+	/// are merged when the state is queried or `Flush` is called. Use `TrackingMode::kAccounting` to enable
+	/// `GetStatistics` and `TrackingMode::kStacks` to include the call stacks of allocations in leak reports. Use
+	/// `TrackingMode::kSampling` to track only a random sample of allocations in long-running tests.
+	/// @param mode The tracking mode.
+	/// @param maxDeletedHistoryBytes The maximum number of bytes used for the history of deleted blocks.
+	explicit MallocSpy(TrackingMode mode, std::size_t maxDeletedHistoryBytes = kDefaultDeletedHistoryBytes);
 	MallocSpy(const MallocSpy&) = delete;
 	MallocSpy(MallocSpy&&) = delete;
 	// allow creation on the stack
@@ -61,16 +92,147 @@ public:  // IMallocSpy
 	void __stdcall PostHeapMinimize() noexcept override;
 
 public:  // MallocSpy
+	/// @brief Merge all buffered calls into the tables.
+	/// @details Does nothing if the object has not been created with `TrackingMode::kBuffered`.
+	void Flush() const;
+
 	bool IsAllocated(const void* p) const;
+
+	/// @brief Check if a memory block has been deleted.
+	/// @warning The result is only approximate if more blocks have been deleted than fit into the history. Use
+	/// `GetDeletedState` to check if the result is exact. If the address has been allocated again, the previous block is
+	/// still reported as deleted. Use `IsSameAllocation` or `IsGenerationDeleted` for exact checks of a single allocation.
+	/// @param p The address of the memory block.
+	/// @return `true` if the result of `GetDeletedState` is `DeletedState::kDeleted` or `DeletedState::kProbablyDeleted`.
 	bool IsDeleted(const void* p) const;
+
+	/// @brief Get the memory block which is currently allocated at an address.
+	/// @details Keep the generation of the result for use with `IsSameAllocation` and `IsGenerationDeleted`.
+	/// @param p The address of the memory block.
+	/// @return The memory block or `std::nullopt` if the address is not allocated.
+	std::optional<AllocatedBlock> GetAllocation(const void* p) const;
+
+	/// @brief Check if an address still belongs to the same allocation.
+	/// @param p The address of the memory block.
+	/// @param generation The generation of the allocation from `GetAllocation`.
+	/// @return `false` if the memory block has been deleted, even if the address has been allocated again.
+	bool IsSameAllocation(const void* p, std::uint64_t generation) const;
+
+	/// @brief Check if the memory block of an allocation has been deleted.
+	/// @details Unlike `IsDeleted`, the result is exact and not affected by reuse of the address.
+	/// @param generation The generation of the allocation from `GetAllocation`.
+	/// @return `true` if the memory block has been deleted.
+	bool IsGenerationDeleted(std::uint64_t generation) const;
+
+	/// @brief Get the state of a memory block in the history of deleted blocks.
+	/// @param p The address of the memory block.
+	/// @return The state, `DeletedState::kProbablyDeleted` marks an approximate result.
+	DeletedState GetDeletedState(const void* p) const;
+
 	std::size_t GetAllocatedCount() const;
+
+	/// @brief Get the number of memory blocks that have been deleted.
+	/// @return The number of deleted blocks, always exact.
 	std::size_t GetDeletedCount() const;
 
+	/// @brief Get the byte counts of the memory blocks.
+	/// @details The size of each block is the size requested from `IMalloc`, the overhead of the heap is not included.
+	/// @return The statistics, all values are 0 if the object has not been created with `TrackingMode::kAccounting`.
+	AllocationStatistics GetStatistics() const;
+
+	/// @brief Set the peak number of bytes to the number of bytes which are currently allocated.
+	/// @details Use before running the code under test to measure its peak memory usage.
+	void ResetPeakBytes();
+
+	/// @brief Set the average number of bytes between two sampled allocations.
+	/// @details Only used in mode `TrackingMode::kSampling`. All queries for memory blocks only see sampled blocks.
+	/// @param bytes The sampling interval in bytes.
+	void SetSamplingRate(std::size_t bytes) noexcept;
+
+	/// @brief Turn sampling on or off at run time.
+	/// @details Only used in mode `TrackingMode::kSampling`. When sampling is off, all allocations are tracked.
+	/// @param enabled `true` to track only a sample of allocations.
+	void SetSampling(bool enabled) noexcept;
+
+	/// @brief Get unbiased estimates of live and total bytes and allocation counts from the sampled allocations.
+	/// @return The estimates, all values are 0 if the object has not been created with `TrackingMode::kSampling`.
+	SamplingEstimate GetSamplingEstimate() const;
+
+	/// @brief Make a single call of `IMalloc::Alloc` fail.
+	/// @details Failing is implemented by returning 0 from `PreAlloc`. `IMalloc::Realloc` never fails because a size
+	/// of 0 would free the memory block.
+	/// @param index The zero-based index of the allocation, counted from this call.
+	void FailNthAllocation(std::size_t index) noexcept;
+
+	/// @brief Make all allocations fail which are larger than a limit.
+	/// @param size The largest size which does not fail.
+	void FailAllocationsAbove(std::size_t size) noexcept;
+
+	/// @brief Make allocations fail randomly.
+	/// @details The decision only depends on @p seed and the index of the allocation, so runs are repeatable.
+	/// @param probability The probability for failing an allocation in the range [0, 1].
+	/// @param seed The seed.
+	void FailAllocationsRandomly(double probability, std::uint64_t seed) noexcept;
+
+	/// @brief Stop failing allocations.
+	void StopFailingAllocations() noexcept;
+
+	/// @brief Get the number of failed allocations since the current rule for failing has been set.
+	/// @return The number of failed allocations.
+	std::size_t GetFailedAllocationCount() const noexcept;
+
+	/// @brief Run a function once for each allocation it makes, failing a different allocation in each run.
+	/// @details The first run fails the first allocation, the second run fails the second one and so on. Enumeration
+	/// stops after the first run in which no allocation has failed.
+	/// @param function The function to run. It MUST make the same allocations in the same order in each run.
+	/// @return The number of failure points, i.e. the number of allocations in a run without failures.
+	template <typename Function>
+	std::size_t EnumerateAllocationFailures(Function&& function) {
+		return m_faultInjector.EnumerateFailures(std::forward<Function>(function));
+	}
+
+	/// @brief Create a checkpoint for finding the memory blocks allocated after this call.
+	/// @details Blocks which are deleted and allocated again at the same address are told apart by their generation.
+	/// @return The checkpoint which MUST NOT outlive this object.
+	AllocationCheckpoint Checkpoint();
+
+	/// @brief Get all memory blocks which have been allocated after a checkpoint and which are still allocated.
+	/// @details The cost is proportional to the number of allocations since the oldest existing checkpoint.
+	/// @param checkpoint A checkpoint created by this object.
+	/// @return The memory blocks ordered by the time of their allocation.
+	std::vector<AllocatedBlock> GetAllocatedSince(const AllocationCheckpoint& checkpoint) const;
+
+	/// @brief Get the call stack of an allocation with resolved symbols.
+	/// @details Stacks are only captured in mode `TrackingMode::kStacks`. Symbols are resolved on each call.
+	/// @param stack The id of the stack from `AllocatedBlock::stack`.
+	/// @return One line per frame, empty if no stack is available.
+	std::string FormatStack(std::uint32_t stack) const;
+
+	/// @brief Start writing all allocations and deletions to a binary trace file.
+	/// @details Use `ReadTrace` and `AnalyzeTrace` or the command line tool `m4t_alloc_trace` for analyzing the trace.
+	/// A trace which has been started before is stopped.
+	/// @param path The path of the trace file, an existing file is replaced.
+	void StartTrace(const std::filesystem::path& path);
+
+	/// @brief Write all pending records and close the trace file.
+	void StopTrace();
+
+private:
+	/// @brief Add a record to the active trace, if any.
+	/// @param operation The operation.
+	/// @param p The address of the memory block.
+	/// @param size The requested size for `TraceOperation::kAllocated`.
+	void Trace(TraceOperation operation, const void* p, std::size_t size) noexcept;
+
 private:
-	volatile ULONG m_refCount = 1;  ///< @brief The COM reference count of this object.
-	mutable std::shared_mutex m_mutex;
-	std::unordered_set<const void*> m_allocated;  ///< @brief Currently allocated memory blocks.
-	std::multiset<const void*> m_deleted;         ///< @brief All memory blocks that have ever been deleted.
+	volatile ULONG m_refCount = 1;                                 ///< @brief The COM reference count of this object.
+	internal::AllocationTracker m_tracker;                         ///< @brief The state of all memory blocks.
+	internal::FaultInjector m_faultInjector;                       ///< @brief Decides which allocations fail.
+	std::atomic<internal::TraceWriter*> m_trace = nullptr;         ///< @brief The active trace or `nullptr`.
+	std::mutex m_tracesMutex;                                      ///< @brief Guards @p m_traces.
+	std::vector<std::unique_ptr<internal::TraceWriter>> m_traces;  ///< @brief All traces, stopped ones are kept because callbacks might still use them.
+
+	friend class internal::LeakScope;
 };
 
 }  // namespace m4t
@@ -0,0 +1,83 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include "m4t/AllocationFill.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <optional>
+
+#if defined(_WIN32) && (defined(__SANITIZE_ADDRESS__) || !(defined(__clang_analyzer__) || (defined(NDEBUG) && NDEBUG) || !defined(_DEBUG) || !_DEBUG))
+/// @brief The pattern of new memory blocks filled by the debug heap of the C runtime.
+#define M4T_CRT_FILL_PATTERN std::optional<unsigned char>(0xCD)
+#else
+/// @brief The pattern of new memory blocks filled by the C runtime, none in release builds and on other platforms.
+#define M4T_CRT_FILL_PATTERN std::optional<unsigned char>()
+#endif
+
+#if defined(M4T_NEW) && M4T_NEW
+/// @brief Generates a failure if any byte of a memory range has been written since it was allocated.
+/// @details The whole range is compared with the fill pattern of `m4t::EnableAllocationFill` or, if filling is
+/// disabled, of the C runtime. The failure message contains the first and the last modified offset. Without any fill
+/// pattern, this is a simple not-null check.
+/// @param p_ The start of the memory range.
+/// @param size_ The size of the memory range in bytes.
+#define EXPECT_UNINITIALIZED_RANGE(p_, size_) EXPECT_TRUE(m4t::internal::IsUninitializedRange((p_), (size_), m4t::internal::GetUninitializedPattern(M4T_CRT_FILL_PATTERN)))
+#else
+/// @brief Generates a failure if any byte of a memory range has been written since it was allocated.
+/// @details The whole range is compared with the fill pattern of the C runtime. The failure message contains the first
+/// and the last modified offset. Without a fill pattern, e.g. in release builds or on platforms other than Windows,
+/// this is a simple not-null check unless linking with `common-cpp-testing::m4t_new` and calling
+/// `m4t::EnableAllocationFill`.
+/// @param p_ The start of the memory range.
+/// @param size_ The size of the memory range in bytes.
+#define EXPECT_UNINITIALIZED_RANGE(p_, size_) EXPECT_TRUE(m4t::internal::IsUninitializedRange((p_), (size_), M4T_CRT_FILL_PATTERN))
+#endif
+
+namespace m4t {
+
+/// @brief The offsets of the first and the last byte of a memory range which differ from a fill pattern.
+struct TouchedRange {
+	std::size_t first;  ///< @brief The offset of the first modified byte.
+	std::size_t last;   ///< @brief The offset of the last modified byte.
+};
+
+/// @brief Find the bytes of a memory range which have been modified after filling it with a pattern.
+/// @details The range is scanned with SIMD instructions from both ends, so the cost is proportional to the distance
+/// of the modified bytes from the start and the end of the range.
+/// @param p The start of the memory range.
+/// @param size The size of the memory range in bytes.
+/// @param pattern The value of all bytes of the range which have not been modified.
+/// @return The offsets of the first and last modified byte or `std::nullopt` if all bytes match @p pattern.
+[[nodiscard]] std::optional<TouchedRange> FindTouchedRange(const void* p, std::size_t size, unsigned char pattern) noexcept;
+
+namespace internal {
+
+/// @brief Helper for `EXPECT_UNINITIALIZED_RANGE`.
+/// @param p The start of the memory range.
+/// @param size The size of the memory range in bytes.
+/// @param pattern The fill pattern or `std::nullopt` if no pattern is available, then only @p p is checked for `nullptr`.
+/// @return The result of the check with the first and the last touched offset in case of a failure.
+testing::AssertionResult IsUninitializedRange(const void* p, std::size_t size, std::optional<unsigned char> pattern);
+
+}  // namespace internal
+
+}  // namespace m4t
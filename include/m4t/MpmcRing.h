@@ -0,0 +1,262 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+
+namespace m4t {
+
+/// @brief Defines what happens when a record is added to a full ring buffer.
+enum class OverflowPolicy : std::uint8_t {
+	kBlock = 0,  ///< @brief The producer waits until records have been removed.
+	kDrop = 1,   ///< @brief The record is discarded and counted.
+	kGrow = 2,   ///< @brief A new buffer with twice the capacity is appended.
+};
+
+namespace internal {
+
+/// @brief A lock-free ring buffer for multiple producers and consumers.
+/// @details Each segment is a bounded queue as described by Dmitry Vyukov. When a segment is full in mode
+/// `OverflowPolicy::kGrow`, it is closed and a new segment with twice the capacity is appended. Segments are only
+/// released when the ring is destroyed because producers might still access them. The order of the records of each
+/// producer is preserved.
+/// @tparam T The type of the records.
+template <typename T>
+class MpmcRing {
+public:
+	/// @brief Create a new ring buffer.
+	/// @param capacity The initial capacity which is rounded up to the next power of 2.
+	/// @param policy The overflow policy.
+	MpmcRing(const std::size_t capacity, const OverflowPolicy policy)
+	    : m_policy(policy)
+	    , m_first(std::make_unique<Segment>(std::bit_ceil(std::max<std::size_t>(capacity, 2))))
+	    , m_head(m_first.get())
+	    , m_tail(m_first.get()) {
+		// empty
+	}
+	MpmcRing(const MpmcRing&) = delete;
+	MpmcRing(MpmcRing&&) = delete;
+	~MpmcRing() noexcept = default;
+
+public:
+	MpmcRing& operator=(const MpmcRing&) = delete;
+	MpmcRing& operator=(MpmcRing&&) = delete;
+
+public:
+	/// @brief Add a record.
+	/// @details In mode `OverflowPolicy::kBlock` the caller is responsible for waiting or for removing records.
+	/// @param value The record which is moved into the ring if the function returns `true`.
+	/// @return `true` if the record has been added, `false` if the ring is full.
+	bool Push(T& value) {
+		while (true) {
+			Segment* segment = m_tail.load(std::memory_order_acquire);
+			if (segment->TryPush(value)) {
+				[[likely]];
+				return true;
+			}
+			if (m_policy != OverflowPolicy::kGrow) {
+				if (m_policy == OverflowPolicy::kDrop) {
+					m_dropped.fetch_add(1, std::memory_order_relaxed);
+				}
+				return false;
+			}
+			// no more records are added to a full segment to keep the order for the consumer
+			segment->Close();
+			Segment* next = segment->next.load(std::memory_order_acquire);
+			if (!next) {
+				std::unique_ptr<Segment> newSegment = std::make_unique<Segment>(segment->GetCapacity() * 2);
+				if (segment->next.compare_exchange_strong(next, newSegment.get(), std::memory_order_acq_rel)) {
+					next = newSegment.release();
+				}
+				// else another thread has added the segment which is now in next
+			}
+			m_tail.compare_exchange_strong(segment, next, std::memory_order_acq_rel);
+		}
+	}
+
+	/// @brief Remove the oldest record.
+	/// @return The record or `std::nullopt` if the ring is empty or the oldest record is still being added.
+	std::optional<T> Pop() {
+		while (true) {
+			Segment* segment = m_head.load(std::memory_order_acquire);
+			if (std::optional<T> value = segment->TryPop(); value) {
+				return value;
+			}
+			if (!segment->IsDrained()) {
+				return std::nullopt;
+			}
+			Segment* next = segment->next.load(std::memory_order_acquire);
+			if (!next) {
+				return std::nullopt;
+			}
+			m_head.compare_exchange_strong(segment, next, std::memory_order_acq_rel);
+		}
+	}
+
+	/// @brief Get the number of records discarded in mode `OverflowPolicy::kDrop`.
+	/// @return The number of records.
+	[[nodiscard]] std::size_t GetDroppedCount() const noexcept {
+		return m_dropped.load(std::memory_order_relaxed);
+	}
+
+	/// @brief Get the sum of the capacities of all segments.
+	/// @return The capacity.
+	[[nodiscard]] std::size_t GetCapacity() const noexcept {
+		std::size_t capacity = 0;
+		for (const Segment* segment = m_first.get(); segment; segment = segment->next.load(std::memory_order_acquire)) {
+			capacity += segment->GetCapacity();
+		}
+		return capacity;
+	}
+
+	/// @brief Get the overflow policy.
+	/// @return The policy.
+	[[nodiscard]] OverflowPolicy GetPolicy() const noexcept {
+		return m_policy;
+	}
+
+private:
+	/// @brief A bounded queue.
+	class Segment {
+	private:
+		/// @brief The alignment for avoiding false sharing, a fixed value because the type is used in headers.
+		static constexpr std::size_t kCacheLineSize = 64;
+
+		/// @brief Set in @p m_enqueue when no more records are accepted.
+		static constexpr std::size_t kClosed = std::size_t{1} << (sizeof(std::size_t) * 8 - 1);
+
+		/// @brief An entry of the queue.
+		struct Cell {
+			std::atomic<std::size_t> sequence;  ///< @brief The position for which the cell is available.
+			std::optional<T> value;             ///< @brief The record.
+		};
+
+	public:
+		explicit Segment(const std::size_t capacity)
+		    : m_mask(capacity - 1)
+		    , m_cells(std::make_unique<Cell[]>(capacity)) {
+			for (std::size_t i = 0; i < capacity; ++i) {
+				m_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+		Segment(const Segment&) = delete;
+		Segment(Segment&&) = delete;
+		~Segment() noexcept {
+			delete next.load(std::memory_order_relaxed);
+		}
+
+	public:
+		Segment& operator=(const Segment&) = delete;
+		Segment& operator=(Segment&&) = delete;
+
+	public:
+		/// @brief Get the number of cells.
+		/// @return The capacity.
+		[[nodiscard]] std::size_t GetCapacity() const noexcept {
+			return m_mask + 1;
+		}
+
+		/// @brief Add a record.
+		/// @param value The record which is moved into the segment if the function returns `true`.
+		/// @return `true` if the record has been added, `false` if the segment is full or closed.
+		bool TryPush(T& value) {
+			std::size_t pos = m_enqueue.load(std::memory_order_relaxed);
+			while (true) {
+				if (pos & kClosed) {
+					return false;
+				}
+				Cell& cell = m_cells[pos & m_mask];
+				const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				if (sequence == pos) {
+					if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						cell.value.emplace(std::move(value));
+						cell.sequence.store(pos + 1, std::memory_order_release);
+						return true;
+					}
+				} else if (sequence < pos) {
+					// full
+					return false;
+				} else {
+					pos = m_enqueue.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/// @brief Remove the oldest record.
+		/// @return The record or `std::nullopt` if the segment is empty or the oldest record is still being added.
+		std::optional<T> TryPop() {
+			std::size_t pos = m_dequeue.load(std::memory_order_relaxed);
+			while (true) {
+				Cell& cell = m_cells[pos & m_mask];
+				const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+				if (sequence == pos + 1) {
+					if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+						std::optional<T> value = std::move(cell.value);
+						cell.value.reset();
+						cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+						return value;
+					}
+				} else if (sequence < pos + 1) {
+					// empty or a producer is still writing
+					return std::nullopt;
+				} else {
+					pos = m_dequeue.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		/// @brief Stop accepting new records.
+		void Close() noexcept {
+			m_enqueue.fetch_or(kClosed, std::memory_order_acq_rel);
+		}
+
+		/// @brief Check if the segment is closed and all records have been removed.
+		/// @return `true` if the consumer can move on to the next segment.
+		[[nodiscard]] bool IsDrained() const noexcept {
+			const std::size_t enqueue = m_enqueue.load(std::memory_order_acquire);
+			return (enqueue & kClosed) && m_dequeue.load(std::memory_order_acquire) == (enqueue & ~kClosed);
+		}
+
+	public:
+		std::atomic<Segment*> next = nullptr;  ///< @brief The next segment, owned by this segment.
+
+	private:
+		const std::size_t m_mask;                                        ///< @brief The capacity minus 1.
+		std::unique_ptr<Cell[]> m_cells;                                 ///< @brief The cells.
+		alignas(kCacheLineSize) std::atomic<std::size_t> m_enqueue = 0;  ///< @brief The position for the next record and `kClosed`.
+		alignas(kCacheLineSize) std::atomic<std::size_t> m_dequeue = 0;  ///< @brief The position of the oldest record.
+	};
+
+private:
+	const OverflowPolicy m_policy;           ///< @brief The overflow policy.
+	std::unique_ptr<Segment> m_first;        ///< @brief The first segment which owns all other segments.
+	std::atomic<Segment*> m_head;            ///< @brief The segment for removing records.
+	std::atomic<Segment*> m_tail;            ///< @brief The segment for adding records.
+	std::atomic<std::size_t> m_dropped = 0;  ///< @brief The number of discarded records.
+};
+
+}  // namespace internal
+}  // namespace m4t
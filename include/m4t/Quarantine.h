@@ -0,0 +1,82 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+/// @brief Quarantine for memory blocks freed by the global `operator delete`.
+/// @details The functions in this file are implemented in the separate library `common-cpp-testing::m4t_new` which
+/// also replaces the global allocation functions.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace m4t {
+
+/// @brief The default value for the maximum number of bytes held in the quarantine.
+inline constexpr std::size_t kDefaultQuarantineBytes = std::size_t{16} * 1024 * 1024;
+
+/// @brief Start holding memory blocks freed by the global `operator delete` in a quarantine.
+/// @details Each block is filled with a poison pattern and only released for real when it is pushed out of the
+/// quarantine by newer blocks. This allows `EXPECT_DELETED` to check deleted memory without AddressSanitizer. Memory
+/// freed by other means than `operator delete` is not put into the quarantine.
+/// @param maxBytes The maximum number of bytes held in the quarantine.
+void EnableQuarantine(std::size_t maxBytes = kDefaultQuarantineBytes);
+
+/// @brief Release all memory blocks held in the quarantine and stop putting new ones into it.
+void DisableQuarantine() noexcept;
+
+namespace internal {
+
+/// @brief The value of all bytes of a memory block in the quarantine.
+inline constexpr unsigned char kQuarantinePoison = 0xDD;
+
+/// @brief The maximum number of bytes checked for the poison pattern by `IsQuarantined`.
+inline constexpr std::size_t kQuarantineCheckBytes = 64;
+
+/// @brief `true` if the quarantine is enabled, only changed while holding the lock of the quarantine.
+/// @details Defined inline so that the global `operator delete` only needs a single load if the quarantine is disabled.
+inline constinit std::atomic<bool> g_quarantineEnabled = false;
+
+/// @brief Check if the quarantine is active.
+/// @return `true` if the quarantine is enabled.
+[[nodiscard]] inline bool IsQuarantineEnabled() noexcept {
+	return g_quarantineEnabled.load(std::memory_order_relaxed);
+}
+
+/// @brief Put a memory block into the quarantine.
+/// @details The block is filled with the poison pattern, the oldest blocks are released if required. A block which
+/// is already held in the quarantine has been deleted twice. This is reported as a test failure and the block is kept.
+/// @param p The memory block.
+/// @param size The usable size of the memory block.
+/// @param aligned `true` if the block has been allocated by an overload of `operator new` with alignment.
+/// @return `true` if the block is held in the quarantine, else the caller MUST free the memory itself.
+[[nodiscard]] bool Quarantine(void* p, std::size_t size, bool aligned) noexcept;
+
+/// @brief Check if a memory block is held in the quarantine and still filled with the poison pattern.
+/// @details The check is O(1) because only the first `kQuarantineCheckBytes` are checked for the pattern.
+/// @param p The memory block.
+/// @return `true` if the block is in the quarantine and has not been modified.
+[[nodiscard]] bool IsQuarantined(const void* p) noexcept;
+
+/// @brief Helper for `EXPECT_DELETED` which checks deleted memory using the quarantine.
+/// @param p The memory block.
+/// @return The result of `IsQuarantined` or `true` for any pointer other than `nullptr` if the quarantine is disabled.
+[[nodiscard]] bool IsDeletedMemory(const void* p) noexcept;
+
+}  // namespace internal
+
+}  // namespace m4t
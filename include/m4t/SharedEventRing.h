@@ -0,0 +1,250 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace m4t {
+
+/// @brief The name of the environment variable which passes the name of the shared memory to child processes.
+inline constexpr char kSharedEventRingVariable[] = "M4T_SHARED_EVENT_RING";
+
+/// @brief The kind of a `SharedEventRecord`.
+enum class SharedRecordType : std::uint8_t {
+	kDebug = 0,  ///< @brief Debug output, argument 0 is the level followed by the messages in the order of `LogListener::Debug`.
+	kEvent = 1   ///< @brief An event with the user arguments excluding file name and line.
+};
+
+/// @brief A parsed call of `OutputDebugStringA` or `EventWriteEx` in a child process.
+/// @details The record has a fixed size and contains no pointers, so it can be copied through shared memory.
+class SharedEventRecord {
+public:
+	/// @brief The maximum size of all arguments including a 4 byte size prefix for each argument.
+	static constexpr std::size_t kMaxPayload = 472;
+
+public:
+	/// @brief Get the kind of record.
+	/// @return The kind of record.
+	[[nodiscard]] SharedRecordType GetType() const noexcept {
+		return m_type;
+	}
+
+	/// @brief Get the id of the process which wrote the record.
+	/// @return The process id.
+	[[nodiscard]] std::uint32_t GetProcessId() const noexcept {
+		return m_processId;
+	}
+
+	/// @brief Get the id of the thread which wrote the record.
+	/// @return The thread id as reported by the operating system.
+	[[nodiscard]] std::uint32_t GetThreadId() const noexcept {
+		return m_threadId;
+	}
+
+	/// @brief Get the id from the event descriptor.
+	/// @return The event id or 0 for debug output.
+	[[nodiscard]] std::uint16_t GetEventId() const noexcept {
+		return m_eventId;
+	}
+
+	/// @brief Get the level from the event descriptor.
+	/// @return The level or 0 for debug output.
+	[[nodiscard]] std::uint8_t GetLevel() const noexcept {
+		return m_level;
+	}
+
+	/// @brief Get the keyword from the event descriptor.
+	/// @return The keyword or 0 for debug output.
+	[[nodiscard]] std::uint64_t GetKeyword() const noexcept {
+		return m_keyword;
+	}
+
+	/// @brief Get the number of arguments.
+	/// @return The number of arguments.
+	[[nodiscard]] std::uint32_t GetArgCount() const noexcept {
+		return m_argCount;
+	}
+
+	/// @brief Get the payload of an argument.
+	/// @param index The index of the argument.
+	/// @return The bytes of the argument which are part of the record.
+	/// @throws std::out_of_range if @p index is not less than `GetArgCount()`.
+	[[nodiscard]] std::span<const std::byte> GetArg(std::uint32_t index) const;
+
+	/// @brief Get the payload of an argument as text.
+	/// @param index The index of the argument.
+	/// @return The text which is part of the record.
+	/// @throws std::out_of_range if @p index is not less than `GetArgCount()`.
+	[[nodiscard]] std::string_view GetString(const std::uint32_t index) const {
+		const std::span<const std::byte> data = GetArg(index);
+		return std::string_view(reinterpret_cast<const char*>(data.data()), data.size());
+	}
+
+private:
+	/// @brief Append an argument.
+	/// @param data The bytes of the argument.
+	/// @return `false` if the argument does not fit into the record.
+	bool AddArg(std::span<const std::byte> data) noexcept;
+
+private:
+	std::uint32_t m_processId = 0;                       ///< @brief The id of the process.
+	std::uint32_t m_threadId = 0;                        ///< @brief The id of the thread.
+	std::uint64_t m_keyword = 0;                         ///< @brief The keyword of the event.
+	std::uint32_t m_argCount = 0;                        ///< @brief The number of arguments.
+	std::uint16_t m_size = 0;                            ///< @brief The number of bytes used in @p m_payload.
+	std::uint16_t m_eventId = 0;                         ///< @brief The id of the event.
+	SharedRecordType m_type = SharedRecordType::kDebug;  ///< @brief The kind of record.
+	std::uint8_t m_level = 0;                            ///< @brief The level of the event.
+	std::array<std::byte, kMaxPayload> m_payload;        ///< @brief The arguments, each prefixed by its size.
+
+	friend class SharedEventWriter;
+};
+
+static_assert(std::is_trivially_copyable_v<SharedEventRecord>);
+
+/// @brief Owns a ring buffer in named shared memory and receives the records written by child processes.
+/// @details The ring uses a sequence number per slot, so child processes never take a lock. The records are received
+/// in the order in which the slots were reserved. A child reserves a slot and then claims it before copying the record.
+/// A slot which was reserved by a child which died before claiming it would block all following records. Therefore
+/// such a slot is skipped and counted as dropped once it is pending for longer than a timeout. A child which resumes
+/// after the timeout fails to claim the slot and loses its record. A claimed slot is never skipped because the child
+/// might still be copying the record.
+/// Uses POSIX shared memory on Linux and a file mapping on Windows.
+class SharedEventCollector {
+public:
+	/// @brief The default number of records.
+	static constexpr std::size_t kDefaultCapacity = 1024;
+
+	/// @brief The default time after which a reserved slot without a record is skipped.
+	static constexpr std::chrono::milliseconds kDefaultStaleTimeout{1000};
+
+public:
+	/// @brief Create the shared memory.
+	/// @param name The name of the shared memory which is passed to the child processes.
+	/// @param capacity The number of records, rounded up to a power of 2.
+	/// @param staleTimeout The time after which a slot which was reserved but not claimed is skipped.
+	/// @throws std::system_error if the shared memory cannot be created, e.g. because the name is already in use.
+	explicit SharedEventCollector(const std::string& name, std::size_t capacity = kDefaultCapacity, std::chrono::milliseconds staleTimeout = kDefaultStaleTimeout);
+	SharedEventCollector(const SharedEventCollector&) = delete;
+	SharedEventCollector(SharedEventCollector&&) = delete;
+	~SharedEventCollector() noexcept;
+
+public:
+	SharedEventCollector& operator=(const SharedEventCollector&) = delete;
+	SharedEventCollector& operator=(SharedEventCollector&&) = delete;
+
+public:
+	/// @brief Get the name of the shared memory.
+	/// @details Pass the name to the child processes in the environment variable `kSharedEventRingVariable`.
+	/// @return The name.
+	[[nodiscard]] const std::string& GetName() const noexcept;
+
+	/// @brief Get the number of records.
+	/// @return The capacity of the ring buffer.
+	[[nodiscard]] std::size_t GetCapacity() const noexcept;
+
+	/// @brief Remove the oldest record.
+	/// @details Records are only removed by a single thread at a time. A slot which has been reserved but not claimed
+	/// for longer than the timeout is skipped.
+	/// @return The record or `std::nullopt` if no complete record is available.
+	[[nodiscard]] std::optional<SharedEventRecord> Pop();
+
+	/// @brief Get the number of records discarded because the ring buffer was full or the slot was skipped.
+	/// @return The number of records.
+	[[nodiscard]] std::uint64_t GetDroppedCount() const noexcept;
+
+private:
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+};
+
+/// @brief Writes records into the ring buffer of a `SharedEventCollector` in another process.
+class SharedEventWriter {
+public:
+	/// @brief Open the shared memory.
+	/// @param name The name of the shared memory.
+	/// @throws std::system_error if the shared memory cannot be opened.
+	/// @throws std::invalid_argument if the shared memory was not created by a `SharedEventCollector`.
+	explicit SharedEventWriter(const std::string& name);
+	SharedEventWriter(const SharedEventWriter&) = delete;
+	SharedEventWriter(SharedEventWriter&&) = delete;
+	~SharedEventWriter() noexcept;
+
+public:
+	SharedEventWriter& operator=(const SharedEventWriter&) = delete;
+	SharedEventWriter& operator=(SharedEventWriter&&) = delete;
+
+public:
+	/// @brief Open the shared memory named by the environment variable `kSharedEventRingVariable`.
+	/// @return The writer or `nullptr` if the variable is not set.
+	/// @throws std::system_error if the shared memory cannot be opened.
+	/// @throws std::invalid_argument if the shared memory was not created by a `SharedEventCollector`.
+	[[nodiscard]] static std::unique_ptr<SharedEventWriter> FromEnvironment();
+
+public:
+	/// @brief Parse and write debug output.
+	/// @param text The output of `OutputDebugStringA`.
+	/// @return `false` if the output was not written by `m3c::Log`, it is too large or the ring buffer is full.
+	bool WriteDebug(std::string_view text) noexcept;
+
+	/// @brief Write an event.
+	/// @param eventId The event id.
+	/// @param level The level of the event.
+	/// @param keyword The keyword of the event.
+	/// @param argCount The number of arguments.
+	/// @param getArg A function returning the bytes of an argument as a `std::span<const std::byte>`.
+	/// @return `false` if the event is too large or the ring buffer is full.
+	template <typename F>
+	bool WriteEvent(const std::uint16_t eventId, const std::uint8_t level, const std::uint64_t keyword, const std::uint32_t argCount, F&& getArg) noexcept {
+		SharedEventRecord record;
+		record.m_type = SharedRecordType::kEvent;
+		record.m_eventId = eventId;
+		record.m_level = level;
+		record.m_keyword = keyword;
+		for (std::uint32_t i = 0; i < argCount; ++i) {
+			if (!record.AddArg(getArg(i))) {
+				[[unlikely]];
+				return false;
+			}
+		}
+		return Push(record);
+	}
+
+private:
+	/// @brief Add a record to the ring buffer.
+	/// @param record The record, process and thread ids are set by this function.
+	/// @return `false` if the ring buffer is full or the slot was skipped by the `SharedEventCollector`.
+	bool Push(SharedEventRecord& record) noexcept;
+
+private:
+	class Impl;
+	std::unique_ptr<Impl> m_impl;
+};
+
+}  // namespace m4t
@@ -0,0 +1,159 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include "m4t/AllocationTracker.h"
+#include "m4t/DeletedHistory.h"
+#include "m4t/LeakScope.h"  // IWYU pragma: export
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace m4t {
+
+/// @brief A `std::pmr::memory_resource` for use in testing which tracks all memory blocks of an upstream resource.
+/// @details The state of the memory blocks is tracked in the same way as in `MallocSpy`.
+class SpyMemoryResource : public std::pmr::memory_resource {
+public:
+	/// @brief The default value for the maximum memory used for the history of deleted blocks.
+	static constexpr std::size_t kDefaultDeletedHistoryBytes = internal::AllocationTracker::kDefaultDeletedHistoryBytes;
+
+public:
+	/// @brief Create a new object which allocates from the default memory resource.
+	SpyMemoryResource();
+
+	/// @brief Create a new object.
+	/// @details See `MallocSpy` for a description of the tracking modes.
+	/// @param upstream The memory resource used for allocating, it MUST outlive this object.
+	/// @param mode The tracking mode.
+	/// @param maxDeletedHistoryBytes The maximum number of bytes used for the history of deleted blocks.
+	explicit SpyMemoryResource(std::pmr::memory_resource* upstream, TrackingMode mode = TrackingMode::kImmediate, std::size_t maxDeletedHistoryBytes = kDefaultDeletedHistoryBytes);
+	SpyMemoryResource(const SpyMemoryResource&) = delete;
+	SpyMemoryResource(SpyMemoryResource&&) = delete;
+	~SpyMemoryResource() noexcept override = default;
+
+public:
+	SpyMemoryResource& operator=(const SpyMemoryResource&) = delete;
+	SpyMemoryResource& operator=(SpyMemoryResource&&) = delete;
+
+public:
+	/// @brief Get the memory resource used for allocating.
+	/// @return The upstream memory resource.
+	[[nodiscard]] std::pmr::memory_resource* GetUpstream() const noexcept {
+		return m_upstream;
+	}
+
+	/// @brief Merge all buffered calls into the tables.
+	/// @details Does nothing if the object has not been created with `TrackingMode::kBuffered`.
+	void Flush() const;
+
+	/// @brief Check if a memory block is currently allocated.
+	/// @param p The address of the memory block.
+	/// @return `true` if the memory block has been allocated from this resource and not yet deallocated.
+	bool IsAllocated(const void* p) const;
+
+	/// @brief Check if a memory block has been deleted.
+	/// @warning The result is only approximate if more blocks have been deleted than fit into the history. Use
+	/// `GetDeletedState` to check if the result is exact.
+	/// @param p The address of the memory block.
+	/// @return `true` if the result of `GetDeletedState` is `DeletedState::kDeleted` or `DeletedState::kProbablyDeleted`.
+	bool IsDeleted(const void* p) const;
+
+	/// @brief Get the memory block which is currently allocated at an address.
+	/// @param p The address of the memory block.
+	/// @return The memory block or `std::nullopt` if the address is not allocated.
+	std::optional<AllocatedBlock> GetAllocation(const void* p) const;
+
+	/// @brief Check if an address still belongs to the same allocation.
+	/// @param p The address of the memory block.
+	/// @param generation The generation of the allocation from `GetAllocation`.
+	/// @return `false` if the memory block has been deleted, even if the address has been allocated again.
+	bool IsSameAllocation(const void* p, std::uint64_t generation) const;
+
+	/// @brief Check if the memory block of an allocation has been deleted.
+	/// @param generation The generation of the allocation from `GetAllocation`.
+	/// @return `true` if the memory block has been deleted.
+	bool IsGenerationDeleted(std::uint64_t generation) const;
+
+	/// @brief Get the state of a memory block in the history of deleted blocks.
+	/// @param p The address of the memory block.
+	/// @return The state, `DeletedState::kProbablyDeleted` marks an approximate result.
+	DeletedState GetDeletedState(const void* p) const;
+
+	/// @brief Get the number of memory blocks that are currently allocated.
+	/// @return The number of allocated blocks.
+	std::size_t GetAllocatedCount() const;
+
+	/// @brief Get the number of memory blocks that have been deleted.
+	/// @return The number of deleted blocks, always exact.
+	std::size_t GetDeletedCount() const;
+
+	/// @brief Get the byte counts of the memory blocks.
+	/// @details The size of each block is the size requested from this resource.
+	/// @return The statistics, all values are 0 if the object has not been created with `TrackingMode::kAccounting`.
+	AllocationStatistics GetStatistics() const;
+
+	/// @brief Set the peak number of bytes to the number of bytes which are currently allocated.
+	void ResetPeakBytes();
+
+	/// @brief Set the average number of bytes between two sampled allocations.
+	/// @details Only used in mode `TrackingMode::kSampling`. All queries for memory blocks only see sampled blocks.
+	/// @param bytes The sampling interval in bytes.
+	void SetSamplingRate(std::size_t bytes) noexcept;
+
+	/// @brief Turn sampling on or off at run time.
+	/// @details Only used in mode `TrackingMode::kSampling`. When sampling is off, all allocations are tracked.
+	/// @param enabled `true` to track only a sample of allocations.
+	void SetSampling(bool enabled) noexcept;
+
+	/// @brief Get unbiased estimates of live and total bytes and allocation counts from the sampled allocations.
+	/// @return The estimates, all values are 0 if the object has not been created with `TrackingMode::kSampling`.
+	SamplingEstimate GetSamplingEstimate() const;
+
+	/// @brief Create a checkpoint for finding the memory blocks allocated after this call.
+	/// @return The checkpoint which MUST NOT outlive this object.
+	AllocationCheckpoint Checkpoint();
+
+	/// @brief Get all memory blocks which have been allocated after a checkpoint and which are still allocated.
+	/// @param checkpoint A checkpoint created by this object.
+	/// @return The memory blocks ordered by the time of their allocation.
+	std::vector<AllocatedBlock> GetAllocatedSince(const AllocationCheckpoint& checkpoint) const;
+
+	/// @brief Get the call stack of an allocation with resolved symbols.
+	/// @param stack The id of the stack from `AllocatedBlock::stack`.
+	/// @return One line per frame, empty if no stack is available.
+	std::string FormatStack(std::uint32_t stack) const;
+
+protected:
+	[[nodiscard]] void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override;
+	[[nodiscard]] bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+private:
+	std::pmr::memory_resource* const m_upstream;  ///< @brief The memory resource used for allocating.
+	internal::AllocationTracker m_tracker;        ///< @brief The state of all memory blocks.
+
+	friend class internal::LeakScope;
+};
+
+}  // namespace m4t
@@ -0,0 +1,92 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace m4t::internal {
+
+/// @brief Capture the return addresses of the current call stack.
+/// @details Uses `RtlCaptureStackBackTrace` on Windows and `backtrace` elsewhere.
+/// @param skip The number of frames to skip, not counting this function.
+/// @param frames The buffer receiving the return addresses.
+/// @return The number of frames written to @p frames.
+std::size_t CaptureStack(std::size_t skip, std::span<void*> frames) noexcept;
+
+/// @brief Get a human-readable description of a code address.
+/// @details Uses the debug help library on Windows and `dladdr` elsewhere. This function is slow.
+/// @param address The code address.
+/// @return The module and symbol of the address, if available.
+std::string SymbolizeFrame(const void* address);
+
+/// @brief A concurrent table which stores each unique call stack once and identifies it by a 32-bit id.
+/// @details Lookups of known stacks only hold the lock of a single shard in shared mode. Stacks are never removed.
+class StackTable {
+public:
+	/// @brief The maximum number of frames stored for each stack.
+	static constexpr std::size_t kMaxFrames = 32;
+
+	/// @brief The id of an empty stack.
+	static constexpr std::uint32_t kNoStack = 0;
+
+public:
+	StackTable();
+	StackTable(const StackTable&) = delete;
+	StackTable(StackTable&&) = delete;
+	~StackTable() noexcept;
+
+public:
+	StackTable& operator=(const StackTable&) = delete;
+	StackTable& operator=(StackTable&&) = delete;
+
+public:
+	/// @brief Capture the current call stack and add it to the table.
+	/// @param skip The number of frames to skip, not counting this function.
+	/// @return The id of the stack or `kNoStack` if the stack could not be captured.
+	std::uint32_t Capture(std::size_t skip) noexcept;
+
+	/// @brief Add a stack to the table.
+	/// @param frames The return addresses of the stack, at most `kMaxFrames` are stored.
+	/// @return The id of the stack, the same for equal stacks, or `kNoStack` if @p frames is empty.
+	std::uint32_t Intern(std::span<void* const> frames);
+
+	/// @brief Get the return addresses of a stack.
+	/// @param id The id of the stack.
+	/// @return The frames or an empty vector for `kNoStack` and unknown ids.
+	[[nodiscard]] std::vector<const void*> GetFrames(std::uint32_t id) const;
+
+	/// @brief Get the number of unique stacks.
+	/// @return The number of stacks in the table.
+	[[nodiscard]] std::size_t GetCount() const noexcept;
+
+private:
+	struct Shard;
+
+	static constexpr std::size_t kShardBits = 4;                  ///< @brief The number of hash bits used for selecting a shard.
+	static constexpr std::size_t kShardCount = 1u << kShardBits;  ///< @brief The number of shards.
+
+	std::unique_ptr<Shard[]> m_shards;  ///< @brief The shards of the table.
+};
+
+}  // namespace m4t::internal
@@ -0,0 +1,90 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+
+namespace m4t {
+
+/// @brief Streams timestamped records to a file in the Chrome trace event format.
+/// @details Each record becomes an instant event on the timeline of its thread. The file can be opened with
+/// `chrome://tracing` or https://ui.perfetto.dev. Records may be added from any thread.
+class TraceRecorder {
+public:
+	/// @brief Create the file.
+	/// @param path The path of the file which is overwritten.
+	/// @throws std::system_error if the file cannot be created.
+	explicit TraceRecorder(const std::filesystem::path& path);
+	TraceRecorder(const TraceRecorder&) = delete;
+	TraceRecorder(TraceRecorder&&) = delete;
+	~TraceRecorder() noexcept;
+
+public:
+	TraceRecorder& operator=(const TraceRecorder&) = delete;
+	TraceRecorder& operator=(TraceRecorder&&) = delete;
+
+public:
+	/// @brief Add an event.
+	/// @param eventId The event id.
+	/// @param level The level of the event.
+	/// @param keyword The keyword of the event.
+	/// @param threadId The id of the thread which wrote the event.
+	/// @param activityId The 16 bytes of the activity id as a `GUID` or an empty span.
+	/// @param time The time of the event.
+	void AddEvent(std::uint16_t eventId, std::uint8_t level, std::uint64_t keyword, std::uint32_t threadId, std::span<const std::byte> activityId, std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now());
+
+	/// @brief Add debug output.
+	/// @param level The debug level.
+	/// @param message The message.
+	/// @param threadId The id of the thread which wrote the output.
+	/// @param activityId The 16 bytes of the activity id as a `GUID` or an empty span.
+	/// @param time The time of the output.
+	void AddDebug(std::string_view level, std::string_view message, std::uint32_t threadId, std::span<const std::byte> activityId, std::chrono::steady_clock::time_point time = std::chrono::steady_clock::now());
+
+	/// @brief Write all buffered records to the file.
+	/// @details The file is only a valid JSON document after the recorder has been destroyed.
+	void Flush();
+
+	/// @brief Get the number of records.
+	/// @return The number of records added.
+	[[nodiscard]] std::size_t GetCount() const noexcept;
+
+private:
+	/// @brief Write a record.
+	/// @param record The JSON object of the record without a separator.
+	void Write(std::string_view record);
+
+private:
+	const std::chrono::steady_clock::time_point m_start;  ///< @brief The time of the first record on the timeline.
+	const std::uint32_t m_processId;                      ///< @brief The id of the current process.
+	std::ofstream m_file;                                 ///< @brief The output file.
+	std::atomic<std::size_t> m_count = 0;                 ///< @brief The number of records.
+	std::mutex m_mutex;                                   ///< @brief Serializes writing to the file.
+};
+
+}  // namespace m4t
@@ -18,6 +18,11 @@ limitations under the License.
 
 #pragma once
 
+#include "m4t/AllocationFill.h"   // IWYU pragma: export
+#include "m4t/AllocationLimit.h"  // IWYU pragma: export
+#include "m4t/MemoryPattern.h"    // IWYU pragma: export
+#include "m4t/Quarantine.h"       // IWYU pragma: export
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
@@ -30,6 +35,7 @@ limitations under the License.
 
 #include <cstddef>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <regex>
 #include <string>
@@ -79,10 +85,13 @@ int __asan_address_is_poisoned(void const volatile* addr);
 /// @param p_ The pointer to check. It MUST point to at least 4 valid bytes of memory.
 #define EXPECT_UNINITIALIZED(p_) EXPECT_NOT_NULL(p_)
 
+#if !defined(M4T_NEW) || !M4T_NEW
 /// @brief Generates a failure if @p p_ is not deleted memory.
-/// @warning This macro requires ASan AddressSanitizer, else it is a simple not-null check.
+/// @warning This macro requires ASan AddressSanitizer or linking with `common-cpp-testing::m4t_new`, else it is a
+/// simple not-null check.
 /// @param p_ The pointer to check.
 #define EXPECT_DELETED(p_) EXPECT_NOT_NULL(p_)
+#endif
 
 #else
 
@@ -100,11 +109,23 @@ int __asan_address_is_poisoned(void const volatile* addr);
 /// @param p_ The pointer to check. It MUST point to at least 4 valid bytes of memory.
 #define EXPECT_UNINITIALIZED(p_) __pragma(warning(suppress : 6001)) EXPECT_EQ(0xCDCDCDCD, *std::bit_cast<std::uint32_t*>((p_)))
 
+#if !defined(M4T_NEW) || !M4T_NEW
 /// @brief Generates a failure if @p p_ is not deleted memory.
-/// @warning This macro requires ASan AddressSanitizer, else it is a no-op.
+/// @warning This macro requires ASan AddressSanitizer or linking with `common-cpp-testing::m4t_new`, else it is a
+/// no-op.
 /// @param p_ The pointer to check.
 #define EXPECT_DELETED(p_) __pragma(message(__FILE__ "(" M4T_MAKE_STRING(M4T_STRINGIZE, __LINE__) "): Deleted check requires ASAN"))
 #endif
+#endif
+
+#if !defined(__SANITIZE_ADDRESS__) && defined(M4T_NEW) && M4T_NEW
+/// @brief Generates a failure if @p p_ is not deleted memory.
+/// @details Without AddressSanitizer, the memory block MUST be held in the quarantine, i.e. it has been freed by
+/// `operator delete` after calling `m4t::EnableQuarantine` and still contains the poison pattern. If the quarantine
+/// is not enabled, this is a simple not-null check.
+/// @param p_ The pointer to check.
+#define EXPECT_DELETED(p_) EXPECT_TRUE(m4t::internal::IsDeletedMemory((p_))) << "Memory at " << (p_) << " is not deleted"
+#endif
 
 //
 // Mock helpers
@@ -0,0 +1,42 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationFill.h"
+
+#include <atomic>
+#include <optional>
+
+namespace m4t {
+
+void EnableAllocationFill(const unsigned char pattern) noexcept {
+	internal::g_fillPattern.store(pattern, std::memory_order_relaxed);
+}
+
+void DisableAllocationFill() noexcept {
+	internal::g_fillPattern.store(internal::kNoFill, std::memory_order_relaxed);
+}
+
+std::optional<unsigned char> GetAllocationFillPattern() noexcept {
+	const int pattern = internal::g_fillPattern.load(std::memory_order_relaxed);
+	if (pattern == internal::kNoFill) {
+		return std::nullopt;
+	}
+	return static_cast<unsigned char>(pattern);
+}
+
+}  // namespace m4t
@@ -0,0 +1,319 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+/// @brief Replacement of the global allocation functions, built as the separate library `m4t_new`.
+
+#include "m4t/AllocationLimit.h"
+
+#include "m4t/AllocationFill.h"
+#include "m4t/Quarantine.h"
+
+#include <gtest/gtest.h>
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace m4t {
+
+namespace {
+
+/// @brief The counting state of a thread.
+struct CounterState {
+	bool armed = false;       ///< @brief `true` if calls are counted.
+	AllocationCounts counts;  ///< @brief The number of calls while armed.
+};
+
+/// @brief The counting state of the current thread.
+/// @details `constinit` makes sure that access does not require a check for initialization.
+constinit thread_local CounterState t_counterState;
+
+/// @brief Count an allocation if the current thread is armed.
+/// @param size The number of bytes.
+void CountAllocation(const std::size_t size) noexcept {
+	CounterState& state = t_counterState;
+	if (state.armed) {
+		[[unlikely]];
+		++state.counts.allocations;
+		state.counts.bytes += size;
+	}
+}
+
+/// @brief Count a deallocation if the current thread is armed.
+/// @param p The pointer, `nullptr` is not counted.
+void CountDeallocation(const void* const p) noexcept {
+	CounterState& state = t_counterState;
+	if (state.armed && p) {
+		[[unlikely]];
+		++state.counts.deallocations;
+	}
+}
+
+/// @brief Allocate memory as required for `operator new`.
+/// @details The memory is filled with the pattern if filling is enabled.
+/// @param size The number of bytes.
+/// @return The memory.
+/// @throws std::bad_alloc if no memory is available and no new handler is installed.
+void* Allocate(const std::size_t size) {
+	CountAllocation(size);
+	while (true) {
+		// NOLINTNEXTLINE(cppcoreguidelines-no-malloc): Implementation of operator new.
+		if (void* const p = std::malloc(size ? size : 1); p) {
+			[[likely]];
+			internal::FillAllocation(p, size);
+			return p;
+		}
+		const std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+/// @brief Allocate aligned memory as required for `operator new`.
+/// @details The memory is filled with the pattern if filling is enabled.
+/// @param size The number of bytes.
+/// @param alignment The alignment.
+/// @return The memory.
+/// @throws std::bad_alloc if no memory is available and no new handler is installed.
+void* AllocateAligned(const std::size_t size, const std::align_val_t alignment) {
+	CountAllocation(size);
+	const std::size_t align = static_cast<std::size_t>(alignment);
+	while (true) {
+#if defined(_WIN32)
+		void* const p = _aligned_malloc(size ? size : 1, align);
+#else
+		// aligned_alloc requires a multiple of the alignment
+		void* const p = std::aligned_alloc(align, size ? (size + align - 1) & ~(align - 1) : align);  // NOLINT(cppcoreguidelines-no-malloc): Implementation of operator new.
+#endif
+		if (p) {
+			[[likely]];
+			internal::FillAllocation(p, size);
+			return p;
+		}
+		const std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+/// @brief Free memory allocated by `Allocate`.
+/// @details The memory is put into the quarantine if it is enabled.
+/// @param p The memory, may be `nullptr`.
+void Deallocate(void* const p) noexcept {
+	CountDeallocation(p);
+	if (p && internal::IsQuarantineEnabled()) {
+		[[unlikely]];
+#if defined(_WIN32)
+		const std::size_t size = _msize(p);
+#elif defined(__APPLE__)
+		const std::size_t size = malloc_size(p);
+#else
+		const std::size_t size = malloc_usable_size(p);
+#endif
+		if (internal::Quarantine(p, size, false)) {
+			return;
+		}
+	}
+	std::free(p);  // NOLINT(cppcoreguidelines-no-malloc): Implementation of operator delete.
+}
+
+/// @brief Free memory allocated by `AllocateAligned`.
+/// @details The memory is put into the quarantine if it is enabled.
+/// @param p The memory, may be `nullptr`.
+/// @param alignment The alignment.
+void DeallocateAligned(void* const p, [[maybe_unused]] const std::align_val_t alignment) noexcept {
+	CountDeallocation(p);
+	if (p && internal::IsQuarantineEnabled()) {
+		[[unlikely]];
+#if defined(_WIN32)
+		const std::size_t size = _aligned_msize(p, static_cast<std::size_t>(alignment), 0);
+#elif defined(__APPLE__)
+		const std::size_t size = malloc_size(p);
+#else
+		const std::size_t size = malloc_usable_size(p);
+#endif
+		if (internal::Quarantine(p, size, true)) {
+			return;
+		}
+	}
+#if defined(_WIN32)
+	_aligned_free(p);
+#else
+	std::free(p);  // NOLINT(cppcoreguidelines-no-malloc): Implementation of operator delete.
+#endif
+}
+
+/// @brief Get the difference between two counts.
+/// @param current The current counts.
+/// @param start The counts at the start.
+/// @return The difference.
+AllocationCounts Subtract(const AllocationCounts& current, const AllocationCounts& start) noexcept {
+	return {.allocations = current.allocations - start.allocations,
+	        .bytes = current.bytes - start.bytes,
+	        .deallocations = current.deallocations - start.deallocations};
+}
+
+}  // namespace
+
+namespace internal {
+
+AllocationLimitScope::AllocationLimitScope(const std::size_t maxAllocations, const char* const file, const int line) noexcept
+    : m_maxAllocations(maxAllocations)
+    , m_file(file)
+    , m_line(line)
+    , m_outer(t_counterState.counts)
+    , m_outerArmed(t_counterState.armed) {
+	t_counterState.armed = true;
+}
+
+AllocationLimitScope::~AllocationLimitScope() noexcept {
+	const AllocationCounts counts = GetCounts();
+	t_counterState.armed = m_outerArmed;
+	if (counts.allocations <= m_maxAllocations) {
+		return;
+	}
+	try {
+		ADD_FAILURE_AT(m_file, m_line) << "Expected at most " << m_maxAllocations << " allocation(s), actual: "
+		                               << counts.allocations << " allocation(s) of " << counts.bytes << " bytes";
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+AllocationCounts AllocationLimitScope::GetCounts() const noexcept {
+	return Subtract(t_counterState.counts, m_outer);
+}
+
+}  // namespace internal
+
+}  // namespace m4t
+
+//
+// Replacement of the global allocation functions
+//
+
+// NOLINTBEGIN(readability-inconsistent-declaration-parameter-name): Use names from the standard.
+
+void* operator new(const std::size_t size) {
+	return m4t::Allocate(size);
+}
+
+void* operator new[](const std::size_t size) {
+	return m4t::Allocate(size);
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment) {
+	return m4t::AllocateAligned(size, alignment);
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment) {
+	return m4t::AllocateAligned(size, alignment);
+}
+
+void* operator new(const std::size_t size, const std::nothrow_t& /* tag */) noexcept {
+	try {
+		return m4t::Allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](const std::size_t size, const std::nothrow_t& /* tag */) noexcept {
+	try {
+		return m4t::Allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new(const std::size_t size, const std::align_val_t alignment, const std::nothrow_t& /* tag */) noexcept {
+	try {
+		return m4t::AllocateAligned(size, alignment);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](const std::size_t size, const std::align_val_t alignment, const std::nothrow_t& /* tag */) noexcept {
+	try {
+		return m4t::AllocateAligned(size, alignment);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* const p) noexcept {
+	m4t::Deallocate(p);
+}
+
+void operator delete[](void* const p) noexcept {
+	m4t::Deallocate(p);
+}
+
+void operator delete(void* const p, const std::size_t /* size */) noexcept {
+	m4t::Deallocate(p);
+}
+
+void operator delete[](void* const p, const std::size_t /* size */) noexcept {
+	m4t::Deallocate(p);
+}
+
+void operator delete(void* const p, const std::align_val_t alignment) noexcept {
+	m4t::DeallocateAligned(p, alignment);
+}
+
+void operator delete[](void* const p, const std::align_val_t alignment) noexcept {
+	m4t::DeallocateAligned(p, alignment);
+}
+
+void operator delete(void* const p, const std::size_t /* size */, const std::align_val_t alignment) noexcept {
+	m4t::DeallocateAligned(p, alignment);
+}
+
+void operator delete[](void* const p, const std::size_t /* size */, const std::align_val_t alignment) noexcept {
+	m4t::DeallocateAligned(p, alignment);
+}
+
+void operator delete(void* const p, const std::nothrow_t& /* tag */) noexcept {
+	m4t::Deallocate(p);
+}
+
+void operator delete[](void* const p, const std::nothrow_t& /* tag */) noexcept {
+	m4t::Deallocate(p);
+}
+
+void operator delete(void* const p, const std::align_val_t alignment, const std::nothrow_t& /* tag */) noexcept {
+	m4t::DeallocateAligned(p, alignment);
+}
+
+void operator delete[](void* const p, const std::align_val_t alignment, const std::nothrow_t& /* tag */) noexcept {
+	m4t::DeallocateAligned(p, alignment);
+}
+
+// NOLINTEND(readability-inconsistent-declaration-parameter-name)
@@ -0,0 +1,310 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTable.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
+#include <type_traits>
+
+namespace m4t::internal {
+
+namespace {
+
+constexpr std::uintptr_t kEmpty = 0;                       ///< @brief Marker for a slot which has never been used.
+constexpr std::uintptr_t kTombstone = ~std::uintptr_t{0};  ///< @brief Marker for a slot whose address has been erased.
+constexpr std::uintptr_t kBusy = ~std::uintptr_t{1};       ///< @brief Marker for a slot whose record is being written.
+constexpr std::size_t kInitialCapacity = 64;               ///< @brief The initial number of slots per shard.
+
+static_assert(std::is_trivially_copyable_v<AllocationRecord> && sizeof(AllocationRecord) % sizeof(std::uint64_t) == 0);
+
+/// @brief The size of an `AllocationRecord` in words.
+constexpr std::size_t kRecordWords = sizeof(AllocationRecord) / sizeof(std::uint64_t);
+
+/// @brief An `AllocationRecord` as words which can be copied atomically.
+using RecordWords = std::array<std::uint64_t, kRecordWords>;
+
+/// @brief A slot of the table.
+/// @details The record is written while the key is `kBusy` and published by storing the key with release semantics.
+/// Because a slot may be reused while `Find` copies the record, the record is guarded by a sequence lock: @p version
+/// is odd while the record is written and changes with every write, so readers can detect and retry a torn copy.
+struct Slot {
+	std::atomic<std::uintptr_t> key;                            ///< @brief The address or one of the marker values.
+	std::atomic<std::uint32_t> version;                         ///< @brief The sequence number of the record.
+	std::array<std::atomic<std::uint64_t>, kRecordWords> data;  ///< @brief The data of the memory block.
+
+	/// @brief Get the record.
+	/// @details The words are read individually, i.e. the result may be torn if the record is written concurrently.
+	/// @return The data of the memory block.
+	[[nodiscard]] AllocationRecord Load() const noexcept {
+		RecordWords words;
+		for (std::size_t i = 0; i < words.size(); ++i) {
+			words[i] = data[i].load(std::memory_order_relaxed);
+		}
+		return std::bit_cast<AllocationRecord>(words);
+	}
+
+	/// @brief Set the record.
+	/// @note The caller MUST own the slot, i.e. either have set the key to `kBusy` or hold the lock exclusively.
+	/// @param record The data of the memory block.
+	void Store(const AllocationRecord& record) noexcept {
+		const RecordWords words = std::bit_cast<RecordWords>(record);
+		for (std::size_t i = 0; i < words.size(); ++i) {
+			data[i].store(words[i], std::memory_order_relaxed);
+		}
+	}
+};
+
+}  // namespace
+
+/// @brief A shard of the table.
+/// @details The lock is held in shared mode for all operations on slots and exclusively when the slot array is replaced.
+struct alignas(std::hardware_destructive_interference_size) AllocationTable::Shard {
+	mutable std::shared_mutex mutex;
+	std::unique_ptr<Slot[]> slots;       ///< @brief The slots, guarded by @p mutex.
+	std::size_t capacity = 0;            ///< @brief The number of slots, always a power of 2.
+	std::atomic<std::size_t> count = 0;  ///< @brief The number of addresses.
+	std::atomic<std::size_t> used = 0;   ///< @brief The number of slots which are not `kEmpty`.
+
+	/// @brief Allocate a new slot array.
+	/// @param newCapacity The number of slots.
+	void Allocate(const std::size_t newCapacity) {
+		slots = std::make_unique<Slot[]>(newCapacity);
+		capacity = newCapacity;
+	}
+
+	/// @brief Write the record to a slot which has been reserved using `kBusy`.
+	/// @param slot The slot.
+	/// @param key The address.
+	/// @param record The data of the memory block.
+	void Publish(Slot& slot, const std::uintptr_t key, const AllocationRecord& record) noexcept {
+		const std::uint32_t version = slot.version.load(std::memory_order_relaxed);
+		slot.version.store(version + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.Store(record);
+		slot.version.store(version + 2, std::memory_order_release);
+		slot.key.store(key, std::memory_order_release);
+		count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// @brief Try to add an address to the slots.
+	/// @note The caller MUST hold @p mutex in shared mode.
+	/// @param key The address.
+	/// @param hash The hash value of @p key.
+	/// @param record The data of the memory block.
+	/// @return `false` if the shard must grow before the address can be added.
+	bool TryInsert(const std::uintptr_t key, const std::uint64_t hash, const AllocationRecord& record) noexcept {
+		const std::size_t mask = capacity - 1;
+		// keep load factor including tombstones at 50 % at most
+		const std::size_t maxUsed = capacity / 2;
+		for (std::size_t i = 0; i < capacity;) {
+			Slot& slot = slots[(hash + i) & mask];
+			std::uintptr_t value = slot.key.load(std::memory_order_acquire);
+			if (value == kEmpty) {
+				if (used.fetch_add(1, std::memory_order_relaxed) >= maxUsed) {
+					used.fetch_sub(1, std::memory_order_relaxed);
+					return false;
+				}
+				if (slot.key.compare_exchange_strong(value, kBusy, std::memory_order_acquire)) {
+					Publish(slot, key, record);
+					return true;
+				}
+				used.fetch_sub(1, std::memory_order_relaxed);
+				// slot was taken concurrently, examine again
+				continue;
+			}
+			if (value == kTombstone) {
+				if (slot.key.compare_exchange_strong(value, kBusy, std::memory_order_acquire)) {
+					Publish(slot, key, record);
+					return true;
+				}
+				// slot was taken concurrently, examine again
+				continue;
+			}
+			++i;
+		}
+		return false;
+	}
+
+	/// @brief Find the slot of an address.
+	/// @note The caller MUST hold @p mutex in shared mode.
+	/// @param key The address.
+	/// @param hash The hash value of @p key.
+	/// @return The slot or `nullptr` if the address is not in the shard.
+	Slot* Find(const std::uintptr_t key, const std::uint64_t hash) const noexcept {
+		const std::size_t mask = capacity - 1;
+		for (std::size_t i = 0; i < capacity; ++i) {
+			Slot& slot = slots[(hash + i) & mask];
+			const std::uintptr_t value = slot.key.load(std::memory_order_acquire);
+			if (value == key) {
+				return &slot;
+			}
+			if (value == kEmpty) {
+				return nullptr;
+			}
+		}
+		return nullptr;
+	}
+
+	/// @brief Replace the slot array with one which is sized for the current number of addresses.
+	/// @details Tombstones are dropped in the process. Does nothing if another thread has already grown the shard.
+	void Grow() {
+		const std::unique_lock lock(mutex);
+		if (used.load(std::memory_order_relaxed) < capacity / 2) {
+			return;
+		}
+
+		const std::size_t newCapacity = std::max(kInitialCapacity, std::bit_ceil(count.load(std::memory_order_relaxed) * 4));
+		std::unique_ptr<Slot[]> oldSlots = std::move(slots);
+		const std::size_t oldCapacity = capacity;
+		Allocate(newCapacity);
+
+		const std::size_t mask = capacity - 1;
+		std::size_t newUsed = 0;
+		for (std::size_t i = 0; i < oldCapacity; ++i) {
+			const std::uintptr_t key = oldSlots[i].key.load(std::memory_order_relaxed);
+			if (key == kEmpty || key == kTombstone) {
+				continue;
+			}
+			const std::uint64_t hash = HashAddress(key);
+			for (std::size_t j = 0;; ++j) {
+				Slot& slot = slots[(hash + j) & mask];
+				if (slot.key.load(std::memory_order_relaxed) == kEmpty) {
+					slot.key.store(key, std::memory_order_relaxed);
+					slot.Store(oldSlots[i].Load());
+					break;
+				}
+			}
+			++newUsed;
+		}
+		used.store(newUsed, std::memory_order_relaxed);
+	}
+};
+
+AllocationTable::AllocationTable()
+    : m_shards(std::make_unique<Shard[]>(kShardCount)) {
+	for (std::size_t i = 0; i < kShardCount; ++i) {
+		m_shards[i].Allocate(kInitialCapacity);
+	}
+}
+
+AllocationTable::~AllocationTable() noexcept = default;
+
+void AllocationTable::Insert(const void* const p, const AllocationRecord& record) {
+	const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+	if (key == kEmpty) {
+		[[unlikely]];
+		return;
+	}
+	const std::uint64_t hash = HashAddress(key);
+	Shard& shard = m_shards[hash >> (64 - kShardBits)];
+	while (true) {
+		{
+			const std::shared_lock lock(shard.mutex);
+			if (shard.TryInsert(key, hash, record)) {
+				[[likely]];
+				return;
+			}
+		}
+		shard.Grow();
+	}
+}
+
+std::optional<AllocationRecord> AllocationTable::Erase(const void* const p) noexcept {
+	const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+	if (key == kEmpty) {
+		[[unlikely]];
+		return std::nullopt;
+	}
+	const std::uint64_t hash = HashAddress(key);
+	Shard& shard = m_shards[hash >> (64 - kShardBits)];
+
+	const std::shared_lock lock(shard.mutex);
+	Slot* const slot = shard.Find(key, hash);
+	if (!slot) {
+		return std::nullopt;
+	}
+	// the address cannot be inserted again before this call returns, so the record is stable
+	const AllocationRecord record = slot->Load();
+	std::uintptr_t value = key;
+	if (!slot->key.compare_exchange_strong(value, kTombstone, std::memory_order_acq_rel)) {
+		// erased concurrently
+		return std::nullopt;
+	}
+	shard.count.fetch_sub(1, std::memory_order_relaxed);
+	return record;
+}
+
+std::optional<AllocationRecord> AllocationTable::Find(const void* const p) const noexcept {
+	const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+	if (key == kEmpty) {
+		[[unlikely]];
+		return std::nullopt;
+	}
+	const std::uint64_t hash = HashAddress(key);
+	const Shard& shard = m_shards[hash >> (64 - kShardBits)];
+
+	const std::shared_lock lock(shard.mutex);
+	while (true) {
+		const Slot* const slot = shard.Find(key, hash);
+		if (!slot) {
+			return std::nullopt;
+		}
+		const std::uint32_t version = slot->version.load(std::memory_order_acquire);
+		const AllocationRecord record = slot->Load();
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if ((version & 1) == 0 && slot->version.load(std::memory_order_relaxed) == version
+		    && slot->key.load(std::memory_order_relaxed) == key) {
+			[[likely]];
+			return record;
+		}
+		// the slot was erased and reused while the record was copied, look up again
+	}
+}
+
+bool AllocationTable::Contains(const void* const p) const noexcept {
+	const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+	if (key == kEmpty) {
+		[[unlikely]];
+		return false;
+	}
+	const std::uint64_t hash = HashAddress(key);
+	const Shard& shard = m_shards[hash >> (64 - kShardBits)];
+
+	const std::shared_lock lock(shard.mutex);
+	return shard.Find(key, hash) != nullptr;
+}
+
+std::size_t AllocationTable::GetCount() const noexcept {
+	std::size_t count = 0;
+	for (std::size_t i = 0; i < kShardCount; ++i) {
+		count += m_shards[i].count.load(std::memory_order_relaxed);
+	}
+	return count;
+}
+
+}  // namespace m4t::internal
@@ -0,0 +1,580 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTrace.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace m4t {
+
+namespace {
+
+/// @brief The first bytes of each trace file.
+constexpr std::array<char, 8> kMagic = {'M', '4', 'T', 'T', 'R', 'A', 'C', 'E'};
+
+/// @brief The version of the file format, stored after `kMagic`.
+constexpr std::uint8_t kVersion = 1;
+
+/// @brief The maximum number of bytes of a variable-length integer.
+constexpr std::size_t kMaxVarintSize = 10;
+
+/// @brief The maximum number of bytes of an encoded record.
+constexpr std::size_t kMaxRecordSize = 3 * kMaxVarintSize;
+
+/// @brief Encode an unsigned integer using 7 bits per byte, least significant group first.
+/// @param value The value.
+/// @param out The buffer which MUST have room for `kMaxVarintSize` bytes.
+/// @return The number of bytes written.
+std::size_t EncodeVarint(std::uint64_t value, std::byte* const out) noexcept {
+	std::size_t length = 0;
+	while (value >= 0x80) {
+		out[length++] = static_cast<std::byte>((value & 0x7F) | 0x80);
+		value >>= 7;
+	}
+	out[length++] = static_cast<std::byte>(value);
+	return length;
+}
+
+/// @brief Decode an integer written by `EncodeVarint`.
+/// @param data The data.
+/// @param pos The position in @p data, updated to the first byte after the value.
+/// @return The value.
+/// @throws std::runtime_error if the value is truncated or too long.
+std::uint64_t DecodeVarint(const std::span<const std::byte> data, std::size_t& pos) {
+	std::uint64_t value = 0;
+	for (std::size_t shift = 0; shift < kMaxVarintSize * 7; shift += 7) {
+		if (pos >= data.size()) {
+			[[unlikely]];
+			break;
+		}
+		const std::uint64_t byte = std::to_integer<std::uint64_t>(data[pos++]);
+		value |= (byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return value;
+		}
+	}
+	throw std::runtime_error("invalid trace: bad integer");
+}
+
+/// @brief Map signed values to unsigned ones so that values with a small magnitude get a short encoding.
+/// @param value The signed value.
+/// @return The unsigned value.
+constexpr std::uint64_t EncodeZigZag(const std::int64_t value) noexcept {
+	return (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63);
+}
+
+/// @brief Reverse `EncodeZigZag`.
+/// @param value The unsigned value.
+/// @return The signed value.
+constexpr std::int64_t DecodeZigZag(const std::uint64_t value) noexcept {
+	return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+}
+
+/// @brief The source of process-wide unique writer ids, 0 is never used.
+std::atomic<std::uint64_t> g_nextWriterId = 1;
+
+/// @brief The thread buffer used by the current thread for the most recently used writer.
+struct ThreadBufferCache {
+	std::uint64_t writerId = 0;  ///< @brief The id of the writer.
+	void* buffer = nullptr;      ///< @brief The thread buffer.
+};
+
+thread_local ThreadBufferCache t_threadBufferCache;
+
+/// @brief A read-only mapping of a whole file into memory.
+class MappedFile {
+public:
+	/// @brief Map a file.
+	/// @param path The path of the file.
+	/// @throws std::system_error if the file cannot be mapped.
+	explicit MappedFile(const std::filesystem::path& path) {
+#if defined(_WIN32)
+		m_hFile = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE) {
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "CreateFileW");
+		}
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_hFile, &size)) {
+			Fail("GetFileSizeEx");
+		}
+		m_size = static_cast<std::size_t>(size.QuadPart);
+		if (!m_size) {
+			return;
+		}
+		m_hMapping = CreateFileMappingW(m_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!m_hMapping) {
+			Fail("CreateFileMappingW");
+		}
+		m_data = static_cast<const std::byte*>(MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0));
+		if (!m_data) {
+			Fail("MapViewOfFile");
+		}
+#else
+		m_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);  // NOLINT(cppcoreguidelines-pro-type-vararg): POSIX API.
+		if (m_fd < 0) {
+			throw std::system_error(errno, std::generic_category(), "open");
+		}
+		struct stat status;
+		if (fstat(m_fd, &status)) {
+			Fail("fstat");
+		}
+		m_size = static_cast<std::size_t>(status.st_size);
+		if (!m_size) {
+			return;
+		}
+		void* const data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+		if (data == MAP_FAILED) {  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast, performance-no-int-to-ptr): POSIX API.
+			Fail("mmap");
+		}
+		m_data = static_cast<const std::byte*>(data);
+#endif
+	}
+	MappedFile(const MappedFile&) = delete;
+	MappedFile(MappedFile&&) = delete;
+	~MappedFile() noexcept {
+		Unmap();
+	}
+
+public:
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&&) = delete;
+
+public:
+	/// @brief Get the contents of the file.
+	/// @return The contents.
+	[[nodiscard]] std::span<const std::byte> GetData() const noexcept {
+		return {m_data, m_data ? m_size : 0};
+	}
+
+private:
+	/// @brief Release all resources and throw an exception for the last error.
+	/// @param function The name of the failed function.
+	[[noreturn]] void Fail(const char* const function) {
+#if defined(_WIN32)
+		const DWORD lastError = GetLastError();
+		Unmap();
+		throw std::system_error(static_cast<int>(lastError), std::system_category(), function);
+#else
+		const int error = errno;
+		Unmap();
+		throw std::system_error(error, std::generic_category(), function);
+#endif
+	}
+
+	/// @brief Release all resources.
+	void Unmap() noexcept {
+#if defined(_WIN32)
+		if (m_data) {
+			UnmapViewOfFile(m_data);
+		}
+		if (m_hMapping) {
+			CloseHandle(m_hMapping);
+		}
+		if (m_hFile != INVALID_HANDLE_VALUE) {
+			CloseHandle(m_hFile);
+		}
+		m_hMapping = nullptr;
+		m_hFile = INVALID_HANDLE_VALUE;
+#else
+		if (m_data) {
+			munmap(const_cast<std::byte*>(m_data), m_size);  // NOLINT(cppcoreguidelines-pro-type-const-cast): POSIX API.
+		}
+		if (m_fd >= 0) {
+			close(m_fd);
+		}
+		m_fd = -1;
+#endif
+		m_data = nullptr;
+	}
+
+private:
+#if defined(_WIN32)
+	HANDLE m_hFile = INVALID_HANDLE_VALUE;  ///< @brief The file.
+	HANDLE m_hMapping = nullptr;            ///< @brief The mapping object.
+#else
+	int m_fd = -1;  ///< @brief The file descriptor.
+#endif
+	const std::byte* m_data = nullptr;  ///< @brief The mapped contents.
+	std::size_t m_size = 0;             ///< @brief The size of the file.
+};
+
+}  // namespace
+
+std::vector<TraceRecord> ReadTrace(const std::filesystem::path& path) {
+	const MappedFile file(path);
+	const std::span<const std::byte> data = file.GetData();
+	if (data.size() < kMagic.size() + 1 || std::memcmp(data.data(), kMagic.data(), kMagic.size()) || std::to_integer<std::uint8_t>(data[kMagic.size()]) != kVersion) {
+		throw std::runtime_error("invalid trace: bad header");
+	}
+
+	/// @brief The values of the previous record of a thread.
+	struct ThreadState {
+		std::uint64_t timestamp = 0;  ///< @brief The timestamp.
+		std::uint64_t address = 0;    ///< @brief The address.
+	};
+	std::unordered_map<std::uint32_t, ThreadState> threads;
+	std::vector<TraceRecord> records;
+
+	std::size_t pos = kMagic.size() + 1;
+	while (pos < data.size()) {
+		const std::uint64_t thread = DecodeVarint(data, pos);
+		const std::uint64_t length = DecodeVarint(data, pos);
+		if (thread > std::numeric_limits<std::uint32_t>::max() || length > data.size() - pos) {
+			throw std::runtime_error("invalid trace: bad block");
+		}
+		const std::span<const std::byte> block = data.first(pos + static_cast<std::size_t>(length));
+		ThreadState& state = threads[static_cast<std::uint32_t>(thread)];
+		while (pos < block.size()) {
+			const std::uint64_t header = DecodeVarint(block, pos);
+			state.timestamp += header >> 1;
+			state.address += static_cast<std::uint64_t>(DecodeZigZag(DecodeVarint(block, pos)));
+			const TraceOperation operation = static_cast<TraceOperation>(header & 1);
+			const std::uint64_t size = operation == TraceOperation::kAllocated ? DecodeVarint(block, pos) : 0;
+			records.push_back({.timestamp = state.timestamp,
+			                   .address = static_cast<std::uintptr_t>(state.address),
+			                   .size = static_cast<std::size_t>(size),
+			                   .thread = static_cast<std::uint32_t>(thread),
+			                   .operation = operation});
+		}
+	}
+
+	// blocks of different threads are not ordered
+	std::ranges::stable_sort(records, {}, &TraceRecord::timestamp);
+	return records;
+}
+
+TraceSummary AnalyzeTrace(const std::span<const TraceRecord> records, const std::size_t intervals, const std::size_t sizes) {
+	TraceSummary summary;
+	if (records.empty()) {
+		return summary;
+	}
+
+	const std::uint64_t first = records.front().timestamp;
+	const std::uint64_t duration = records.back().timestamp - first + 1;
+	const std::uint64_t width = (duration + std::max<std::uint64_t>(intervals, 1) - 1) / std::max<std::uint64_t>(intervals, 1);
+
+	/// @brief Size and timestamp of a memory block.
+	struct LiveBlock {
+		std::size_t size;         ///< @brief The size.
+		std::uint64_t timestamp;  ///< @brief The time of the allocation.
+	};
+	std::unordered_map<std::uintptr_t, LiveBlock> live;
+	std::unordered_map<std::size_t, std::size_t> sizeCounts;
+	std::size_t currentBytes = 0;
+
+	for (const TraceRecord& record : records) {
+		const std::uint64_t index = (record.timestamp - first) / width;
+		while (summary.timeline.size() <= index) {
+			const std::uint64_t start = first + summary.timeline.size() * width;
+			summary.timeline.push_back({.start = start, .end = start + width, .peakBytes = currentBytes, .allocations = 0});
+		}
+		TraceInterval& interval = summary.timeline.back();
+
+		if (record.operation == TraceOperation::kAllocated) {
+			++summary.allocationCount;
+			++interval.allocations;
+			++sizeCounts[record.size];
+			const auto [it, inserted] = live.try_emplace(record.address, LiveBlock{record.size, record.timestamp});
+			if (!inserted) {
+				// the deletion has not been recorded
+				currentBytes -= it->second.size;
+				it->second = {record.size, record.timestamp};
+			}
+			currentBytes += record.size;
+			interval.peakBytes = std::max(interval.peakBytes, currentBytes);
+			if (currentBytes > summary.peakBytes) {
+				summary.peakBytes = currentBytes;
+				summary.peakTimestamp = record.timestamp;
+			}
+		} else if (const auto it = live.find(record.address); it != live.end()) {
+			++summary.deletionCount;
+			++summary.lifetimes[std::bit_width(record.timestamp - it->second.timestamp)];
+			currentBytes -= it->second.size;
+			live.erase(it);
+		} else {
+			++summary.unknownDeletionCount;
+		}
+	}
+
+	summary.liveCount = live.size();
+	summary.liveBytes = currentBytes;
+
+	summary.hottestSizes.reserve(sizeCounts.size());
+	for (const auto& [size, count] : sizeCounts) {
+		summary.hottestSizes.push_back({.size = size, .count = count});
+	}
+	const auto middle = summary.hottestSizes.begin() + static_cast<std::ptrdiff_t>(std::min(sizes, summary.hottestSizes.size()));
+	std::partial_sort(summary.hottestSizes.begin(), middle, summary.hottestSizes.end(), [](const TraceSize& lhs, const TraceSize& rhs) noexcept {
+		return lhs.count > rhs.count || (lhs.count == rhs.count && lhs.size < rhs.size);
+	});
+	summary.hottestSizes.erase(middle, summary.hottestSizes.end());
+	return summary;
+}
+
+namespace internal {
+
+/// @brief An unbounded single-producer single-consumer queue of encoded records.
+/// @details The owning thread appends to the last chunk, draining writes and deletes chunks from the front.
+class TraceWriter::ThreadBuffer {
+private:
+	static constexpr std::size_t kChunkSize = std::size_t{64} * 1024;  ///< @brief The number of bytes per chunk.
+
+	struct Chunk {
+		std::atomic<std::size_t> size = 0;   ///< @brief The number of bytes written by the producer.
+		std::atomic<Chunk*> next = nullptr;  ///< @brief The next chunk, set by the producer.
+		std::byte data[kChunkSize];          ///< @brief The encoded records.
+	};
+
+public:
+	ThreadBuffer(const std::thread::id owner, const std::uint32_t index)
+	    : m_owner(owner)
+	    , m_index(index)
+	    , m_head(new Chunk())
+	    , m_tail(m_head) {
+		// empty
+	}
+	ThreadBuffer(const ThreadBuffer&) = delete;
+	ThreadBuffer(ThreadBuffer&&) = delete;
+	~ThreadBuffer() noexcept {
+		while (m_head) {
+			Chunk* const next = m_head->next.load(std::memory_order_relaxed);
+			delete m_head;
+			m_head = next;
+		}
+	}
+
+public:
+	ThreadBuffer& operator=(const ThreadBuffer&) = delete;
+	ThreadBuffer& operator=(ThreadBuffer&&) = delete;
+
+public:
+	[[nodiscard]] std::thread::id GetOwner() const noexcept {
+		return m_owner;
+	}
+
+	/// @brief Encode and append a record, MUST only be called by the owning thread.
+	/// @details The record is dropped if no memory is available for a new chunk.
+	/// @param timestamp The timestamp which MUST NOT be less than the one of the previous record.
+	/// @param operation The operation.
+	/// @param address The address.
+	/// @param size The size, only stored for `TraceOperation::kAllocated`.
+	/// @return `true` if a chunk has been filled by this call.
+	bool Append(const std::uint64_t timestamp, const TraceOperation operation, const std::uintptr_t address, const std::size_t size) noexcept {
+		std::byte record[kMaxRecordSize];
+		std::size_t length = EncodeVarint(((timestamp - m_timestamp) << 1) | static_cast<std::uint64_t>(operation), record);
+		length += EncodeVarint(EncodeZigZag(static_cast<std::int64_t>(static_cast<std::uint64_t>(address) - m_address)), &record[length]);
+		if (operation == TraceOperation::kAllocated) {
+			length += EncodeVarint(size, &record[length]);
+		}
+
+		bool filled = false;
+		std::size_t used = m_tail->size.load(std::memory_order_relaxed);
+		if (used + length > kChunkSize) {
+			Chunk* const chunk = new (std::nothrow) Chunk;
+			if (!chunk) {
+				[[unlikely]];
+				return false;
+			}
+			m_tail->next.store(chunk, std::memory_order_release);
+			m_tail = chunk;
+			used = 0;
+			filled = true;
+		}
+		std::memcpy(&m_tail->data[used], record, length);
+		m_tail->size.store(used + length, std::memory_order_release);
+
+		m_timestamp = timestamp;
+		m_address = address;
+		return filled;
+	}
+
+	/// @brief Write all published records to a stream, MUST only be called by one thread at a time.
+	/// @param out The stream.
+	void Drain(std::ostream& out) {
+		while (true) {
+			// the size of a chunk is final once the next one exists
+			Chunk* const next = m_head->next.load(std::memory_order_acquire);
+			const std::size_t size = m_head->size.load(std::memory_order_acquire);
+			if (size > m_read) {
+				std::byte header[2 * kMaxVarintSize];
+				std::size_t length = EncodeVarint(m_index, header);
+				length += EncodeVarint(size - m_read, &header[length]);
+				out.write(reinterpret_cast<const char*>(header), static_cast<std::streamsize>(length));
+				out.write(reinterpret_cast<const char*>(&m_head->data[m_read]), static_cast<std::streamsize>(size - m_read));
+				m_read = size;
+			}
+			if (!next) {
+				return;
+			}
+			delete m_head;
+			m_head = next;
+			m_read = 0;
+		}
+	}
+
+private:
+	const std::thread::id m_owner;  ///< @brief The thread appending to this buffer.
+	const std::uint32_t m_index;    ///< @brief The index of the thread in the trace.
+	Chunk* m_head;                  ///< @brief The first chunk, only used by the consumer.
+	std::size_t m_read = 0;         ///< @brief The number of bytes consumed from @p m_head.
+	Chunk* m_tail;                  ///< @brief The last chunk, only used by the producer.
+	std::uint64_t m_timestamp = 0;  ///< @brief The timestamp of the previous record, only used by the producer.
+	std::uint64_t m_address = 0;    ///< @brief The address of the previous record, only used by the producer.
+};
+
+TraceWriter::TraceWriter(const std::filesystem::path& path)
+    : m_id(g_nextWriterId.fetch_add(1, std::memory_order_relaxed))
+    , m_start(std::chrono::steady_clock::now())
+    , m_file(path, std::ios::binary | std::ios::trunc) {
+	if (!m_file) {
+		throw std::system_error(std::make_error_code(std::errc::io_error), "create trace file");
+	}
+	m_file.write(kMagic.data(), kMagic.size());
+	m_file.put(static_cast<char>(kVersion));
+	m_thread = std::thread(&TraceWriter::Run, this);
+}
+
+TraceWriter::~TraceWriter() noexcept {
+	try {
+		Close();
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+void TraceWriter::Write(const TraceOperation operation, const void* const address, const std::size_t size) noexcept {
+	if (!address || m_closed.load(std::memory_order_relaxed)) {
+		[[unlikely]];
+		return;
+	}
+	const std::uint64_t timestamp = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count());
+	try {
+		if (GetThreadBuffer().Append(timestamp, operation, reinterpret_cast<std::uintptr_t>(address), size)) {
+			// let the background thread write the full chunk
+			if (!m_pending.exchange(true, std::memory_order_release)) {
+				m_pending.notify_one();
+			}
+		}
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+void TraceWriter::Flush() {
+	const std::scoped_lock lock(m_mutex);
+	if (m_file.is_open()) {
+		Drain();
+		m_file.flush();
+	}
+}
+
+void TraceWriter::Close() {
+	{
+		const std::scoped_lock lock(m_mutex);
+		m_closed.store(true, std::memory_order_relaxed);
+		if (m_file.is_open()) {
+			Drain();
+			m_file.close();
+		}
+	}
+	if (m_thread.joinable()) {
+		// the background thread stops once the file is closed
+		m_pending.store(true, std::memory_order_release);
+		m_pending.notify_one();
+		m_thread.join();
+	}
+}
+
+TraceWriter::ThreadBuffer& TraceWriter::GetThreadBuffer() {
+	ThreadBufferCache& cache = t_threadBufferCache;
+	if (cache.writerId == m_id) {
+		[[likely]];
+		return *static_cast<ThreadBuffer*>(cache.buffer);
+	}
+
+	const std::thread::id threadId = std::this_thread::get_id();
+	const std::scoped_lock lock(m_mutex);
+	const auto it = std::ranges::find_if(m_buffers, [threadId](const std::unique_ptr<ThreadBuffer>& buffer) noexcept {
+		return buffer->GetOwner() == threadId;
+	});
+	ThreadBuffer* const buffer = it == m_buffers.end() ? m_buffers.emplace_back(std::make_unique<ThreadBuffer>(threadId, static_cast<std::uint32_t>(m_buffers.size()))).get() : it->get();
+	cache = {m_id, buffer};
+	return *buffer;
+}
+
+void TraceWriter::Run() {
+	while (true) {
+		m_pending.wait(false, std::memory_order_acquire);
+		m_pending.store(false, std::memory_order_relaxed);
+
+		const std::scoped_lock lock(m_mutex);
+		if (!m_file.is_open()) {
+			return;
+		}
+		try {
+			Drain();
+			m_file.flush();
+		} catch (...) {
+			// ignore, but assert
+			assert(false);
+		}
+	}
+}
+
+void TraceWriter::Drain() {
+	for (const std::unique_ptr<ThreadBuffer>& buffer : m_buffers) {
+		buffer->Drain(m_file);
+	}
+}
+
+}  // namespace internal
+
+}  // namespace m4t
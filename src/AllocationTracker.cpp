@@ -0,0 +1,524 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTracker.h"
+
+#include "m4t/AllocationTable.h"
+#include "m4t/DeletedHistory.h"
+#include "m4t/GenerationSet.h"
+#include "m4t/StackTable.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace m4t::internal {
+
+namespace {
+
+/// @brief The source of process-wide unique tracker ids, 0 is never used.
+std::atomic<std::uint64_t> g_nextTrackerId = 1;
+
+/// @brief The event buffer used by the current thread for the most recently used tracker.
+struct EventBufferCache {
+	std::uint64_t trackerId = 0;  ///< @brief The id of the tracker.
+	void* buffer = nullptr;       ///< @brief The event buffer.
+};
+
+thread_local EventBufferCache t_eventBufferCache;
+
+/// @brief The sampling state of a thread, shared by all trackers.
+struct SamplerState {
+	std::int64_t bytesUntilSample = 0;  ///< @brief The countdown until the next sampled allocation.
+	std::size_t rate = 0;               ///< @brief The sampling rate used for @p bytesUntilSample, 0 if not set.
+	std::uint64_t random = 0;           ///< @brief The state of the random number generator.
+};
+
+thread_local SamplerState t_samplerState;
+
+/// @brief The source of seeds for the random number generators of all threads.
+std::atomic<std::uint64_t> g_nextSamplerSeed = 0;
+
+/// @brief Get the next number from a SplitMix64 random number generator.
+/// @param state The state of the generator.
+/// @return A random number.
+std::uint64_t NextRandom(std::uint64_t& state) noexcept {
+	std::uint64_t value = (state += 0x9E3779B97F4A7C15ull);
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+	return value ^ (value >> 31);
+}
+
+/// @brief Draw the number of bytes until the next sample from an exponential distribution.
+/// @details Sampling with exponentially distributed intervals samples each byte with the same probability.
+/// @param state The sampling state of the current thread.
+/// @param rate The average number of bytes between two samples.
+/// @return The number of bytes.
+std::int64_t NextSampleInterval(SamplerState& state, const std::size_t rate) noexcept {
+	// uniform in (0, 1]
+	const double uniform = static_cast<double>((NextRandom(state.random) >> 11) + 1) * 0x1.0p-53;
+	const double interval = -std::log(uniform) * static_cast<double>(rate);
+	return static_cast<std::int64_t>(std::min(interval, static_cast<double>(std::numeric_limits<std::int64_t>::max() / 2))) + 1;
+}
+
+}  // namespace
+
+enum class AllocationTracker::Operation : std::uint8_t {
+	kAllocated = 0,
+	kDeleted = 1
+};
+
+struct AllocationTracker::Event {
+	std::uint64_t sequence;  ///< @brief The global order of the event.
+	const void* address;     ///< @brief The address of the memory block.
+	std::size_t size;        ///< @brief The size of the memory block for `Operation::kAllocated`.
+	std::uint32_t stack;     ///< @brief The id of the call stack for `Operation::kAllocated`.
+	float weight;            ///< @brief The weight of a sampled block for `Operation::kAllocated`.
+	Operation operation;     ///< @brief The operation.
+};
+
+/// @brief A part of the journal of allocations.
+/// @details Each entry is validated against the table when reading, so entries for blocks which have been deleted
+/// or reallocated are simply skipped.
+struct alignas(std::hardware_destructive_interference_size) AllocationTracker::JournalShard {
+	std::mutex mutex;                                            ///< @brief Guards @p entries.
+	std::vector<std::pair<const void*, std::uint64_t>> entries;  ///< @brief Address and generation of each allocation.
+};
+
+/// @brief An unbounded single-producer single-consumer queue of events.
+/// @details The owning thread appends to the last chunk, merging consumes from the first chunk. Chunks are deleted
+/// by the consumer once the producer has moved on to the next one.
+class AllocationTracker::EventBuffer {
+private:
+	static constexpr std::size_t kChunkSize = 1024;  ///< @brief The number of events per chunk.
+
+	struct Chunk {
+		std::atomic<std::size_t> size = 0;   ///< @brief The number of events written by the producer.
+		std::atomic<Chunk*> next = nullptr;  ///< @brief The next chunk, set by the producer.
+		Event events[kChunkSize];            ///< @brief The events.
+	};
+
+public:
+	explicit EventBuffer(const std::thread::id owner)
+	    : m_owner(owner)
+	    , m_head(new Chunk())
+	    , m_tail(m_head) {
+		// empty
+	}
+	EventBuffer(const EventBuffer&) = delete;
+	EventBuffer(EventBuffer&&) = delete;
+	~EventBuffer() noexcept {
+		while (m_head) {
+			Chunk* const next = m_head->next.load(std::memory_order_relaxed);
+			delete m_head;
+			m_head = next;
+		}
+	}
+
+public:
+	EventBuffer& operator=(const EventBuffer&) = delete;
+	EventBuffer& operator=(EventBuffer&&) = delete;
+
+public:
+	[[nodiscard]] std::thread::id GetOwner() const noexcept {
+		return m_owner;
+	}
+
+	/// @brief Append an event, MUST only be called by the owning thread.
+	/// @param event The event.
+	void Append(const Event& event) {
+		std::size_t size = m_tail->size.load(std::memory_order_relaxed);
+		if (size == kChunkSize) {
+			Chunk* const chunk = new Chunk();
+			m_tail->next.store(chunk, std::memory_order_release);
+			m_tail = chunk;
+			size = 0;
+		}
+		m_tail->events[size] = event;
+		m_tail->size.store(size + 1, std::memory_order_release);
+	}
+
+	/// @brief Move all published events to a vector, MUST only be called by one thread at a time.
+	/// @param events The vector receiving the events.
+	void Drain(std::vector<Event>& events) {
+		while (true) {
+			const std::size_t size = m_head->size.load(std::memory_order_acquire);
+			events.insert(events.end(), &m_head->events[m_read], &m_head->events[size]);
+			m_read = size;
+			if (size < kChunkSize) {
+				return;
+			}
+			Chunk* const next = m_head->next.load(std::memory_order_acquire);
+			if (!next) {
+				return;
+			}
+			delete m_head;
+			m_head = next;
+			m_read = 0;
+		}
+	}
+
+private:
+	const std::thread::id m_owner;  ///< @brief The thread appending to this buffer.
+	Chunk* m_head;                  ///< @brief The first chunk, only used by the consumer.
+	std::size_t m_read = 0;         ///< @brief The number of events consumed from @p m_head.
+	Chunk* m_tail;                  ///< @brief The last chunk, only used by the producer.
+};
+
+AllocationTracker::AllocationTracker(const TrackingMode mode, const std::size_t maxDeletedHistoryBytes)
+    : m_mode(mode)
+    , m_id(g_nextTrackerId.fetch_add(1, std::memory_order_relaxed))
+    , m_deleted(maxDeletedHistoryBytes)
+    , m_samplingRate(kDefaultSamplingRate)
+    , m_sampling((mode & TrackingMode::kSampling) == TrackingMode::kSampling)
+    , m_journal(std::make_unique<JournalShard[]>(kJournalShardCount)) {
+	// empty
+}
+
+AllocationTracker::~AllocationTracker() noexcept = default;
+
+void AllocationTracker::Allocated(const void* const p, const std::size_t size) noexcept {
+	if (!p) {
+		[[unlikely]];
+		return;
+	}
+	float weight = 0;
+	if ((m_mode & TrackingMode::kSampling) == TrackingMode::kSampling) {
+		weight = Sample(size);
+		if (!weight) {
+			[[likely]];
+			return;
+		}
+	}
+	const std::uint32_t stack = (m_mode & TrackingMode::kStacks) == TrackingMode::kStacks ? m_stacks.Capture(1) : StackTable::kNoStack;
+	Record({0, p, size, stack, weight, Operation::kAllocated});
+}
+
+void AllocationTracker::Deleted(const void* const p) noexcept {
+	if (!p) {
+		[[unlikely]];
+		return;
+	}
+	// blocks which have not been sampled are not tracked, events are never buffered in mode kSampling
+	if ((m_mode & TrackingMode::kSampling) == TrackingMode::kSampling && !m_allocated.Contains(p)) {
+		[[likely]];
+		return;
+	}
+	Record({0, p, 0, StackTable::kNoStack, 0, Operation::kDeleted});
+}
+
+void AllocationTracker::Flush() const {
+	if ((m_mode & TrackingMode::kBuffered) != TrackingMode::kBuffered) {
+		return;
+	}
+
+	const std::scoped_lock lock(m_buffersMutex);
+	for (const std::unique_ptr<EventBuffer>& buffer : m_buffers) {
+		buffer->Drain(m_merge);
+	}
+	// events of each thread are already in order, but threads interleave
+	std::ranges::sort(m_merge, {}, &Event::sequence);
+	for (const Event& event : m_merge) {
+		Apply(event);
+	}
+	m_merge.clear();
+}
+
+bool AllocationTracker::IsAllocated(const void* const p) const {
+	Flush();
+	return m_allocated.Contains(p);
+}
+
+DeletedState AllocationTracker::GetDeletedState(const void* const p) const {
+	Flush();
+	return m_deleted.Find(p);
+}
+
+std::size_t AllocationTracker::GetAllocatedCount() const {
+	Flush();
+	return m_allocated.GetCount();
+}
+
+std::size_t AllocationTracker::GetDeletedCount() const {
+	Flush();
+	return m_deleted.GetCount();
+}
+
+std::optional<AllocatedBlock> AllocationTracker::GetAllocation(const void* const p) const {
+	Flush();
+	const std::optional<AllocationRecord> record = m_allocated.Find(p);
+	if (!record) {
+		return std::nullopt;
+	}
+	return AllocatedBlock{p, record->size, record->generation, record->stack};
+}
+
+bool AllocationTracker::IsSameAllocation(const void* const p, const std::uint64_t generation) const {
+	Flush();
+	const std::optional<AllocationRecord> record = m_allocated.Find(p);
+	return record && record->generation == generation;
+}
+
+bool AllocationTracker::IsGenerationDeleted(const std::uint64_t generation) const {
+	Flush();
+	return m_deletedGenerations.Contains(generation);
+}
+
+AllocationStatistics AllocationTracker::GetStatistics() const {
+	Flush();
+	AllocationStatistics statistics;
+	statistics.currentBytes = m_currentBytes.load(std::memory_order_relaxed);
+	statistics.peakBytes = m_peakBytes.load(std::memory_order_relaxed);
+	statistics.totalBytes = m_totalBytes.load(std::memory_order_relaxed);
+	for (std::size_t i = 0; i < AllocationStatistics::kSizeClassCount; ++i) {
+		statistics.sizeClasses[i] = m_sizeClasses[i].load(std::memory_order_relaxed);
+	}
+	return statistics;
+}
+
+void AllocationTracker::ResetPeakBytes() {
+	Flush();
+	m_peakBytes.store(m_currentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void AllocationTracker::SetSamplingRate(const std::size_t bytes) noexcept {
+	m_samplingRate.store(std::max(bytes, std::size_t{1}), std::memory_order_relaxed);
+}
+
+void AllocationTracker::SetSampling(const bool enabled) noexcept {
+	m_sampling.store(enabled, std::memory_order_relaxed);
+}
+
+SamplingEstimate AllocationTracker::GetSamplingEstimate() const {
+	Flush();
+	SamplingEstimate estimate;
+	estimate.liveBytes = m_estimatedLiveBytes.load(std::memory_order_relaxed);
+	estimate.liveCount = m_estimatedLiveCount.load(std::memory_order_relaxed);
+	estimate.totalBytes = m_estimatedTotalBytes.load(std::memory_order_relaxed);
+	estimate.totalCount = m_estimatedTotalCount.load(std::memory_order_relaxed);
+	return estimate;
+}
+
+AllocationCheckpoint AllocationTracker::Checkpoint() {
+	Flush();
+
+	const std::scoped_lock lock(m_checkpointsMutex);
+	// sequentially consistent: either Apply sees the checkpoint or the checkpoint sees the generation of Apply
+	m_checkpoints.fetch_add(1);
+	return AllocationCheckpoint(*this, m_generation.load());
+}
+
+std::vector<AllocatedBlock> AllocationTracker::GetAllocatedSince(const AllocationCheckpoint& checkpoint) const {
+	assert(checkpoint.m_tracker == this);
+	Flush();
+
+	std::vector<AllocatedBlock> blocks;
+	for (std::size_t i = 0; i < kJournalShardCount; ++i) {
+		JournalShard& shard = m_journal[i];
+		const std::scoped_lock lock(shard.mutex);
+		for (const auto& [address, generation] : shard.entries) {
+			if (generation < checkpoint.m_generation) {
+				continue;
+			}
+			// skip blocks which have been deleted or reallocated since
+			if (const std::optional<AllocationRecord> record = m_allocated.Find(address); record && record->generation == generation) {
+				blocks.push_back({address, record->size, generation, record->stack});
+			}
+		}
+	}
+	std::ranges::sort(blocks, {}, &AllocatedBlock::generation);
+	return blocks;
+}
+
+std::string AllocationTracker::FormatStack(const std::uint32_t stack) const {
+	std::string result;
+	for (const void* const frame : m_stacks.GetFrames(stack)) {
+		result += "    at ";
+		result += SymbolizeFrame(frame);
+		result += '\n';
+	}
+	return result;
+}
+
+void AllocationTracker::ReleaseCheckpoint() noexcept {
+	const std::scoped_lock lock(m_checkpointsMutex);
+	if (m_checkpoints.fetch_sub(1) != 1) {
+		return;
+	}
+	for (std::size_t i = 0; i < kJournalShardCount; ++i) {
+		JournalShard& shard = m_journal[i];
+		const std::scoped_lock shardLock(shard.mutex);
+		shard.entries.clear();
+	}
+}
+
+AllocationTracker::EventBuffer& AllocationTracker::GetEventBuffer() {
+	EventBufferCache& cache = t_eventBufferCache;
+	if (cache.trackerId == m_id) {
+		[[likely]];
+		return *static_cast<EventBuffer*>(cache.buffer);
+	}
+
+	const std::thread::id threadId = std::this_thread::get_id();
+	const std::scoped_lock lock(m_buffersMutex);
+	const auto it = std::ranges::find_if(m_buffers, [threadId](const std::unique_ptr<EventBuffer>& buffer) noexcept {
+		return buffer->GetOwner() == threadId;
+	});
+	EventBuffer* const buffer = it == m_buffers.end() ? m_buffers.emplace_back(std::make_unique<EventBuffer>(threadId)).get() : it->get();
+	cache = {m_id, buffer};
+	return *buffer;
+}
+
+float AllocationTracker::Sample(const std::size_t size) const noexcept {
+	if (!m_sampling.load(std::memory_order_relaxed)) {
+		// track all allocations
+		return 1;
+	}
+
+	SamplerState& state = t_samplerState;
+	const std::size_t rate = m_samplingRate.load(std::memory_order_relaxed);
+	if (state.rate != rate) {
+		[[unlikely]];
+		if (!state.rate) {
+			state.random = g_nextSamplerSeed.fetch_add(1, std::memory_order_relaxed) ^ reinterpret_cast<std::uintptr_t>(&state);
+		}
+		state.rate = rate;
+		state.bytesUntilSample = NextSampleInterval(state, rate);
+	}
+
+	// blocks of size 0 are sampled like blocks of size 1
+	const std::int64_t bytes = static_cast<std::int64_t>(std::min(std::max(size, std::size_t{1}), static_cast<std::size_t>(std::numeric_limits<std::int64_t>::max() / 2)));
+	state.bytesUntilSample -= bytes;
+	if (state.bytesUntilSample > 0) {
+		[[likely]];
+		return 0;
+	}
+	state.bytesUntilSample = NextSampleInterval(state, rate);
+
+	// the inverse of the probability that at least one byte of the block is sampled
+	const double probability = -std::expm1(-static_cast<double>(bytes) / static_cast<double>(rate));
+	return static_cast<float>(1 / probability);
+}
+
+void AllocationTracker::Record(Event event) noexcept {
+	// sampled events are rare, and applying them immediately allows Deleted to drop frees of blocks not sampled
+	if ((m_mode & (TrackingMode::kBuffered | TrackingMode::kSampling)) != TrackingMode::kBuffered) {
+		Apply(event);
+		return;
+	}
+
+	try {
+		event.sequence = m_sequence.fetch_add(1, std::memory_order_relaxed);
+		GetEventBuffer().Append(event);
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+void AllocationTracker::Apply(const Event& event) const noexcept {
+	const bool accounting = (m_mode & TrackingMode::kAccounting) == TrackingMode::kAccounting;
+	switch (event.operation) {
+	case Operation::kAllocated: {
+		const std::uint64_t generation = m_generation.fetch_add(1);
+		try {
+			m_allocated.Insert(event.address, {event.size, generation, event.stack, event.weight});
+			if (m_checkpoints.load()) {
+				JournalShard& shard = m_journal[HashAddress(reinterpret_cast<std::uintptr_t>(event.address)) >> (64 - kJournalShardBits)];
+				const std::scoped_lock lock(shard.mutex);
+				shard.entries.emplace_back(event.address, generation);
+			}
+		} catch (...) {
+			// ignore, but assert
+			assert(false);
+		}
+		if (accounting) {
+			const std::size_t current = m_currentBytes.fetch_add(event.size, std::memory_order_relaxed) + event.size;
+			std::size_t peak = m_peakBytes.load(std::memory_order_relaxed);
+			while (peak < current && !m_peakBytes.compare_exchange_weak(peak, current, std::memory_order_relaxed)) {
+				// empty
+			}
+			m_totalBytes.fetch_add(event.size, std::memory_order_relaxed);
+			m_sizeClasses[AllocationStatistics::GetSizeClass(event.size)].fetch_add(1, std::memory_order_relaxed);
+		}
+		if (event.weight) {
+			const double bytes = static_cast<double>(event.size) * event.weight;
+			m_estimatedLiveBytes.fetch_add(bytes, std::memory_order_relaxed);
+			m_estimatedLiveCount.fetch_add(event.weight, std::memory_order_relaxed);
+			m_estimatedTotalBytes.fetch_add(bytes, std::memory_order_relaxed);
+			m_estimatedTotalCount.fetch_add(event.weight, std::memory_order_relaxed);
+		}
+		break;
+	}
+	case Operation::kDeleted:
+		if (const std::optional<AllocationRecord> record = m_allocated.Erase(event.address); record) {
+			try {
+				m_deletedGenerations.Insert(record->generation);
+			} catch (...) {
+				// ignore, but assert
+				assert(false);
+			}
+			if (accounting) {
+				m_currentBytes.fetch_sub(record->size, std::memory_order_relaxed);
+			}
+			if (record->weight) {
+				m_estimatedLiveBytes.fetch_sub(static_cast<double>(record->size) * record->weight, std::memory_order_relaxed);
+				m_estimatedLiveCount.fetch_sub(record->weight, std::memory_order_relaxed);
+			}
+		}
+		m_deleted.Insert(event.address);
+		break;
+	}
+}
+
+}  // namespace m4t::internal
+
+namespace m4t {
+
+AllocationCheckpoint::AllocationCheckpoint(internal::AllocationTracker& tracker, const std::uint64_t generation) noexcept
+    : m_tracker(&tracker)
+    , m_generation(generation) {
+	// empty
+}
+
+AllocationCheckpoint::AllocationCheckpoint(AllocationCheckpoint&& checkpoint) noexcept
+    : m_tracker(std::exchange(checkpoint.m_tracker, nullptr))
+    , m_generation(checkpoint.m_generation) {
+	// empty
+}
+
+AllocationCheckpoint::~AllocationCheckpoint() noexcept {
+	if (m_tracker) {
+		m_tracker->ReleaseCheckpoint();
+	}
+}
+
+}  // namespace m4t
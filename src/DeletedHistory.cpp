@@ -0,0 +1,193 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/DeletedHistory.h"
+
+#include "m4t/AllocationTable.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace m4t::internal {
+
+namespace {
+
+constexpr std::size_t kFilterHashes = 4;  ///< @brief The number of bits set in the bloom filter per address.
+
+}  // namespace
+
+/// @brief A shard of the history.
+/// @details All members are guarded by @p mutex.
+struct alignas(std::hardware_destructive_interference_size) DeletedHistory::Shard {
+	/// @brief An entry of the counted hash map.
+	struct Entry {
+		std::uintptr_t key;  ///< @brief The address, 0 marks an empty entry.
+		std::size_t count;   ///< @brief The number of times the address is in the ring.
+	};
+
+	mutable std::mutex mutex;
+	std::unique_ptr<std::uintptr_t[]> ring;   ///< @brief The most recently deleted addresses.
+	std::size_t ringCapacity = 0;             ///< @brief The number of entries in @p ring.
+	std::size_t ringSize = 0;                 ///< @brief The number of used entries in @p ring.
+	std::size_t ringHead = 0;                 ///< @brief The index of the next entry to write in @p ring.
+	std::unique_ptr<Entry[]> map;             ///< @brief Open-addressing map of all addresses in @p ring.
+	std::size_t mapCapacity = 0;              ///< @brief The number of entries in @p map, always a power of 2.
+	std::unique_ptr<std::uint64_t[]> filter;  ///< @brief A bloom filter of all addresses which have been evicted from @p ring.
+	std::size_t filterBits = 0;               ///< @brief The number of bits in @p filter, always a power of 2.
+	bool filtered = false;                    ///< @brief `true` if any address has been added to @p filter.
+
+	/// @brief Allocate all memory for the shard.
+	/// @param maxBytes The maximum number of bytes to use.
+	void Allocate(const std::size_t maxBytes) {
+		// use 3/4 of the memory for the ring and a map with a load factor of at most 50 %
+		constexpr std::size_t kBytesPerMapEntry = sizeof(Entry) + sizeof(std::uintptr_t) / 2;
+		mapCapacity = std::max<std::size_t>(2, std::bit_floor(maxBytes / 4 * 3 / kBytesPerMapEntry));
+		ringCapacity = mapCapacity / 2;
+		filterBits = std::max<std::size_t>(64, std::bit_floor(maxBytes / 4 * 8));
+
+		ring = std::make_unique<std::uintptr_t[]>(ringCapacity);
+		map = std::make_unique<Entry[]>(mapCapacity);
+		filter = std::make_unique<std::uint64_t[]>(filterBits / 64);
+	}
+
+	/// @brief Get the index of an address in the map or the index of the empty entry where it belongs.
+	/// @param key The address.
+	/// @param hash The hash value of @p key.
+	/// @return The index in @p map.
+	[[nodiscard]] std::size_t FindEntry(const std::uintptr_t key, const std::uint64_t hash) const noexcept {
+		const std::size_t mask = mapCapacity - 1;
+		std::size_t index = hash & mask;
+		while (map[index].key && map[index].key != key) {
+			index = (index + 1) & mask;
+		}
+		return index;
+	}
+
+	/// @brief Decrement the count of an address and remove it from the map if it is no longer in the ring.
+	/// @details Uses backward shift deletion to keep probe sequences intact without tombstones.
+	/// @param key The address.
+	/// @return `true` if the address has been removed.
+	bool Release(const std::uintptr_t key) noexcept {
+		const std::size_t mask = mapCapacity - 1;
+		std::size_t hole = FindEntry(key, HashAddress(key));
+		if (--map[hole].count) {
+			return false;
+		}
+		for (std::size_t index = (hole + 1) & mask; map[index].key; index = (index + 1) & mask) {
+			const std::size_t home = HashAddress(map[index].key) & mask;
+			// move entry if hole is on the probe sequence between home and index
+			if (((index - home) & mask) >= ((index - hole) & mask)) {
+				map[hole] = map[index];
+				hole = index;
+			}
+		}
+		map[hole] = {};
+		return true;
+	}
+
+	/// @brief Add an address to the bloom filter.
+	/// @param hash The hash value of the address.
+	void AddToFilter(const std::uint64_t hash) noexcept {
+		const std::uint64_t step = (hash >> 32) | 1;
+		for (std::size_t i = 0; i < kFilterHashes; ++i) {
+			const std::size_t bit = (hash + i * step) & (filterBits - 1);
+			filter[bit / 64] |= std::uint64_t{1} << (bit % 64);
+		}
+	}
+
+	/// @brief Check if an address might be in the bloom filter.
+	/// @param hash The hash value of the address.
+	/// @return `false` if the address has never been added to the filter.
+	[[nodiscard]] bool MightBeInFilter(const std::uint64_t hash) const noexcept {
+		const std::uint64_t step = (hash >> 32) | 1;
+		for (std::size_t i = 0; i < kFilterHashes; ++i) {
+			const std::size_t bit = (hash + i * step) & (filterBits - 1);
+			if (!(filter[bit / 64] & (std::uint64_t{1} << (bit % 64)))) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+DeletedHistory::DeletedHistory(const std::size_t maxBytes)
+    : m_shards(std::make_unique<Shard[]>(kShardCount)) {
+	for (std::size_t i = 0; i < kShardCount; ++i) {
+		m_shards[i].Allocate(maxBytes / kShardCount);
+	}
+}
+
+DeletedHistory::~DeletedHistory() noexcept = default;
+
+void DeletedHistory::Insert(const void* const p) noexcept {
+	const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+	if (!key) {
+		[[unlikely]];
+		return;
+	}
+	const std::uint64_t hash = HashAddress(key);
+	Shard& shard = m_shards[hash >> (64 - kShardBits)];
+	{
+		const std::scoped_lock lock(shard.mutex);
+		if (shard.ringSize == shard.ringCapacity) {
+			// evict oldest entry
+			const std::uintptr_t evicted = shard.ring[shard.ringHead];
+			if (shard.Release(evicted)) {
+				shard.AddToFilter(HashAddress(evicted));
+				shard.filtered = true;
+			}
+		} else {
+			++shard.ringSize;
+		}
+		shard.ring[shard.ringHead] = key;
+		shard.ringHead = (shard.ringHead + 1) % shard.ringCapacity;
+
+		Shard::Entry& entry = shard.map[shard.FindEntry(key, hash)];
+		entry.key = key;
+		++entry.count;
+	}
+	m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+DeletedState DeletedHistory::Find(const void* const p) const noexcept {
+	const std::uintptr_t key = reinterpret_cast<std::uintptr_t>(p);
+	if (!key) {
+		[[unlikely]];
+		return DeletedState::kNotDeleted;
+	}
+	const std::uint64_t hash = HashAddress(key);
+	const Shard& shard = m_shards[hash >> (64 - kShardBits)];
+
+	const std::scoped_lock lock(shard.mutex);
+	if (shard.map[shard.FindEntry(key, hash)].key) {
+		return DeletedState::kDeleted;
+	}
+	return shard.filtered && shard.MightBeInFilter(hash) ? DeletedState::kProbablyDeleted : DeletedState::kNotDeleted;
+}
+
+std::size_t DeletedHistory::GetExactCapacity() const noexcept {
+	return m_shards[0].ringCapacity * kShardCount;
+}
+
+}  // namespace m4t::internal
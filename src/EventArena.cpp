@@ -0,0 +1,228 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventArena.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace m4t {
+
+/// @brief The location of the payload of an argument.
+struct CapturedEvent::Arg {
+	std::uint32_t offset;  ///< @brief The offset of the payload relative to the end of the argument table.
+	std::uint32_t size;    ///< @brief The size of the payload.
+};
+
+/// @brief The header of an event in the arena, followed by the argument table and the payload.
+struct CapturedEvent::Record {
+	std::uint64_t keyword;   ///< @brief The keyword.
+	std::uint32_t size;      ///< @brief The size of the record including argument table, payload and padding.
+	std::uint32_t argCount;  ///< @brief The number of arguments.
+	std::uint16_t eventId;   ///< @brief The event id.
+	std::uint8_t level;      ///< @brief The level.
+
+	/// @brief Get the argument table.
+	/// @return The first entry of the table.
+	[[nodiscard]] Arg* GetArgs() noexcept {
+		return reinterpret_cast<Arg*>(this + 1);
+	}
+
+	/// @brief Get the argument table.
+	/// @return The first entry of the table.
+	[[nodiscard]] const Arg* GetArgs() const noexcept {
+		return reinterpret_cast<const Arg*>(this + 1);
+	}
+
+	/// @brief Get the start of the payload.
+	/// @return The address of the payload of the first argument.
+	[[nodiscard]] std::byte* GetPayload() noexcept {
+		return reinterpret_cast<std::byte*>(GetArgs() + argCount);
+	}
+
+	/// @brief Get the start of the payload.
+	/// @return The address of the payload of the first argument.
+	[[nodiscard]] const std::byte* GetPayload() const noexcept {
+		return reinterpret_cast<const std::byte*>(GetArgs() + argCount);
+	}
+};
+
+/// @brief A block of memory holding records.
+struct EventArena::Chunk {
+	std::unique_ptr<std::byte[]> data;  ///< @brief The memory.
+	std::size_t capacity;               ///< @brief The size of @p data.
+	std::size_t used;                   ///< @brief The number of bytes used by records.
+};
+
+namespace {
+
+/// @brief The alignment of records.
+constexpr std::size_t kRecordAlignment = alignof(std::uint64_t);
+
+}  // namespace
+
+//
+// CapturedEvent
+//
+
+std::uint16_t CapturedEvent::GetEventId() const noexcept {
+	return m_record->eventId;
+}
+
+std::uint8_t CapturedEvent::GetLevel() const noexcept {
+	return m_record->level;
+}
+
+std::uint64_t CapturedEvent::GetKeyword() const noexcept {
+	return m_record->keyword;
+}
+
+std::uint32_t CapturedEvent::GetArgCount() const noexcept {
+	return m_record->argCount;
+}
+
+std::span<const std::byte> CapturedEvent::GetArg(const std::uint32_t index) const {
+	if (index >= m_record->argCount) {
+		throw std::out_of_range("argument index");
+	}
+	const Arg& arg = m_record->GetArgs()[index];
+	return {m_record->GetPayload() + arg.offset, arg.size};
+}
+
+//
+// EventArena::Iterator
+//
+
+EventArena::Iterator::Iterator(const Chunk* const chunk, const Chunk* const end) noexcept
+    : m_chunk(chunk)
+    , m_end(end) {
+	SkipEmpty();
+}
+
+CapturedEvent EventArena::Iterator::operator*() const noexcept {
+	return CapturedEvent(reinterpret_cast<const CapturedEvent::Record*>(&m_chunk->data[m_offset]));
+}
+
+EventArena::Iterator& EventArena::Iterator::operator++() noexcept {
+	m_offset += reinterpret_cast<const CapturedEvent::Record*>(&m_chunk->data[m_offset])->size;
+	SkipEmpty();
+	return *this;
+}
+
+EventArena::Iterator EventArena::Iterator::operator++(int) noexcept {
+	Iterator result = *this;
+	++*this;
+	return result;
+}
+
+void EventArena::Iterator::SkipEmpty() noexcept {
+	while (m_chunk != m_end && m_offset == m_chunk->used) {
+		++m_chunk;
+		m_offset = 0;
+	}
+	if (m_chunk == m_end) {
+		// make equal to end()
+		m_chunk = m_end = nullptr;
+	}
+}
+
+//
+// EventArena
+//
+
+EventArena::EventArena() = default;
+
+EventArena::~EventArena() noexcept = default;
+
+std::byte* EventArena::Allocate(const std::uint16_t eventId, const std::uint8_t level, const std::uint64_t keyword, const std::uint32_t argCount, const std::size_t payloadSize) {
+	using Record = CapturedEvent::Record;
+	const std::size_t size = (sizeof(Record) + argCount * sizeof(CapturedEvent::Arg) + payloadSize + kRecordAlignment - 1) & ~(kRecordAlignment - 1);
+	if (size > std::numeric_limits<std::uint32_t>::max()) {
+		throw std::length_error("event too large");
+	}
+
+	// events are never split, all chunks after the current one are empty
+	if (m_current == m_chunks.size() || m_chunks[m_current].capacity - m_chunks[m_current].used < size) {
+		const std::size_t next = m_current < m_chunks.size() && m_chunks[m_current].used ? m_current + 1 : m_current;
+		const auto it = std::find_if(m_chunks.begin() + static_cast<std::ptrdiff_t>(next), m_chunks.end(), [size](const Chunk& chunk) noexcept {
+			return chunk.capacity >= size;
+		});
+		if (it == m_chunks.end()) {
+			const std::size_t capacity = std::max(size, kChunkSize);
+			m_chunks.insert(m_chunks.begin() + static_cast<std::ptrdiff_t>(next), Chunk{.data = std::make_unique_for_overwrite<std::byte[]>(capacity), .capacity = capacity, .used = 0});
+		} else {
+			std::swap(*it, m_chunks[next]);
+		}
+		m_current = next;
+	}
+
+	Chunk& chunk = m_chunks[m_current];
+	Record* const record = new (&chunk.data[chunk.used]) Record{.keyword = keyword, .size = static_cast<std::uint32_t>(size), .argCount = argCount, .eventId = eventId, .level = level};
+	chunk.used += size;
+	++m_count;
+	return reinterpret_cast<std::byte*>(record);
+}
+
+void EventArena::WriteArg(std::byte* const record, const std::uint32_t index, const std::size_t offset, const std::span<const std::byte> arg) noexcept {
+	CapturedEvent::Record* const header = reinterpret_cast<CapturedEvent::Record*>(record);
+	header->GetArgs()[index] = {.offset = static_cast<std::uint32_t>(offset), .size = static_cast<std::uint32_t>(arg.size())};
+	if (!arg.empty()) {
+		std::memcpy(header->GetPayload() + offset, arg.data(), arg.size());
+	}
+}
+
+void EventArena::Reset() noexcept {
+	const std::scoped_lock lock(m_mutex);
+	for (Chunk& chunk : m_chunks) {
+		chunk.used = 0;
+	}
+	m_current = 0;
+	m_count = 0;
+}
+
+std::size_t EventArena::GetCount() const noexcept {
+	return m_count;
+}
+
+std::size_t EventArena::GetCapacity() const noexcept {
+	std::size_t capacity = 0;
+	for (const Chunk& chunk : m_chunks) {
+		capacity += chunk.capacity;
+	}
+	return capacity;
+}
+
+EventArena::Iterator EventArena::begin() const noexcept {
+	return Iterator(m_chunks.data(), m_chunks.data() + m_chunks.size());
+}
+
+EventArena::Iterator EventArena::end() const noexcept {
+	return Iterator();
+}
+
+}  // namespace m4t
@@ -0,0 +1,104 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventExpectations.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace m4t {
+
+namespace {
+
+/// @brief Convert a count for use with `testing::Cardinality`.
+/// @param count The count.
+/// @return The count limited to the range of `int`.
+int ToCallCount(const std::uint64_t count) noexcept {
+	return static_cast<int>(std::min<std::uint64_t>(count, std::numeric_limits<int>::max()));
+}
+
+}  // namespace
+
+EventExpectations& EventExpectations::Expect(const std::uint16_t eventId, const testing::Cardinality& cardinality) {
+	return AddEntry(eventId, cardinality, nullptr);
+}
+
+testing::AssertionResult EventExpectations::Verify() const {
+	std::vector<std::uint16_t> eventIds;
+	eventIds.reserve(m_entries.size());
+	for (const auto& [eventId, entry] : m_entries) {
+		eventIds.push_back(eventId);
+	}
+	std::sort(eventIds.begin(), eventIds.end());
+
+	testing::AssertionResult result = testing::AssertionSuccess();
+	std::size_t failures = 0;
+	const std::scoped_lock lock(m_mutex);
+	for (const std::uint16_t eventId : eventIds) {
+		const Entry& entry = m_entries.at(eventId);
+		const int count = ToCallCount(entry.count.load(std::memory_order_relaxed));
+		const std::uint64_t mismatched = entry.mismatched.load(std::memory_order_relaxed);
+		if (entry.cardinality.IsSatisfiedByCallCount(count) && !mismatched) {
+			continue;
+		}
+		if (!failures++) {
+			result = testing::AssertionFailure();
+		}
+		std::ostringstream description;
+		description << "\nEvent " << eventId << ": expected to be ";
+		entry.cardinality.DescribeTo(&description);
+		description << ", actual: ";
+		testing::Cardinality::DescribeActualCallCountTo(count, &description);
+		if (mismatched) {
+			description << ", " << mismatched << " with other arguments, first: " << entry.mismatch;
+		}
+		result << description.str();
+	}
+	if (failures) {
+		result << "\n"
+		       << failures << " of " << m_entries.size() << " event expectations not met";
+	}
+	return result;
+}
+
+EventExpectations& EventExpectations::AddEntry(const std::uint16_t eventId, const testing::Cardinality& cardinality, ArgMatcher&& matcher) {
+	if (!m_entries.try_emplace(eventId, cardinality, std::move(matcher)).second) {
+		throw std::invalid_argument("event id already has an expectation");
+	}
+	return *this;
+}
+
+void EventExpectations::AddMismatch(Entry& entry, std::string&& explanation) {
+	const std::scoped_lock lock(m_mutex);
+	if (!entry.mismatched.fetch_add(1, std::memory_order_relaxed)) {
+		entry.mismatch = std::move(explanation);
+	}
+}
+
+}  // namespace m4t
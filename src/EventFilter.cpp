@@ -0,0 +1,91 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventFilter.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+
+namespace m4t {
+
+namespace {
+
+/// @brief Set or clear a range of bits.
+/// @param bits The bitmap.
+/// @param first The first bit.
+/// @param last The last bit, inclusive.
+/// @param value `true` to set the bits, `false` to clear them.
+void SetBits(const std::span<std::uint64_t> bits, const std::size_t first, const std::size_t last, const bool value) noexcept {
+	for (std::size_t word = first / 64; word <= last / 64; ++word) {
+		const std::size_t from = word == first / 64 ? first % 64 : 0;
+		const std::size_t to = word == last / 64 ? last % 64 : 63;
+		const std::uint64_t mask = (std::numeric_limits<std::uint64_t>::max() >> (63 - to + from)) << from;
+		if (value) {
+			bits[word] |= mask;
+		} else {
+			bits[word] &= ~mask;
+		}
+	}
+}
+
+}  // namespace
+
+EventFilter::EventFilter() noexcept {
+	m_eventIds.fill(std::numeric_limits<std::uint64_t>::max());
+	m_levels.fill(std::numeric_limits<std::uint64_t>::max());
+}
+
+EventFilter& EventFilter::IncludeEventIds(const std::uint16_t first, const std::uint16_t last) noexcept {
+	if (m_allEventIds) {
+		m_eventIds.fill(0);
+		m_allEventIds = false;
+	}
+	if (first <= last) {
+		SetBits(m_eventIds, first, last, true);
+	}
+	return *this;
+}
+
+EventFilter& EventFilter::ExcludeEventIds(const std::uint16_t first, const std::uint16_t last) noexcept {
+	if (first <= last) {
+		SetBits(m_eventIds, first, last, false);
+	}
+	return *this;
+}
+
+EventFilter& EventFilter::SetLevelMask(const std::uint64_t mask) noexcept {
+	m_levels.fill(0);
+	m_levels[0] = mask;
+	return *this;
+}
+
+EventFilter& EventFilter::SetMaxLevel(const std::uint8_t maxLevel) noexcept {
+	m_levels.fill(0);
+	SetBits(m_levels, 0, maxLevel, true);
+	return *this;
+}
+
+EventFilter& EventFilter::SetKeywordMask(const std::uint64_t any, const std::uint64_t all) noexcept {
+	m_anyKeyword = any;
+	m_allKeyword = all;
+	return *this;
+}
+
+}  // namespace m4t
@@ -0,0 +1,201 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventStatistics.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace m4t {
+
+namespace {
+
+/// @brief Set an atomic value to the result of a function if it changes the value.
+/// @param value The atomic value.
+/// @param arg The argument for @p fn.
+/// @param fn A function returning the new value for the current value and @p arg.
+template <typename F>
+void UpdateAtomic(std::atomic<std::uint64_t>& value, const std::uint64_t arg, F&& fn) noexcept {
+	std::uint64_t current = value.load(std::memory_order_relaxed);
+	for (std::uint64_t next = fn(current, arg); next != current && !value.compare_exchange_weak(current, next, std::memory_order_relaxed); next = fn(current, arg)) {
+		// empty
+	}
+}
+
+}  // namespace
+
+//
+// HistogramSnapshot
+//
+
+std::uint64_t HistogramSnapshot::GetValueAtPercentile(const double percentile) const noexcept {
+	if (!m_count) {
+		return 0;
+	}
+	const double rank = std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * static_cast<double>(m_count));
+	const std::uint64_t target = std::max<std::uint64_t>(static_cast<std::uint64_t>(rank), 1);
+	std::uint64_t total = 0;
+	for (std::size_t i = 0; i < kBucketCount; ++i) {
+		total += m_buckets[i];
+		if (total >= target) {
+			return std::clamp(GetBucketLimit(i), GetMin(), m_max);
+		}
+	}
+	return m_max;
+}
+
+//
+// LatencyHistogram
+//
+
+void LatencyHistogram::Record(const std::uint64_t value) noexcept {
+	m_buckets[HistogramSnapshot::GetBucket(value)].fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(value, std::memory_order_relaxed);
+	UpdateAtomic(m_min, value, [](const std::uint64_t current, const std::uint64_t arg) noexcept {
+		return std::min(current, arg);
+	});
+	UpdateAtomic(m_max, value, [](const std::uint64_t current, const std::uint64_t arg) noexcept {
+		return std::max(current, arg);
+	});
+	m_count.fetch_add(1, std::memory_order_release);
+}
+
+HistogramSnapshot LatencyHistogram::GetSnapshot() const noexcept {
+	HistogramSnapshot snapshot;
+	snapshot.m_count = m_count.load(std::memory_order_acquire);
+	std::uint64_t count = 0;
+	for (std::size_t i = 0; i < HistogramSnapshot::kBucketCount; ++i) {
+		snapshot.m_buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+		count += snapshot.m_buckets[i];
+	}
+	// keep the statistics consistent with the buckets
+	snapshot.m_count = std::min(snapshot.m_count, count);
+	snapshot.m_sum = m_sum.load(std::memory_order_relaxed);
+	snapshot.m_min = m_min.load(std::memory_order_relaxed);
+	snapshot.m_max = m_max.load(std::memory_order_relaxed);
+	return snapshot;
+}
+
+//
+// EventStatistics
+//
+
+/// @brief The counter of a single event id or debug level.
+struct EventStatistics::Slot {
+	std::atomic<std::uint64_t> count;             ///< @brief The number of occurrences.
+	std::atomic<std::int64_t> last;               ///< @brief The time of the latest occurrence or 0.
+	std::atomic<LatencyHistogram*> interArrival;  ///< @brief The time between two occurrences, allocated on demand.
+
+	/// @brief Count an occurrence.
+	/// @param now The time of the occurrence.
+	void Add(const std::chrono::steady_clock::time_point now) noexcept {
+		const std::int64_t ticks = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+		count.fetch_add(1, std::memory_order_relaxed);
+		const std::int64_t previous = last.exchange(ticks, std::memory_order_relaxed);
+		if (!previous) {
+			return;
+		}
+		LatencyHistogram* histogram = interArrival.load(std::memory_order_acquire);
+		if (!histogram) {
+			[[unlikely]];
+			LatencyHistogram* const created = new (std::nothrow) LatencyHistogram();
+			if (!created) {
+				// counting is more important than the histogram
+				return;
+			}
+			if (interArrival.compare_exchange_strong(histogram, created, std::memory_order_acq_rel)) {
+				histogram = created;
+			} else {
+				delete created;
+			}
+		}
+		// concurrent threads might exchange the time out of order
+		histogram->Record(ticks > previous ? static_cast<std::uint64_t>(ticks - previous) : 0);
+	}
+
+	/// @brief Get a copy of the counter.
+	/// @return The counter.
+	[[nodiscard]] EventCounter GetSnapshot() const noexcept {
+		const LatencyHistogram* const histogram = interArrival.load(std::memory_order_acquire);
+		return {.count = count.load(std::memory_order_relaxed), .interArrival = histogram ? histogram->GetSnapshot() : HistogramSnapshot()};
+	}
+
+	Slot() noexcept = default;
+	Slot(const Slot&) = delete;
+	Slot(Slot&&) = delete;
+
+	~Slot() noexcept {
+		delete interArrival.load(std::memory_order_relaxed);
+	}
+
+	Slot& operator=(const Slot&) = delete;
+	Slot& operator=(Slot&&) = delete;
+};
+
+EventStatistics::EventStatistics()
+    : m_events(std::make_unique<Slot[]>(kEventIdCount)) {
+	// empty
+}
+
+EventStatistics::~EventStatistics() noexcept = default;
+
+void EventStatistics::AddEvent(const std::uint16_t eventId, const std::chrono::steady_clock::time_point now) noexcept {
+	m_events[eventId].Add(now);
+}
+
+void EventStatistics::AddDebug(const std::string_view level, const std::chrono::steady_clock::time_point now) {
+	{
+		const std::shared_lock lock(m_debugMutex);
+		if (const auto it = m_debug.find(level); it != m_debug.end()) {
+			[[likely]];
+			it->second->Add(now);
+			return;
+		}
+	}
+	std::unique_ptr<Slot> slot = std::make_unique<Slot>();
+	const std::scoped_lock lock(m_debugMutex);
+	// another thread might have added the level in the meantime
+	m_debug.try_emplace(std::string(level), std::move(slot)).first->second->Add(now);
+}
+
+EventStatisticsSnapshot EventStatistics::GetSnapshot() const {
+	EventStatisticsSnapshot snapshot;
+	for (std::size_t i = 0; i < kEventIdCount; ++i) {
+		if (m_events[i].count.load(std::memory_order_relaxed)) {
+			snapshot.events.emplace(static_cast<std::uint16_t>(i), m_events[i].GetSnapshot());
+		}
+	}
+	const std::shared_lock lock(m_debugMutex);
+	for (const auto& [level, slot] : m_debug) {
+		snapshot.debug.emplace(level, slot->GetSnapshot());
+	}
+	return snapshot;
+}
+
+}  // namespace m4t
@@ -0,0 +1,97 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/FaultInjector.h"
+
+#include "m4t/AllocationTable.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace m4t::internal {
+
+void FaultInjector::FailNth(const std::size_t index) noexcept {
+	m_value.store(index, std::memory_order_relaxed);
+	Activate(Rule::kNth);
+}
+
+void FaultInjector::FailAbove(const std::size_t size) noexcept {
+	m_value.store(size, std::memory_order_relaxed);
+	Activate(Rule::kAbove);
+}
+
+void FaultInjector::FailRandomly(const double probability, const std::uint64_t seed) noexcept {
+	constexpr double kScale = 18446744073709551616.0;  // 2^64
+	std::uint64_t threshold;
+	if (probability <= 0) {
+		threshold = 0;
+	} else if (probability >= 1) {
+		threshold = std::numeric_limits<std::uint64_t>::max();
+	} else {
+		threshold = static_cast<std::uint64_t>(probability * kScale);
+	}
+	m_value.store(threshold, std::memory_order_relaxed);
+	m_seed.store(seed, std::memory_order_relaxed);
+	Activate(Rule::kRandomly);
+}
+
+void FaultInjector::Reset() noexcept {
+	Activate(Rule::kNone);
+}
+
+bool FaultInjector::ShouldFail(const std::size_t size) noexcept {
+	const Rule rule = m_rule.load(std::memory_order_acquire);
+	if (rule == Rule::kNone) {
+		[[likely]];
+		return false;
+	}
+	const std::size_t index = m_allocations.fetch_add(1, std::memory_order_relaxed);
+
+	bool fail;
+	switch (rule) {
+	case Rule::kNth:
+		fail = index == m_value.load(std::memory_order_relaxed);
+		break;
+	case Rule::kAbove:
+		fail = size > m_value.load(std::memory_order_relaxed);
+		break;
+	case Rule::kRandomly: {
+		const std::uint64_t threshold = m_value.load(std::memory_order_relaxed);
+		const std::uint64_t random = HashAddress(m_seed.load(std::memory_order_relaxed) + index * 0x9E3779B97F4A7C15ull);
+		fail = random < threshold || threshold == std::numeric_limits<std::uint64_t>::max();
+		break;
+	}
+	case Rule::kNone:
+	default:
+		return false;
+	}
+	if (fail) {
+		m_failures.fetch_add(1, std::memory_order_relaxed);
+	}
+	return fail;
+}
+
+void FaultInjector::Activate(const Rule rule) noexcept {
+	m_allocations.store(0, std::memory_order_relaxed);
+	m_failures.store(0, std::memory_order_relaxed);
+	m_rule.store(rule, std::memory_order_release);
+}
+
+}  // namespace m4t::internal
@@ -0,0 +1,151 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/GenerationSet.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+namespace m4t::internal {
+
+/// @brief A part of the bitmap.
+struct GenerationSet::Chunk {
+	std::atomic<std::uint64_t> words[kChunkWords];  ///< @brief The bitmap.
+	std::atomic<std::uint32_t> count;               ///< @brief The number of bits set in @p words.
+};
+
+namespace {
+
+/// @brief The number of generations per chunk.
+constexpr std::uint32_t kGenerationsPerChunk = std::uint32_t{1} << 22;
+
+/// @brief Marker for a chunk with all generations in the set which has been released.
+/// @details The value is never a valid address of a chunk.
+template <typename T>
+T* const kFullChunk = reinterpret_cast<T*>(alignof(T));  // NOLINT(performance-no-int-to-ptr): Marker is never dereferenced.
+
+/// @brief Throw an exception if a generation cannot be stored.
+/// @param generation The generation.
+void CheckGeneration(const std::uint64_t generation) {
+	if (generation >= GenerationSet::kMaxGenerations) {
+		[[unlikely]];
+		throw std::out_of_range("generation");
+	}
+}
+
+}  // namespace
+
+GenerationSet::GenerationSet() noexcept = default;
+
+GenerationSet::~GenerationSet() noexcept {
+	std::atomic<Chunk*>* const directory = m_directory.load(std::memory_order_relaxed);
+	if (!directory) {
+		return;
+	}
+	for (std::size_t i = 0; i < kChunkCount; ++i) {
+		if (Chunk* const chunk = directory[i].load(std::memory_order_relaxed); chunk != kFullChunk<Chunk>) {
+			delete chunk;
+		}
+	}
+	delete[] directory;
+}
+
+void GenerationSet::Insert(const std::uint64_t generation) {
+	static_assert(kGenerationsPerChunk == std::size_t{1} << kChunkBits);
+	CheckGeneration(generation);
+
+	std::atomic<Chunk*>& slot = GetDirectory()[generation >> kChunkBits];
+	Chunk* chunk = slot.load(std::memory_order_acquire);
+	if (!chunk) {
+		[[unlikely]];
+		std::unique_ptr<Chunk> newChunk = std::make_unique<Chunk>();
+		if (slot.compare_exchange_strong(chunk, newChunk.get(), std::memory_order_acq_rel)) {
+			chunk = newChunk.release();
+			m_chunks.fetch_add(1, std::memory_order_relaxed);
+		}
+		// else another thread has added the chunk which is now in chunk
+	}
+	if (chunk == kFullChunk<Chunk>) {
+		[[unlikely]];
+		return;
+	}
+
+	const std::size_t bit = generation & (kGenerationsPerChunk - 1);
+	const std::uint64_t mask = std::uint64_t{1} << (bit % 64);
+	if (chunk->words[bit / 64].fetch_or(mask, std::memory_order_release) & mask) {
+		[[unlikely]];
+		return;
+	}
+	// the thread setting the last bit is the last one accessing the chunk because each generation is added only once
+	if (chunk->count.fetch_add(1, std::memory_order_acq_rel) + 1 == kGenerationsPerChunk) {
+		[[unlikely]];
+		slot.store(kFullChunk<Chunk>, std::memory_order_seq_cst);
+		while (m_readers.load(std::memory_order_seq_cst)) {
+			std::this_thread::yield();
+		}
+		delete chunk;
+		m_chunks.fetch_sub(1, std::memory_order_relaxed);
+	}
+}
+
+bool GenerationSet::Contains(const std::uint64_t generation) const {
+	CheckGeneration(generation);
+
+	const std::atomic<Chunk*>* const directory = m_directory.load(std::memory_order_acquire);
+	if (!directory) {
+		return false;
+	}
+
+	// prevent the chunk from being released while it is read
+	m_readers.fetch_add(1, std::memory_order_seq_cst);
+	const Chunk* const chunk = directory[generation >> kChunkBits].load(std::memory_order_seq_cst);
+	bool result;
+	if (!chunk) {
+		result = false;
+	} else if (chunk == kFullChunk<Chunk>) {
+		result = true;
+	} else {
+		const std::size_t bit = generation & (kGenerationsPerChunk - 1);
+		result = (chunk->words[bit / 64].load(std::memory_order_acquire) & (std::uint64_t{1} << (bit % 64))) != 0;
+	}
+	m_readers.fetch_sub(1, std::memory_order_release);
+	return result;
+}
+
+std::size_t GenerationSet::GetChunkCount() const noexcept {
+	return m_chunks.load(std::memory_order_relaxed);
+}
+
+std::atomic<GenerationSet::Chunk*>* GenerationSet::GetDirectory() {
+	std::atomic<Chunk*>* directory = m_directory.load(std::memory_order_acquire);
+	if (!directory) {
+		[[unlikely]];
+		std::unique_ptr<std::atomic<Chunk*>[]> newDirectory = std::make_unique<std::atomic<Chunk*>[]>(kChunkCount);
+		if (m_directory.compare_exchange_strong(directory, newDirectory.get(), std::memory_order_acq_rel)) {
+			directory = newDirectory.release();
+		}
+		// else another thread has added the directory which is now in directory
+	}
+	return directory;
+}
+
+}  // namespace m4t::internal
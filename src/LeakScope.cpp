@@ -0,0 +1,58 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/LeakScope.h"
+
+#include "m4t/AllocationTracker.h"
+
+#include <gtest/gtest.h>
+
+#include <cassert>
+#include <sstream>
+#include <vector>
+
+namespace m4t::internal {
+
+LeakScope::LeakScope(AllocationTracker& tracker, const char* const file, const int line)
+    : m_tracker(tracker)
+    , m_file(file)
+    , m_line(line)
+    , m_checkpoint(tracker.Checkpoint()) {
+	// empty
+}
+
+LeakScope::~LeakScope() noexcept {
+	try {
+		const std::vector<AllocatedBlock> blocks = m_tracker.GetAllocatedSince(m_checkpoint);
+		if (blocks.empty()) {
+			return;
+		}
+		std::ostringstream message;
+		message << blocks.size() << " memory block(s) leaked:\n";
+		for (const AllocatedBlock& block : blocks) {
+			message << "  " << block.address << " (" << block.size << " bytes, generation " << block.generation << ")\n"
+			        << m_tracker.FormatStack(block.stack);
+		}
+		ADD_FAILURE_AT(m_file, m_line) << message.str();
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+}  // namespace m4t::internal
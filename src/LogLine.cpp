@@ -0,0 +1,211 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/LogLine.h"
+
+#include <cstddef>
+#include <string_view>
+
+namespace m4t::internal {
+
+namespace {
+
+constexpr std::string_view kAt = "\tat ";                ///< @brief The prefix of the location of the message.
+constexpr std::string_view kCausedBy = "\tcaused by: ";  ///< @brief The prefix of the message of a cause.
+constexpr std::string_view kCauseAt = "\t\tat ";         ///< @brief The prefix of the location of a cause.
+constexpr std::string_view kThreadSeparator = "] [";     ///< @brief The separator between level and thread id.
+
+/// @brief Check if a character is a decimal digit.
+/// @param ch The character.
+/// @return `true` if @p ch is a digit.
+constexpr bool IsDigit(const char ch) noexcept {
+	return ch >= '0' && ch <= '9';
+}
+
+/// @brief Check if a character is a word character as in `\w` of a regular expression.
+/// @param ch The character.
+/// @return `true` if @p ch is a letter, a digit or an underscore.
+constexpr bool IsWord(const char ch) noexcept {
+	return IsDigit(ch) || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_';
+}
+
+/// @brief A cursor over the text which records the first error.
+class Parser {
+public:
+	explicit Parser(const std::string_view text) noexcept
+	    : m_text(text) {
+		// empty
+	}
+
+public:
+	/// @brief Parse the whole text.
+	/// @return The result.
+	LogLine Parse() noexcept {
+		LogLine result{};
+		if (!Skip("[")) {
+			return Fail(result, "Expected '['");
+		}
+		// the level ends at the first "] [" followed by digits and "] ", like the non-greedy regex `\[(.+?)\] \[\d+\] `
+		const std::size_t levelStart = m_pos;
+		if (m_pos < m_text.size() && m_text[m_pos] == '\n') {
+			return Fail(result, "Expected level");
+		}
+		while (true) {
+			const std::size_t end = m_text.find_first_of("]\n", m_pos + 1);
+			if (end == std::string_view::npos || m_text[end] == '\n') {
+				m_pos = end == std::string_view::npos ? m_text.size() : end;
+				return Fail(result, "Expected '] [' after level");
+			}
+			m_pos = end;
+			const std::size_t separator = m_pos;
+			if (Skip(kThreadSeparator) && SkipDigits() && Skip("] ")) {
+				result.level = m_text.substr(levelStart, separator - levelStart);
+				break;
+			}
+			m_pos = separator;
+		}
+		result.message = Line();
+		if (result.message.empty()) {
+			return Fail(result, "Expected message");
+		}
+		if (!Location(kAt)) {
+			return Fail(result, "Expected location of message");
+		}
+
+		const std::size_t causesStart = m_pos;
+		while (m_pos < m_text.size()) {
+			if (!Skip(kCausedBy)) {
+				return Fail(result, "Expected cause");
+			}
+			if (Line().empty()) {
+				return Fail(result, "Expected message of cause");
+			}
+			if (!Location(kCauseAt)) {
+				return Fail(result, "Expected location of cause");
+			}
+		}
+		result.causes = m_text.substr(causesStart);
+		return result;
+	}
+
+private:
+	/// @brief Skip a fixed string.
+	/// @param str The string.
+	/// @return `true` if the text at the current position starts with @p str.
+	bool Skip(const std::string_view str) noexcept {
+		if (m_text.substr(m_pos).starts_with(str)) {
+			m_pos += str.size();
+			return true;
+		}
+		return false;
+	}
+
+	/// @brief Skip one or more digits.
+	/// @return `true` if at least one digit has been skipped.
+	bool SkipDigits() noexcept {
+		const std::size_t start = m_pos;
+		while (m_pos < m_text.size() && IsDigit(m_text[m_pos])) {
+			++m_pos;
+		}
+		return m_pos != start;
+	}
+
+	/// @brief Get the rest of the current line and skip the line break.
+	/// @return The line without the line break or an empty view if the line is empty or has no line break.
+	std::string_view Line() noexcept {
+		const std::size_t end = m_text.find('\n', m_pos);
+		if (end == std::string_view::npos) {
+			m_pos = m_text.size();
+			return {};
+		}
+		const std::string_view line = m_text.substr(m_pos, end - m_pos);
+		m_pos = end + 1;
+		return line;
+	}
+
+	/// @brief Parse a line `prefix file(line) (function)`.
+	/// @param prefix The expected prefix.
+	/// @return `true` if the line is valid.
+	bool Location(const std::string_view prefix) noexcept {
+		if (!Skip(prefix)) {
+			return false;
+		}
+		const std::size_t start = m_pos;
+		const std::string_view line = Line();
+		if (line.empty()) {
+			m_pos = start;
+			return false;
+		}
+		// scan backwards: ')' word+ '(' ' ' ')' digit+ '(' and at least one character for the file
+		std::size_t pos = line.size();
+		const auto back = [&line, &pos](const char ch) noexcept {
+			if (pos > 0 && line[pos - 1] == ch) {
+				--pos;
+				return true;
+			}
+			return false;
+		};
+		const auto backWhile = [&line, &pos](bool (*const predicate)(char) noexcept) noexcept {
+			const std::size_t end = pos;
+			while (pos > 0 && predicate(line[pos - 1])) {
+				--pos;
+			}
+			return pos != end;
+		};
+		if (back(')') && backWhile(&IsWord) && back('(') && back(' ') && back(')') && backWhile(&IsDigit) && back('(') && pos > 0) {
+			return true;
+		}
+		m_pos = start + pos;
+		return false;
+	}
+
+	/// @brief Record an error at the current position.
+	/// @param result The result to update.
+	/// @param error The description of the error.
+	/// @return @p result.
+	LogLine& Fail(LogLine& result, const char* const error) const noexcept {
+		result.error = error;
+		result.errorOffset = m_pos;
+		return result;
+	}
+
+private:
+	const std::string_view m_text;  ///< @brief The text.
+	std::size_t m_pos = 0;          ///< @brief The current position.
+};
+
+}  // namespace
+
+LogLine ParseLogLine(const std::string_view text) noexcept {
+	return Parser(text).Parse();
+}
+
+std::string_view NextCause(std::string_view& causes) noexcept {
+	if (!causes.starts_with(kCausedBy)) {
+		causes = {};
+		return {};
+	}
+	const std::size_t end = causes.find('\n');
+	const std::string_view message = causes.substr(kCausedBy.size(), end - kCausedBy.size());
+	// skip the location
+	const std::size_t next = causes.find('\n', end + 1);
+	causes = next == std::string_view::npos ? std::string_view() : causes.substr(next + 1);
+	return message;
+}
+
+}  // namespace m4t::internal
@@ -18,106 +18,618 @@ limitations under the License.
 
 #include "m4t/LogListener.h"
 
-#include "m4t/m4t.h"
+#include "m4t/EventArena.h"
+#include "m4t/EventExpectations.h"
+#include "m4t/EventFilter.h"
+#include "m4t/LogLine.h"
+#include "m4t/MpmcRing.h"
+#include "m4t/SharedEventRing.h"
+#include "m4t/TraceRecorder.h"
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include <windows.h>
-#include <detours_gmock.h>
+#include <detours.h>
 #include <evntprov.h>
 
 #include <algorithm>
-#include <regex>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <stdexcept>
-#include <type_traits>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace m4t {
 
 namespace t = testing;
 
-#undef WIN32_FUNCTIONS
-#define WIN32_FUNCTIONS(fn_)                                                                                                                                                                         \
-	fn_(1, void, WINAPI, OutputDebugStringA,                                                                                                                                                         \
-	    (LPCSTR lpOutputString),                                                                                                                                                                     \
-	    (lpOutputString),                                                                                                                                                                            \
-	    nullptr);                                                                                                                                                                                    \
-	fn_(8, ULONG, __stdcall, EventWriteEx,                                                                                                                                                           \
-	    (REGHANDLE RegHandle, PCEVENT_DESCRIPTOR EventDescriptor, ULONG64 Filter, ULONG Flags, LPCGUID ActivityId, LPCGUID RelatedActivityId, ULONG UserDataCount, PEVENT_DATA_DESCRIPTOR UserData), \
-	    (RegHandle, EventDescriptor, Filter, Flags, ActivityId, RelatedActivityId, UserDataCount, UserData),                                                                                         \
-	    nullptr)
+namespace {
 
-class LogListener::Impl {
-public:
-	auto& GetMock() noexcept {
-		return m_win32;
+/// @brief The innermost listener of the current thread.
+constinit thread_local const LogListener* t_listener = nullptr;
+
+/// @brief A copy of an intercepted call in mode `LogListenerMode::kDeferred`.
+struct DeferredRecord {
+	std::string debug;                        ///< @brief The output of `OutputDebugStringA`, empty for events.
+	EVENT_DESCRIPTOR descriptor;              ///< @brief The event descriptor.
+	std::vector<EVENT_DATA_DESCRIPTOR> args;  ///< @brief The user arguments pointing into @p payload.
+	std::unique_ptr<std::byte[]> payload;     ///< @brief The copy of the data of all user arguments.
+};
+
+void CallDebug(const LogListener& listener, const std::string& level, std::string_view& causes) {
+	// call in reverse order (i.e. same order as Event)
+	const std::string_view cause = internal::NextCause(causes);
+	if (!cause.empty()) {
+		CallDebug(listener, level, causes);
+		listener.Debug(level, std::string(cause));
 	}
+}
 
-public:
-	DTGM_API_MOCK(m_win32, WIN32_FUNCTIONS);
+/// @brief A copy of a call which is passed to the real function on a background thread.
+struct ForwardRecord {
+	bool event;                               ///< @brief `true` for `EventWriteEx`, `false` for `OutputDebugStringA`.
+	std::string debug;                        ///< @brief The output of `OutputDebugStringA`, empty for events.
+	REGHANDLE regHandle;                      ///< @brief The registration handle of the provider.
+	EVENT_DESCRIPTOR descriptor;              ///< @brief The event descriptor.
+	ULONG64 filter;                           ///< @brief The filter for the sessions.
+	ULONG flags;                              ///< @brief The flags.
+	std::optional<GUID> activityId;           ///< @brief The activity id.
+	std::optional<GUID> relatedActivityId;    ///< @brief The related activity id.
+	std::vector<EVENT_DATA_DESCRIPTOR> args;  ///< @brief All arguments pointing into @p payload.
+	std::unique_ptr<std::byte[]> payload;     ///< @brief The copy of the data of all arguments.
 };
 
-namespace {
+/// @brief Copy the data of event arguments.
+/// @param count The number of arguments.
+/// @param userData The arguments.
+/// @param args Receives descriptors pointing into the result.
+/// @return The copy of the data of all arguments.
+std::unique_ptr<std::byte[]> CopyUserData(const std::uint32_t count, const EVENT_DATA_DESCRIPTOR* const userData, std::vector<EVENT_DATA_DESCRIPTOR>& args) {
+	std::size_t size = 0;
+	for (std::uint32_t i = 0; i < count; ++i) {
+		size += userData[i].Size;
+	}
+	std::unique_ptr<std::byte[]> payload = std::make_unique_for_overwrite<std::byte[]>(size);
+	args.resize(count);
+	std::size_t offset = 0;
+	for (std::uint32_t i = 0; i < count; ++i) {
+		std::byte* const data = &payload[offset];
+		std::memcpy(data, reinterpret_cast<const void*>(userData[i].Ptr), userData[i].Size);  // NOLINT(performance-no-int-to-ptr): API provides pointer as integer value.
+		EventDataDescCreate(&args[i], data, userData[i].Size);
+		offset += userData[i].Size;
+	}
+	return payload;
+}
 
-const std::regex& GetLineRegex() {
-	static const std::regex kLineRegex("^\\[(.+?)\\] \\[\\d+\\] (.+)\n\tat .+\\(\\d+\\) \\(\\w+\\)\n((?:\tcaused by: .+\n\t\tat .+\\(\\d+\\) \\(\\w+\\)\n)*)$", std::regex_constants::optimize);
-	return kLineRegex;
+/// @brief Get the activity id of a call.
+/// @param activityId The activity id passed to the function or `nullptr` for using the activity id of the thread.
+/// @param buffer A buffer for the activity id of the thread.
+/// @return The bytes of the activity id or an empty span if the thread has no activity id.
+std::span<const std::byte> GetActivityId(const GUID* const activityId, GUID& buffer) noexcept {
+	if (activityId) {
+		return std::as_bytes(std::span(activityId, 1));
+	}
+	if (EventActivityIdControl(EVENT_ACTIVITY_CTRL_GET_ID, &buffer) != ERROR_SUCCESS) {
+		return {};
+	}
+	return std::as_bytes(std::span(&buffer, 1));
 }
 
-const std::regex& GetCauseRegex() {
-	static const std::regex kCauseRegex("^\tcaused by: (.+)\n\t\tat .+\\(\\d+\\) \\(\\w+\\)\n", std::regex_constants::optimize);
-	return kCauseRegex;
+/// @brief Call the mock methods for the output of `OutputDebugStringA`.
+/// @param listener The listener.
+/// @param line The valid parsed output.
+void DispatchDebug(const LogListener& listener, const internal::LogLine& line) {
+	const std::string level(line.level);
+	std::string_view causes = line.causes;
+	CallDebug(listener, level, causes);
+	listener.Debug(level, std::string(line.message));
 }
 
-void CallDebug(LogListener& listener, const std::string& level, std::sregex_token_iterator& it) {
-	// call in reverse order (i.e. same order as Event, first match is whole string, second is level (-> ignore)
-	if (it != std::sregex_token_iterator()) {
-		const std::string str = it->str();
-		CallDebug(listener, level, ++it);
-		listener.Debug(level, str);
+/// @brief Call the mock methods for an event.
+/// @param listener The listener.
+/// @param expectations The table of expected events which is checked first.
+/// @param typed The handler for the event id or `nullptr` for calling `Event` and `EventArg`.
+/// @param descriptor The event descriptor.
+/// @param argCount The number of user arguments.
+/// @param userData The user arguments.
+void DispatchEvent(const LogListener& listener, EventExpectations& expectations, internal::TypedEventHandler* const typed, const EVENT_DESCRIPTOR& descriptor, const std::uint32_t argCount, const EVENT_DATA_DESCRIPTOR* const userData) {
+	if (expectations.Add(descriptor.Id, argCount, [userData](const std::uint32_t index) noexcept {
+		    return internal::GetEventArg(userData, index);
+	    })) {
+		return;
+	}
+	if (typed) {
+		typed->Dispatch(argCount, userData);
+		return;
+	}
+	listener.Event(descriptor.Id, descriptor.Level, descriptor.Keyword, argCount);
+	for (std::uint32_t i = 0; i < argCount; ++i) {
+		listener.EventArg(i, userData[i].Size, reinterpret_cast<const void*>(userData[i].Ptr));  // NOLINT(performance-no-int-to-ptr): API provides pointer as integer value.
 	}
 }
 
-LogListenerMode operator&(const LogListenerMode lhs, const LogListenerMode rhs) {
-	return static_cast<LogListenerMode>(static_cast<std::underlying_type_t<LogListenerMode>>(lhs) & static_cast<std::underlying_type_t<LogListenerMode>>(rhs));
+}  // namespace
+
+class LogListener::Impl {
+public:
+	Impl(const LogListenerMode mode, const OverflowPolicy overflow, const std::size_t capacity)
+	    : m_ring((mode & LogListenerMode::kDeferred) == LogListenerMode::kDeferred ? std::make_unique<internal::MpmcRing<DeferredRecord>>(capacity, overflow) : nullptr)
+	    , m_statistics((mode & LogListenerMode::kCount) == LogListenerMode::kCount ? std::make_unique<EventStatistics>() : nullptr)
+	    , m_capture((mode & LogListenerMode::kCapture) == LogListenerMode::kCapture) {
+		// empty
+	}
+
+public:
+	auto& GetArena() noexcept {
+		return m_arena;
+	}
+
+	auto& GetExpectations() noexcept {
+		return m_expectations;
+	}
+
+	auto& GetFilter() noexcept {
+		return m_filter;
+	}
+
+	/// @brief Register the handler for an event id.
+	/// @param eventId The event id.
+	/// @param handler The handler.
+	/// @throws std::invalid_argument if a handler for the event id already exists.
+	void AddTypedEventHandler(const std::uint16_t eventId, std::unique_ptr<internal::TypedEventHandler> handler) {
+		if (!m_typed.try_emplace(eventId, std::move(handler)).second) {
+			throw std::invalid_argument("event id already has a schema");
+		}
+	}
+
+	/// @brief Get the handler for an event id.
+	/// @param eventId The event id.
+	/// @return The handler or `nullptr` if no schema exists for the event id.
+	[[nodiscard]] internal::TypedEventHandler* FindTypedEventHandler(const std::uint16_t eventId) const noexcept {
+		if (m_typed.empty()) {
+			[[likely]];
+			return nullptr;
+		}
+		const auto it = m_typed.find(eventId);
+		return it == m_typed.end() ? nullptr : it->second.get();
+	}
+
+	[[nodiscard]] ForwardPolicy GetForwardPolicy() const noexcept {
+		return m_forwardPolicy;
+	}
+
+	void SetForwardPolicy(const ForwardPolicy policy) noexcept {
+		m_forwardPolicy = policy;
+	}
+
+	[[nodiscard]] TraceRecorder* GetTraceRecorder() const noexcept {
+		return m_recorder;
+	}
+
+	void SetTraceRecorder(TraceRecorder* const recorder) noexcept {
+		m_recorder = recorder;
+	}
+
+	/// @brief Get the counters.
+	/// @return The counters or `nullptr` if not in mode `LogListenerMode::kCount`.
+	[[nodiscard]] EventStatistics* GetStatistics() const noexcept {
+		return m_statistics.get();
+	}
+
+	[[nodiscard]] bool IsCapture() const noexcept {
+		return m_capture;
+	}
+
+	[[nodiscard]] bool IsDeferred() const noexcept {
+		return m_ring != nullptr;
+	}
+
+	/// @brief Add a record to the ring buffer.
+	/// @param listener The listener for calling the mock methods if the ring buffer is full.
+	/// @param record The record.
+	void Defer(const LogListener& listener, DeferredRecord& record) {
+		while (!m_ring->Push(record)) {
+			if (m_ring->GetPolicy() == OverflowPolicy::kDrop) {
+				return;
+			}
+			// make room by processing the records in the context of the producer
+			Flush(listener);
+			std::this_thread::yield();
+		}
+	}
+
+	/// @brief Call the mock methods for all records in the ring buffer.
+	/// @param listener The listener.
+	void Flush(const LogListener& listener) {
+		if (!m_ring) {
+			return;
+		}
+		// keep the order of the records, the lock is recursive because a mock action might log on the same thread and
+		// then flush in `Defer` if the ring buffer is full
+		const std::scoped_lock lock(m_flushMutex);
+		for (std::optional<DeferredRecord> record = m_ring->Pop(); record; record = m_ring->Pop()) {
+			if (record->debug.empty()) {
+				DispatchEvent(listener, m_expectations, FindTypedEventHandler(record->descriptor.Id), record->descriptor, static_cast<std::uint32_t>(record->args.size()), record->args.data());
+			} else {
+				DispatchDebug(listener, internal::ParseLogLine(record->debug));
+			}
+		}
+	}
+
+	[[nodiscard]] std::size_t GetDroppedCount() const noexcept {
+		return m_ring ? m_ring->GetDroppedCount() : 0;
+	}
+
+private:
+	EventFilter m_filter;                                                                     ///< @brief The filter for events.
+	std::unordered_map<std::uint16_t, std::unique_ptr<internal::TypedEventHandler>> m_typed;  ///< @brief The handlers for events with a schema.
+	EventExpectations m_expectations;                                                         ///< @brief The table of expected events.
+	EventArena m_arena;                                                                       ///< @brief The events captured in mode `LogListenerMode::kCapture`.
+	std::unique_ptr<internal::MpmcRing<DeferredRecord>> m_ring;                               ///< @brief The records in mode `LogListenerMode::kDeferred`.
+	std::unique_ptr<EventStatistics> m_statistics;                                            ///< @brief The counters in mode `LogListenerMode::kCount`.
+	ForwardPolicy m_forwardPolicy = ForwardPolicy::kSync;                                     ///< @brief The policy for calling the real functions.
+	TraceRecorder* m_recorder = nullptr;                                                      ///< @brief The optional recorder for a timeline.
+	std::recursive_mutex m_flushMutex;                                                        ///< @brief Serializes calling the mock methods for the records.
+	bool m_capture;                                                                           ///< @brief `true` in mode `LogListenerMode::kCapture`.
+};
+
+namespace internal {
+
+/// @brief The hooks for `OutputDebugStringA` and `EventWriteEx` which are installed once per process.
+/// @details Each intercepted call is passed to the innermost listener of the calling thread. Calls on threads without
+/// a listener are forwarded to the real functions unchanged. The functions are detoured directly instead of using a
+/// mock object because gmock serializes all calls of mock methods using a global mutex.
+class LogListenerHooks {
+private:
+	LogListenerHooks() {
+		LONG error = DetourTransactionBegin();
+		if (error != NO_ERROR) {
+			throw std::system_error(static_cast<int>(error), std::system_category(), "DetourTransactionBegin");
+		}
+		error = DetourUpdateThread(GetCurrentThread());
+		if (error == NO_ERROR) {
+			error = DetourAttach(reinterpret_cast<PVOID*>(&m_outputDebugStringA), reinterpret_cast<PVOID>(&HookOutputDebugStringA));
+		}
+		if (error == NO_ERROR) {
+			error = DetourAttach(reinterpret_cast<PVOID*>(&m_eventWriteEx), reinterpret_cast<PVOID>(&HookEventWriteEx));
+		}
+		if (error != NO_ERROR) {
+			DetourTransactionAbort();
+			throw std::system_error(static_cast<int>(error), std::system_category(), "DetourAttach");
+		}
+		error = DetourTransactionCommit();
+		if (error != NO_ERROR) {
+			throw std::system_error(static_cast<int>(error), std::system_category(), "DetourTransactionCommit");
+		}
+	}
+
+public:
+	LogListenerHooks(const LogListenerHooks&) = delete;
+	LogListenerHooks(LogListenerHooks&&) = delete;
+	~LogListenerHooks() noexcept = default;
+
+public:
+	LogListenerHooks& operator=(const LogListenerHooks&) = delete;
+	LogListenerHooks& operator=(LogListenerHooks&&) = delete;
+
+public:
+	/// @brief Get the hooks, installing them when called for the first time.
+	/// @details The hooks are never removed because calls might happen on any thread at any time.
+	/// @return The hooks.
+	static LogListenerHooks& GetInstance() {
+		static LogListenerHooks* const kInstance = new LogListenerHooks();
+		return *kInstance;
+	}
+
+	/// @brief Wait until all calls added using `ForwardPolicy::kBatch` have been passed to the real functions.
+	void WaitForForwarding() {
+		std::unique_lock lock(m_forwardMutex);
+		m_forwardIdle.wait(lock, [this]() noexcept {
+			return m_forwardQueue.empty() && !m_forwarding;
+		});
+	}
+
+	/// @brief Write all calls on threads without a listener to the ring buffer of a parent process.
+	/// @param writer The writer which is never destroyed.
+	void SetWriter(std::unique_ptr<SharedEventWriter> writer) noexcept {
+		// keep any previous writer because other threads might still be using it
+		m_writer.store(writer.release(), std::memory_order_release);
+	}
+
+private:
+	/// @brief The detour of `OutputDebugStringA`.
+	/// @param lpOutputString The output.
+	static void WINAPI HookOutputDebugStringA(const LPCSTR lpOutputString) {
+		LogListenerHooks& hooks = GetInstance();
+		if (const LogListener* const listener = t_listener; listener) {
+			OnOutputDebugStringA(*listener, lpOutputString);
+			switch (listener->m_impl->GetForwardPolicy()) {
+			case ForwardPolicy::kSync:
+				break;
+			case ForwardPolicy::kDrop:
+				return;
+			case ForwardPolicy::kBatch:
+				hooks.Enqueue(ForwardRecord{.event = false, .debug = lpOutputString ? lpOutputString : "", .regHandle = 0, .descriptor = {}, .filter = 0, .flags = 0, .activityId = {}, .relatedActivityId = {}, .args = {}, .payload = nullptr});
+				return;
+			}
+		} else if (SharedEventWriter* const writer = hooks.m_writer.load(std::memory_order_acquire); writer && lpOutputString) {
+			writer->WriteDebug(lpOutputString);
+		}
+		hooks.m_outputDebugStringA(lpOutputString);
+	}
+
+	/// @brief The detour of `EventWriteEx`.
+	/// @param regHandle The registration handle of the provider.
+	/// @param eventDescriptor The event descriptor.
+	/// @param filter The filter for the sessions.
+	/// @param flags The flags.
+	/// @param activityId The activity id or `nullptr` for the activity id of the thread.
+	/// @param relatedActivityId The related activity id or `nullptr`.
+	/// @param userDataCount The number of arguments including file name and line.
+	/// @param userData The arguments.
+	/// @return The result of the real function or `ERROR_SUCCESS` if the call is not forwarded synchronously.
+	static ULONG __stdcall HookEventWriteEx(const REGHANDLE regHandle, const EVENT_DESCRIPTOR* const eventDescriptor, const ULONG64 filter, const ULONG flags, const GUID* const activityId, const GUID* const relatedActivityId, const ULONG userDataCount, EVENT_DATA_DESCRIPTOR* const userData) {
+		LogListenerHooks& hooks = GetInstance();
+		if (const LogListener* const listener = t_listener; listener) {
+			OnEventWriteEx(*listener, eventDescriptor, activityId, userDataCount, userData);
+			switch (listener->m_impl->GetForwardPolicy()) {
+			case ForwardPolicy::kSync:
+				break;
+			case ForwardPolicy::kDrop:
+				return static_cast<ULONG>(ERROR_SUCCESS);
+			case ForwardPolicy::kBatch: {
+				ForwardRecord record{.event = true, .debug = {}, .regHandle = regHandle, .descriptor = *eventDescriptor, .filter = filter, .flags = flags, .activityId = activityId ? std::optional(*activityId) : std::nullopt, .relatedActivityId = relatedActivityId ? std::optional(*relatedActivityId) : std::nullopt, .args = {}, .payload = nullptr};
+				record.payload = CopyUserData(userDataCount, userData, record.args);
+				hooks.Enqueue(std::move(record));
+				return static_cast<ULONG>(ERROR_SUCCESS);
+			}
+			}
+		} else if (SharedEventWriter* const writer = hooks.m_writer.load(std::memory_order_acquire); writer) {
+			// ignore file name and line which are added by m3c::Log automatically
+			writer->WriteEvent(eventDescriptor->Id, eventDescriptor->Level, eventDescriptor->Keyword, std::max<std::uint32_t>(userDataCount, 2) - 2, [userData](const std::uint32_t index) noexcept {
+				return GetEventArg(userData, index);
+			});
+		}
+		return hooks.m_eventWriteEx(regHandle, eventDescriptor, filter, flags, activityId, relatedActivityId, userDataCount, userData);
+	}
+
+	/// @brief Add a call for passing it to the real function on the background thread.
+	/// @param record The copy of the call.
+	void Enqueue(ForwardRecord&& record) {
+		{
+			const std::scoped_lock lock(m_forwardMutex);
+			if (!m_forwardThread.joinable()) {
+				[[unlikely]];
+				m_forwardThread = std::thread(&LogListenerHooks::Forward, this);
+			}
+			m_forwardQueue.push_back(std::move(record));
+		}
+		m_forwardReady.notify_one();
+	}
+
+	/// @brief Pass all queued calls to the real functions in batches, never returns.
+	void Forward() {
+		std::vector<ForwardRecord> batch;
+		std::unique_lock lock(m_forwardMutex);
+		while (true) {
+			m_forwardReady.wait(lock, [this]() noexcept {
+				return !m_forwardQueue.empty();
+			});
+			batch.swap(m_forwardQueue);
+			m_forwarding = true;
+			lock.unlock();
+			for (ForwardRecord& record : batch) {
+				if (record.event) {
+					m_eventWriteEx(record.regHandle, &record.descriptor, record.filter, record.flags, record.activityId ? &*record.activityId : nullptr, record.relatedActivityId ? &*record.relatedActivityId : nullptr, static_cast<ULONG>(record.args.size()), record.args.data());
+				} else {
+					m_outputDebugStringA(record.debug.c_str());
+				}
+			}
+			batch.clear();
+			lock.lock();
+			m_forwarding = false;
+			m_forwardIdle.notify_all();
+		}
+	}
+
+	/// @brief Process the output of `OutputDebugStringA` for a listener.
+	/// @param listener The listener.
+	/// @param lpOutputString The output.
+	static void OnOutputDebugStringA(const LogListener& listener, const LPCSTR lpOutputString) {
+		// other output which is not written by m3c::Log is passed on unchanged
+		if (const LogLine line = ParseLogLine(lpOutputString ? lpOutputString : ""); line.IsValid()) {
+			LogListener::Impl& impl = *listener.m_impl;
+			if (TraceRecorder* const recorder = impl.GetTraceRecorder(); recorder) {
+				GUID activityId;
+				recorder->AddDebug(line.level, line.message, GetCurrentThreadId(), GetActivityId(nullptr, activityId));
+			}
+			if (EventStatistics* const statistics = impl.GetStatistics(); statistics) {
+				statistics->AddDebug(line.level);
+			} else if (impl.IsDeferred()) {
+				DeferredRecord record{.debug = lpOutputString, .descriptor = {}, .args = {}, .payload = nullptr};
+				impl.Defer(listener, record);
+			} else {
+				DispatchDebug(listener, line);
+			}
+		}
+	}
+
+	/// @brief Process an event for a listener.
+	/// @param listener The listener.
+	/// @param eventDescriptor The event descriptor.
+	/// @param activityId The activity id or `nullptr` for the activity id of the thread.
+	/// @param userDataCount The number of arguments including file name and line.
+	/// @param userData The arguments.
+	static void OnEventWriteEx(const LogListener& listener, const EVENT_DESCRIPTOR* const eventDescriptor, const GUID* const activityId, const ULONG userDataCount, const EVENT_DATA_DESCRIPTOR* const userData) {
+		LogListener::Impl& impl = *listener.m_impl;
+		if (!impl.GetFilter().Matches(eventDescriptor->Id, eventDescriptor->Level, eventDescriptor->Keyword)) {
+			return;
+		}
+		if (TraceRecorder* const recorder = impl.GetTraceRecorder(); recorder) {
+			GUID buffer;
+			recorder->AddEvent(eventDescriptor->Id, eventDescriptor->Level, eventDescriptor->Keyword, GetCurrentThreadId(), GetActivityId(activityId, buffer));
+		}
+		// ignore file name and line which are added by m3c::Log automatically
+		const std::uint32_t userArgCount = std::max<std::uint32_t>(userDataCount, 2) - 2;
+		if (EventStatistics* const statistics = impl.GetStatistics(); statistics) {
+			statistics->AddEvent(eventDescriptor->Id);
+		} else if (impl.IsDeferred()) {
+			std::vector<EVENT_DATA_DESCRIPTOR> args;
+			std::unique_ptr<std::byte[]> payload = CopyUserData(userArgCount, userData, args);
+			DeferredRecord record{.debug = {}, .descriptor = *eventDescriptor, .args = std::move(args), .payload = std::move(payload)};
+			impl.Defer(listener, record);
+		} else {
+			DispatchEvent(listener, impl.GetExpectations(), impl.FindTypedEventHandler(eventDescriptor->Id), *eventDescriptor, userArgCount, userData);
+		}
+		if (impl.IsCapture()) {
+			impl.GetArena().Add(eventDescriptor->Id, eventDescriptor->Level, eventDescriptor->Keyword, userArgCount, [userData](const std::uint32_t index) noexcept {
+				return GetEventArg(userData, index);
+			});
+		}
+	}
+
+private:
+	std::atomic<SharedEventWriter*> m_writer = nullptr;                            ///< @brief The writer for calls on threads without a listener.
+	std::vector<ForwardRecord> m_forwardQueue;                                     ///< @brief The calls waiting for the background thread.
+	std::mutex m_forwardMutex;                                                     ///< @brief Protects @p m_forwardQueue and @p m_forwarding.
+	std::condition_variable m_forwardReady;                                        ///< @brief Signals new calls in @p m_forwardQueue.
+	std::condition_variable m_forwardIdle;                                         ///< @brief Signals that the background thread has finished a batch.
+	std::thread m_forwardThread;                                                   ///< @brief The background thread, started on first use.
+	bool m_forwarding = false;                                                     ///< @brief `true` while the background thread calls the real functions.
+	decltype(&::OutputDebugStringA) m_outputDebugStringA = &::OutputDebugStringA;  ///< @brief The trampoline for calling the real function.
+	decltype(&::EventWriteEx) m_eventWriteEx = &::EventWriteEx;                    ///< @brief The trampoline for calling the real function.
+};
+
+}  // namespace internal
+
+//
+// LogListener::ThreadScope
+//
+
+LogListener::ThreadScope::ThreadScope(const LogListener& listener) noexcept
+    : m_listener(listener)
+    , m_previous(std::exchange(t_listener, &listener)) {
+	// empty
 }
 
-}  // namespace
+LogListener::ThreadScope::~ThreadScope() noexcept {
+	assert(t_listener == &m_listener);
+	t_listener = m_previous;
+}
 
+//
+// LogListener
+//
 
-LogListener::LogListener(const LogListenerMode mode)
-    : m_impl(std::make_unique<Impl>()) {
-	ON_CALL(m_impl->GetMock(), OutputDebugStringA(m4t::MatchesRegex(GetLineRegex())))
-	    .WillByDefault(t::Invoke([this](const LPCSTR lpOutputString) {
-		    std::cmatch match;
-		    if (!std::regex_match(lpOutputString, match, GetLineRegex())) {
-			    throw std::invalid_argument("regex mismatch");
-		    }
-		    const std::string level = match.str(1);
-		    const std::string cause = match.str(3);
-		    std::sregex_token_iterator it = std::sregex_token_iterator(cause.cbegin(), cause.cend(), GetCauseRegex(), 1);
-		    CallDebug(*this, level, it);
-		    Debug(level, match.str(2));
-		    return m_impl->GetMock().DTGM_Real_OutputDebugStringA(lpOutputString);
-	    }));
-
-	ON_CALL(m_impl->GetMock(), EventWriteEx)
-	    .WillByDefault(t::Invoke([this](const REGHANDLE regHandle, const EVENT_DESCRIPTOR* const eventDescriptor, const ULONG64 filter, const ULONG flags, const GUID* activityId, const GUID* const relatedActivityId, const ULONG userDataCount, EVENT_DATA_DESCRIPTOR* const userData) {
-		    // ignore file name and line which are added by m3c::Log automatically
-		    const std::uint32_t userArgCount = std::max<std::uint32_t>(userDataCount, 2) - 2;
-		    Event(eventDescriptor->Id, eventDescriptor->Level, eventDescriptor->Keyword, userArgCount);
-		    for (std::uint32_t i = 0; i < userArgCount; ++i) {
-			    EventArg(i, userData[i].Size, reinterpret_cast<const void*>(userData[i].Ptr));  // NOLINT(performance-no-int-to-ptr): API provides pointer as integer value.
-		    }
-		    return m_impl->GetMock().DTGM_Real_EventWriteEx(regHandle, eventDescriptor, filter, flags, activityId, relatedActivityId, userDataCount, userData);
-	    }));
+LogListener::LogListener(const LogListenerMode mode, const OverflowPolicy overflow, const std::size_t capacity)
+    : m_impl(std::make_unique<Impl>(mode, overflow, capacity))
+    , m_scope(*this) {
+	internal::LogListenerHooks::GetInstance();
 
 	EXPECT_CALL(*this, Debug).Times((mode & LogListenerMode::kStrictDebug) == LogListenerMode::kStrictDebug ? t::Exactly(0) : t::AnyNumber());
 	EXPECT_CALL(*this, Event).Times((mode & LogListenerMode::kStrictEvent) == LogListenerMode::kStrictEvent ? t::Exactly(0) : t::AnyNumber());
+	EXPECT_CALL(*this, ProcessDebug).Times((mode & LogListenerMode::kStrictDebug) == LogListenerMode::kStrictDebug ? t::Exactly(0) : t::AnyNumber());
+	EXPECT_CALL(*this, ProcessEvent).Times((mode & LogListenerMode::kStrictEvent) == LogListenerMode::kStrictEvent ? t::Exactly(0) : t::AnyNumber());
 	EXPECT_CALL(*this, EventArg).Times(t::AnyNumber());  // calls are always allowed
 }
 
-// required to delete std::unique_ptr with incomplete type
-LogListener::~LogListener() = default;
+LogListener::~LogListener() {
+	// call the mock methods before the expectations are verified
+	try {
+		Flush();
+		EXPECT_TRUE(m_impl->GetExpectations().Verify());
+		if (m_impl->GetForwardPolicy() == ForwardPolicy::kBatch) {
+			internal::LogListenerHooks::GetInstance().WaitForForwarding();
+		}
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+EventExpectations& LogListener::ExpectEvents() noexcept {
+	return m_impl->GetExpectations();
+}
+
+const EventArena& LogListener::GetCapturedEvents() const noexcept {
+	return m_impl->GetArena();
+}
+
+void LogListener::AddTypedEventHandler(const std::uint16_t eventId, std::unique_ptr<internal::TypedEventHandler> handler) {
+	m_impl->AddTypedEventHandler(eventId, std::move(handler));
+}
+
+internal::TypedEventHandler* LogListener::FindTypedEventHandler(const std::uint16_t eventId) const noexcept {
+	return m_impl->FindTypedEventHandler(eventId);
+}
+
+void LogListener::SetEventFilter(const EventFilter& filter) noexcept {
+	m_impl->GetFilter() = filter;
+}
+
+void LogListener::SetForwardPolicy(const ForwardPolicy policy) noexcept {
+	m_impl->SetForwardPolicy(policy);
+}
+
+void LogListener::SetTraceRecorder(TraceRecorder* const recorder) noexcept {
+	m_impl->SetTraceRecorder(recorder);
+}
+
+void LogListener::ClearCapturedEvents() noexcept {
+	m_impl->GetArena().Reset();
+}
+
+void LogListener::Flush() const {
+	m_impl->Flush(*this);
+}
+
+std::size_t LogListener::GetDroppedCount() const noexcept {
+	return m_impl->GetDroppedCount();
+}
+
+void LogListener::Receive(SharedEventCollector& collector) const {
+	for (std::optional<SharedEventRecord> record = collector.Pop(); record; record = collector.Pop()) {
+		if (record->GetType() == SharedRecordType::kDebug) {
+			const std::string level(record->GetString(0));
+			for (std::uint32_t i = 1; i < record->GetArgCount(); ++i) {
+				ProcessDebug(record->GetProcessId(), level, std::string(record->GetString(i)));
+			}
+		} else {
+			ProcessEvent(record->GetProcessId(), record->GetEventId(), record->GetLevel(), record->GetKeyword(), record->GetArgCount());
+			for (std::uint32_t i = 0; i < record->GetArgCount(); ++i) {
+				const std::span<const std::byte> arg = record->GetArg(i);
+				EventArg(i, static_cast<ULONG>(arg.size()), arg.data());
+			}
+		}
+	}
+}
+
+EventStatisticsSnapshot LogListener::GetStatistics() const {
+	const EventStatistics* const statistics = m_impl->GetStatistics();
+	return statistics ? statistics->GetSnapshot() : EventStatisticsSnapshot();
+}
+
+bool ForwardLogToParent() {
+	std::unique_ptr<SharedEventWriter> writer = SharedEventWriter::FromEnvironment();
+	if (!writer) {
+		return false;
+	}
+	internal::LogListenerHooks::GetInstance().SetWriter(std::move(writer));
+	return true;
+}
 
 }  // namespace m4t
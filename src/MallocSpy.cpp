@@ -18,15 +18,50 @@ limitations under the License.
 
 #include "m4t/MallocSpy.h"
 
+#include "m4t/AllocationTrace.h"
+#include "m4t/AllocationTracker.h"
+#include "m4t/DeletedHistory.h"
+#include "m4t/FaultInjector.h"
+
 #include <unknwn.h>
 
+#include <atomic>
 #include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
 #include <mutex>
-#include <shared_mutex>
-#include <unordered_set>
+#include <optional>
+#include <string>
+#include <vector>
 
 namespace m4t {
 
+namespace {
+
+/// @brief The size passed to `PreAlloc` or `PreRealloc` for use in the matching `PostAlloc` or `PostRealloc`.
+/// @details COM calls the pre and post methods on the same thread.
+thread_local std::size_t t_requestSize = 0;
+
+}  // namespace
+
+MallocSpy::MallocSpy()
+    : MallocSpy(kDefaultDeletedHistoryBytes) {
+	// empty
+}
+
+MallocSpy::MallocSpy(const std::size_t maxDeletedHistoryBytes)
+    : MallocSpy(TrackingMode::kImmediate, maxDeletedHistoryBytes) {
+	// empty
+}
+
+MallocSpy::MallocSpy(const TrackingMode mode, const std::size_t maxDeletedHistoryBytes)
+    : m_tracker(mode, maxDeletedHistoryBytes) {
+	// empty
+}
+
+
 //
 // IUnknown
 //
@@ -65,30 +100,24 @@ ULONG MallocSpy::Release() noexcept {
 //
 
 SIZE_T __stdcall MallocSpy::PreAlloc(_In_ const SIZE_T cbRequest) noexcept {
+	if (m_faultInjector.ShouldFail(cbRequest)) {
+		[[unlikely]];
+		return 0;
+	}
+	t_requestSize = cbRequest;
 	return cbRequest;
 }
 
 void* __stdcall MallocSpy::PostAlloc(_In_ void* const pActual) noexcept {
-	try {
-		const std::scoped_lock lock(m_mutex);
-		m_allocated.insert(pActual);
-	} catch (...) {
-		// ignore, but assert
-		assert(false);
-	}
+	m_tracker.Allocated(pActual, t_requestSize);
+	Trace(TraceOperation::kAllocated, pActual, t_requestSize);
 
 	return pActual;
 }
 
 void* __stdcall MallocSpy::PreFree(_In_ void* const pRequest, _In_ const BOOL /* fSpyed */) noexcept {
-	try {
-		const std::scoped_lock lock(m_mutex);
-		m_allocated.erase(pRequest);
-		m_deleted.insert(pRequest);
-	} catch (...) {
-		// ignore, but assert
-		assert(false);
-	}
+	m_tracker.Deleted(pRequest);
+	Trace(TraceOperation::kDeleted, pRequest, 0);
 
 	return pRequest;
 }
@@ -98,14 +127,9 @@ void __stdcall MallocSpy::PostFree(_In_ const BOOL /* fSpyed */) noexcept {
 }
 
 SIZE_T __stdcall MallocSpy::PreRealloc(_In_ void* const pRequest, _In_ const SIZE_T cbRequest, _Outptr_ void** const ppNewRequest, _In_ BOOL /* fSpyed */) noexcept {
-	try {
-		const std::scoped_lock lock(m_mutex);
-		m_allocated.erase(pRequest);
-		m_deleted.insert(pRequest);
-	} catch (...) {
-		// ignore, but assert
-		assert(false);
-	}
+	m_tracker.Deleted(pRequest);
+	Trace(TraceOperation::kDeleted, pRequest, 0);
+	t_requestSize = cbRequest;
 
 	if (ppNewRequest) {
 		[[likely]];
@@ -115,13 +139,8 @@ SIZE_T __stdcall MallocSpy::PreRealloc(_In_ void* const pRequest, _In_ const SIZ
 }
 
 void* __stdcall MallocSpy::PostRealloc(_In_ void* const pActual, _In_ BOOL /* fSpyed */) noexcept {
-	try {
-		const std::scoped_lock lock(m_mutex);
-		m_allocated.insert(pActual);
-	} catch (...) {
-		// ignore, but assert
-		assert(false);
-	}
+	m_tracker.Allocated(pActual, t_requestSize);
+	Trace(TraceOperation::kAllocated, pActual, t_requestSize);
 
 	return pActual;
 }
@@ -150,24 +169,114 @@ void __stdcall MallocSpy::PostHeapMinimize() noexcept {
 	// empty
 }
 
+void MallocSpy::Flush() const {
+	m_tracker.Flush();
+}
+
 bool MallocSpy::IsAllocated(const void* const p) const {
-	const std::shared_lock lock(m_mutex);
-	return m_allocated.contains(p);
+	return m_tracker.IsAllocated(p);
+}
+
+bool MallocSpy::IsDeleted(const void* const p) const {
+	return m_tracker.GetDeletedState(p) != DeletedState::kNotDeleted;
+}
+
+std::optional<AllocatedBlock> MallocSpy::GetAllocation(const void* const p) const {
+	return m_tracker.GetAllocation(p);
+}
+
+bool MallocSpy::IsSameAllocation(const void* const p, const std::uint64_t generation) const {
+	return m_tracker.IsSameAllocation(p, generation);
+}
+
+bool MallocSpy::IsGenerationDeleted(const std::uint64_t generation) const {
+	return m_tracker.IsGenerationDeleted(generation);
 }
 
-bool MallocSpy::IsDeleted(const void* p) const {
-	const std::shared_lock lock(m_mutex);
-	return m_deleted.contains(p);
+DeletedState MallocSpy::GetDeletedState(const void* const p) const {
+	return m_tracker.GetDeletedState(p);
 }
 
 std::size_t MallocSpy::GetAllocatedCount() const {
-	const std::shared_lock lock(m_mutex);
-	return m_allocated.size();
+	return m_tracker.GetAllocatedCount();
 }
 
 std::size_t MallocSpy::GetDeletedCount() const {
-	const std::shared_lock lock(m_mutex);
-	return m_deleted.size();
+	return m_tracker.GetDeletedCount();
+}
+
+AllocationStatistics MallocSpy::GetStatistics() const {
+	return m_tracker.GetStatistics();
+}
+
+void MallocSpy::ResetPeakBytes() {
+	m_tracker.ResetPeakBytes();
+}
+
+void MallocSpy::SetSamplingRate(const std::size_t bytes) noexcept {
+	m_tracker.SetSamplingRate(bytes);
+}
+
+void MallocSpy::SetSampling(const bool enabled) noexcept {
+	m_tracker.SetSampling(enabled);
+}
+
+SamplingEstimate MallocSpy::GetSamplingEstimate() const {
+	return m_tracker.GetSamplingEstimate();
+}
+
+void MallocSpy::FailNthAllocation(const std::size_t index) noexcept {
+	m_faultInjector.FailNth(index);
+}
+
+void MallocSpy::FailAllocationsAbove(const std::size_t size) noexcept {
+	m_faultInjector.FailAbove(size);
+}
+
+void MallocSpy::FailAllocationsRandomly(const double probability, const std::uint64_t seed) noexcept {
+	m_faultInjector.FailRandomly(probability, seed);
+}
+
+void MallocSpy::StopFailingAllocations() noexcept {
+	m_faultInjector.Reset();
+}
+
+std::size_t MallocSpy::GetFailedAllocationCount() const noexcept {
+	return m_faultInjector.GetFailureCount();
+}
+
+AllocationCheckpoint MallocSpy::Checkpoint() {
+	return m_tracker.Checkpoint();
+}
+
+std::vector<AllocatedBlock> MallocSpy::GetAllocatedSince(const AllocationCheckpoint& checkpoint) const {
+	return m_tracker.GetAllocatedSince(checkpoint);
+}
+
+std::string MallocSpy::FormatStack(const std::uint32_t stack) const {
+	return m_tracker.FormatStack(stack);
+}
+
+void MallocSpy::StartTrace(const std::filesystem::path& path) {
+	const std::scoped_lock lock(m_tracesMutex);
+	internal::TraceWriter* const trace = m_traces.emplace_back(std::make_unique<internal::TraceWriter>(path)).get();
+	if (internal::TraceWriter* const previous = m_trace.exchange(trace, std::memory_order_acq_rel); previous) {
+		previous->Close();
+	}
+}
+
+void MallocSpy::StopTrace() {
+	const std::scoped_lock lock(m_tracesMutex);
+	if (internal::TraceWriter* const trace = m_trace.exchange(nullptr, std::memory_order_acq_rel); trace) {
+		trace->Close();
+	}
+}
+
+void MallocSpy::Trace(const TraceOperation operation, const void* const p, const std::size_t size) noexcept {
+	if (internal::TraceWriter* const trace = m_trace.load(std::memory_order_acquire); trace) {
+		[[unlikely]];
+		trace->Write(operation, p, size);
+	}
 }
 
 }  // namespace m4t
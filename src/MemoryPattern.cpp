@@ -0,0 +1,175 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/MemoryPattern.h"
+
+#include <gtest/gtest.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define M4T_SSE2 1
+#endif
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+namespace m4t {
+
+namespace {
+
+#if defined(M4T_SSE2)
+/// @brief The number of bytes compared in one step.
+constexpr std::size_t kVectorSize = sizeof(__m128i);
+
+/// @brief The mask returned by `_mm_movemask_epi8` if all bytes are equal.
+constexpr unsigned kAllEqual = 0xFFFFu;
+
+/// @brief Compare 16 bytes with a pattern.
+/// @param data The bytes, need not be aligned.
+/// @param expected The pattern in all bytes.
+/// @return A mask with one bit per byte which is set if the byte matches.
+unsigned Compare(const unsigned char* const data, const __m128i expected) noexcept {
+	return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), expected)));
+}
+
+/// @brief Check if 64 bytes match a pattern.
+/// @param data The bytes, need not be aligned.
+/// @param expected The pattern in all bytes.
+/// @return `true` if all bytes match.
+bool IsBlockEqual(const unsigned char* const data, const __m128i expected) noexcept {
+	const __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data)), expected);
+	const __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + kVectorSize)), expected);
+	const __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 2 * kVectorSize)), expected);
+	const __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 3 * kVectorSize)), expected);
+	return static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d)))) == kAllEqual;
+}
+#else
+/// @brief The number of bytes compared in one step.
+constexpr std::size_t kVectorSize = sizeof(std::uint64_t);
+
+/// @brief Compare 8 bytes with a pattern.
+/// @param data The bytes, need not be aligned.
+/// @param expected The pattern in all bytes.
+/// @return `true` if all bytes match.
+bool IsWordEqual(const unsigned char* const data, const std::uint64_t expected) noexcept {
+	std::uint64_t value;
+	std::memcpy(&value, data, sizeof(value));
+	return value == expected;
+}
+#endif
+
+/// @brief The number of bytes checked in one iteration of the fast loop.
+constexpr std::size_t kBlockSize = 4 * kVectorSize;
+
+/// @brief Find the first byte which does not match a pattern.
+/// @param data The bytes.
+/// @param size The number of bytes.
+/// @param pattern The pattern.
+/// @return The offset of the first byte or @p size if all bytes match.
+std::size_t FindFirst(const unsigned char* const data, const std::size_t size, const unsigned char pattern) noexcept {
+	std::size_t pos = 0;
+#if defined(M4T_SSE2)
+	const __m128i expected = _mm_set1_epi8(static_cast<char>(pattern));
+	while (pos + kBlockSize <= size && IsBlockEqual(&data[pos], expected)) {
+		pos += kBlockSize;
+	}
+	for (; pos + kVectorSize <= size; pos += kVectorSize) {
+		if (const unsigned mask = Compare(&data[pos], expected); mask != kAllEqual) {
+			return pos + static_cast<std::size_t>(std::countr_one(mask));
+		}
+	}
+#else
+	const std::uint64_t expected = 0x0101010101010101ull * pattern;
+	while (pos + kVectorSize <= size && IsWordEqual(&data[pos], expected)) {
+		pos += kVectorSize;
+	}
+#endif
+	for (; pos < size; ++pos) {
+		if (data[pos] != pattern) {
+			return pos;
+		}
+	}
+	return size;
+}
+
+/// @brief Find the last byte which does not match a pattern.
+/// @param data The bytes.
+/// @param size The number of bytes.
+/// @param pattern The pattern.
+/// @return The offset of the last byte plus one or 0 if all bytes match.
+std::size_t FindLast(const unsigned char* const data, const std::size_t size, const unsigned char pattern) noexcept {
+	std::size_t end = size;
+#if defined(M4T_SSE2)
+	const __m128i expected = _mm_set1_epi8(static_cast<char>(pattern));
+	while (end >= kBlockSize && IsBlockEqual(&data[end - kBlockSize], expected)) {
+		end -= kBlockSize;
+	}
+	for (; end >= kVectorSize; end -= kVectorSize) {
+		if (const unsigned mask = Compare(&data[end - kVectorSize], expected); mask != kAllEqual) {
+			return end - static_cast<std::size_t>(std::countl_one(static_cast<std::uint16_t>(mask)));
+		}
+	}
+#else
+	const std::uint64_t expected = 0x0101010101010101ull * pattern;
+	while (end >= kVectorSize && IsWordEqual(&data[end - kVectorSize], expected)) {
+		end -= kVectorSize;
+	}
+#endif
+	for (; end > 0; --end) {
+		if (data[end - 1] != pattern) {
+			return end;
+		}
+	}
+	return 0;
+}
+
+}  // namespace
+
+std::optional<TouchedRange> FindTouchedRange(const void* const p, const std::size_t size, const unsigned char pattern) noexcept {
+	const unsigned char* const data = static_cast<const unsigned char*>(p);
+	const std::size_t first = FindFirst(data, size, pattern);
+	if (first == size) {
+		return std::nullopt;
+	}
+	// only scan the part after the first modified byte
+	return TouchedRange{.first = first, .last = first + FindLast(&data[first], size - first, pattern) - 1};
+}
+
+namespace internal {
+
+testing::AssertionResult IsUninitializedRange(const void* const p, const std::size_t size, const std::optional<unsigned char> pattern) {
+	if (!p) {
+		return testing::AssertionFailure() << "Memory range is nullptr";
+	}
+	if (!pattern) {
+		return testing::AssertionSuccess();
+	}
+	const std::optional<TouchedRange> touched = FindTouchedRange(p, size, *pattern);
+	if (!touched) {
+		return testing::AssertionSuccess();
+	}
+	return testing::AssertionFailure() << "Memory range of " << size << " bytes at " << p << " has been written from offset "
+	                                   << touched->first << " to offset " << touched->last;
+}
+
+}  // namespace internal
+
+}  // namespace m4t
@@ -0,0 +1,210 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/Quarantine.h"
+
+#include "m4t/AllocationTable.h"
+
+#include <gtest/gtest.h>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+namespace m4t {
+
+namespace {
+
+/// @brief A memory block held in the quarantine.
+struct QuarantineEntry {
+	void* p;           ///< @brief The memory block.
+	std::size_t size;  ///< @brief The usable size of the memory block.
+	bool aligned;      ///< @brief `true` if the block has been allocated with alignment.
+};
+
+/// @brief The maximum number of memory blocks held in the quarantine.
+constexpr std::size_t kQuarantineCapacity = std::size_t{64} * 1024;
+
+/// @brief Guards all state of the quarantine.
+std::mutex g_quarantineMutex;
+
+/// @brief The memory blocks in FIFO order, a ring buffer with `kQuarantineCapacity` entries.
+QuarantineEntry* g_quarantineEntries = nullptr;
+
+/// @brief The index of the oldest entry in `g_quarantineEntries`.
+std::size_t g_quarantineHead = 0;
+
+/// @brief The number of entries in `g_quarantineEntries`.
+std::size_t g_quarantineCount = 0;
+
+/// @brief The sum of the sizes of all entries in `g_quarantineEntries`.
+std::size_t g_quarantineBytes = 0;
+
+/// @brief The maximum value of `g_quarantineBytes`.
+std::size_t g_quarantineMaxBytes = 0;
+
+/// @brief Index of the memory blocks in the quarantine for O(1) lookup.
+internal::AllocationTable* g_quarantineTable = nullptr;
+
+/// @brief `true` while the current thread modifies the quarantine.
+/// @details Memory freed by the quarantine itself, e.g. when growing the table, MUST NOT enter the quarantine.
+constinit thread_local bool t_inQuarantine = false;
+
+/// @brief Free a memory block for real.
+/// @param entry The entry of the block.
+void Release(const QuarantineEntry& entry) noexcept {
+#if defined(_WIN32)
+	if (entry.aligned) {
+		_aligned_free(entry.p);
+		return;
+	}
+#endif
+	std::free(entry.p);  // NOLINT(cppcoreguidelines-no-malloc): Implementation of operator delete.
+}
+
+/// @brief Remove the oldest entry from the quarantine and free its memory, MUST hold `g_quarantineMutex`.
+void ReleaseOldest() noexcept {
+	const QuarantineEntry& entry = g_quarantineEntries[g_quarantineHead];
+	g_quarantineTable->Erase(entry.p);
+	g_quarantineBytes -= entry.size;
+	Release(entry);
+	g_quarantineHead = (g_quarantineHead + 1) % kQuarantineCapacity;
+	--g_quarantineCount;
+}
+
+/// @brief Fill a memory block with the poison pattern and add it to the quarantine.
+/// @param p The memory block.
+/// @param size The usable size of the memory block.
+/// @param aligned `true` if the block has been allocated with alignment.
+/// @param deletedTwice Set to `true` if the block is already held in the quarantine.
+/// @return `true` if the block is held in the quarantine.
+bool Push(void* const p, const std::size_t size, const bool aligned, bool& deletedTwice) noexcept {
+	const std::scoped_lock lock(g_quarantineMutex);
+	if (!internal::g_quarantineEnabled.load(std::memory_order_relaxed) || size > g_quarantineMaxBytes) {
+		return false;
+	}
+	if (g_quarantineTable->Contains(p)) {
+		// the block MUST NOT be freed a second time
+		deletedTwice = true;
+		return true;
+	}
+	std::memset(p, internal::kQuarantinePoison, size);
+	while (g_quarantineCount == kQuarantineCapacity || g_quarantineBytes + size > g_quarantineMaxBytes) {
+		ReleaseOldest();
+	}
+	try {
+		g_quarantineTable->Insert(p, {.size = size});
+	} catch (...) {
+		return false;
+	}
+	g_quarantineEntries[(g_quarantineHead + g_quarantineCount) % kQuarantineCapacity] = {.p = p, .size = size, .aligned = aligned};
+	++g_quarantineCount;
+	g_quarantineBytes += size;
+	return true;
+}
+
+}  // namespace
+
+void EnableQuarantine(const std::size_t maxBytes) {
+	const std::scoped_lock lock(g_quarantineMutex);
+	if (!g_quarantineTable) {
+		std::unique_ptr<internal::AllocationTable> table = std::make_unique<internal::AllocationTable>();
+		g_quarantineEntries = new QuarantineEntry[kQuarantineCapacity];
+		g_quarantineTable = table.release();
+	}
+	g_quarantineMaxBytes = maxBytes;
+	while (g_quarantineBytes > g_quarantineMaxBytes) {
+		ReleaseOldest();
+	}
+	internal::g_quarantineEnabled.store(true, std::memory_order_relaxed);
+}
+
+void DisableQuarantine() noexcept {
+	internal::AllocationTable* table;
+	QuarantineEntry* entries;
+	{
+		const std::scoped_lock lock(g_quarantineMutex);
+		internal::g_quarantineEnabled.store(false, std::memory_order_relaxed);
+		while (g_quarantineCount) {
+			ReleaseOldest();
+		}
+		g_quarantineHead = 0;
+		table = std::exchange(g_quarantineTable, nullptr);
+		entries = std::exchange(g_quarantineEntries, nullptr);
+	}
+	// quarantine is disabled, so deleting does not enter it
+	delete table;
+	delete[] entries;
+}
+
+namespace internal {
+
+bool Quarantine(void* const p, const std::size_t size, const bool aligned) noexcept {
+	if (t_inQuarantine || !p) {
+		return false;
+	}
+	t_inQuarantine = true;
+	bool deletedTwice = false;
+	const bool result = Push(p, size, aligned, deletedTwice);
+	if (deletedTwice) {
+		[[unlikely]];
+		// report without holding the lock, memory freed by gtest does not enter the quarantine
+		try {
+			ADD_FAILURE() << "Memory block " << p << " deleted twice";
+		} catch (...) {
+			// ignore, but assert
+			assert(false);
+		}
+	}
+	t_inQuarantine = false;
+	return result;
+}
+
+bool IsQuarantined(const void* const p) noexcept {
+	const std::scoped_lock lock(g_quarantineMutex);
+	if (!g_quarantineTable) {
+		return false;
+	}
+	const std::optional<AllocationRecord> record = g_quarantineTable->Find(p);
+	if (!record) {
+		return false;
+	}
+	const unsigned char* const bytes = static_cast<const unsigned char*>(p);
+	return std::all_of(bytes, bytes + std::min(record->size, kQuarantineCheckBytes), [](const unsigned char value) noexcept {
+		return value == kQuarantinePoison;
+	});
+}
+
+bool IsDeletedMemory(const void* const p) noexcept {
+	return IsQuarantineEnabled() ? IsQuarantined(p) : p != nullptr;
+}
+
+}  // namespace internal
+
+}  // namespace m4t
@@ -0,0 +1,523 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/SharedEventRing.h"
+
+#include "m4t/LogLine.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+#endif
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace m4t {
+
+namespace {
+
+/// @brief Marks a ring buffer which has been completely initialized.
+constexpr std::uint32_t kMagic = 0x4D345452;  // M4TR
+
+/// @brief The size of a cache line for separating the counters of producers and consumer.
+constexpr std::size_t kCacheLineSize = 64;
+
+/// @brief Set in the sequence number of a slot while a writer copies the record.
+constexpr std::uint64_t kWritingBit = std::uint64_t{1} << 63;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "atomics in shared memory must be lock-free");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "atomics in shared memory must be lock-free");
+
+/// @brief The start of the shared memory.
+struct Header {
+	std::atomic<std::uint32_t> magic;                            ///< @brief `kMagic` after initialization.
+	std::uint32_t capacity;                                      ///< @brief The number of slots, a power of 2.
+	alignas(kCacheLineSize) std::atomic<std::uint64_t> enqueue;  ///< @brief The position of the next slot for writing.
+	alignas(kCacheLineSize) std::atomic<std::uint64_t> dequeue;  ///< @brief The position of the next slot for reading.
+	alignas(kCacheLineSize) std::atomic<std::uint64_t> dropped;  ///< @brief The number of records discarded because the buffer was full or the slot was skipped.
+};
+
+/// @brief A slot of the ring buffer which follows the header.
+struct Slot {
+	std::atomic<std::uint64_t> sequence;  ///< @brief The position for which the slot can be written, with `kWritingBit` while the record is copied, plus 1 if it can be read.
+	SharedEventRecord record;             ///< @brief The record.
+};
+
+/// @brief Get the size of the shared memory.
+/// @param capacity The number of slots.
+/// @return The size in bytes.
+constexpr std::size_t GetMappingSize(const std::size_t capacity) noexcept {
+	return sizeof(Header) + capacity * sizeof(Slot);
+}
+
+/// @brief Get the slots of a ring buffer.
+/// @param header The header at the start of the shared memory.
+/// @return The slots.
+std::span<Slot> GetSlots(Header& header) noexcept {
+	return std::span(reinterpret_cast<Slot*>(reinterpret_cast<std::byte*>(&header) + sizeof(Header)), header.capacity);
+}
+
+/// @brief Get the id of the current process.
+/// @return The process id.
+std::uint32_t CurrentProcessId() noexcept {
+#if defined(_WIN32)
+	return ::GetCurrentProcessId();
+#else
+	return static_cast<std::uint32_t>(getpid());
+#endif
+}
+
+/// @brief Get the id of the current thread.
+/// @return The thread id.
+std::uint32_t CurrentThreadId() noexcept {
+#if defined(_WIN32)
+	return ::GetCurrentThreadId();
+#elif defined(__linux__)
+	return static_cast<std::uint32_t>(syscall(SYS_gettid));
+#else
+	std::uint64_t id = 0;
+	pthread_threadid_np(nullptr, &id);
+	return static_cast<std::uint32_t>(id);
+#endif
+}
+
+/// @brief A view of named shared memory.
+class SharedMemory {
+public:
+	/// @brief Create new shared memory.
+	/// @param name The name.
+	/// @param size The size in bytes.
+	/// @throws std::system_error if the shared memory cannot be created.
+	SharedMemory(const std::string& name, const std::size_t size)
+	    : m_name(GetSystemName(name))
+	    , m_owner(true) {
+#if defined(_WIN32)
+		m_handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, static_cast<DWORD>(static_cast<std::uint64_t>(size) >> 32), static_cast<DWORD>(size), m_name.c_str());
+		if (!m_handle || GetLastError() == ERROR_ALREADY_EXISTS) {
+			const DWORD lastError = GetLastError();
+			Close();
+			throw std::system_error(static_cast<int>(lastError), std::system_category(), "CreateFileMappingA");
+		}
+#else
+		m_handle = shm_open(m_name.c_str(), O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+		if (m_handle < 0) {
+			throw std::system_error(errno, std::system_category(), "shm_open");
+		}
+		if (ftruncate(m_handle, static_cast<off_t>(size))) {
+			const int error = errno;
+			Close();
+			throw std::system_error(error, std::system_category(), "ftruncate");
+		}
+#endif
+		Map(size);
+	}
+
+	/// @brief Open existing shared memory.
+	/// @param name The name.
+	/// @throws std::system_error if the shared memory cannot be opened.
+	explicit SharedMemory(const std::string& name)
+	    : m_name(GetSystemName(name))
+	    , m_owner(false) {
+#if defined(_WIN32)
+		m_handle = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, m_name.c_str());
+		if (!m_handle) {
+			throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "OpenFileMappingA");
+		}
+		Map(0);
+#else
+		m_handle = shm_open(m_name.c_str(), O_RDWR, 0);
+		if (m_handle < 0) {
+			throw std::system_error(errno, std::system_category(), "shm_open");
+		}
+		struct stat status;
+		if (fstat(m_handle, &status)) {
+			const int error = errno;
+			Close();
+			throw std::system_error(error, std::system_category(), "fstat");
+		}
+		Map(static_cast<std::size_t>(status.st_size));
+#endif
+	}
+
+	SharedMemory(const SharedMemory&) = delete;
+	SharedMemory(SharedMemory&&) = delete;
+
+	~SharedMemory() noexcept {
+#if defined(_WIN32)
+		if (m_address) {
+			UnmapViewOfFile(m_address);
+		}
+#else
+		if (m_address) {
+			munmap(m_address, m_size);
+		}
+		if (m_owner) {
+			shm_unlink(m_name.c_str());
+		}
+#endif
+		Close();
+	}
+
+public:
+	SharedMemory& operator=(const SharedMemory&) = delete;
+	SharedMemory& operator=(SharedMemory&&) = delete;
+
+public:
+	[[nodiscard]] void* GetAddress() const noexcept {
+		return m_address;
+	}
+
+	[[nodiscard]] std::size_t GetSize() const noexcept {
+		return m_size;
+	}
+
+private:
+	/// @brief Get the name used by the operating system.
+	/// @param name The name.
+	/// @return The name with a leading slash for POSIX shared memory.
+	static std::string GetSystemName(const std::string& name) {
+#if defined(_WIN32)
+		return name;
+#else
+		return name.starts_with('/') ? name : '/' + name;
+#endif
+	}
+
+	/// @brief Map the shared memory into the address space of the process.
+	/// @param size The size in bytes, 0 for mapping all.
+	/// @throws std::system_error if the shared memory cannot be mapped.
+	void Map(const std::size_t size) {
+#if defined(_WIN32)
+		m_address = MapViewOfFile(m_handle, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, size);
+		if (!m_address) {
+			const DWORD lastError = GetLastError();
+			Close();
+			throw std::system_error(static_cast<int>(lastError), std::system_category(), "MapViewOfFile");
+		}
+		MEMORY_BASIC_INFORMATION info;
+		m_size = VirtualQuery(m_address, &info, sizeof(info)) ? info.RegionSize : size;
+#else
+		m_address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_handle, 0);
+		if (m_address == MAP_FAILED) {
+			const int error = errno;
+			m_address = nullptr;
+			if (m_owner) {
+				shm_unlink(m_name.c_str());
+			}
+			Close();
+			throw std::system_error(error, std::system_category(), "mmap");
+		}
+		m_size = size;
+#endif
+	}
+
+	/// @brief Close the handle of the shared memory.
+	void Close() noexcept {
+#if defined(_WIN32)
+		if (m_handle) {
+			CloseHandle(m_handle);
+			m_handle = nullptr;
+		}
+#else
+		if (m_handle >= 0) {
+			close(m_handle);
+			m_handle = -1;
+		}
+#endif
+	}
+
+private:
+	std::string m_name;  ///< @brief The name used by the operating system.
+#if defined(_WIN32)
+	HANDLE m_handle = nullptr;  ///< @brief The handle of the file mapping.
+#else
+	int m_handle = -1;  ///< @brief The file descriptor of the shared memory.
+#endif
+	void* m_address = nullptr;  ///< @brief The address of the mapping.
+	std::size_t m_size = 0;     ///< @brief The size of the mapping.
+	bool m_owner;               ///< @brief `true` if the shared memory is removed when the object is destroyed.
+};
+
+}  // namespace
+
+//
+// SharedEventRecord
+//
+
+std::span<const std::byte> SharedEventRecord::GetArg(const std::uint32_t index) const {
+	if (index >= m_argCount) {
+		throw std::out_of_range("argument index");
+	}
+	std::size_t offset = 0;
+	for (std::uint32_t i = 0;; ++i) {
+		std::uint32_t size;
+		std::memcpy(&size, &m_payload[offset], sizeof(size));
+		offset += sizeof(size);
+		if (i == index) {
+			return std::span(&m_payload[offset], size);
+		}
+		offset += size;
+	}
+}
+
+bool SharedEventRecord::AddArg(const std::span<const std::byte> data) noexcept {
+	if (sizeof(std::uint32_t) + data.size() > kMaxPayload - m_size) {
+		return false;
+	}
+	const std::uint32_t size = static_cast<std::uint32_t>(data.size());
+	std::memcpy(&m_payload[m_size], &size, sizeof(size));
+	if (!data.empty()) {
+		std::memcpy(&m_payload[m_size + sizeof(size)], data.data(), data.size());
+	}
+	m_size = static_cast<std::uint16_t>(m_size + sizeof(size) + data.size());
+	++m_argCount;
+	return true;
+}
+
+//
+// SharedEventCollector
+//
+
+class SharedEventCollector::Impl {
+public:
+	Impl(const std::string& name, const std::size_t capacity, const std::chrono::milliseconds staleTimeout)
+	    : m_name(name)
+	    , m_staleTimeout(staleTimeout)
+	    , m_memory(name, GetMappingSize(std::bit_ceil(std::max<std::size_t>(capacity, 2))))
+	    , m_header(*new (m_memory.GetAddress()) Header{}) {
+		m_header.capacity = static_cast<std::uint32_t>(std::bit_ceil(std::max<std::size_t>(capacity, 2)));
+		std::span<Slot> slots = GetSlots(m_header);
+		for (std::size_t i = 0; i < slots.size(); ++i) {
+			new (&slots[i]) Slot{.sequence = i, .record = {}};
+		}
+		m_header.magic.store(kMagic, std::memory_order_release);
+	}
+
+public:
+	[[nodiscard]] const std::string& GetName() const noexcept {
+		return m_name;
+	}
+
+	[[nodiscard]] std::size_t GetCapacity() const noexcept {
+		return m_header.capacity;
+	}
+
+	[[nodiscard]] std::optional<SharedEventRecord> Pop() {
+		const std::scoped_lock lock(m_mutex);
+		while (true) {
+			const std::uint64_t position = m_header.dequeue.load(std::memory_order_relaxed);
+			Slot& slot = GetSlots(m_header)[position & (m_header.capacity - 1)];
+			std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence == position && m_header.enqueue.load(std::memory_order_relaxed) > position) {
+				// slot is reserved but the writer has not started copying the record yet
+				if (!IsStale(position)) {
+					return std::nullopt;
+				}
+				// a late writer fails to claim the slot, so the slot can be passed to the next writer immediately
+				if (slot.sequence.compare_exchange_strong(sequence, position + m_header.capacity, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					m_header.dropped.fetch_add(1, std::memory_order_relaxed);
+					m_header.dequeue.store(position + 1, std::memory_order_relaxed);
+					continue;
+				}
+				// the writer has claimed the slot in the meantime
+			}
+			if (sequence != position + 1) {
+				// a slot is never skipped while the record is copied
+				return std::nullopt;
+			}
+			const SharedEventRecord record = slot.record;
+			slot.sequence.store(position + m_header.capacity, std::memory_order_release);
+			m_header.dequeue.store(position + 1, std::memory_order_relaxed);
+			return record;
+		}
+	}
+
+	[[nodiscard]] std::uint64_t GetDroppedCount() const noexcept {
+		return m_header.dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+	/// @brief Check if a reserved slot has been waiting for its record for longer than the timeout.
+	/// @details The time is measured from the first call for @p position.
+	/// @param position The position of the slot.
+	/// @return `true` if the slot should be skipped.
+	[[nodiscard]] bool IsStale(const std::uint64_t position) {
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (position != m_stalePosition) {
+			m_stalePosition = position;
+			m_staleSince = now;
+			return false;
+		}
+		return now - m_staleSince >= m_staleTimeout;
+	}
+
+private:
+	std::string m_name;                                  ///< @brief The name of the shared memory.
+	std::chrono::milliseconds m_staleTimeout;            ///< @brief The time after which a reserved slot is skipped.
+	SharedMemory m_memory;                               ///< @brief The shared memory.
+	Header& m_header;                                    ///< @brief The header of the ring buffer in the shared memory.
+	std::mutex m_mutex;                                  ///< @brief Serializes removing records.
+	std::uint64_t m_stalePosition = ~std::uint64_t{0};   ///< @brief The position of the slot which is waiting for its record.
+	std::chrono::steady_clock::time_point m_staleSince;  ///< @brief The time when the collector started waiting for @p m_stalePosition.
+};
+
+SharedEventCollector::SharedEventCollector(const std::string& name, const std::size_t capacity, const std::chrono::milliseconds staleTimeout)
+    : m_impl(std::make_unique<Impl>(name, capacity, staleTimeout)) {
+	// empty
+}
+
+SharedEventCollector::~SharedEventCollector() noexcept = default;
+
+const std::string& SharedEventCollector::GetName() const noexcept {
+	return m_impl->GetName();
+}
+
+std::size_t SharedEventCollector::GetCapacity() const noexcept {
+	return m_impl->GetCapacity();
+}
+
+std::optional<SharedEventRecord> SharedEventCollector::Pop() {
+	return m_impl->Pop();
+}
+
+std::uint64_t SharedEventCollector::GetDroppedCount() const noexcept {
+	return m_impl->GetDroppedCount();
+}
+
+//
+// SharedEventWriter
+//
+
+class SharedEventWriter::Impl {
+public:
+	explicit Impl(const std::string& name)
+	    : m_memory(name)
+	    , m_header(*static_cast<Header*>(m_memory.GetAddress())) {
+		if (m_memory.GetSize() < sizeof(Header) || m_header.magic.load(std::memory_order_acquire) != kMagic || m_memory.GetSize() < GetMappingSize(m_header.capacity)) {
+			throw std::invalid_argument("not a shared event ring");
+		}
+	}
+
+public:
+	bool Push(const SharedEventRecord& record) noexcept {
+		const std::span<Slot> slots = GetSlots(m_header);
+		std::uint64_t position = m_header.enqueue.load(std::memory_order_relaxed);
+		while (true) {
+			Slot& slot = slots[position & (slots.size() - 1)];
+			const std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+			if (sequence == position) {
+				if (m_header.enqueue.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					// claim the slot before copying, fails if the collector has skipped the slot in the meantime
+					std::uint64_t expected = position;
+					if (!slot.sequence.compare_exchange_strong(expected, position | kWritingBit, std::memory_order_acquire, std::memory_order_relaxed)) {
+						return false;
+					}
+					slot.record = record;
+					slot.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			} else if ((sequence & ~kWritingBit) < position) {
+				// never wait for the parent process
+				m_header.dropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			} else {
+				position = m_header.enqueue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+private:
+	SharedMemory m_memory;  ///< @brief The shared memory.
+	Header& m_header;       ///< @brief The header of the ring buffer in the shared memory.
+};
+
+SharedEventWriter::SharedEventWriter(const std::string& name)
+    : m_impl(std::make_unique<Impl>(name)) {
+	// empty
+}
+
+SharedEventWriter::~SharedEventWriter() noexcept = default;
+
+std::unique_ptr<SharedEventWriter> SharedEventWriter::FromEnvironment() {
+	const char* const name = std::getenv(kSharedEventRingVariable);  // NOLINT(concurrency-mt-unsafe): Environment is not modified concurrently.
+	return name && *name ? std::make_unique<SharedEventWriter>(name) : nullptr;
+}
+
+bool SharedEventWriter::WriteDebug(const std::string_view text) noexcept {
+	const internal::LogLine line = internal::ParseLogLine(text);
+	if (!line.IsValid()) {
+		return false;
+	}
+	SharedEventRecord record;
+	record.m_type = SharedRecordType::kDebug;
+	if (!record.AddArg(std::as_bytes(std::span(line.level)))) {
+		return false;
+	}
+	// same order as LogListener::Debug, i.e. causes in reverse order followed by the message
+	constexpr std::size_t kMaxCauses = 16;
+	std::array<std::string_view, kMaxCauses> causes;
+	std::size_t count = 0;
+	std::string_view remaining = line.causes;
+	for (std::string_view cause = internal::NextCause(remaining); !cause.empty(); cause = internal::NextCause(remaining)) {
+		if (count == kMaxCauses) {
+			return false;
+		}
+		causes[count++] = cause;
+	}
+	while (count) {
+		if (!record.AddArg(std::as_bytes(std::span(causes[--count])))) {
+			return false;
+		}
+	}
+	return record.AddArg(std::as_bytes(std::span(line.message))) && Push(record);
+}
+
+bool SharedEventWriter::Push(SharedEventRecord& record) noexcept {
+	record.m_processId = CurrentProcessId();
+	record.m_threadId = CurrentThreadId();
+	return m_impl->Push(record);
+}
+
+}  // namespace m4t
@@ -0,0 +1,128 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/SpyMemoryResource.h"
+
+#include "m4t/AllocationTracker.h"
+#include "m4t/DeletedHistory.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace m4t {
+
+SpyMemoryResource::SpyMemoryResource()
+    : SpyMemoryResource(std::pmr::get_default_resource()) {
+	// empty
+}
+
+SpyMemoryResource::SpyMemoryResource(std::pmr::memory_resource* const upstream, const TrackingMode mode, const std::size_t maxDeletedHistoryBytes)
+    : m_upstream(upstream)
+    , m_tracker(mode, maxDeletedHistoryBytes) {
+	// empty
+}
+
+void SpyMemoryResource::Flush() const {
+	m_tracker.Flush();
+}
+
+bool SpyMemoryResource::IsAllocated(const void* const p) const {
+	return m_tracker.IsAllocated(p);
+}
+
+bool SpyMemoryResource::IsDeleted(const void* const p) const {
+	return m_tracker.GetDeletedState(p) != DeletedState::kNotDeleted;
+}
+
+std::optional<AllocatedBlock> SpyMemoryResource::GetAllocation(const void* const p) const {
+	return m_tracker.GetAllocation(p);
+}
+
+bool SpyMemoryResource::IsSameAllocation(const void* const p, const std::uint64_t generation) const {
+	return m_tracker.IsSameAllocation(p, generation);
+}
+
+bool SpyMemoryResource::IsGenerationDeleted(const std::uint64_t generation) const {
+	return m_tracker.IsGenerationDeleted(generation);
+}
+
+DeletedState SpyMemoryResource::GetDeletedState(const void* const p) const {
+	return m_tracker.GetDeletedState(p);
+}
+
+std::size_t SpyMemoryResource::GetAllocatedCount() const {
+	return m_tracker.GetAllocatedCount();
+}
+
+std::size_t SpyMemoryResource::GetDeletedCount() const {
+	return m_tracker.GetDeletedCount();
+}
+
+AllocationStatistics SpyMemoryResource::GetStatistics() const {
+	return m_tracker.GetStatistics();
+}
+
+void SpyMemoryResource::ResetPeakBytes() {
+	m_tracker.ResetPeakBytes();
+}
+
+void SpyMemoryResource::SetSamplingRate(const std::size_t bytes) noexcept {
+	m_tracker.SetSamplingRate(bytes);
+}
+
+void SpyMemoryResource::SetSampling(const bool enabled) noexcept {
+	m_tracker.SetSampling(enabled);
+}
+
+SamplingEstimate SpyMemoryResource::GetSamplingEstimate() const {
+	return m_tracker.GetSamplingEstimate();
+}
+
+AllocationCheckpoint SpyMemoryResource::Checkpoint() {
+	return m_tracker.Checkpoint();
+}
+
+std::vector<AllocatedBlock> SpyMemoryResource::GetAllocatedSince(const AllocationCheckpoint& checkpoint) const {
+	return m_tracker.GetAllocatedSince(checkpoint);
+}
+
+std::string SpyMemoryResource::FormatStack(const std::uint32_t stack) const {
+	return m_tracker.FormatStack(stack);
+}
+
+void* SpyMemoryResource::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+	void* const p = m_upstream->allocate(bytes, alignment);
+	m_tracker.Allocated(p, bytes);
+	return p;
+}
+
+void SpyMemoryResource::do_deallocate(void* const p, const std::size_t bytes, const std::size_t alignment) {
+	m_tracker.Deleted(p);
+	m_upstream->deallocate(p, bytes, alignment);
+}
+
+bool SpyMemoryResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+	// memory is tracked per object, so blocks MUST be deallocated using the same object
+	return this == &other;
+}
+
+}  // namespace m4t
@@ -0,0 +1,228 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/StackTable.h"
+
+#include "m4t/AllocationTable.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <dbghelp.h>
+#else
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#endif
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <span>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace m4t::internal {
+
+namespace {
+
+/// @brief Calculate the hash value of a stack.
+/// @param frames The return addresses.
+/// @return The hash value.
+std::uint64_t HashFrames(const std::span<void* const> frames) noexcept {
+	std::uint64_t hash = frames.size();
+	for (const void* const frame : frames) {
+		hash = HashAddress(hash ^ reinterpret_cast<std::uintptr_t>(frame));
+	}
+	return hash;
+}
+
+#if defined(_WIN32)
+/// @brief Guards all calls to the debug help library which is not thread-safe.
+std::mutex g_symbolsMutex;
+
+/// @brief `true` if `SymInitialize` has been called successfully, guarded by `g_symbolsMutex`.
+bool g_symbolsInitialized = false;
+#endif
+
+}  // namespace
+
+std::size_t CaptureStack(const std::size_t skip, const std::span<void*> frames) noexcept {
+#if defined(_WIN32)
+	return RtlCaptureStackBackTrace(static_cast<DWORD>(skip + 1), static_cast<DWORD>(frames.size()), frames.data(), nullptr);
+#else
+	constexpr std::size_t kMaxCapture = 128;
+	void* buffer[kMaxCapture];
+	const std::size_t count = static_cast<std::size_t>(backtrace(buffer, static_cast<int>(std::min(kMaxCapture, skip + 1 + frames.size()))));
+	if (count <= skip + 1) {
+		return 0;
+	}
+	return static_cast<std::size_t>(std::copy(&buffer[skip + 1], &buffer[count], frames.begin()) - frames.begin());
+#endif
+}
+
+std::string SymbolizeFrame(const void* const address) {
+	std::ostringstream str;
+#if defined(_WIN32)
+	const std::scoped_lock lock(g_symbolsMutex);
+	const HANDLE hProcess = GetCurrentProcess();
+	if (!g_symbolsInitialized) {
+		SymSetOptions(SymGetOptions() | SYMOPT_UNDNAME | SYMOPT_LOAD_LINES | SYMOPT_DEFERRED_LOADS);
+		g_symbolsInitialized = SymInitialize(hProcess, nullptr, TRUE) != FALSE;
+	}
+
+	const DWORD64 addr = reinterpret_cast<DWORD64>(address);
+	alignas(SYMBOL_INFO) std::byte buffer[sizeof(SYMBOL_INFO) + MAX_SYM_NAME * sizeof(CHAR)];
+	SYMBOL_INFO* const pSymbol = reinterpret_cast<SYMBOL_INFO*>(buffer);
+	pSymbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+	pSymbol->MaxNameLen = MAX_SYM_NAME;
+	DWORD64 displacement = 0;
+	if (g_symbolsInitialized && SymFromAddr(hProcess, addr, &displacement, pSymbol)) {
+		str << pSymbol->Name << "+0x" << std::hex << displacement << std::dec;
+	}
+	IMAGEHLP_LINE64 line{};
+	line.SizeOfStruct = sizeof(line);
+	DWORD lineDisplacement = 0;
+	if (g_symbolsInitialized && SymGetLineFromAddr64(hProcess, addr, &lineDisplacement, &line)) {
+		str << " at " << line.FileName << '(' << line.LineNumber << ')';
+	}
+#else
+	Dl_info info;
+	if (dladdr(address, &info) && info.dli_fname) {
+		str << info.dli_fname;
+		if (info.dli_sname) {
+			int status = 0;
+			const std::unique_ptr<char, decltype(&std::free)> demangled(abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), &std::free);
+			str << '(' << (status == 0 && demangled ? demangled.get() : info.dli_sname)
+			    << "+0x" << std::hex << (static_cast<const std::byte*>(address) - static_cast<const std::byte*>(info.dli_saddr)) << std::dec << ')';
+		}
+	}
+#endif
+	str << " [" << address << ']';
+	return str.str();
+}
+
+struct alignas(std::hardware_destructive_interference_size) StackTable::Shard {
+	mutable std::shared_mutex mutex;
+	std::deque<std::vector<const void*>> stacks;              ///< @brief The frames of each stack, guarded by @p mutex.
+	std::unordered_multimap<std::uint64_t, std::size_t> index;  ///< @brief Hash values mapped to indexes into @p stacks, guarded by @p mutex.
+
+	/// @brief Find a stack.
+	/// @note The caller MUST hold @p mutex.
+	/// @param frames The return addresses.
+	/// @param hash The hash value of @p frames.
+	/// @return The index into @p stacks or `std::size_t(-1)` if the stack is not in the shard.
+	std::size_t Find(const std::span<void* const> frames, const std::uint64_t hash) const noexcept {
+		const auto [begin, end] = index.equal_range(hash);
+		for (auto it = begin; it != end; ++it) {
+			if (std::ranges::equal(stacks[it->second], frames)) {
+				return it->second;
+			}
+		}
+		return static_cast<std::size_t>(-1);
+	}
+};
+
+StackTable::StackTable()
+    : m_shards(std::make_unique<Shard[]>(kShardCount)) {
+	// empty
+}
+
+StackTable::~StackTable() noexcept = default;
+
+std::uint32_t StackTable::Capture(const std::size_t skip) noexcept {
+	void* frames[kMaxFrames];
+	const std::size_t count = CaptureStack(skip + 1, frames);
+	try {
+		return Intern(std::span(frames, count));
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+		return kNoStack;
+	}
+}
+
+std::uint32_t StackTable::Intern(std::span<void* const> frames) {
+	frames = frames.first(std::min(frames.size(), kMaxFrames));
+	if (frames.empty()) {
+		return kNoStack;
+	}
+
+	const std::uint64_t hash = HashFrames(frames);
+	const std::size_t shardIndex = hash >> (64 - kShardBits);
+	Shard& shard = m_shards[shardIndex];
+	const auto makeId = [shardIndex](const std::size_t index) noexcept {
+		return static_cast<std::uint32_t>(((index << kShardBits) | shardIndex) + 1);
+	};
+
+	{
+		const std::shared_lock lock(shard.mutex);
+		if (const std::size_t index = shard.Find(frames, hash); index != static_cast<std::size_t>(-1)) {
+			[[likely]];
+			return makeId(index);
+		}
+	}
+
+	const std::unique_lock lock(shard.mutex);
+	// another thread might have added the stack in between
+	if (const std::size_t index = shard.Find(frames, hash); index != static_cast<std::size_t>(-1)) {
+		return makeId(index);
+	}
+	const std::size_t index = shard.stacks.size();
+	if (index >= (std::size_t{1} << (32 - kShardBits)) - 1) {
+		[[unlikely]];
+		return kNoStack;
+	}
+	shard.stacks.emplace_back(frames.begin(), frames.end());
+	shard.index.emplace(hash, index);
+	return makeId(index);
+}
+
+std::vector<const void*> StackTable::GetFrames(const std::uint32_t id) const {
+	if (id == kNoStack) {
+		return {};
+	}
+	const std::size_t value = id - 1;
+	const Shard& shard = m_shards[value & (kShardCount - 1)];
+	const std::size_t index = value >> kShardBits;
+
+	const std::shared_lock lock(shard.mutex);
+	if (index >= shard.stacks.size()) {
+		return {};
+	}
+	return shard.stacks[index];
+}
+
+std::size_t StackTable::GetCount() const noexcept {
+	std::size_t count = 0;
+	for (std::size_t i = 0; i < kShardCount; ++i) {
+		const std::shared_lock lock(m_shards[i].mutex);
+		count += m_shards[i].stacks.size();
+	}
+	return count;
+}
+
+}  // namespace m4t::internal
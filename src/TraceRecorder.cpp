@@ -0,0 +1,222 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/TraceRecorder.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace m4t {
+
+namespace {
+
+/// @brief The size of an activity id.
+constexpr std::size_t kActivityIdSize = 16;
+
+/// @brief Get the id of the current process.
+/// @return The process id.
+std::uint32_t CurrentProcessId() noexcept {
+#if defined(_WIN32)
+	return ::GetCurrentProcessId();
+#else
+	return static_cast<std::uint32_t>(getpid());
+#endif
+}
+
+/// @brief Append an unsigned integer value.
+/// @param str The output.
+/// @param value The value.
+/// @param base The base of the number.
+/// @param width The minimum number of digits.
+void AppendNumber(std::string& str, const std::uint64_t value, const int base = 10, const std::size_t width = 0) {
+	char buffer[64];
+	const char* const end = std::to_chars(std::begin(buffer), std::end(buffer), value, base).ptr;
+	const std::size_t length = static_cast<std::size_t>(end - buffer);
+	if (length < width) {
+		str.append(width - length, '0');
+	}
+	str.append(buffer, length);
+}
+
+/// @brief Append a string as a quoted JSON string.
+/// @details The output is plain ASCII because the encoding of debug output is not known. Control characters and bytes
+/// with the high bit set are escaped, i.e. the input is treated as ISO 8859-1.
+/// @param str The output.
+/// @param value The string.
+void AppendString(std::string& str, const std::string_view value) {
+	str += '"';
+	for (const char c : value) {
+		switch (c) {
+		case '"':
+			str += "\\\"";
+			break;
+		case '\\':
+			str += "\\\\";
+			break;
+		case '\n':
+			str += "\\n";
+			break;
+		case '\r':
+			str += "\\r";
+			break;
+		case '\t':
+			str += "\\t";
+			break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20 || static_cast<unsigned char>(c) >= 0x80) {
+				str += "\\u";
+				AppendNumber(str, static_cast<unsigned char>(c), 16, 4);
+			} else {
+				str += c;
+			}
+		}
+	}
+	str += '"';
+}
+
+/// @brief Append the fields common to all records.
+/// @param str The output.
+/// @param name The name of the record.
+/// @param category The category of the record.
+/// @param start The time of the start of the timeline.
+/// @param time The time of the record.
+/// @param processId The process id.
+/// @param threadId The thread id.
+void AppendHeader(std::string& str, const std::string_view name, const std::string_view category, const std::chrono::steady_clock::time_point start, const std::chrono::steady_clock::time_point time, const std::uint32_t processId, const std::uint32_t threadId) {
+	// timestamps are in microseconds with nanosecond resolution
+	const std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time - start).count();
+	const std::uint64_t elapsed = ns > 0 ? static_cast<std::uint64_t>(ns) : 0;
+
+	str += "{\"name\":";
+	AppendString(str, name);
+	str += ",\"cat\":";
+	AppendString(str, category);
+	str += ",\"ph\":\"i\",\"s\":\"t\",\"ts\":";
+	AppendNumber(str, elapsed / 1000);
+	str += '.';
+	AppendNumber(str, elapsed % 1000, 10, 3);
+	str += ",\"pid\":";
+	AppendNumber(str, processId);
+	str += ",\"tid\":";
+	AppendNumber(str, threadId);
+}
+
+/// @brief Append the activity id as an argument.
+/// @param str The output.
+/// @param activityId The 16 bytes of a `GUID` or an empty span.
+void AppendActivityId(std::string& str, const std::span<const std::byte> activityId) {
+	if (activityId.size() != kActivityIdSize) {
+		return;
+	}
+	// GUID uses little endian for the first three fields
+	constexpr std::size_t kOrder[kActivityIdSize] = {3, 2, 1, 0, 5, 4, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+	str += ",\"activity\":\"";
+	for (std::size_t i = 0; i < kActivityIdSize; ++i) {
+		if (i == 4 || i == 6 || i == 8 || i == 10) {
+			str += '-';
+		}
+		AppendNumber(str, static_cast<std::uint8_t>(activityId[kOrder[i]]), 16, 2);
+	}
+	str += '"';
+}
+
+}  // namespace
+
+TraceRecorder::TraceRecorder(const std::filesystem::path& path)
+    : m_start(std::chrono::steady_clock::now())
+    , m_processId(CurrentProcessId())
+    , m_file(path, std::ios::out | std::ios::trunc | std::ios::binary) {
+	if (!m_file) {
+		throw std::system_error(errno, std::generic_category(), "open trace file");
+	}
+	m_file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+}
+
+TraceRecorder::~TraceRecorder() noexcept {
+	try {
+		const std::scoped_lock lock(m_mutex);
+		m_file << "\n]}\n";
+		m_file.flush();
+	} catch (...) {
+		// ignore, but assert
+		assert(false);
+	}
+}
+
+void TraceRecorder::AddEvent(const std::uint16_t eventId, const std::uint8_t level, const std::uint64_t keyword, const std::uint32_t threadId, const std::span<const std::byte> activityId, const std::chrono::steady_clock::time_point time) {
+	std::string record;
+	record.reserve(256);
+	std::string name = "Event ";
+	AppendNumber(name, eventId);
+	AppendHeader(record, name, "event", m_start, time, m_processId, threadId);
+	record += ",\"args\":{\"id\":";
+	AppendNumber(record, eventId);
+	record += ",\"level\":";
+	AppendNumber(record, level);
+	record += ",\"keyword\":\"0x";
+	AppendNumber(record, keyword, 16);
+	record += '"';
+	AppendActivityId(record, activityId);
+	record += "}}";
+	Write(record);
+}
+
+void TraceRecorder::AddDebug(const std::string_view level, const std::string_view message, const std::uint32_t threadId, const std::span<const std::byte> activityId, const std::chrono::steady_clock::time_point time) {
+	std::string record;
+	record.reserve(256 + message.size());
+	AppendHeader(record, level, "debug", m_start, time, m_processId, threadId);
+	record += ",\"args\":{\"message\":";
+	AppendString(record, message);
+	AppendActivityId(record, activityId);
+	record += "}}";
+	Write(record);
+}
+
+void TraceRecorder::Flush() {
+	const std::scoped_lock lock(m_mutex);
+	m_file.flush();
+}
+
+std::size_t TraceRecorder::GetCount() const noexcept {
+	return m_count.load(std::memory_order_relaxed);
+}
+
+void TraceRecorder::Write(const std::string_view record) {
+	const std::scoped_lock lock(m_mutex);
+	m_file << (m_count.fetch_add(1, std::memory_order_relaxed) ? ",\n" : "\n") << record;
+}
+
+}  // namespace m4t
@@ -0,0 +1,95 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationFill.h"
+
+#include "m4t/MemoryPattern.h"
+
+#include <gtest/gtest-spi.h>  // IWYU pragma: keep
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+
+namespace m4t::test {
+namespace {
+
+/// @brief A type with extended alignment for testing aligned allocation.
+struct alignas(64) Aligned {
+	std::uint8_t data[256];  ///< @brief Some data.
+};
+
+class AllocationFill_Test : public testing::Test {
+protected:
+	void TearDown() override {
+		DisableAllocationFill();
+	}
+};
+
+TEST_F(AllocationFill_Test, Disabled) {
+	EXPECT_FALSE(GetAllocationFillPattern().has_value());
+	EXPECT_EQ(0x42, internal::GetUninitializedPattern(0x42));
+	EXPECT_FALSE(internal::GetUninitializedPattern(std::nullopt).has_value());
+}
+
+TEST_F(AllocationFill_Test, Enabled) {
+	EnableAllocationFill();
+
+	EXPECT_EQ(kDefaultFillPattern, GetAllocationFillPattern());
+	EXPECT_EQ(kDefaultFillPattern, internal::GetUninitializedPattern(0x42));
+	EXPECT_EQ(kDefaultFillPattern, internal::GetUninitializedPattern(std::nullopt));
+
+	constexpr std::size_t kSize = 1000;
+	const std::unique_ptr<std::uint8_t[]> buffer(new std::uint8_t[kSize]);  // NOLINT(cppcoreguidelines-avoid-c-arrays): Uninitialized on purpose.
+	EXPECT_TRUE(internal::IsUninitializedRange(buffer.get(), kSize, kDefaultFillPattern));
+
+	buffer[kSize - 1] = 0;
+	const std::optional<TouchedRange> touched = FindTouchedRange(buffer.get(), kSize, kDefaultFillPattern);
+	ASSERT_TRUE(touched.has_value());
+	EXPECT_EQ(kSize - 1, touched->first);
+	EXPECT_EQ(kSize - 1, touched->last);
+}
+
+TEST_F(AllocationFill_Test, Enabled_Aligned) {
+	EnableAllocationFill(0xA5);
+
+	Aligned* const nothrow = new (std::nothrow) Aligned;
+	ASSERT_NE(nullptr, nothrow);
+	EXPECT_TRUE(internal::IsUninitializedRange(nothrow->data, sizeof(Aligned::data), 0xA5));
+	delete nothrow;
+
+	const std::unique_ptr<Aligned> ptr(new Aligned);
+	EXPECT_TRUE(internal::IsUninitializedRange(ptr->data, sizeof(Aligned::data), 0xA5));
+}
+
+TEST_F(AllocationFill_Test, ExpectUninitializedRange) {
+	EnableAllocationFill();
+
+	const std::unique_ptr<std::uint8_t[]> buffer(new std::uint8_t[100]);  // NOLINT(cppcoreguidelines-avoid-c-arrays): Uninitialized on purpose.
+
+	EXPECT_UNINITIALIZED_RANGE(buffer.get(), 100);
+	buffer[10] = 0;
+	buffer[70] = 0;
+	EXPECT_NONFATAL_FAILURE(EXPECT_UNINITIALIZED_RANGE(buffer.get(), 100), "has been written from offset 10 to offset 70");
+}
+
+}  // namespace
+}  // namespace m4t::test
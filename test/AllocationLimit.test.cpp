@@ -0,0 +1,145 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationLimit.h"
+
+#include <gtest/gtest-spi.h>  // IWYU pragma: keep
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+/// @brief A type with extended alignment for testing aligned allocation.
+struct alignas(64) Aligned {
+	std::byte data[64];  ///< @brief Some data.
+};
+
+TEST(AllocationLimit, Counts) {
+	AllocationLimitScope scope(100, __FILE__, __LINE__);
+
+	EXPECT_EQ(0, scope.GetCounts().allocations);
+
+	{
+		const std::unique_ptr<int> ptr = std::make_unique<int>(1);
+		const std::unique_ptr<int[]> array = std::make_unique<int[]>(4);
+
+		EXPECT_EQ(2, scope.GetCounts().allocations);
+		EXPECT_EQ(sizeof(int) * 5, scope.GetCounts().bytes);
+		EXPECT_EQ(0, scope.GetCounts().deallocations);
+	}
+
+	EXPECT_EQ(2, scope.GetCounts().allocations);
+	EXPECT_EQ(2, scope.GetCounts().deallocations);
+}
+
+TEST(AllocationLimit, Counts_Aligned) {
+	AllocationLimitScope scope(100, __FILE__, __LINE__);
+
+	const std::unique_ptr<Aligned> ptr = std::make_unique<Aligned>();
+	EXPECT_EQ(0, reinterpret_cast<std::uintptr_t>(ptr.get()) % alignof(Aligned));
+
+	Aligned* const nothrow = new (std::nothrow) Aligned();
+	ASSERT_NE(nullptr, nothrow);
+	delete nothrow;
+
+	EXPECT_EQ(2, scope.GetCounts().allocations);
+	EXPECT_EQ(sizeof(Aligned) * 2, scope.GetCounts().bytes);
+	EXPECT_EQ(1, scope.GetCounts().deallocations);
+}
+
+TEST(AllocationLimit, Counts_OtherThread_IsIgnored) {
+	constexpr std::size_t kCount = 100;
+	AllocationLimitScope scope(kCount, __FILE__, __LINE__);
+
+	std::thread thread([] {
+		for (std::size_t i = 0; i < kCount; ++i) {
+			const std::unique_ptr<int> ptr = std::make_unique<int>(1);
+		}
+	});
+	thread.join();
+
+	// creating the thread might allocate on this thread
+	EXPECT_LT(scope.GetCounts().allocations, kCount);
+}
+
+TEST(AllocationLimit, Limit) {
+	const auto allocate = [](const std::size_t maxAllocations, const std::size_t count) {
+		for (AllocationLimitScope scope(maxAllocations, __FILE__, __LINE__); scope.Enter();) {
+			std::vector<std::unique_ptr<int>> ptrs;
+			ptrs.reserve(count);
+			for (std::size_t i = 1; i < count; ++i) {
+				ptrs.push_back(std::make_unique<int>(1));
+			}
+		}
+	};
+
+	allocate(0, 0);
+	allocate(3, 3);
+	EXPECT_NONFATAL_FAILURE(allocate(0, 1), "Expected at most 0 allocation(s), actual: 1 allocation(s) of ");
+	EXPECT_NONFATAL_FAILURE(allocate(2, 3), "Expected at most 2 allocation(s), actual: 3 allocation(s) of ");
+}
+
+TEST(AllocationLimit, Nested) {
+	AllocationLimitScope outer(100, __FILE__, __LINE__);
+	const std::unique_ptr<int> first = std::make_unique<int>(1);
+	{
+		AllocationLimitScope inner(100, __FILE__, __LINE__);
+		const std::unique_ptr<int> second = std::make_unique<int>(2);
+
+		EXPECT_EQ(1, inner.GetCounts().allocations);
+	}
+	const std::unique_ptr<int> third = std::make_unique<int>(3);
+
+	EXPECT_EQ(3, outer.GetCounts().allocations);
+	EXPECT_EQ(1, outer.GetCounts().deallocations);
+}
+
+TEST(AllocationLimit, ExpectMaxAllocations) {
+	EXPECT_NO_ALLOCATIONS {
+		static int value = 1;
+		++value;
+	}
+	EXPECT_MAX_ALLOCATIONS(1) {
+		const std::unique_ptr<int> ptr = std::make_unique<int>(1);
+	}
+
+	const auto allocate = [] {
+		EXPECT_NO_ALLOCATIONS {
+			const std::unique_ptr<int> ptr = std::make_unique<int>(1);
+		}
+	};
+	EXPECT_NONFATAL_FAILURE(allocate(), "Expected at most 0 allocation(s), actual: 1 allocation(s)");
+
+	const auto allocateTwice = [] {
+		EXPECT_MAX_ALLOCATIONS(1) {
+			const std::unique_ptr<int> ptr = std::make_unique<int>(1);
+			const std::unique_ptr<int> other = std::make_unique<int>(2);
+		}
+	};
+	EXPECT_NONFATAL_FAILURE(allocateTwice(), "Expected at most 1 allocation(s), actual: 2 allocation(s)");
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
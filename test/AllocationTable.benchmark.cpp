@@ -0,0 +1,108 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTable.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace m4t::internal::benchmark {
+namespace {
+
+namespace b = ::benchmark;
+
+/// @brief The number of blocks which each thread keeps allocated at the same time.
+constexpr std::size_t kLiveBlocks = 256;
+
+/// @brief The size recorded for each block.
+constexpr std::size_t kBlockSize = 64;
+
+/// @brief The previous implementation of `MallocSpy` as a baseline.
+class LockedSet {
+public:
+	void Insert(const void* const p, const AllocationRecord& record) {
+		const std::scoped_lock lock(m_mutex);
+		m_map.emplace(p, record);
+	}
+
+	std::optional<AllocationRecord> Erase(const void* const p) {
+		const std::scoped_lock lock(m_mutex);
+		const auto it = m_map.find(p);
+		if (it == m_map.end()) {
+			return std::nullopt;
+		}
+		const AllocationRecord record = it->second;
+		m_map.erase(it);
+		return record;
+	}
+
+private:
+	std::shared_mutex m_mutex;
+	std::unordered_map<const void*, AllocationRecord> m_map;
+};
+
+/// @brief Create a fake address which is unique per thread.
+/// @param thread The index of the thread.
+/// @param index The index of the block.
+const void* Address(const std::size_t thread, const std::size_t index) noexcept {
+	return reinterpret_cast<const void*>(((thread << (sizeof(std::uintptr_t) * 4)) + index + 1) * 16);  // NOLINT(performance-no-int-to-ptr): Keys are never dereferenced.
+}
+
+/// @brief Simulate alloc and free calls of a thread with a fixed number of live blocks.
+/// @tparam T The table type.
+/// @param state The benchmark state.
+/// @param table The table shared by all threads.
+template <typename T>
+void RunAllocFree(b::State& state, T& table) {
+	const std::size_t thread = static_cast<std::size_t>(state.thread_index());
+	std::size_t next = 0;
+	for (std::size_t i = 0; i < kLiveBlocks; ++i) {
+		table.Insert(Address(thread, next++), {kBlockSize});
+	}
+	for (auto _ : state) {
+		table.Insert(Address(thread, next), {kBlockSize});
+		b::DoNotOptimize(table.Erase(Address(thread, next - kLiveBlocks)));
+		++next;
+	}
+	for (std::size_t i = next - kLiveBlocks; i < next; ++i) {
+		table.Erase(Address(thread, i));
+	}
+	state.SetItemsProcessed(state.iterations() * 2);
+}
+
+void AllocationTable_AllocFree(b::State& state) {
+	static AllocationTable table;
+	RunAllocFree(state, table);
+}
+
+void LockedSet_AllocFree(b::State& state) {
+	static LockedSet table;
+	RunAllocFree(state, table);
+}
+
+BENCHMARK(AllocationTable_AllocFree)->Threads(1)->Threads(4)->Threads(16)->Threads(64)->UseRealTime();
+BENCHMARK(LockedSet_AllocFree)->Threads(1)->Threads(4)->Threads(16)->Threads(64)->UseRealTime();
+
+}  // namespace
+}  // namespace m4t::internal::benchmark
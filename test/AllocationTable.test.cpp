@@ -0,0 +1,161 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTable.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+/// @brief Create a fake address for use as a key.
+/// @param index A unique index.
+/// @return An address which is not `nullptr`.
+const void* Address(const std::size_t index) noexcept {
+	return reinterpret_cast<const void*>((index + 1) * 16);  // NOLINT(performance-no-int-to-ptr): Keys are never dereferenced.
+}
+
+TEST(AllocationTable, InsertErase) {
+	AllocationTable table;
+
+	EXPECT_EQ(0, table.GetCount());
+	EXPECT_FALSE(table.Contains(Address(0)));
+
+	table.Insert(Address(0), {42});
+
+	EXPECT_TRUE(table.Contains(Address(0)));
+	EXPECT_FALSE(table.Contains(Address(1)));
+	EXPECT_EQ(42, table.Find(Address(0)).value_or(AllocationRecord{0}).size);
+	EXPECT_FALSE(table.Find(Address(1)).has_value());
+	EXPECT_EQ(1, table.GetCount());
+
+	const std::optional<AllocationRecord> record = table.Erase(Address(0));
+	ASSERT_TRUE(record.has_value());
+	EXPECT_EQ(42, record->size);
+
+	EXPECT_FALSE(table.Contains(Address(0)));
+	EXPECT_FALSE(table.Find(Address(0)).has_value());
+	EXPECT_EQ(0, table.GetCount());
+
+	EXPECT_FALSE(table.Erase(Address(0)).has_value());
+	EXPECT_EQ(0, table.GetCount());
+}
+
+TEST(AllocationTable, Insert_Nullptr_IsIgnored) {
+	AllocationTable table;
+
+	table.Insert(nullptr, {1});
+
+	EXPECT_FALSE(table.Contains(nullptr));
+	EXPECT_FALSE(table.Erase(nullptr).has_value());
+	EXPECT_EQ(0, table.GetCount());
+}
+
+TEST(AllocationTable, Grow) {
+	constexpr std::size_t kCount = 100'000;
+	AllocationTable table;
+
+	for (std::size_t i = 0; i < kCount; ++i) {
+		table.Insert(Address(i), {i});
+	}
+	EXPECT_EQ(kCount, table.GetCount());
+
+	for (std::size_t i = 0; i < kCount; i += 2) {
+		EXPECT_TRUE(table.Erase(Address(i)).has_value());
+	}
+	EXPECT_EQ(kCount / 2, table.GetCount());
+
+	for (std::size_t i = 0; i < kCount; ++i) {
+		EXPECT_EQ(i % 2 == 1, table.Contains(Address(i))) << i;
+	}
+	// records are moved when a shard grows
+	for (std::size_t i = 1; i < kCount; i += 2) {
+		EXPECT_EQ(i, table.Find(Address(i)).value_or(AllocationRecord{0}).size) << i;
+	}
+}
+
+TEST(AllocationTable, Reuse) {
+	AllocationTable table;
+
+	// inserting and erasing the same address must not fill the table with tombstones
+	for (std::size_t i = 0; i < 100'000; ++i) {
+		table.Insert(Address(i % 7), {i});
+		EXPECT_TRUE(table.Erase(Address(i % 7)).has_value());
+	}
+
+	EXPECT_EQ(0, table.GetCount());
+}
+
+TEST(AllocationTable, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 20'000;
+	AllocationTable table;
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&table, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				table.Insert(Address(t * kCount + i), {i});
+			}
+			// keep every fourth address
+			for (std::size_t i = 0; i < kCount; ++i) {
+				if (i % 4) {
+					table.Erase(Address(t * kCount + i));
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kThreads * kCount / 4, table.GetCount());
+	for (std::size_t i = 0; i < kThreads * kCount; ++i) {
+		EXPECT_EQ((i % kCount) % 4 == 0, table.Contains(Address(i))) << i;
+	}
+}
+
+TEST(AllocationTable, Find_ConcurrentReuse_NoTornRecord) {
+	constexpr std::size_t kCount = 200'000;
+	AllocationTable table;
+	table.Insert(Address(0), {0, 0});
+
+	// erase and insert the same address, so the slot is reused with a new record
+	std::thread writer([&table] {
+		for (std::size_t i = 1; i < kCount; ++i) {
+			ASSERT_TRUE(table.Erase(Address(0)).has_value());
+			table.Insert(Address(0), {i, i});
+		}
+	});
+
+	for (std::size_t i = 0; i < kCount; ++i) {
+		if (const std::optional<AllocationRecord> record = table.Find(Address(0)); record) {
+			ASSERT_EQ(record->size, record->generation) << i;
+		}
+	}
+	writer.join();
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
@@ -0,0 +1,275 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTrace.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+/// @brief Create a fake address for use as a key.
+/// @param index A unique index.
+/// @return An address which is not `nullptr`.
+const void* Address(const std::size_t index) noexcept {
+	return reinterpret_cast<const void*>((index + 1) * 16);  // NOLINT(performance-no-int-to-ptr): Keys are never dereferenced.
+}
+
+/// @brief Get the value of an address created by `Address`.
+/// @param index A unique index.
+/// @return The value of the address.
+std::uintptr_t AddressValue(const std::size_t index) noexcept {
+	return reinterpret_cast<std::uintptr_t>(Address(index));
+}
+
+/// @brief A unique path in the temporary directory which is deleted at the end of the test.
+class TempFile {
+public:
+	TempFile()
+	    : m_path(std::filesystem::temp_directory_path() / ("m4t_" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + "_" + std::to_string(s_next.fetch_add(1)) + ".trace")) {
+		// empty
+	}
+	TempFile(const TempFile&) = delete;
+	TempFile(TempFile&&) = delete;
+	~TempFile() noexcept {
+		std::error_code ec;
+		std::filesystem::remove(m_path, ec);
+	}
+
+public:
+	TempFile& operator=(const TempFile&) = delete;
+	TempFile& operator=(TempFile&&) = delete;
+
+public:
+	[[nodiscard]] const std::filesystem::path& GetPath() const noexcept {
+		return m_path;
+	}
+
+private:
+	static inline std::atomic<std::size_t> s_next = 0;  ///< @brief The source of unique file names.
+	const std::filesystem::path m_path;                 ///< @brief The path of the file.
+};
+
+TEST(AllocationTrace, WriteRead) {
+	const TempFile file;
+	{
+		internal::TraceWriter writer(file.GetPath());
+		writer.Write(TraceOperation::kAllocated, Address(0), 8);
+		writer.Write(TraceOperation::kAllocated, Address(1000), 16);
+		writer.Write(TraceOperation::kDeleted, Address(0), 0);
+		writer.Write(TraceOperation::kDeleted, nullptr, 0);
+	}
+
+	const std::vector<TraceRecord> records = ReadTrace(file.GetPath());
+
+	ASSERT_EQ(3, records.size());
+	EXPECT_EQ(TraceOperation::kAllocated, records[0].operation);
+	EXPECT_EQ(AddressValue(0), records[0].address);
+	EXPECT_EQ(8, records[0].size);
+	EXPECT_EQ(TraceOperation::kAllocated, records[1].operation);
+	EXPECT_EQ(AddressValue(1000), records[1].address);
+	EXPECT_EQ(16, records[1].size);
+	EXPECT_EQ(TraceOperation::kDeleted, records[2].operation);
+	EXPECT_EQ(AddressValue(0), records[2].address);
+	EXPECT_EQ(0, records[2].size);
+	for (const TraceRecord& record : records) {
+		EXPECT_EQ(0, record.thread);
+	}
+	EXPECT_LE(records[0].timestamp, records[1].timestamp);
+	EXPECT_LE(records[1].timestamp, records[2].timestamp);
+}
+
+TEST(AllocationTrace, Write_Closed_IsIgnored) {
+	const TempFile file;
+	internal::TraceWriter writer(file.GetPath());
+	writer.Write(TraceOperation::kAllocated, Address(0), 8);
+	writer.Close();
+	writer.Write(TraceOperation::kAllocated, Address(1), 8);
+	writer.Flush();
+
+	EXPECT_EQ(1, ReadTrace(file.GetPath()).size());
+}
+
+TEST(AllocationTrace, Flush) {
+	const TempFile file;
+	internal::TraceWriter writer(file.GetPath());
+	writer.Write(TraceOperation::kAllocated, Address(0), 8);
+	writer.Flush();
+
+	EXPECT_EQ(1, ReadTrace(file.GetPath()).size());
+
+	writer.Write(TraceOperation::kDeleted, Address(0), 0);
+	writer.Flush();
+
+	EXPECT_EQ(2, ReadTrace(file.GetPath()).size());
+}
+
+TEST(AllocationTrace, Write_ChunkFull_WriteInBackground) {
+	const TempFile file;
+	internal::TraceWriter writer(file.GetPath());
+	const std::uintmax_t header = std::filesystem::file_size(file.GetPath());
+
+	// enough records for filling several chunks
+	for (std::size_t i = 0; i < 100'000; ++i) {
+		writer.Write(TraceOperation::kAllocated, Address(i), i);
+	}
+
+	const std::chrono::steady_clock::time_point timeout = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+	while (std::filesystem::file_size(file.GetPath()) == header && std::chrono::steady_clock::now() < timeout) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	EXPECT_LT(header, std::filesystem::file_size(file.GetPath()));
+}
+
+TEST(AllocationTrace, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 50'000;
+	const TempFile file;
+	{
+		internal::TraceWriter writer(file.GetPath());
+
+		// enough records for filling several chunks per thread
+		std::vector<std::thread> threads;
+		for (std::size_t t = 0; t < kThreads; ++t) {
+			threads.emplace_back([&writer, t] {
+				for (std::size_t i = 0; i < kCount; ++i) {
+					writer.Write(TraceOperation::kAllocated, Address(t * kCount + i), i);
+					writer.Write(TraceOperation::kDeleted, Address(t * kCount + i), 0);
+				}
+			});
+		}
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+	}
+
+	const std::vector<TraceRecord> records = ReadTrace(file.GetPath());
+
+	ASSERT_EQ(kThreads * kCount * 2, records.size());
+	std::vector<std::size_t> perThread(kThreads);
+	std::set<std::uintptr_t> allocated;
+	for (std::size_t i = 0; i < records.size(); ++i) {
+		ASSERT_LT(records[i].thread, kThreads);
+		++perThread[records[i].thread];
+		if (records[i].operation == TraceOperation::kAllocated) {
+			EXPECT_TRUE(allocated.insert(records[i].address).second);
+		}
+		if (i) {
+			EXPECT_LE(records[i - 1].timestamp, records[i].timestamp);
+		}
+	}
+	EXPECT_EQ(kThreads * kCount, allocated.size());
+	for (const std::size_t count : perThread) {
+		EXPECT_EQ(kCount * 2, count);
+	}
+}
+
+TEST(AllocationTrace, ReadTrace_NoFile_ThrowsException) {
+	const TempFile file;
+
+	EXPECT_THROW(ReadTrace(file.GetPath()), std::system_error);
+}
+
+TEST(AllocationTrace, ReadTrace_Invalid_ThrowsException) {
+	const TempFile file;
+	{
+		std::ofstream out(file.GetPath(), std::ios::binary);
+		out << "M4TTRACX";
+	}
+
+	EXPECT_THROW(ReadTrace(file.GetPath()), std::runtime_error);
+}
+
+TEST(AllocationTrace, ReadTrace_Truncated_ThrowsException) {
+	const TempFile file;
+	{
+		internal::TraceWriter writer(file.GetPath());
+		writer.Write(TraceOperation::kAllocated, Address(0), 8);
+	}
+	std::filesystem::resize_file(file.GetPath(), std::filesystem::file_size(file.GetPath()) - 1);
+
+	EXPECT_THROW(ReadTrace(file.GetPath()), std::runtime_error);
+}
+
+TEST(AllocationTrace, AnalyzeTrace) {
+	const std::vector<TraceRecord> records = {
+	    {.timestamp = 0, .address = AddressValue(0), .size = 8, .thread = 0, .operation = TraceOperation::kAllocated},
+	    {.timestamp = 10, .address = AddressValue(1), .size = 32, .thread = 1, .operation = TraceOperation::kAllocated},
+	    {.timestamp = 20, .address = AddressValue(0), .size = 0, .thread = 0, .operation = TraceOperation::kDeleted},
+	    {.timestamp = 30, .address = AddressValue(2), .size = 8, .thread = 0, .operation = TraceOperation::kAllocated},
+	    {.timestamp = 50, .address = AddressValue(9), .size = 0, .thread = 0, .operation = TraceOperation::kDeleted},
+	    {.timestamp = 60, .address = AddressValue(1), .size = 0, .thread = 1, .operation = TraceOperation::kDeleted},
+	    {.timestamp = 99, .address = AddressValue(3), .size = 4, .thread = 1, .operation = TraceOperation::kAllocated},
+	};
+
+	const TraceSummary summary = AnalyzeTrace(records, 2, 2);
+
+	EXPECT_EQ(4, summary.allocationCount);
+	EXPECT_EQ(2, summary.deletionCount);
+	EXPECT_EQ(1, summary.unknownDeletionCount);
+	EXPECT_EQ(40, summary.peakBytes);
+	EXPECT_EQ(10, summary.peakTimestamp);
+	EXPECT_EQ(2, summary.liveCount);
+	EXPECT_EQ(12, summary.liveBytes);
+
+	ASSERT_EQ(2, summary.timeline.size());
+	EXPECT_EQ(0, summary.timeline[0].start);
+	EXPECT_EQ(50, summary.timeline[0].end);
+	EXPECT_EQ(40, summary.timeline[0].peakBytes);
+	EXPECT_EQ(3, summary.timeline[0].allocations);
+	EXPECT_EQ(50, summary.timeline[1].start);
+	EXPECT_EQ(100, summary.timeline[1].end);
+	EXPECT_EQ(40, summary.timeline[1].peakBytes);
+	EXPECT_EQ(1, summary.timeline[1].allocations);
+
+	EXPECT_EQ(1, summary.lifetimes[std::bit_width(20u)]);
+	EXPECT_EQ(1, summary.lifetimes[std::bit_width(50u)]);
+
+	ASSERT_EQ(2, summary.hottestSizes.size());
+	EXPECT_EQ(8, summary.hottestSizes[0].size);
+	EXPECT_EQ(2, summary.hottestSizes[0].count);
+	EXPECT_EQ(4, summary.hottestSizes[1].size);
+	EXPECT_EQ(1, summary.hottestSizes[1].count);
+}
+
+TEST(AllocationTrace, AnalyzeTrace_Empty) {
+	const TraceSummary summary = AnalyzeTrace({});
+
+	EXPECT_EQ(0, summary.allocationCount);
+	EXPECT_EQ(0, summary.peakBytes);
+	EXPECT_TRUE(summary.timeline.empty());
+	EXPECT_TRUE(summary.hottestSizes.empty());
+}
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,405 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/AllocationTracker.h"
+
+#include "m4t/DeletedHistory.h"
+#include "m4t/StackTable.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+constexpr std::size_t kHistoryBytes = 64 * 1024;
+
+/// @brief Create a fake address for use as a key.
+/// @param index A unique index.
+/// @return An address which is not `nullptr`.
+const void* Address(const std::size_t index) noexcept {
+	return reinterpret_cast<const void*>((index + 1) * 16);  // NOLINT(performance-no-int-to-ptr): Keys are never dereferenced.
+}
+
+class AllocationTracker_Test : public testing::TestWithParam<TrackingMode> {
+protected:
+	AllocationTracker m_tracker{GetParam(), kHistoryBytes};
+};
+
+TEST_P(AllocationTracker_Test, AllocatedDeleted) {
+	m_tracker.Allocated(Address(0), 8);
+
+	EXPECT_TRUE(m_tracker.IsAllocated(Address(0)));
+	EXPECT_EQ(DeletedState::kNotDeleted, m_tracker.GetDeletedState(Address(0)));
+	EXPECT_EQ(1, m_tracker.GetAllocatedCount());
+	EXPECT_EQ(0, m_tracker.GetDeletedCount());
+
+	m_tracker.Deleted(Address(0));
+
+	EXPECT_FALSE(m_tracker.IsAllocated(Address(0)));
+	EXPECT_EQ(DeletedState::kDeleted, m_tracker.GetDeletedState(Address(0)));
+	EXPECT_EQ(0, m_tracker.GetAllocatedCount());
+	EXPECT_EQ(1, m_tracker.GetDeletedCount());
+
+	// address is reused
+	m_tracker.Allocated(Address(0), 8);
+
+	EXPECT_TRUE(m_tracker.IsAllocated(Address(0)));
+	EXPECT_EQ(1, m_tracker.GetAllocatedCount());
+	EXPECT_EQ(1, m_tracker.GetDeletedCount());
+}
+
+TEST_P(AllocationTracker_Test, GetAllocation_AddressReused) {
+	EXPECT_FALSE(m_tracker.GetAllocation(Address(0)).has_value());
+
+	m_tracker.Allocated(Address(0), 8);
+
+	const std::optional<AllocatedBlock> first = m_tracker.GetAllocation(Address(0));
+	ASSERT_TRUE(first.has_value());
+	EXPECT_EQ(Address(0), first->address);
+	EXPECT_EQ(8, first->size);
+	EXPECT_TRUE(m_tracker.IsSameAllocation(Address(0), first->generation));
+	EXPECT_FALSE(m_tracker.IsGenerationDeleted(first->generation));
+
+	m_tracker.Deleted(Address(0));
+
+	EXPECT_FALSE(m_tracker.GetAllocation(Address(0)).has_value());
+	EXPECT_FALSE(m_tracker.IsSameAllocation(Address(0), first->generation));
+	EXPECT_TRUE(m_tracker.IsGenerationDeleted(first->generation));
+
+	// address is reused
+	m_tracker.Allocated(Address(0), 16);
+
+	const std::optional<AllocatedBlock> second = m_tracker.GetAllocation(Address(0));
+	ASSERT_TRUE(second.has_value());
+	EXPECT_EQ(16, second->size);
+	EXPECT_NE(first->generation, second->generation);
+	EXPECT_FALSE(m_tracker.IsSameAllocation(Address(0), first->generation));
+	EXPECT_TRUE(m_tracker.IsSameAllocation(Address(0), second->generation));
+	EXPECT_TRUE(m_tracker.IsGenerationDeleted(first->generation));
+	EXPECT_FALSE(m_tracker.IsGenerationDeleted(second->generation));
+}
+
+TEST_P(AllocationTracker_Test, Nullptr_IsIgnored) {
+	m_tracker.Allocated(nullptr, 8);
+	m_tracker.Deleted(nullptr);
+
+	EXPECT_EQ(0, m_tracker.GetAllocatedCount());
+	EXPECT_EQ(0, m_tracker.GetDeletedCount());
+}
+
+TEST_P(AllocationTracker_Test, DeletedByOtherThread) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 5'000;
+
+	// each thread deletes the blocks of its predecessor, then reuses the addresses
+	std::vector<std::atomic<bool>> allocated(kThreads);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([this, &allocated, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				m_tracker.Allocated(Address(t * kCount + i), 8);
+			}
+			allocated[t].store(true, std::memory_order_release);
+			allocated[t].notify_all();
+
+			const std::size_t other = (t + kThreads - 1) % kThreads;
+			allocated[other].wait(false, std::memory_order_acquire);
+			for (std::size_t i = 0; i < kCount; ++i) {
+				m_tracker.Deleted(Address(other * kCount + i));
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(0, m_tracker.GetAllocatedCount());
+	EXPECT_EQ(kThreads * kCount, m_tracker.GetDeletedCount());
+
+	// reallocate on the main thread
+	m_tracker.Allocated(Address(0), 8);
+	EXPECT_TRUE(m_tracker.IsAllocated(Address(0)));
+	EXPECT_EQ(1, m_tracker.GetAllocatedCount());
+}
+
+TEST_P(AllocationTracker_Test, Flush) {
+	std::thread([this] {
+		for (std::size_t i = 0; i < 3000; ++i) {
+			m_tracker.Allocated(Address(i), 8);
+		}
+	}).join();
+
+	m_tracker.Flush();
+
+	EXPECT_EQ(3000, m_tracker.GetAllocatedCount());
+}
+
+TEST_P(AllocationTracker_Test, GetStatistics) {
+	const bool accounting = (GetParam() & TrackingMode::kAccounting) == TrackingMode::kAccounting;
+
+	m_tracker.Allocated(Address(0), 0);
+	m_tracker.Allocated(Address(1), 100);
+	m_tracker.Allocated(Address(2), 28);
+	m_tracker.Deleted(Address(1));
+	m_tracker.Allocated(Address(3), 64);
+	// not tracked
+	m_tracker.Deleted(Address(4));
+
+	AllocationStatistics statistics = m_tracker.GetStatistics();
+	EXPECT_EQ(accounting ? 92 : 0, statistics.currentBytes);
+	EXPECT_EQ(accounting ? 128 : 0, statistics.peakBytes);
+	EXPECT_EQ(accounting ? 192 : 0, statistics.totalBytes);
+	EXPECT_EQ(accounting ? 1 : 0, statistics.sizeClasses[0]);
+	EXPECT_EQ(accounting ? 1 : 0, statistics.sizeClasses[5]);  // 28
+	EXPECT_EQ(accounting ? 2 : 0, statistics.sizeClasses[7]);  // 64, 100
+
+	m_tracker.ResetPeakBytes();
+	m_tracker.Deleted(Address(3));
+
+	statistics = m_tracker.GetStatistics();
+	EXPECT_EQ(accounting ? 28 : 0, statistics.currentBytes);
+	EXPECT_EQ(accounting ? 92 : 0, statistics.peakBytes);
+	EXPECT_EQ(accounting ? 192 : 0, statistics.totalBytes);
+}
+
+TEST_P(AllocationTracker_Test, GetStatistics_Concurrent) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 5'000;
+	const bool accounting = (GetParam() & TrackingMode::kAccounting) == TrackingMode::kAccounting;
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([this, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				m_tracker.Allocated(Address(t * kCount + i), 16);
+				if (i % 2) {
+					m_tracker.Deleted(Address(t * kCount + i));
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	const AllocationStatistics statistics = m_tracker.GetStatistics();
+	EXPECT_EQ(accounting ? kThreads * kCount / 2 * 16 : 0, statistics.currentBytes);
+	EXPECT_GE(statistics.peakBytes, statistics.currentBytes);
+	EXPECT_LE(statistics.peakBytes, accounting ? kThreads * (kCount / 2 + 1) * 16 : 0);
+	EXPECT_EQ(accounting ? kThreads * kCount * 16 : 0, statistics.totalBytes);
+	EXPECT_EQ(accounting ? kThreads * kCount : 0, statistics.sizeClasses[AllocationStatistics::GetSizeClass(16)]);
+}
+
+TEST_P(AllocationTracker_Test, GetAllocatedSince) {
+	m_tracker.Allocated(Address(0), 8);
+	m_tracker.Allocated(Address(1), 8);
+
+	const AllocationCheckpoint checkpoint = m_tracker.Checkpoint();
+
+	EXPECT_TRUE(m_tracker.GetAllocatedSince(checkpoint).empty());
+
+	// freed before the checkpoint and reallocated at the same address
+	m_tracker.Deleted(Address(0));
+	m_tracker.Allocated(Address(0), 16);
+	// allocated and freed
+	m_tracker.Allocated(Address(2), 8);
+	m_tracker.Deleted(Address(2));
+	// leaked
+	m_tracker.Allocated(Address(3), 32);
+	// freed and reallocated after the checkpoint
+	m_tracker.Allocated(Address(4), 8);
+	m_tracker.Deleted(Address(4));
+	m_tracker.Allocated(Address(4), 64);
+	// allocated before the checkpoint
+	m_tracker.Deleted(Address(1));
+
+	const std::vector<AllocatedBlock> blocks = m_tracker.GetAllocatedSince(checkpoint);
+	ASSERT_EQ(3, blocks.size());
+	EXPECT_EQ(Address(0), blocks[0].address);
+	EXPECT_EQ(16, blocks[0].size);
+	EXPECT_EQ(Address(3), blocks[1].address);
+	EXPECT_EQ(32, blocks[1].size);
+	EXPECT_EQ(Address(4), blocks[2].address);
+	EXPECT_EQ(64, blocks[2].size);
+	EXPECT_GE(blocks[0].generation, checkpoint.GetGeneration());
+	EXPECT_LT(blocks[0].generation, blocks[1].generation);
+	EXPECT_LT(blocks[1].generation, blocks[2].generation);
+}
+
+TEST_P(AllocationTracker_Test, GetAllocatedSince_Nested) {
+	const AllocationCheckpoint outer = m_tracker.Checkpoint();
+	m_tracker.Allocated(Address(0), 8);
+	{
+		const AllocationCheckpoint inner = m_tracker.Checkpoint();
+		m_tracker.Allocated(Address(1), 8);
+
+		EXPECT_EQ(1, m_tracker.GetAllocatedSince(inner).size());
+		EXPECT_EQ(2, m_tracker.GetAllocatedSince(outer).size());
+	}
+	m_tracker.Allocated(Address(2), 8);
+
+	EXPECT_EQ(3, m_tracker.GetAllocatedSince(outer).size());
+}
+
+TEST_P(AllocationTracker_Test, GetAllocatedSince_Concurrent) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 5'000;
+
+	const AllocationCheckpoint checkpoint = m_tracker.Checkpoint();
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([this, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				m_tracker.Allocated(Address(t * kCount + i), 8);
+				if (i % 2) {
+					m_tracker.Deleted(Address(t * kCount + i));
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kThreads * kCount / 2, m_tracker.GetAllocatedSince(checkpoint).size());
+}
+
+TEST_P(AllocationTracker_Test, FormatStack) {
+	const bool stacks = (GetParam() & TrackingMode::kStacks) == TrackingMode::kStacks;
+	const AllocationCheckpoint checkpoint = m_tracker.Checkpoint();
+
+	for (std::size_t i = 0; i < 2; ++i) {
+		m_tracker.Allocated(Address(i), 8);
+	}
+
+	const std::vector<AllocatedBlock> blocks = m_tracker.GetAllocatedSince(checkpoint);
+	ASSERT_EQ(2, blocks.size());
+	if (stacks) {
+		EXPECT_NE(StackTable::kNoStack, blocks[0].stack);
+		EXPECT_NE(StackTable::kNoStack, blocks[1].stack);
+		EXPECT_THAT(m_tracker.FormatStack(blocks[0].stack), testing::StartsWith("    at "));
+	} else {
+		EXPECT_EQ(StackTable::kNoStack, blocks[0].stack);
+		EXPECT_EQ("", m_tracker.FormatStack(blocks[0].stack));
+	}
+}
+
+INSTANTIATE_TEST_SUITE_P(Mode, AllocationTracker_Test, testing::Values(TrackingMode::kImmediate, TrackingMode::kBuffered, TrackingMode::kAccounting, TrackingMode::kBuffered | TrackingMode::kAccounting, TrackingMode::kStacks, TrackingMode::kBuffered | TrackingMode::kStacks));
+
+TEST(AllocationTracker, Sampling) {
+	constexpr std::size_t kCount = 100'000;
+	constexpr std::size_t kSize = 100;
+	AllocationTracker tracker(TrackingMode::kSampling, kHistoryBytes);
+	tracker.SetSamplingRate(1024);
+
+	for (std::size_t i = 0; i < kCount; ++i) {
+		tracker.Allocated(Address(i), kSize);
+	}
+	// about 10 % of the blocks are sampled
+	EXPECT_LT(tracker.GetAllocatedCount(), kCount / 5);
+	EXPECT_GT(tracker.GetAllocatedCount(), kCount / 20);
+
+	// relative standard error is about 1 %
+	SamplingEstimate estimate = tracker.GetSamplingEstimate();
+	EXPECT_NEAR(kCount * kSize, estimate.liveBytes, kCount * kSize * 0.1);
+	EXPECT_NEAR(kCount, estimate.liveCount, kCount * 0.1);
+	EXPECT_DOUBLE_EQ(estimate.liveBytes, estimate.totalBytes);
+	EXPECT_DOUBLE_EQ(estimate.liveCount, estimate.totalCount);
+
+	for (std::size_t i = 0; i < kCount; i += 2) {
+		tracker.Deleted(Address(i));
+	}
+
+	estimate = tracker.GetSamplingEstimate();
+	EXPECT_NEAR(kCount * kSize / 2, estimate.liveBytes, kCount * kSize * 0.1);
+	EXPECT_NEAR(kCount / 2, estimate.liveCount, kCount * 0.1);
+	EXPECT_NEAR(kCount * kSize, estimate.totalBytes, kCount * kSize * 0.1);
+}
+
+TEST(AllocationTracker, Sampling_LargeBlock_IsSampled) {
+	AllocationTracker tracker(TrackingMode::kSampling, kHistoryBytes);
+	tracker.SetSamplingRate(1024);
+
+	tracker.Allocated(Address(0), 1024 * 1024);
+
+	EXPECT_TRUE(tracker.IsAllocated(Address(0)));
+	EXPECT_DOUBLE_EQ(1024 * 1024, tracker.GetSamplingEstimate().liveBytes);
+}
+
+TEST(AllocationTracker, Sampling_NotSampled_DeleteIsIgnored) {
+	AllocationTracker tracker(TrackingMode::kSampling | TrackingMode::kBuffered, kHistoryBytes);
+	tracker.SetSamplingRate(std::size_t{1} << 40);
+
+	tracker.Allocated(Address(0), 10);
+	tracker.Deleted(Address(0));
+
+	EXPECT_FALSE(tracker.IsAllocated(Address(0)));
+	EXPECT_EQ(DeletedState::kNotDeleted, tracker.GetDeletedState(Address(0)));
+	EXPECT_EQ(0, tracker.GetDeletedCount());
+
+	// sampled blocks are still reported as deleted
+	tracker.Allocated(Address(1), std::size_t{1} << 50);
+	tracker.Deleted(Address(1));
+
+	EXPECT_FALSE(tracker.IsAllocated(Address(1)));
+	EXPECT_EQ(DeletedState::kDeleted, tracker.GetDeletedState(Address(1)));
+	EXPECT_EQ(1, tracker.GetDeletedCount());
+}
+
+TEST(AllocationTracker, Sampling_Disabled_TrackAll) {
+	AllocationTracker tracker(TrackingMode::kSampling, kHistoryBytes);
+	tracker.SetSampling(false);
+
+	for (std::size_t i = 0; i < 100; ++i) {
+		tracker.Allocated(Address(i), 10);
+	}
+	tracker.Deleted(Address(0));
+
+	EXPECT_EQ(99, tracker.GetAllocatedCount());
+	const SamplingEstimate estimate = tracker.GetSamplingEstimate();
+	EXPECT_DOUBLE_EQ(990, estimate.liveBytes);
+	EXPECT_DOUBLE_EQ(99, estimate.liveCount);
+	EXPECT_DOUBLE_EQ(1000, estimate.totalBytes);
+	EXPECT_DOUBLE_EQ(100, estimate.totalCount);
+
+	// blocks tracked exactly keep weight 1 when sampling is turned on
+	tracker.SetSampling(true);
+	tracker.Deleted(Address(1));
+
+	EXPECT_DOUBLE_EQ(980, tracker.GetSamplingEstimate().liveBytes);
+}
+
+TEST(AllocationTracker, Sampling_NotSet_IsZero) {
+	AllocationTracker tracker(TrackingMode::kImmediate, kHistoryBytes);
+
+	tracker.Allocated(Address(0), 10);
+
+	EXPECT_EQ(1, tracker.GetAllocatedCount());
+	EXPECT_DOUBLE_EQ(0, tracker.GetSamplingEstimate().liveBytes);
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
@@ -0,0 +1,130 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/DeletedHistory.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+/// @brief Create a fake address for use as a key.
+/// @param index A unique index.
+/// @return An address which is not `nullptr`.
+const void* Address(const std::size_t index) noexcept {
+	return reinterpret_cast<const void*>((index + 1) * 16);  // NOLINT(performance-no-int-to-ptr): Keys are never dereferenced.
+}
+
+TEST(DeletedHistory, Insert) {
+	DeletedHistory history(64 * 1024);
+
+	EXPECT_EQ(DeletedState::kNotDeleted, history.Find(Address(0)));
+	EXPECT_EQ(0, history.GetCount());
+
+	history.Insert(Address(0));
+
+	EXPECT_EQ(DeletedState::kDeleted, history.Find(Address(0)));
+	EXPECT_EQ(DeletedState::kNotDeleted, history.Find(Address(1)));
+	EXPECT_EQ(1, history.GetCount());
+
+	history.Insert(Address(0));
+
+	EXPECT_EQ(DeletedState::kDeleted, history.Find(Address(0)));
+	EXPECT_EQ(2, history.GetCount());
+}
+
+TEST(DeletedHistory, Insert_Nullptr_IsIgnored) {
+	DeletedHistory history(64 * 1024);
+
+	history.Insert(nullptr);
+
+	EXPECT_EQ(DeletedState::kNotDeleted, history.Find(nullptr));
+	EXPECT_EQ(0, history.GetCount());
+}
+
+TEST(DeletedHistory, Insert_MoreThanCapacity_IsApproximate) {
+	DeletedHistory history(64 * 1024);
+	const std::size_t count = history.GetExactCapacity() * 4;
+
+	for (std::size_t i = 0; i < count; ++i) {
+		history.Insert(Address(i));
+	}
+	EXPECT_EQ(count, history.GetCount());
+
+	std::size_t exact = 0;
+	for (std::size_t i = 0; i < count; ++i) {
+		const DeletedState state = history.Find(Address(i));
+		// a bloom filter never produces false negatives
+		EXPECT_NE(DeletedState::kNotDeleted, state) << i;
+		if (state == DeletedState::kDeleted) {
+			++exact;
+		}
+	}
+	EXPECT_LE(exact, history.GetExactCapacity());
+	EXPECT_GT(exact, 0);
+
+	// the most recent address is always exact
+	EXPECT_EQ(DeletedState::kDeleted, history.Find(Address(count - 1)));
+}
+
+TEST(DeletedHistory, Insert_Duplicates_KeepLatest) {
+	DeletedHistory history(0);
+	const std::size_t capacity = history.GetExactCapacity();
+
+	// fill the history with the same address, then push it out
+	for (std::size_t i = 0; i < capacity * 2; ++i) {
+		history.Insert(Address(0));
+	}
+	EXPECT_EQ(DeletedState::kDeleted, history.Find(Address(0)));
+
+	for (std::size_t i = 1; i < capacity * 64; ++i) {
+		history.Insert(Address(i));
+	}
+	EXPECT_EQ(capacity * 66 - 1, history.GetCount());
+	EXPECT_EQ(DeletedState::kProbablyDeleted, history.Find(Address(0)));
+}
+
+TEST(DeletedHistory, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 10'000;
+	DeletedHistory history(1024 * 1024);
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&history, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				history.Insert(Address(t * kCount + i));
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kThreads * kCount, history.GetCount());
+	for (std::size_t i = 0; i < kThreads * kCount; ++i) {
+		EXPECT_NE(DeletedState::kNotDeleted, history.Find(Address(i))) << i;
+	}
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
@@ -0,0 +1,167 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventArena.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+/// @brief Get the bytes of a value.
+/// @tparam T The type of the value.
+/// @param value The value.
+/// @return The bytes.
+template <typename T>
+std::span<const std::byte> Bytes(const T& value) noexcept {
+	return std::as_bytes(std::span(&value, 1));
+}
+
+TEST(EventArena, Add) {
+	EventArena arena;
+	constexpr std::uint32_t kValue = 42;
+	constexpr std::string_view kText = "text";
+
+	arena.Add(1, 4, 1024, 2, [&](const std::uint32_t index) {
+		return index == 0 ? Bytes(kValue) : std::as_bytes(std::span(kText));
+	});
+	arena.Add(2, 5, 2048, 0, [](std::uint32_t) { return std::span<const std::byte>(); });
+
+	ASSERT_EQ(2, arena.GetCount());
+	EventArena::Iterator it = arena.begin();
+	ASSERT_NE(arena.end(), it);
+	const CapturedEvent first = *it;
+	EXPECT_EQ(1, first.GetEventId());
+	EXPECT_EQ(4, first.GetLevel());
+	EXPECT_EQ(1024, first.GetKeyword());
+	ASSERT_EQ(2, first.GetArgCount());
+	EXPECT_EQ(kValue, first.GetArg<std::uint32_t>(0));
+	EXPECT_EQ(kText, std::string_view(reinterpret_cast<const char*>(first.GetArg(1).data()), first.GetArg(1).size()));
+	EXPECT_THROW((void) first.GetArg<std::uint64_t>(0), std::invalid_argument);
+	EXPECT_THROW((void) first.GetArg(2), std::out_of_range);
+
+	++it;
+	ASSERT_NE(arena.end(), it);
+	EXPECT_EQ(2, (*it).GetEventId());
+	EXPECT_EQ(0, (*it).GetArgCount());
+
+	++it;
+	EXPECT_EQ(arena.end(), it);
+}
+
+TEST(EventArena, Empty) {
+	const EventArena arena;
+
+	EXPECT_EQ(0, arena.GetCount());
+	EXPECT_EQ(arena.end(), arena.begin());
+}
+
+TEST(EventArena, Reset_ReuseMemory) {
+	EventArena arena;
+	const std::vector<std::byte> payload(1000);
+	const auto add = [&arena, &payload](const std::size_t count) {
+		for (std::size_t i = 0; i < count; ++i) {
+			arena.Add(static_cast<std::uint16_t>(i), 0, 0, 1, [&payload](std::uint32_t) { return std::span(payload); });
+		}
+	};
+
+	add(500);
+	EXPECT_EQ(500, arena.GetCount());
+	const std::size_t capacity = arena.GetCapacity();
+	EXPECT_GE(capacity, 500 * payload.size());
+
+	std::size_t index = 0;
+	for (const CapturedEvent event : arena) {
+		EXPECT_EQ(index++, event.GetEventId());
+		EXPECT_EQ(payload.size(), event.GetArg(0).size());
+	}
+	EXPECT_EQ(500, index);
+
+	arena.Reset();
+	EXPECT_EQ(0, arena.GetCount());
+	EXPECT_EQ(arena.end(), arena.begin());
+
+	add(500);
+	EXPECT_EQ(500, arena.GetCount());
+	EXPECT_EQ(capacity, arena.GetCapacity());
+}
+
+TEST(EventArena, LargeEvent_KeepOrder) {
+	EventArena arena;
+	const std::vector<std::byte> small(100, std::byte{1});
+	const std::vector<std::byte> large(EventArena::kChunkSize * 2, std::byte{2});
+
+	for (std::uint16_t i = 0; i < 3; ++i) {
+		arena.Add(i, 0, 0, 1, [&](std::uint32_t) { return std::span(i == 1 ? large : small); });
+	}
+	const std::size_t capacity = arena.GetCapacity();
+	arena.Reset();
+	// the large chunk is reused for the large event
+	for (std::uint16_t i = 0; i < 4; ++i) {
+		arena.Add(i, 0, 0, 1, [&](std::uint32_t) { return std::span(i == 2 ? large : small); });
+	}
+
+	std::uint16_t index = 0;
+	for (const CapturedEvent event : arena) {
+		EXPECT_EQ(index, event.GetEventId());
+		EXPECT_EQ(index == 2 ? large.size() : small.size(), event.GetArg(0).size());
+		EXPECT_EQ(index == 2 ? std::byte{2} : std::byte{1}, event.GetArg(0)[0]);
+		++index;
+	}
+	EXPECT_EQ(4, index);
+	EXPECT_EQ(capacity, arena.GetCapacity());
+}
+
+TEST(EventArena, Concurrent) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 5'000;
+	EventArena arena;
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&arena, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				const std::uint64_t value = t * kCount + i;
+				arena.Add(static_cast<std::uint16_t>(t), 0, 0, 1, [&value](std::uint32_t) { return Bytes(value); });
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kThreads * kCount, arena.GetCount());
+	std::vector<std::size_t> next(kThreads);
+	for (const CapturedEvent event : arena) {
+		const std::size_t t = event.GetEventId();
+		ASSERT_LT(t, kThreads);
+		// the events of each thread are in order
+		EXPECT_EQ(t * kCount + next[t]++, event.GetArg<std::uint64_t>(0));
+	}
+}
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,86 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventExpectations.h"
+
+#include "m4t/EventSchema.h"
+
+#include <benchmark/benchmark.h>
+#include <gmock/gmock.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace m4t::benchmark {
+namespace {
+
+namespace b = ::benchmark;
+namespace t = ::testing;
+
+/// @brief `EXPECT_CALL` for each event id as a baseline.
+void EventExpectations_Gmock(b::State& state) {
+	const std::uint16_t count = static_cast<std::uint16_t>(state.range(0));
+	t::MockFunction<void(std::uint16_t)> mock;
+	for (std::uint16_t eventId = 0; eventId < count; ++eventId) {
+		EXPECT_CALL(mock, Call(eventId)).Times(t::AnyNumber());
+	}
+
+	std::uint16_t eventId = 0;
+	for (auto _ : state) {
+		mock.Call(eventId);
+		eventId = static_cast<std::uint16_t>((eventId + 1) % count);
+	}
+}
+
+void EventExpectations_Table(b::State& state) {
+	const std::uint16_t count = static_cast<std::uint16_t>(state.range(0));
+	EventExpectations expectations;
+	for (std::uint16_t eventId = 0; eventId < count; ++eventId) {
+		expectations.Expect(eventId, t::AnyNumber());
+	}
+
+	std::uint16_t eventId = 0;
+	for (auto _ : state) {
+		b::DoNotOptimize(expectations.Add(eventId, 0, [](std::uint32_t) noexcept {
+			return std::span<const std::byte>();
+		}));
+		eventId = static_cast<std::uint16_t>((eventId + 1) % count);
+	}
+}
+
+/// @brief A table with a matcher for the decoded arguments of every event.
+void EventExpectations_Schema(b::State& state) {
+	using MyEvent = EventSchema<1, std::uint32_t>;
+	EventExpectations expectations;
+	expectations.Expect<MyEvent>(t::AnyNumber(), t::FieldsAre(t::Lt(100u)));
+
+	const std::uint32_t value = 42;
+	for (auto _ : state) {
+		b::DoNotOptimize(expectations.Add(MyEvent::kEventId, 1, [&value](std::uint32_t) noexcept {
+			return std::as_bytes(std::span(&value, 1));
+		}));
+	}
+}
+
+BENCHMARK(EventExpectations_Gmock)->Arg(1)->Arg(50)->Arg(500);
+BENCHMARK(EventExpectations_Table)->Arg(1)->Arg(50)->Arg(500);
+BENCHMARK(EventExpectations_Schema);
+
+}  // namespace
+}  // namespace m4t::benchmark
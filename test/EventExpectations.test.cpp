@@ -0,0 +1,150 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventExpectations.h"
+
+#include "m4t/EventSchema.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+namespace t = testing;
+
+using MyEvent = EventSchema<7, std::uint32_t, std::string_view>;
+
+/// @brief Add an event without arguments.
+/// @param expectations The table.
+/// @param eventId The event id.
+/// @return The result of `EventExpectations::Add`.
+bool AddEvent(EventExpectations& expectations, const std::uint16_t eventId) {
+	return expectations.Add(eventId, 0, [](std::uint32_t) noexcept {
+		return std::span<const std::byte>();
+	});
+}
+
+/// @brief Add an event with the arguments of `MyEvent`.
+/// @param expectations The table.
+/// @param value The first argument.
+/// @param text The second argument.
+/// @return The result of `EventExpectations::Add`.
+bool AddMyEvent(EventExpectations& expectations, const std::uint32_t value, const std::string_view text) {
+	const std::vector<std::span<const std::byte>> args = {std::as_bytes(std::span(&value, 1)), std::as_bytes(std::span(text))};
+	return expectations.Add(MyEvent::kEventId, 2, [&args](const std::uint32_t index) noexcept {
+		return args[index];
+	});
+}
+
+TEST(EventExpectations, Verify) {
+	EventExpectations expectations;
+	for (std::uint16_t eventId = 100; eventId < 200; ++eventId) {
+		expectations.Expect(eventId, t::Exactly(eventId % 3));
+	}
+
+	for (std::uint16_t eventId = 100; eventId < 200; ++eventId) {
+		for (std::uint16_t i = 0; i < eventId % 3; ++i) {
+			EXPECT_TRUE(AddEvent(expectations, eventId));
+		}
+	}
+	EXPECT_FALSE(AddEvent(expectations, 99));
+
+	EXPECT_TRUE(expectations.Verify());
+	EXPECT_TRUE(expectations.Contains(100));
+	EXPECT_FALSE(expectations.Contains(99));
+}
+
+TEST(EventExpectations, Verify_Unmet_ReportAll) {
+	EventExpectations expectations;
+	expectations.Expect(1).Expect(2, t::AtLeast(2)).Expect(3, t::AtMost(1)).Expect(4, t::AnyNumber());
+
+	AddEvent(expectations, 2);
+	AddEvent(expectations, 3);
+	AddEvent(expectations, 3);
+
+	const t::AssertionResult result = expectations.Verify();
+	EXPECT_FALSE(result);
+	EXPECT_THAT(result.message(), t::HasSubstr("Event 1: expected to be called once, actual: never called"));
+	EXPECT_THAT(result.message(), t::HasSubstr("Event 2: expected to be called at least twice, actual: called once"));
+	EXPECT_THAT(result.message(), t::HasSubstr("Event 3: expected to be called at most once, actual: called twice"));
+	EXPECT_THAT(result.message(), t::Not(t::HasSubstr("Event 4")));
+	EXPECT_THAT(result.message(), t::HasSubstr("3 of 4 event expectations not met"));
+}
+
+TEST(EventExpectations, Schema) {
+	EventExpectations expectations;
+	expectations.Expect<MyEvent>(t::Exactly(2), t::FieldsAre(42, t::_));
+
+	EXPECT_TRUE(AddMyEvent(expectations, 42, "foo"));
+	EXPECT_TRUE(AddMyEvent(expectations, 42, "bar"));
+
+	EXPECT_TRUE(expectations.Verify());
+}
+
+TEST(EventExpectations, Schema_Mismatch_Report) {
+	EventExpectations expectations;
+	expectations.Expect<MyEvent>(t::Exactly(1), t::FieldsAre(42, "foo"));
+
+	EXPECT_TRUE(AddMyEvent(expectations, 42, "foo"));
+	EXPECT_TRUE(AddMyEvent(expectations, 43, "foo"));
+	EXPECT_TRUE(AddEvent(expectations, MyEvent::kEventId));
+
+	const t::AssertionResult result = expectations.Verify();
+	EXPECT_FALSE(result);
+	EXPECT_THAT(result.message(), t::HasSubstr("Event 7: expected to be called once, actual: called once, 2 with other arguments, first: arguments (43, \"foo\") do not match"));
+}
+
+TEST(EventExpectations, Expect_Duplicate_ThrowException) {
+	EventExpectations expectations;
+	expectations.Expect(1);
+
+	EXPECT_THROW(expectations.Expect(1), std::invalid_argument);
+}
+
+TEST(EventExpectations, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 10'000;
+	EventExpectations expectations;
+	expectations.Expect(1, t::Exactly(static_cast<int>(kThreads * kCount)));
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < kThreads; ++i) {
+		threads.emplace_back([&expectations] {
+			for (std::size_t j = 0; j < kCount; ++j) {
+				AddEvent(expectations, 1);
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_TRUE(expectations.Verify());
+}
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,102 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventFilter.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace m4t::test {
+namespace {
+
+TEST(EventFilter, Default_AcceptAll) {
+	const EventFilter filter;
+
+	for (std::size_t id = 0; id < EventFilter::kEventIdCount; ++id) {
+		EXPECT_TRUE(filter.Matches(static_cast<std::uint16_t>(id), 4, 1024)) << id;
+	}
+	EXPECT_TRUE(filter.Matches(0, 0, 0));
+	EXPECT_TRUE(filter.Matches(0, 255, 0xFFFFFFFFFFFFFFFF));
+}
+
+TEST(EventFilter, IncludeEventIds) {
+	EventFilter filter;
+	filter.IncludeEventId(1).IncludeEventIds(60, 130).IncludeEventId(65535);
+
+	for (std::size_t id = 0; id < EventFilter::kEventIdCount; ++id) {
+		const bool expected = id == 1 || (id >= 60 && id <= 130) || id == 65535;
+		EXPECT_EQ(expected, filter.Matches(static_cast<std::uint16_t>(id), 4, 0)) << id;
+	}
+}
+
+TEST(EventFilter, ExcludeEventIds) {
+	EventFilter filter;
+	filter.ExcludeEventIds(0, 63).ExcludeEventId(100);
+
+	for (std::size_t id = 0; id < 200; ++id) {
+		EXPECT_EQ(id >= 64 && id != 100, filter.Matches(static_cast<std::uint16_t>(id), 4, 0)) << id;
+	}
+	EXPECT_TRUE(filter.Matches(65535, 4, 0));
+}
+
+TEST(EventFilter, IncludeAllExcludeSome) {
+	EventFilter filter;
+	filter.IncludeEventIds(0, 65535).ExcludeEventIds(10, 20);
+
+	EXPECT_TRUE(filter.Matches(9, 4, 0));
+	EXPECT_FALSE(filter.Matches(10, 4, 0));
+	EXPECT_FALSE(filter.Matches(20, 4, 0));
+	EXPECT_TRUE(filter.Matches(21, 4, 0));
+}
+
+TEST(EventFilter, Levels) {
+	EventFilter filter;
+
+	filter.SetMaxLevel(3);
+	EXPECT_TRUE(filter.Matches(1, 0, 0));
+	EXPECT_TRUE(filter.Matches(1, 3, 0));
+	EXPECT_FALSE(filter.Matches(1, 4, 0));
+	EXPECT_FALSE(filter.Matches(1, 255, 0));
+
+	filter.SetLevelMask((1u << 2) | (1u << 5));
+	EXPECT_FALSE(filter.Matches(1, 1, 0));
+	EXPECT_TRUE(filter.Matches(1, 2, 0));
+	EXPECT_TRUE(filter.Matches(1, 5, 0));
+	EXPECT_FALSE(filter.Matches(1, 64, 0));
+
+	filter.SetMaxLevel(255);
+	EXPECT_TRUE(filter.Matches(1, 255, 0));
+}
+
+TEST(EventFilter, Keywords) {
+	EventFilter filter;
+	filter.SetKeywordMask(0x0F, 0x01);
+
+	// keyword 0 is always accepted
+	EXPECT_TRUE(filter.Matches(1, 4, 0));
+	EXPECT_TRUE(filter.Matches(1, 4, 0x01));
+	EXPECT_TRUE(filter.Matches(1, 4, 0x03));
+	EXPECT_FALSE(filter.Matches(1, 4, 0x02));
+	EXPECT_FALSE(filter.Matches(1, 4, 0x10));
+	EXPECT_TRUE(filter.Matches(1, 4, 0x11));
+}
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,98 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventSchema.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+/// @brief A trivially copyable type like `GUID`.
+struct Id {
+	std::uint32_t data1;    ///< @brief Some data.
+	std::uint16_t data2;    ///< @brief Some data.
+	std::uint16_t data3;    ///< @brief Some data.
+	std::uint8_t data4[8];  ///< @brief Some data.
+
+	bool operator==(const Id&) const noexcept = default;
+};
+
+using MyEvent = EventSchema<42, std::uint32_t, std::wstring_view, Id, std::string_view>;
+
+static_assert(MyEvent::kEventId == 42);
+static_assert(MyEvent::kArgCount == 4);
+
+/// @brief Get the bytes of a value.
+/// @tparam T The type of the value.
+/// @param value The value.
+/// @return The bytes.
+template <typename T>
+std::span<const std::byte> Bytes(const T& value) noexcept {
+	return std::as_bytes(std::span(&value, 1));
+}
+
+TEST(EventSchema, Decode) {
+	constexpr std::uint32_t kValue = 7;
+	constexpr wchar_t kText[] = L"MyText";
+	constexpr char kNarrow[] = {'a', 'b'};
+	constexpr Id kId{1, 2, 3, {4, 5, 6, 7, 8, 9, 10, 11}};
+	const std::vector<std::span<const std::byte>> args = {Bytes(kValue), std::as_bytes(std::span(kText)), Bytes(kId), std::as_bytes(std::span(kNarrow))};
+
+	const std::optional<MyEvent::Tuple> result = MyEvent::Decode(4, [&args](const std::uint32_t index) { return args[index]; });
+
+	ASSERT_TRUE(result.has_value());
+	EXPECT_EQ(kValue, std::get<0>(*result));
+	// trailing null character is removed
+	EXPECT_EQ(L"MyText", std::get<1>(*result));
+	EXPECT_EQ(kId, std::get<2>(*result));
+	// no null character
+	EXPECT_EQ("ab", std::get<3>(*result));
+}
+
+TEST(EventSchema, Decode_WrongCount_ReturnNullopt) {
+	constexpr std::uint32_t kValue = 7;
+
+	EXPECT_FALSE(MyEvent::Decode(1, [&](std::uint32_t) { return Bytes(kValue); }).has_value());
+	EXPECT_FALSE((EventSchema<1, std::uint32_t>::Decode(0, [&](std::uint32_t) { return Bytes(kValue); }).has_value()));
+}
+
+TEST(EventSchema, Decode_WrongSize_ReturnNullopt) {
+	constexpr std::uint64_t kValue = 7;
+	constexpr char kOdd[] = {'a', 'b', 'c'};
+
+	EXPECT_FALSE((EventSchema<1, std::uint32_t>::Decode(1, [&](std::uint32_t) { return Bytes(kValue); }).has_value()));
+	EXPECT_FALSE((EventSchema<1, std::wstring_view>::Decode(1, [&](std::uint32_t) { return std::as_bytes(std::span(kOdd)); }).has_value()));
+}
+
+TEST(EventSchema, Decode_NoArgs) {
+	const std::optional<EventSchema<1>::Tuple> result = EventSchema<1>::Decode(0, [](std::uint32_t) { return std::span<const std::byte>(); });
+
+	EXPECT_TRUE(result.has_value());
+}
+
+}  // namespace
+}  // namespace m4t::test
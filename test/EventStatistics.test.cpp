@@ -0,0 +1,169 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/EventStatistics.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+/// @brief Create a time for use in tests.
+/// @param ns The time in nanoseconds, MUST NOT be 0.
+/// @return The time.
+std::chrono::steady_clock::time_point Time(const std::int64_t ns) noexcept {
+	return std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(ns)));
+}
+
+//
+// HistogramSnapshot
+//
+
+TEST(HistogramSnapshot, GetBucket) {
+	for (std::uint64_t value = 0; value < 4096; ++value) {
+		const std::size_t bucket = HistogramSnapshot::GetBucket(value);
+		EXPECT_LE(value, HistogramSnapshot::GetBucketLimit(bucket)) << value;
+		if (bucket) {
+			EXPECT_GT(value, HistogramSnapshot::GetBucketLimit(bucket - 1)) << value;
+		}
+	}
+	EXPECT_EQ(HistogramSnapshot::kBucketCount - 1, HistogramSnapshot::GetBucket(std::numeric_limits<std::uint64_t>::max()));
+	EXPECT_EQ(std::numeric_limits<std::uint64_t>::max(), HistogramSnapshot::GetBucketLimit(HistogramSnapshot::kBucketCount - 1));
+}
+
+//
+// LatencyHistogram
+//
+
+TEST(LatencyHistogram, Record) {
+	LatencyHistogram histogram;
+	for (std::uint64_t value = 1; value <= 1000; ++value) {
+		histogram.Record(value * 1000);
+	}
+
+	const HistogramSnapshot snapshot = histogram.GetSnapshot();
+
+	EXPECT_EQ(1000, snapshot.GetCount());
+	EXPECT_EQ(1000, snapshot.GetMin());
+	EXPECT_EQ(1'000'000, snapshot.GetMax());
+	EXPECT_DOUBLE_EQ(500'500, snapshot.GetMean());
+	EXPECT_EQ(1023, snapshot.GetValueAtPercentile(0));
+	EXPECT_EQ(1'000'000, snapshot.GetValueAtPercentile(100));
+
+	const double p50 = static_cast<double>(snapshot.GetValueAtPercentile(50));
+	EXPECT_GE(p50, 500'000);
+	EXPECT_LE(p50, 500'000 * (1 + 1.0 / HistogramSnapshot::kSubBucketCount));
+
+	const double p99 = static_cast<double>(snapshot.GetValueAtPercentile(99));
+	EXPECT_GE(p99, 990'000);
+	EXPECT_LE(p99, 990'000 * (1 + 1.0 / HistogramSnapshot::kSubBucketCount));
+}
+
+TEST(LatencyHistogram, Record_Empty) {
+	const LatencyHistogram histogram;
+
+	const HistogramSnapshot snapshot = histogram.GetSnapshot();
+
+	EXPECT_EQ(0, snapshot.GetCount());
+	EXPECT_EQ(0, snapshot.GetMin());
+	EXPECT_EQ(0, snapshot.GetMax());
+	EXPECT_DOUBLE_EQ(0, snapshot.GetMean());
+	EXPECT_EQ(0, snapshot.GetValueAtPercentile(50));
+}
+
+//
+// EventStatistics
+//
+
+TEST(EventStatistics, AddEvent) {
+	EventStatistics statistics;
+
+	statistics.AddEvent(7, Time(1000));
+	statistics.AddEvent(7, Time(1100));
+	statistics.AddEvent(7, Time(1300));
+	statistics.AddEvent(65535, Time(1400));
+
+	const EventStatisticsSnapshot snapshot = statistics.GetSnapshot();
+
+	ASSERT_EQ(2, snapshot.events.size());
+	EXPECT_TRUE(snapshot.debug.empty());
+
+	const EventCounter& counter = snapshot.events.at(7);
+	EXPECT_EQ(3, counter.count);
+	EXPECT_EQ(2, counter.interArrival.GetCount());
+	EXPECT_EQ(100, counter.interArrival.GetMin());
+	EXPECT_EQ(200, counter.interArrival.GetMax());
+
+	EXPECT_EQ(1, snapshot.events.at(65535).count);
+	EXPECT_EQ(0, snapshot.events.at(65535).interArrival.GetCount());
+}
+
+TEST(EventStatistics, AddDebug) {
+	EventStatistics statistics;
+
+	statistics.AddDebug("ERROR", Time(1000));
+	statistics.AddDebug("INFO", Time(1000));
+	statistics.AddDebug("ERROR", Time(1050));
+
+	const EventStatisticsSnapshot snapshot = statistics.GetSnapshot();
+
+	EXPECT_TRUE(snapshot.events.empty());
+	ASSERT_EQ(2, snapshot.debug.size());
+	EXPECT_EQ(2, snapshot.debug.find("ERROR")->second.count);
+	EXPECT_EQ(50, snapshot.debug.find("ERROR")->second.interArrival.GetMax());
+	EXPECT_EQ(1, snapshot.debug.find("INFO")->second.count);
+}
+
+TEST(EventStatistics, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 10'000;
+	EventStatistics statistics;
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&statistics, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				statistics.AddEvent(static_cast<std::uint16_t>(i % 2));
+				statistics.AddDebug(t % 2 ? "ERROR" : "INFO");
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	const EventStatisticsSnapshot snapshot = statistics.GetSnapshot();
+
+	ASSERT_EQ(2, snapshot.events.size());
+	EXPECT_EQ(kThreads * kCount / 2, snapshot.events.at(0).count);
+	EXPECT_EQ(kThreads * kCount / 2 - 1, snapshot.events.at(0).interArrival.GetCount());
+	EXPECT_EQ(kThreads * kCount / 2, snapshot.events.at(1).count);
+	ASSERT_EQ(2, snapshot.debug.size());
+	EXPECT_EQ(kThreads * kCount / 2, snapshot.debug.find("ERROR")->second.count);
+	EXPECT_EQ(kThreads * kCount / 2, snapshot.debug.find("INFO")->second.count);
+}
+
+}  // namespace
+}  // namespace m4t::test
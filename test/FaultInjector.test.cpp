@@ -0,0 +1,167 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/FaultInjector.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+TEST(FaultInjector, None) {
+	FaultInjector injector;
+
+	for (std::size_t i = 0; i < 100; ++i) {
+		EXPECT_FALSE(injector.ShouldFail(i));
+	}
+	EXPECT_EQ(0, injector.GetFailureCount());
+}
+
+TEST(FaultInjector, FailNth) {
+	FaultInjector injector;
+	injector.FailNth(2);
+
+	EXPECT_FALSE(injector.ShouldFail(1));
+	EXPECT_FALSE(injector.ShouldFail(1));
+	EXPECT_TRUE(injector.ShouldFail(1));
+	EXPECT_FALSE(injector.ShouldFail(1));
+
+	EXPECT_EQ(4, injector.GetAllocationCount());
+	EXPECT_EQ(1, injector.GetFailureCount());
+
+	injector.Reset();
+
+	EXPECT_FALSE(injector.ShouldFail(1));
+	EXPECT_EQ(0, injector.GetFailureCount());
+}
+
+TEST(FaultInjector, FailAbove) {
+	FaultInjector injector;
+	injector.FailAbove(100);
+
+	EXPECT_FALSE(injector.ShouldFail(0));
+	EXPECT_FALSE(injector.ShouldFail(100));
+	EXPECT_TRUE(injector.ShouldFail(101));
+	EXPECT_TRUE(injector.ShouldFail(1000));
+
+	EXPECT_EQ(2, injector.GetFailureCount());
+}
+
+TEST(FaultInjector, FailRandomly) {
+	constexpr std::size_t kCount = 10'000;
+	FaultInjector injector;
+
+	injector.FailRandomly(0.25, 42);
+	std::vector<bool> first;
+	for (std::size_t i = 0; i < kCount; ++i) {
+		first.push_back(injector.ShouldFail(1));
+	}
+	EXPECT_NEAR(kCount / 4, injector.GetFailureCount(), kCount / 20);
+
+	// same seed, same failures
+	injector.FailRandomly(0.25, 42);
+	std::vector<bool> second;
+	for (std::size_t i = 0; i < kCount; ++i) {
+		second.push_back(injector.ShouldFail(1));
+	}
+	EXPECT_EQ(first, second);
+
+	// other seed, other failures
+	injector.FailRandomly(0.25, 43);
+	std::vector<bool> third;
+	for (std::size_t i = 0; i < kCount; ++i) {
+		third.push_back(injector.ShouldFail(1));
+	}
+	EXPECT_NE(first, third);
+}
+
+TEST(FaultInjector, FailRandomly_Limits) {
+	FaultInjector injector;
+
+	injector.FailRandomly(0, 1);
+	for (std::size_t i = 0; i < 100; ++i) {
+		EXPECT_FALSE(injector.ShouldFail(1));
+	}
+
+	injector.FailRandomly(1, 1);
+	for (std::size_t i = 0; i < 100; ++i) {
+		EXPECT_TRUE(injector.ShouldFail(1));
+	}
+}
+
+TEST(FaultInjector, EnumerateFailures) {
+	FaultInjector injector;
+	std::vector<std::size_t> failed;
+
+	const std::size_t count = injector.EnumerateFailures([&injector, &failed] {
+		for (std::size_t i = 0; i < 3; ++i) {
+			if (injector.ShouldFail(1)) {
+				failed.push_back(i);
+				// simulate error handling which stops at the first failure
+				return;
+			}
+		}
+	});
+
+	EXPECT_EQ(3, count);
+	EXPECT_EQ((std::vector<std::size_t>{0, 1, 2}), failed);
+	EXPECT_FALSE(injector.ShouldFail(1));
+}
+
+TEST(FaultInjector, EnumerateFailures_Exception_Reset) {
+	FaultInjector injector;
+
+	const auto function = [&injector] {
+		if (injector.ShouldFail(1)) {
+			throw std::runtime_error("out of memory");
+		}
+	};
+	EXPECT_THROW(injector.EnumerateFailures(function), std::runtime_error);
+
+	EXPECT_FALSE(injector.ShouldFail(1));
+}
+
+TEST(FaultInjector, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 10'000;
+	FaultInjector injector;
+	injector.FailNth(kThreads * kCount / 2);
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&injector] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				static_cast<void>(injector.ShouldFail(1));
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kThreads * kCount, injector.GetAllocationCount());
+	EXPECT_EQ(1, injector.GetFailureCount());
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
@@ -0,0 +1,116 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/GenerationSet.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+TEST(GenerationSet, Insert) {
+	GenerationSet set;
+
+	EXPECT_FALSE(set.Contains(0));
+	EXPECT_FALSE(set.Contains(1));
+
+	set.Insert(0);
+
+	EXPECT_TRUE(set.Contains(0));
+	EXPECT_FALSE(set.Contains(1));
+	EXPECT_FALSE(set.Contains(64));
+
+	set.Insert(64);
+
+	EXPECT_TRUE(set.Contains(0));
+	EXPECT_TRUE(set.Contains(64));
+	EXPECT_FALSE(set.Contains(63));
+	EXPECT_FALSE(set.Contains(65));
+}
+
+TEST(GenerationSet, Insert_DifferentChunks) {
+	GenerationSet set;
+	constexpr std::uint64_t kLarge = std::uint64_t{1} << 30;
+
+	set.Insert(kLarge);
+	set.Insert(kLarge * 2 + 1);
+
+	EXPECT_TRUE(set.Contains(kLarge));
+	EXPECT_TRUE(set.Contains(kLarge * 2 + 1));
+	EXPECT_FALSE(set.Contains(kLarge + 1));
+	EXPECT_FALSE(set.Contains(kLarge * 2));
+	EXPECT_FALSE(set.Contains(0));
+}
+
+TEST(GenerationSet, Insert_AboveMax_ThrowException) {
+	GenerationSet set;
+
+	EXPECT_THROW(set.Insert(GenerationSet::kMaxGenerations), std::out_of_range);
+	EXPECT_THROW(static_cast<void>(set.Contains(GenerationSet::kMaxGenerations)), std::out_of_range);
+	EXPECT_FALSE(set.Contains(GenerationSet::kMaxGenerations - 1));
+}
+
+TEST(GenerationSet, Insert_AllOfChunk_ReleaseChunk) {
+	constexpr std::uint64_t kChunkSize = std::uint64_t{1} << 22;
+	GenerationSet set;
+
+	EXPECT_EQ(0, set.GetChunkCount());
+
+	for (std::uint64_t i = 0; i < kChunkSize; ++i) {
+		set.Insert(i);
+	}
+	set.Insert(kChunkSize + 1);
+
+	EXPECT_EQ(1, set.GetChunkCount());
+	EXPECT_TRUE(set.Contains(0));
+	EXPECT_TRUE(set.Contains(kChunkSize - 1));
+	EXPECT_FALSE(set.Contains(kChunkSize));
+	EXPECT_TRUE(set.Contains(kChunkSize + 1));
+}
+
+TEST(GenerationSet, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 10'000;
+	GenerationSet set;
+
+	// interleave the generations so that all threads write to the same words
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&set, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				set.Insert(i * kThreads * 2 + t);
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	for (std::size_t i = 0; i < kCount * kThreads * 2; ++i) {
+		EXPECT_EQ(i % (kThreads * 2) < kThreads, set.Contains(i)) << i;
+	}
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
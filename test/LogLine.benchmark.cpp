@@ -0,0 +1,112 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/LogLine.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace m4t::internal::benchmark {
+namespace {
+
+namespace b = ::benchmark;
+
+/// @brief A message without causes.
+constexpr const char* kCauses0 = "[Info] [1234] Some message with a moderate length\n\tat src\\Module\\File.cpp(99) (MyFunction)\n";
+
+/// @brief A message with two causes.
+constexpr const char* kCauses2 = "[Error] [1234] Some message with a moderate length\n\tat src\\Module\\File.cpp(99) (MyFunction)\n\tcaused by: The cause\n\t\tat src\\Module\\File.cpp(98) (MyCauseFunction)\n\tcaused by: The root cause\n\t\tat src\\Module\\Other.cpp(97) (MyRootCauseFunction)\n";
+
+/// @brief Output which is not written by `m3c::Log`.
+constexpr const char* kOther = "Some other output which is not written by the logger\n";
+
+/// @brief The regular expression of the previous implementation of `LogListener`.
+const std::regex& GetLineRegex() {
+	static const std::regex kLineRegex("^\\[(.+?)\\] \\[\\d+\\] (.+)\n\tat .+\\(\\d+\\) \\(\\w+\\)\n((?:\tcaused by: .+\n\t\tat .+\\(\\d+\\) \\(\\w+\\)\n)*)$", std::regex_constants::optimize);
+	return kLineRegex;
+}
+
+/// @brief The regular expression for causes of the previous implementation of `LogListener`.
+const std::regex& GetCauseRegex() {
+	static const std::regex kCauseRegex("^\tcaused by: (.+)\n\t\tat .+\\(\\d+\\) \\(\\w+\\)\n", std::regex_constants::optimize);
+	return kCauseRegex;
+}
+
+/// @brief The previous implementation of `LogListener` as a baseline.
+/// @param text The text.
+/// @return The total size of level, message and causes.
+std::size_t ParseRegex(const char* const text) {
+	// once for the matcher of ON_CALL
+	if (!std::regex_match(text, GetLineRegex())) {
+		return 0;
+	}
+	std::cmatch match;
+	if (!std::regex_match(text, match, GetLineRegex())) {
+		throw std::invalid_argument("regex mismatch");
+	}
+	const std::string level = match.str(1);
+	const std::string cause = match.str(3);
+	std::size_t result = level.size() + match.str(2).size();
+	for (std::sregex_token_iterator it(cause.cbegin(), cause.cend(), GetCauseRegex(), 1); it != std::sregex_token_iterator(); ++it) {
+		result += it->str().size();
+	}
+	return result;
+}
+
+/// @brief The current implementation of `LogListener`.
+/// @param text The text.
+/// @return The total size of level, message and causes.
+std::size_t ParseView(const char* const text) noexcept {
+	const LogLine line = ParseLogLine(text);
+	if (!line.IsValid()) {
+		return 0;
+	}
+	std::size_t result = line.level.size() + line.message.size();
+	std::string_view causes = line.causes;
+	for (std::string_view cause = NextCause(causes); !cause.empty(); cause = NextCause(causes)) {
+		result += cause.size();
+	}
+	return result;
+}
+
+void LogLine_Regex(b::State& state, const char* const text) {
+	for (auto _ : state) {
+		b::DoNotOptimize(ParseRegex(text));
+	}
+}
+
+void LogLine_View(b::State& state, const char* const text) {
+	for (auto _ : state) {
+		b::DoNotOptimize(ParseView(text));
+	}
+}
+
+BENCHMARK_CAPTURE(LogLine_Regex, Causes0, kCauses0);
+BENCHMARK_CAPTURE(LogLine_View, Causes0, kCauses0);
+BENCHMARK_CAPTURE(LogLine_Regex, Causes2, kCauses2);
+BENCHMARK_CAPTURE(LogLine_View, Causes2, kCauses2);
+BENCHMARK_CAPTURE(LogLine_Regex, Other, kOther);
+BENCHMARK_CAPTURE(LogLine_View, Other, kOther);
+
+}  // namespace
+}  // namespace m4t::internal::benchmark
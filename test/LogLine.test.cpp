@@ -0,0 +1,93 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/LogLine.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <string_view>
+
+namespace m4t::internal::test {
+namespace {
+
+TEST(LogLine, Parse_Causes0) {
+	const LogLine line = ParseLogLine("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+
+	ASSERT_TRUE(line.IsValid()) << line.error;
+	EXPECT_EQ("MyLevel", line.level);
+	EXPECT_EQ("MyMessage", line.message);
+	EXPECT_TRUE(line.causes.empty());
+}
+
+TEST(LogLine, Parse_Causes2) {
+	const LogLine line = ParseLogLine("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n\t\tat file.cpp(98) (MyCauseFunction)\n\tcaused by: MyRootCause\n\t\tat dir\\file (2).cpp(97) (My_Root_Cause_Function)\n");
+
+	ASSERT_TRUE(line.IsValid()) << line.error;
+	EXPECT_EQ("MyLevel", line.level);
+	EXPECT_EQ("MyMessage", line.message);
+
+	std::string_view causes = line.causes;
+	EXPECT_EQ("MyCause", NextCause(causes));
+	EXPECT_EQ("MyRootCause", NextCause(causes));
+	EXPECT_EQ("", NextCause(causes));
+	EXPECT_TRUE(causes.empty());
+}
+
+TEST(LogLine, Parse_LevelWithBrackets) {
+	const LogLine line = ParseLogLine("[My] [Level] [x] [1234] My] [1] Message\n\tat file(line).cpp(99) (MyFunction)\n");
+
+	ASSERT_TRUE(line.IsValid()) << line.error;
+	EXPECT_EQ("My] [Level] [x", line.level);
+	EXPECT_EQ("My] [1] Message", line.message);
+}
+
+TEST(LogLine, Parse_Malformed_ReportError) {
+	struct Case {
+		std::string_view text;
+		std::string_view error;
+		std::size_t offset;
+	};
+	constexpr Case kCases[] = {
+	    {"", "Expected '['", 0},
+	    {"Some other output\n", "Expected '['", 0},
+	    {"[\n] [1] MyMessage\n\tat file.cpp(99) (MyFunction)\n", "Expected level", 1},
+	    {"[MyLevel] [MyThread] MyMessage\n", "Expected '] [' after level", 30},
+	    {"[MyLevel] [1234] \n\tat file.cpp(99) (MyFunction)\n", "Expected message", 18},
+	    {"[MyLevel] [1234] MyMessage", "Expected message", 26},
+	    {"[MyLevel] [1234] MyMessage\n", "Expected location of message", 27},
+	    {"[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)", "Expected location of message", 31},
+	    {"[MyLevel] [1234] MyMessage\n\tat (99) (MyFunction)\n", "Expected location of message", 31},
+	    {"[MyLevel] [1234] MyMessage\n\tat file.cpp(x) (MyFunction)\n", "Expected location of message", 41},
+	    {"[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (My::Function)\n", "Expected location of message", 49},
+	    {"[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\nMore\n", "Expected cause", 57},
+	    {"[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n", "Expected location of cause", 77},
+	    {"[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n\tat file.cpp(98) (MyCauseFunction)\n", "Expected location of cause", 77},
+	};
+
+	for (const Case& c : kCases) {
+		const LogLine line = ParseLogLine(c.text);
+
+		ASSERT_FALSE(line.IsValid()) << c.text;
+		EXPECT_EQ(c.error, line.error) << c.text;
+		EXPECT_EQ(c.offset, line.errorOffset) << c.text;
+	}
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
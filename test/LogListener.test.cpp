@@ -25,14 +25,46 @@ limitations under the License.
 #include <windows.h>
 #include <evntprov.h>
 
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
 
 namespace m4t::test {
 namespace {
 
 namespace t = testing;
 
+/// @brief Log an event and a debug message on another thread while the global mutex of gmock is locked.
+/// @param listener The listener for the other thread.
+/// @return `true` if both calls have returned without waiting for the mutex.
+bool LogWithGmockMutexLocked(const LogListener& listener) {
+	std::future<void> result;
+	bool ready;
+	{
+		const t::internal::MutexLock lock(&t::internal::g_gmock_mutex);
+		result = std::async(std::launch::async, [&listener] {
+			const LogListener::ThreadScope scope(listener);
+			EVENT_DESCRIPTOR event;
+			EventDescCreate(&event, 7, 0, 0, 4, 0, 0, 1024);
+			EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+			OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+		});
+		ready = result.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+	}
+	result.get();
+	return ready;
+}
+
 TEST(LogListener, NoLogging) {
 	const LogListener log;
 
@@ -79,6 +111,14 @@ TEST(LogListener, Debug_Causes2) {
 	OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n\t\tat file.cpp(98) (MyCauseFunction)\n\tcaused by: MyRootCause\n\t\tat file.cpp(97) (MyRootCauseFunction)\n");
 }
 
+TEST(LogListener, Debug_Malformed_IsIgnored) {
+	const LogListener log(LogListenerMode::kStrictDebug);
+
+	OutputDebugStringA("Some other output\n");
+	OutputDebugStringA("[MyLevel] [1234] MyMessage\n");
+	OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n");
+}
+
 TEST(LogListener, Event_Data0) {
 	constexpr char kFile[] = "file.cpp";
 	constexpr std::uint32_t kLine = 99;
@@ -147,6 +187,525 @@ TEST(LogListener, Event_Data2) {
 	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 4, data);
 }
 
+TEST(LogListener, Event_Capture) {
+	LogListener log(LogListenerMode::kStrictDebug | LogListenerMode::kCapture);
+
+	{
+		constexpr char kFile[] = "file.cpp";
+		constexpr std::uint32_t kLine = 99;
+		const std::uint32_t value = 42;
+		const std::string text = "MyText";
+
+		EVENT_DESCRIPTOR event;
+		EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+
+		EVENT_DATA_DESCRIPTOR data[4];
+		EventDataDescCreate(&data[0], &value, sizeof(value));
+		EventDataDescCreate(&data[1], text.c_str(), static_cast<ULONG>(text.size()));
+		EventDataDescCreate(&data[2], kFile, sizeof(kFile));
+		EventDataDescCreate(&data[3], &kLine, sizeof(kLine));
+
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 4, data);
+		EventDescCreate(&event, 2, 0, 0, 98, 0, 0, 2048);
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 2, &data[2]);
+	}
+
+	// payload is still available after the call
+	ASSERT_EQ(2, log.GetCapturedEvents().GetCount());
+	EventArena::Iterator it = log.GetCapturedEvents().begin();
+	EXPECT_EQ(1, (*it).GetEventId());
+	EXPECT_EQ(99, (*it).GetLevel());
+	EXPECT_EQ(1024, (*it).GetKeyword());
+	ASSERT_EQ(2, (*it).GetArgCount());
+	EXPECT_EQ(42, (*it).GetArg<std::uint32_t>(0));
+	EXPECT_EQ(6, (*it).GetArg(1).size());
+	++it;
+	EXPECT_EQ(2, (*it).GetEventId());
+	EXPECT_EQ(0, (*it).GetArgCount());
+
+	log.ClearCapturedEvents();
+	EXPECT_EQ(0, log.GetCapturedEvents().GetCount());
+}
+
+TEST(LogListener, Event_NoCapture_IsEmpty) {
+	LogListener log;
+
+	constexpr char kFile[] = "file.cpp";
+	constexpr std::uint32_t kLine = 99;
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+
+	EVENT_DATA_DESCRIPTOR data[2];
+	EventDataDescCreate(&data[0], kFile, sizeof(kFile));
+	EventDataDescCreate(&data[1], &kLine, sizeof(kLine));
+
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 2, data);
+
+	EXPECT_EQ(0, log.GetCapturedEvents().GetCount());
+}
+
+TEST(LogListener, Event_Filter) {
+	LogListener log(LogListenerMode::kStrictEvent | LogListenerMode::kCapture);
+	log.SetEventFilter(EventFilter().IncludeEventIds(10, 20).SetMaxLevel(4));
+
+	EXPECT_CALL(log, Event(10, 4, 1024, 0));
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 9, 0, 0, 4, 0, 0, 1024);
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+	EventDescCreate(&event, 10, 0, 0, 5, 0, 0, 1024);
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+	EventDescCreate(&event, 10, 0, 0, 4, 0, 0, 1024);
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+
+	EXPECT_EQ(1, log.GetCapturedEvents().GetCount());
+}
+
+TEST(LogListener, Event_Schema) {
+	constexpr char kFile[] = "file.cpp";
+	constexpr int kLine = 99;
+	constexpr std::uint32_t kValue = 42;
+	constexpr wchar_t kText[] = L"MyText";
+	using MyEvent = EventSchema<1, std::uint32_t, std::wstring_view>;
+	LogListener log(LogListenerMode::kStrictEvent);
+
+	EXPECT_CALL(log.OnEvent<MyEvent>(), Call(kValue, std::wstring_view(L"MyText")));
+	EXPECT_CALL(log, Event(2, 99, 1024, 0));
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+
+	EVENT_DATA_DESCRIPTOR data[4];
+	EventDataDescCreate(&data[0], &kValue, sizeof(kValue));
+	EventDataDescCreate(&data[1], kText, sizeof(kText));
+	EventDataDescCreate(&data[2], kFile, sizeof(kFile));
+	EventDataDescCreate(&data[3], &kLine, sizeof(kLine));
+
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 4, data);
+
+	// other ids still use Event and EventArg
+	EventDescCreate(&event, 2, 0, 0, 99, 0, 0, 1024);
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 2, &data[2]);
+}
+
+TEST(LogListener, Event_Schema_Mismatch) {
+	constexpr char kFile[] = "file.cpp";
+	constexpr int kLine = 99;
+	constexpr std::uint16_t kValue = 42;
+	using MyEvent = EventSchema<1, std::uint32_t>;
+	LogListener log(LogListenerMode::kStrictEvent);
+
+	EXPECT_CALL(log.OnEvent<MyEvent>(), Call).Times(0);
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+
+	EVENT_DATA_DESCRIPTOR data[3];
+	EventDataDescCreate(&data[0], &kValue, sizeof(kValue));
+	EventDataDescCreate(&data[1], kFile, sizeof(kFile));
+	EventDataDescCreate(&data[2], &kLine, sizeof(kLine));
+
+	EXPECT_NONFATAL_FAILURE(EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 3, data), "do not match the schema");
+}
+
+TEST(LogListener, Event_Schema_SameSchema_UseSameMock) {
+	constexpr char kFile[] = "file.cpp";
+	constexpr int kLine = 99;
+	using MyEvent = EventSchema<1, std::uint32_t>;
+	LogListener log(LogListenerMode::kStrictEvent);
+
+	const t::InSequence s;
+	EXPECT_CALL(log.OnEvent<MyEvent>(), Call(42));
+	EXPECT_CALL(log.OnEvent<MyEvent>(), Call(43));
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+
+	EVENT_DATA_DESCRIPTOR data[3];
+	EventDataDescCreate(&data[1], kFile, sizeof(kFile));
+	EventDataDescCreate(&data[2], &kLine, sizeof(kLine));
+	for (const std::uint32_t value : {42u, 43u}) {
+		EventDataDescCreate(&data[0], &value, sizeof(value));
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 3, data);
+	}
+}
+
+TEST(LogListener, Event_Schema_OtherSchema_ThrowException) {
+	using MyEvent = EventSchema<1, std::uint32_t>;
+	using MyOtherEvent = EventSchema<1, std::uint64_t>;
+	LogListener log;
+
+	log.OnEvent<MyEvent>();
+
+	EXPECT_THROW(log.OnEvent<MyOtherEvent>(), std::invalid_argument);
+}
+
+
+//
+// Expectation table
+//
+
+TEST(LogListener, ExpectEvents) {
+	LogListener log(LogListenerMode::kStrictEvent);
+	log.ExpectEvents().Expect(1, t::Exactly(2)).Expect(2);
+	EXPECT_CALL(log, Event(3, 99, 1024, 0));
+
+	EVENT_DESCRIPTOR event;
+	for (const USHORT eventId : {1, 2, 1, 3}) {
+		EventDescCreate(&event, eventId, 0, 0, 99, 0, 0, 1024);
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+	}
+}
+
+TEST(LogListener, ExpectEvents_Unmet_Error) {
+	EXPECT_NONFATAL_FAILURE(
+	    {
+		    LogListener log;
+		    log.ExpectEvents().Expect(1).Expect(2);
+
+		    EVENT_DESCRIPTOR event;
+		    EventDescCreate(&event, 2, 0, 0, 99, 0, 0, 1024);
+		    EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+	    },
+	    "Event 1: expected to be called once, actual: never called");
+}
+
+
+//
+// Trace
+//
+
+TEST(LogListener, TraceRecorder) {
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "m4t_LogListener_TraceRecorder.json";
+	{
+		TraceRecorder recorder(path);
+		LogListener log;
+		log.SetTraceRecorder(&recorder);
+
+		constexpr GUID kActivityId = {0x01020304, 0x0506, 0x0708, {0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff}};
+		EVENT_DESCRIPTOR event;
+		EventDescCreate(&event, 7, 0, 0, 4, 0, 0, 1024);
+		EventWriteEx(0, &event, 0, 0, &kActivityId, nullptr, 0, nullptr);
+		OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+
+		EXPECT_EQ(2, recorder.GetCount());
+	}
+
+	std::ifstream file(path, std::ios::binary);
+	const std::string trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	file.close();
+	std::filesystem::remove(path);
+
+	EXPECT_THAT(trace, t::HasSubstr("\"tid\":" + std::to_string(GetCurrentThreadId()) + ",\"args\":{\"id\":7,\"level\":4,\"keyword\":\"0x400\",\"activity\":\"01020304-0506-0708-090a-0b0c0d0e0fff\"}}"));
+	EXPECT_THAT(trace, t::HasSubstr("{\"name\":\"MyLevel\",\"cat\":\"debug\""));
+}
+
+TEST(LogListener, Forward_Drop) {
+	LogListener log;
+	log.SetForwardPolicy(ForwardPolicy::kDrop);
+
+	EXPECT_CALL(log, Debug).Times(0);
+	EXPECT_CALL(log, Debug("MyLevel", "MyMessage"));
+	EXPECT_CALL(log, Event).Times(0);
+	EXPECT_CALL(log, Event(7, 4, 1024, 0));
+	EXPECT_CALL(log, EventArg).Times(0);
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 7, 0, 0, 4, 0, 0, 1024);
+	EXPECT_EQ(static_cast<ULONG>(ERROR_SUCCESS), EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr));
+	OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+}
+
+TEST(LogListener, Forward_Batch) {
+	constexpr char kFile[] = "file.cpp";
+	constexpr std::uint32_t kLine = 99;
+	LogListener log;
+	log.SetForwardPolicy(ForwardPolicy::kBatch);
+
+	EXPECT_CALL(log, Debug).Times(0);
+	EXPECT_CALL(log, Debug("MyLevel", "MyMessage")).Times(100);
+	EXPECT_CALL(log, Event).Times(0);
+	EXPECT_CALL(log, Event(7, 4, 1024, 0)).Times(100);
+	EXPECT_CALL(log, EventArg).Times(0);
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 7, 0, 0, 4, 0, 0, 1024);
+
+	EVENT_DATA_DESCRIPTOR data[2];
+	EventDataDescCreate(&data[0], kFile, sizeof(kFile));
+	EventDataDescCreate(&data[1], &kLine, sizeof(kLine));
+
+	for (int i = 0; i < 100; ++i) {
+		EXPECT_EQ(static_cast<ULONG>(ERROR_SUCCESS), EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 2, data));
+		OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+	}
+}
+
+
+//
+// Threads
+//
+
+TEST(LogListener, Nested_InnermostListener) {
+	LogListener outer;
+	EXPECT_CALL(outer, Debug).Times(0);
+	{
+		const LogListener inner;
+		EXPECT_CALL(inner, Debug("MyLevel", "MyMessage"));
+
+		OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+	}
+	ASSERT_TRUE(t::Mock::VerifyAndClearExpectations(&outer));
+
+	EXPECT_CALL(outer, Debug("MyLevel", "MyMessage"));
+	OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+}
+
+TEST(LogListener, Threads_Independent) {
+	constexpr std::size_t kThreads = 4;
+	const LogListener log;
+	EXPECT_CALL(log, Event).Times(0);
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < kThreads; ++i) {
+		threads.emplace_back([i] {
+			const LogListener threadLog;
+			EXPECT_CALL(threadLog, Event(static_cast<USHORT>(i), 99, 1024, 0));
+
+			EVENT_DESCRIPTOR event;
+			EventDescCreate(&event, static_cast<USHORT>(i), 0, 0, 99, 0, 0, 1024);
+			EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+TEST(LogListener, Threads_NoListener_IsIgnored) {
+	const LogListener log;
+	EXPECT_CALL(log, Event).Times(0);
+
+	std::thread([] {
+		EVENT_DESCRIPTOR event;
+		EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+	}).join();
+}
+
+
+//
+// Child processes
+//
+
+TEST(LogListener, Receive) {
+	constexpr std::uint32_t kValue = 42;
+	SharedEventCollector collector("m4t_LogListener_Receive");
+	SharedEventWriter writer(collector.GetName());
+	LogListener log(LogListenerMode::kStrictAll);
+
+	const DWORD processId = GetCurrentProcessId();
+	const t::InSequence s;
+	EXPECT_CALL(log, ProcessDebug(processId, "MyLevel", "MyCause"));
+	EXPECT_CALL(log, ProcessDebug(processId, "MyLevel", "MyMessage"));
+	EXPECT_CALL(log, ProcessEvent(processId, 7, 4, 1024, 1));
+	EXPECT_CALL(log, EventArg(0, sizeof(kValue), t::_));
+
+	writer.WriteDebug("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n\t\tat file.cpp(98) (MyCauseFunction)\n");
+	writer.WriteEvent(7, 4, 1024, 1, [&kValue](std::uint32_t) noexcept {
+		return std::as_bytes(std::span(&kValue, 1));
+	});
+
+	log.Receive(collector);
+}
+
+
+//
+// Count
+//
+
+TEST(LogListener, Count) {
+	LogListener log(LogListenerMode::kStrictAll | LogListenerMode::kCount);
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 7, 0, 0, 4, 0, 0, 1024);
+	for (int i = 0; i < 3; ++i) {
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+		OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+	}
+
+	const EventStatisticsSnapshot statistics = log.GetStatistics();
+	ASSERT_EQ(1, statistics.events.size());
+	EXPECT_EQ(3, statistics.events.at(7).count);
+	EXPECT_EQ(2, statistics.events.at(7).interArrival.GetCount());
+	ASSERT_EQ(1, statistics.debug.size());
+	EXPECT_EQ(3, statistics.debug.find("MyLevel")->second.count);
+}
+
+TEST(LogListener, Count_NoGmockMutex) {
+	LogListener log(LogListenerMode::kCount);
+
+	EXPECT_TRUE(LogWithGmockMutexLocked(log));
+
+	const EventStatisticsSnapshot statistics = log.GetStatistics();
+	EXPECT_EQ(1, statistics.events.at(7).count);
+	EXPECT_EQ(1, statistics.debug.find("MyLevel")->second.count);
+}
+
+TEST(LogListener, Count_NotEnabled_IsEmpty) {
+	LogListener log;
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 7, 0, 0, 4, 0, 0, 1024);
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+
+	const EventStatisticsSnapshot statistics = log.GetStatistics();
+	EXPECT_TRUE(statistics.events.empty());
+	EXPECT_TRUE(statistics.debug.empty());
+}
+
+
+//
+// Deferred
+//
+
+TEST(LogListener, Deferred_CallOnFlush) {
+	LogListener log(LogListenerMode::kDeferred);
+
+	const t::InSequence s;
+	EXPECT_CALL(log, Debug).Times(0);
+	EXPECT_CALL(log, Event).Times(0);
+	EXPECT_CALL(log, EventArg).Times(0);
+
+	OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n\t\tat file.cpp(98) (MyCauseFunction)\n");
+	ASSERT_TRUE(t::Mock::VerifyAndClearExpectations(&log));
+
+	EXPECT_CALL(log, Debug("MyLevel", "MyCause"));
+	EXPECT_CALL(log, Debug("MyLevel", "MyMessage"));
+	log.Flush();
+}
+
+TEST(LogListener, Deferred_NoGmockMutex) {
+	LogListener log(LogListenerMode::kDeferred);
+	log.SetForwardPolicy(ForwardPolicy::kDrop);
+
+	EXPECT_CALL(log, Debug("MyLevel", "MyMessage"));
+	EXPECT_CALL(log, Event(7, 4, 1024, 0));
+
+	EXPECT_TRUE(LogWithGmockMutexLocked(log));
+}
+
+TEST(LogListener, Deferred_Event_CopyPayload) {
+	LogListener log(LogListenerMode::kDeferred);
+
+	{
+		constexpr char kFile[] = "file.cpp";
+		constexpr std::uint32_t kLine = 99;
+		const std::uint32_t value = 42;
+
+		EVENT_DESCRIPTOR event;
+		EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 1024);
+
+		EVENT_DATA_DESCRIPTOR data[3];
+		EventDataDescCreate(&data[0], &value, sizeof(value));
+		EventDataDescCreate(&data[1], kFile, sizeof(kFile));
+		EventDataDescCreate(&data[2], &kLine, sizeof(kLine));
+
+		EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 3, data);
+	}
+
+	EXPECT_CALL(log, Event(1, 99, 1024, 1));
+	EXPECT_CALL(log, EventArg(0, sizeof(std::uint32_t), t::Truly([](const void* const ptr) {
+		                          return *static_cast<const std::uint32_t*>(ptr) == 42;
+	                          })));
+	log.Flush();
+}
+
+TEST(LogListener, Deferred_Threads_KeepOrderPerThread) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 1000;
+	LogListener log(LogListenerMode::kDeferred, OverflowPolicy::kBlock, 64);
+
+	std::vector<std::size_t> next(kThreads);
+	EXPECT_CALL(log, Event(t::Lt(kThreads), 99, t::_, 0)).Times(kThreads * kCount).WillRepeatedly([&next](const USHORT eventId, UCHAR, const ULONGLONG keyword, ULONG) {
+		EXPECT_EQ(next[eventId]++, keyword);
+	});
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < kThreads; ++i) {
+		threads.emplace_back([&log, i] {
+			const LogListener::ThreadScope scope(log);
+			EVENT_DESCRIPTOR event;
+			for (std::size_t j = 0; j < kCount; ++j) {
+				EventDescCreate(&event, static_cast<USHORT>(i), 0, 0, 99, 0, 0, j);
+				EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+	log.Flush();
+
+	EXPECT_EQ(0, log.GetDroppedCount());
+}
+
+TEST(LogListener, Deferred_LogInActionAndFull_FlushNested) {
+	LogListener log(LogListenerMode::kDeferred, OverflowPolicy::kBlock, 2);
+
+	const t::InSequence s;
+	EXPECT_CALL(log, Event(1, 99, 0, 0)).WillOnce([] {
+		EVENT_DESCRIPTOR event;
+		for (ULONGLONG i = 0; i < 4; ++i) {
+			EventDescCreate(&event, 2, 0, 0, 99, 0, 0, i);
+			EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+		}
+	});
+	for (ULONGLONG i = 0; i < 4; ++i) {
+		EXPECT_CALL(log, Event(2, 99, i, 0));
+	}
+
+	EVENT_DESCRIPTOR event;
+	EventDescCreate(&event, 1, 0, 0, 99, 0, 0, 0);
+	EventWriteEx(0, &event, 0, 0, nullptr, nullptr, 0, nullptr);
+	log.Flush();
+
+	EXPECT_EQ(0, log.GetDroppedCount());
+}
+
+TEST(LogListener, Deferred_Drop) {
+	LogListener log(LogListenerMode::kDeferred, OverflowPolicy::kDrop, 4);
+
+	EXPECT_CALL(log, Debug(t::_, "MyMessage")).Times(4);
+
+	for (std::size_t i = 0; i < 10; ++i) {
+		OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+	}
+
+	EXPECT_EQ(6, log.GetDroppedCount());
+}
+
+TEST(LogListener, Deferred_Grow) {
+	LogListener log(LogListenerMode::kDeferred, OverflowPolicy::kGrow, 4);
+
+	EXPECT_CALL(log, Debug(t::_, "MyMessage")).Times(100);
+
+	for (std::size_t i = 0; i < 100; ++i) {
+		OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+	}
+
+	EXPECT_EQ(0, log.GetDroppedCount());
+}
+
+TEST(LogListener, Deferred_StrictDebugAndNotExpected_ErrorOnFlush) {
+	const LogListener log(LogListenerMode::kStrictDebug | LogListenerMode::kDeferred);
+
+	OutputDebugStringA("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+
+	EXPECT_NONFATAL_FAILURE(log.Flush(), "called more times");
+}
+
 
 //
 // Strict / Non-Strict
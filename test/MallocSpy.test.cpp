@@ -18,8 +18,10 @@ limitations under the License.
 
 #include "m4t/MallocSpy.h"
 
+#include "m4t/AllocationTrace.h"
 #include "m4t/m4t.h"
 
+#include <gtest/gtest-spi.h>  // IWYU pragma: keep
 #include <gtest/gtest.h>
 
 #include <windows.h>
@@ -28,7 +30,12 @@ limitations under the License.
 #include <unknwn.h>
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <filesystem>
+#include <optional>
+#include <thread>
+#include <vector>
 
 namespace m4t::test {
 namespace {
@@ -179,6 +186,335 @@ TEST(MallocSpy, Realloc) {
 	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
 }
 
+TEST(MallocSpy, DeletedHistory_Exceeded_IsApproximate) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy(0);
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+
+	EXPECT_TRUE(pMallocSpy->IsDeleted(ptr));
+	EXPECT_EQ(DeletedState::kDeleted, pMallocSpy->GetDeletedState(ptr));
+
+	// push address out of the exact history
+	constexpr std::size_t kCount = 1024;
+	for (std::size_t i = 1; i <= kCount; ++i) {
+		void* const fake = static_cast<std::byte*>(ptr) + i;
+		EXPECT_EQ(fake, pMallocSpy->PreFree(fake, TRUE));
+	}
+
+	std::free(ptr);
+	pMallocSpy->PostFree(TRUE);
+
+	EXPECT_TRUE(pMallocSpy->IsDeleted(ptr));
+	EXPECT_EQ(DeletedState::kProbablyDeleted, pMallocSpy->GetDeletedState(ptr));
+	EXPECT_EQ(kCount + 1, pMallocSpy->GetDeletedCount());
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, Buffered) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy(TrackingMode::kBuffered);
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+
+	EXPECT_TRUE(pMallocSpy->IsAllocated(ptr));
+	EXPECT_EQ(1, pMallocSpy->GetAllocatedCount());
+
+	std::thread([pMallocSpy, ptr] {
+		EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+		std::free(ptr);
+		pMallocSpy->PostFree(TRUE);
+	}).join();
+
+	pMallocSpy->Flush();
+
+	EXPECT_FALSE(pMallocSpy->IsAllocated(ptr));
+	EXPECT_TRUE(pMallocSpy->IsDeleted(ptr));
+	EXPECT_EQ(0, pMallocSpy->GetAllocatedCount());
+	EXPECT_EQ(1, pMallocSpy->GetDeletedCount());
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, Accounting) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy(TrackingMode::kAccounting);
+
+	EXPECT_EQ(10, pMallocSpy->PreAlloc(10));
+	void* ptr = std::malloc(10);
+	ASSERT_NOT_NULL(ptr);
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+
+	AllocationStatistics statistics = pMallocSpy->GetStatistics();
+	EXPECT_EQ(10, statistics.currentBytes);
+	EXPECT_EQ(10, statistics.peakBytes);
+	EXPECT_EQ(10, statistics.totalBytes);
+	EXPECT_EQ(1, statistics.sizeClasses[AllocationStatistics::GetSizeClass(10)]);
+
+	void* ptrNew = nullptr;
+	EXPECT_EQ(100, pMallocSpy->PreRealloc(ptr, 100, &ptrNew, TRUE));
+	void* const ptrReallocated = std::realloc(ptrNew, 100);
+	ASSERT_NOT_NULL(ptrReallocated);
+	ptr = ptrReallocated;
+	EXPECT_EQ(ptr, pMallocSpy->PostRealloc(ptr, TRUE));
+
+	statistics = pMallocSpy->GetStatistics();
+	EXPECT_EQ(100, statistics.currentBytes);
+	EXPECT_EQ(100, statistics.peakBytes);
+	EXPECT_EQ(110, statistics.totalBytes);
+	EXPECT_EQ(1, statistics.sizeClasses[AllocationStatistics::GetSizeClass(100)]);
+
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	std::free(ptr);
+	pMallocSpy->PostFree(TRUE);
+
+	statistics = pMallocSpy->GetStatistics();
+	EXPECT_EQ(0, statistics.currentBytes);
+	EXPECT_EQ(100, statistics.peakBytes);
+
+	pMallocSpy->ResetPeakBytes();
+
+	EXPECT_EQ(0, pMallocSpy->GetStatistics().peakBytes);
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, Sampling) {
+	MallocSpy* const pMallocSpy = new MallocSpy(TrackingMode::kSampling);
+	pMallocSpy->SetSamplingRate(1);
+
+	// fake addresses are never dereferenced
+	std::byte* const ptr = reinterpret_cast<std::byte*>(std::size_t{0x10000});  // NOLINT(performance-no-int-to-ptr)
+	for (std::size_t i = 0; i < 100; ++i) {
+		EXPECT_EQ(1024, pMallocSpy->PreAlloc(1024));
+		EXPECT_EQ(ptr + i * 1024, pMallocSpy->PostAlloc(ptr + i * 1024));
+	}
+
+	// with a rate of 1 byte, every block is sampled
+	EXPECT_EQ(100, pMallocSpy->GetAllocatedCount());
+	EXPECT_NEAR(100 * 1024, pMallocSpy->GetSamplingEstimate().liveBytes, 1);
+
+	pMallocSpy->SetSampling(false);
+	for (std::size_t i = 0; i < 100; ++i) {
+		EXPECT_EQ(ptr + i * 1024, pMallocSpy->PreFree(ptr + i * 1024, TRUE));
+		pMallocSpy->PostFree(TRUE);
+	}
+
+	EXPECT_EQ(0, pMallocSpy->GetAllocatedCount());
+	EXPECT_NEAR(0, pMallocSpy->GetSamplingEstimate().liveBytes, 1);
+	EXPECT_NEAR(100 * 1024, pMallocSpy->GetSamplingEstimate().totalBytes, 1);
+
+	pMallocSpy->Release();
+}
+
+TEST(MallocSpy, FailAllocations) {
+	MallocSpy* const pMallocSpy = new MallocSpy();
+
+	pMallocSpy->FailNthAllocation(1);
+	EXPECT_EQ(10, pMallocSpy->PreAlloc(10));
+	EXPECT_EQ(0, pMallocSpy->PreAlloc(10));
+	EXPECT_NULL(pMallocSpy->PostAlloc(nullptr));
+	EXPECT_EQ(10, pMallocSpy->PreAlloc(10));
+	EXPECT_EQ(1, pMallocSpy->GetFailedAllocationCount());
+
+	pMallocSpy->FailAllocationsAbove(100);
+	EXPECT_EQ(100, pMallocSpy->PreAlloc(100));
+	EXPECT_EQ(0, pMallocSpy->PreAlloc(101));
+	EXPECT_EQ(1, pMallocSpy->GetFailedAllocationCount());
+
+	pMallocSpy->FailAllocationsRandomly(1, 0);
+	EXPECT_EQ(0, pMallocSpy->PreAlloc(1));
+
+	pMallocSpy->StopFailingAllocations();
+	EXPECT_EQ(101, pMallocSpy->PreAlloc(101));
+	EXPECT_EQ(0, pMallocSpy->GetFailedAllocationCount());
+	EXPECT_EQ(0, pMallocSpy->GetAllocatedCount());
+
+	pMallocSpy->Release();
+}
+
+TEST(MallocSpy, EnumerateAllocationFailures) {
+	MallocSpy* const pMallocSpy = new MallocSpy();
+	std::size_t runs = 0;
+
+	const std::size_t count = pMallocSpy->EnumerateAllocationFailures([pMallocSpy, &runs] {
+		++runs;
+		for (std::size_t i = 0; i < 5; ++i) {
+			if (!pMallocSpy->PreAlloc(1)) {
+				return;
+			}
+		}
+	});
+
+	EXPECT_EQ(5, count);
+	EXPECT_EQ(6, runs);
+	EXPECT_EQ(1, pMallocSpy->PreAlloc(1));
+
+	pMallocSpy->Release();
+}
+
+TEST(MallocSpy, IsSameAllocation) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy();
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+
+	EXPECT_EQ(1, pMallocSpy->PreAlloc(1));
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+
+	const std::optional<AllocatedBlock> block = pMallocSpy->GetAllocation(ptr);
+	ASSERT_TRUE(block.has_value());
+	EXPECT_EQ(1, block->size);
+	EXPECT_TRUE(pMallocSpy->IsSameAllocation(ptr, block->generation));
+
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	pMallocSpy->PostFree(TRUE);
+
+	// simulate reuse of the address by the allocator
+	EXPECT_EQ(1, pMallocSpy->PreAlloc(1));
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+
+	EXPECT_TRUE(pMallocSpy->IsAllocated(ptr));
+	EXPECT_FALSE(pMallocSpy->IsSameAllocation(ptr, block->generation));
+	EXPECT_TRUE(pMallocSpy->IsGenerationDeleted(block->generation));
+
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	pMallocSpy->PostFree(TRUE);
+	std::free(ptr);
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, GetAllocatedSince) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy();
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+	{
+		const AllocationCheckpoint checkpoint = pMallocSpy->Checkpoint();
+
+		EXPECT_EQ(1, pMallocSpy->PreAlloc(1));
+		EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+
+		const std::vector<AllocatedBlock> blocks = pMallocSpy->GetAllocatedSince(checkpoint);
+		ASSERT_EQ(1, blocks.size());
+		EXPECT_EQ(ptr, blocks[0].address);
+		EXPECT_EQ(1, blocks[0].size);
+
+		EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+		pMallocSpy->PostFree(TRUE);
+
+		EXPECT_TRUE(pMallocSpy->GetAllocatedSince(checkpoint).empty());
+	}
+	std::free(ptr);
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, ExpectNoLeaks) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy();
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+
+	EXPECT_NO_LEAKS(*pMallocSpy) {
+		EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+		EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+		pMallocSpy->PostFree(TRUE);
+	}
+
+	const auto leak = [pMallocSpy, ptr] {
+		EXPECT_NO_LEAKS(*pMallocSpy) {
+			EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+		}
+	};
+	EXPECT_NONFATAL_FAILURE(leak(), "1 memory block(s) leaked");
+
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	pMallocSpy->PostFree(TRUE);
+	std::free(ptr);
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, ExpectNoLeaks_Stacks) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy(TrackingMode::kStacks);
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+
+	const auto leak = [pMallocSpy, ptr] {
+		EXPECT_NO_LEAKS(*pMallocSpy) {
+			EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+		}
+	};
+	EXPECT_NONFATAL_FAILURE(leak(), "    at ");
+
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	pMallocSpy->PostFree(TRUE);
+	std::free(ptr);
+
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
+TEST(MallocSpy, Trace) {
+	// NOLINTBEGIN(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc): Test allocation interface.
+	MallocSpy* const pMallocSpy = new MallocSpy();
+	const std::filesystem::path path = std::filesystem::temp_directory_path() / "m4t_MallocSpy_Trace.trace";
+
+	void* const ptr = std::malloc(1);
+	ASSERT_NOT_NULL(ptr);
+
+	pMallocSpy->StartTrace(path);
+
+	EXPECT_EQ(1, pMallocSpy->PreAlloc(1));
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	pMallocSpy->PostFree(TRUE);
+
+	pMallocSpy->StopTrace();
+
+	// not traced
+	EXPECT_EQ(1, pMallocSpy->PreAlloc(1));
+	EXPECT_EQ(ptr, pMallocSpy->PostAlloc(ptr));
+	EXPECT_EQ(ptr, pMallocSpy->PreFree(ptr, TRUE));
+	pMallocSpy->PostFree(TRUE);
+	std::free(ptr);
+
+	const std::vector<TraceRecord> records = ReadTrace(path);
+	ASSERT_EQ(2, records.size());
+	EXPECT_EQ(TraceOperation::kAllocated, records[0].operation);
+	EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr), records[0].address);
+	EXPECT_EQ(1, records[0].size);
+	EXPECT_EQ(TraceOperation::kDeleted, records[1].operation);
+	EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr), records[1].address);
+
+	const TraceSummary summary = AnalyzeTrace(records);
+	EXPECT_EQ(1, summary.peakBytes);
+	EXPECT_EQ(0, summary.liveCount);
+
+	std::filesystem::remove(path);
+	pMallocSpy->Release();
+	// NOLINTEND(cppcoreguidelines-no-malloc, clang-analyzer-unix.Malloc)
+}
+
 TEST(MallocSpy, GetSizeDidAllocHeapMinimize) {
 	MallocSpy* const pMallocSpy = new MallocSpy();
 
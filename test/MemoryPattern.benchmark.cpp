@@ -0,0 +1,75 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/MemoryPattern.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace m4t::internal::benchmark {
+namespace {
+
+namespace b = ::benchmark;
+
+/// @brief The fill pattern.
+constexpr unsigned char kPattern = 0xCD;
+
+/// @brief A byte by byte comparison as a baseline.
+/// @param p The start of the memory range.
+/// @param size The size of the memory range.
+/// @return The offsets of the first and last modified byte or `std::nullopt` if all bytes match.
+std::optional<TouchedRange> FindTouchedRangeBytewise(const void* const p, const std::size_t size) noexcept {
+	const volatile unsigned char* const data = static_cast<const unsigned char*>(p);
+	std::optional<TouchedRange> result;
+	for (std::size_t i = 0; i < size; ++i) {
+		if (data[i] != kPattern) {
+			if (!result) {
+				result = TouchedRange{.first = i, .last = i};
+			} else {
+				result->last = i;
+			}
+		}
+	}
+	return result;
+}
+
+void MemoryPattern_Simd(b::State& state) {
+	const std::vector<unsigned char> buffer(static_cast<std::size_t>(state.range(0)), kPattern);
+	for (auto _ : state) {
+		b::DoNotOptimize(FindTouchedRange(buffer.data(), buffer.size(), kPattern));
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+void MemoryPattern_Bytewise(b::State& state) {
+	const std::vector<unsigned char> buffer(static_cast<std::size_t>(state.range(0)), kPattern);
+	for (auto _ : state) {
+		b::DoNotOptimize(FindTouchedRangeBytewise(buffer.data(), buffer.size()));
+	}
+	state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+
+BENCHMARK(MemoryPattern_Simd)->Range(64, std::int64_t{1} << 20);
+BENCHMARK(MemoryPattern_Bytewise)->Range(64, std::int64_t{1} << 20);
+
+}  // namespace
+}  // namespace m4t::internal::benchmark
@@ -0,0 +1,117 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/MemoryPattern.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+constexpr unsigned char kPattern = 0xCD;
+
+TEST(MemoryPattern, FindTouchedRange_Untouched_ReturnNullopt) {
+	for (std::size_t size = 0; size <= 200; ++size) {
+		const std::vector<unsigned char> buffer(size, kPattern);
+
+		EXPECT_FALSE(FindTouchedRange(buffer.data(), size, kPattern).has_value()) << size;
+	}
+}
+
+TEST(MemoryPattern, FindTouchedRange_SingleByte) {
+	for (std::size_t size = 1; size <= 200; ++size) {
+		for (std::size_t pos = 0; pos < size; ++pos) {
+			std::vector<unsigned char> buffer(size, kPattern);
+			buffer[pos] = 0;
+
+			const std::optional<TouchedRange> touched = FindTouchedRange(buffer.data(), size, kPattern);
+			ASSERT_TRUE(touched.has_value()) << size << " " << pos;
+			EXPECT_EQ(pos, touched->first) << size;
+			EXPECT_EQ(pos, touched->last) << size;
+		}
+	}
+}
+
+TEST(MemoryPattern, FindTouchedRange_TwoBytes) {
+	constexpr std::size_t kSize = 150;
+	for (std::size_t first = 0; first < kSize; ++first) {
+		for (std::size_t last = first + 1; last < kSize; ++last) {
+			std::vector<unsigned char> buffer(kSize, kPattern);
+			buffer[first] = 0;
+			buffer[last] = kPattern + 1;
+
+			const std::optional<TouchedRange> touched = FindTouchedRange(buffer.data(), kSize, kPattern);
+			ASSERT_TRUE(touched.has_value()) << first << " " << last;
+			EXPECT_EQ(first, touched->first);
+			EXPECT_EQ(last, touched->last);
+		}
+	}
+}
+
+TEST(MemoryPattern, FindTouchedRange_Unaligned) {
+	std::vector<unsigned char> buffer(1024 + 16, kPattern);
+	buffer[3 + 500] = 0;
+
+	for (std::size_t offset = 0; offset < 16; ++offset) {
+		const std::optional<TouchedRange> touched = FindTouchedRange(&buffer[offset], 1024, kPattern);
+		ASSERT_TRUE(touched.has_value());
+		EXPECT_EQ(503 - offset, touched->first);
+		EXPECT_EQ(503 - offset, touched->last);
+	}
+}
+
+TEST(MemoryPattern, FindTouchedRange_Large) {
+	constexpr std::size_t kSize = std::size_t{4} * 1024 * 1024;
+	std::vector<unsigned char> buffer(kSize, kPattern);
+	buffer[kSize / 3] = 0;
+	buffer[kSize / 2] = 0;
+
+	const std::optional<TouchedRange> touched = FindTouchedRange(buffer.data(), kSize, kPattern);
+	ASSERT_TRUE(touched.has_value());
+	EXPECT_EQ(kSize / 3, touched->first);
+	EXPECT_EQ(kSize / 2, touched->last);
+}
+
+TEST(MemoryPattern, IsUninitializedRange) {
+	std::vector<unsigned char> buffer(100, kPattern);
+
+	EXPECT_TRUE(internal::IsUninitializedRange(buffer.data(), buffer.size(), kPattern));
+
+	buffer[7] = 0;
+	buffer[42] = 0;
+	const testing::AssertionResult result = internal::IsUninitializedRange(buffer.data(), buffer.size(), kPattern);
+	EXPECT_FALSE(result);
+	EXPECT_THAT(result.message(), testing::HasSubstr("Memory range of 100 bytes at "));
+	EXPECT_THAT(result.message(), testing::EndsWith(" has been written from offset 7 to offset 42"));
+}
+
+TEST(MemoryPattern, IsUninitializedRange_NoPattern_IsNotNullCheck) {
+	const std::vector<unsigned char> buffer(100, 0);
+
+	EXPECT_TRUE(internal::IsUninitializedRange(buffer.data(), buffer.size(), std::nullopt));
+	EXPECT_FALSE(internal::IsUninitializedRange(nullptr, 0, std::nullopt));
+	EXPECT_FALSE(internal::IsUninitializedRange(nullptr, 0, kPattern));
+}
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,194 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/MpmcRing.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+TEST(MpmcRing, PushPop) {
+	MpmcRing<std::unique_ptr<int>> ring(4, OverflowPolicy::kBlock);
+
+	EXPECT_FALSE(ring.Pop().has_value());
+
+	for (int i = 0; i < 4; ++i) {
+		std::unique_ptr<int> value = std::make_unique<int>(i);
+		ASSERT_TRUE(ring.Push(value));
+		EXPECT_EQ(nullptr, value);
+	}
+
+	// full
+	std::unique_ptr<int> value = std::make_unique<int>(4);
+	EXPECT_FALSE(ring.Push(value));
+	EXPECT_NE(nullptr, value);
+	EXPECT_EQ(0, ring.GetDroppedCount());
+
+	for (int i = 0; i < 4; ++i) {
+		const std::optional<std::unique_ptr<int>> result = ring.Pop();
+		ASSERT_TRUE(result.has_value());
+		EXPECT_EQ(i, **result);
+	}
+	EXPECT_FALSE(ring.Pop().has_value());
+
+	// space is available again
+	EXPECT_TRUE(ring.Push(value));
+	EXPECT_EQ(4, ring.GetCapacity());
+}
+
+TEST(MpmcRing, Drop) {
+	MpmcRing<int> ring(2, OverflowPolicy::kDrop);
+
+	for (int i = 0; i < 5; ++i) {
+		int value = i;
+		EXPECT_EQ(i < 2, ring.Push(value));
+	}
+
+	EXPECT_EQ(3, ring.GetDroppedCount());
+	EXPECT_EQ(0, ring.Pop());
+	EXPECT_EQ(1, ring.Pop());
+	EXPECT_FALSE(ring.Pop().has_value());
+}
+
+TEST(MpmcRing, Grow) {
+	MpmcRing<int> ring(2, OverflowPolicy::kGrow);
+
+	for (int i = 0; i < 100; ++i) {
+		int value = i;
+		ASSERT_TRUE(ring.Push(value));
+		// interleave with consumption
+		if (i % 7 == 0) {
+			EXPECT_EQ(i / 7, ring.Pop());
+		}
+	}
+
+	EXPECT_EQ(2 + 4 + 8 + 16 + 32 + 64, ring.GetCapacity());
+	for (int i = 15; i < 100; ++i) {
+		EXPECT_EQ(i, ring.Pop());
+	}
+	EXPECT_FALSE(ring.Pop().has_value());
+	EXPECT_EQ(0, ring.GetDroppedCount());
+}
+
+/// @brief Run producers and a single consumer concurrently.
+/// @param policy The overflow policy.
+void RunConcurrent(const OverflowPolicy policy) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 20'000;
+	MpmcRing<std::size_t> ring(64, policy);
+
+	std::atomic<std::size_t> running = kThreads;
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&ring, &running, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				std::size_t value = t * kCount + i;
+				while (!ring.Push(value) && ring.GetPolicy() == OverflowPolicy::kBlock) {
+					std::this_thread::yield();
+				}
+			}
+			running.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	// the records of each thread are received in order
+	std::vector<std::size_t> next(kThreads);
+	std::size_t received = 0;
+	while (true) {
+		const bool done = running.load(std::memory_order_acquire) == 0;
+		for (std::optional<std::size_t> value = ring.Pop(); value; value = ring.Pop()) {
+			const std::size_t t = *value / kCount;
+			ASSERT_LT(t, kThreads);
+			EXPECT_LT(next[t], *value % kCount + 1);
+			next[t] = *value % kCount + 1;
+			++received;
+		}
+		if (done) {
+			break;
+		}
+		std::this_thread::yield();
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kThreads * kCount, received + ring.GetDroppedCount());
+	if (policy != OverflowPolicy::kDrop) {
+		EXPECT_EQ(0, ring.GetDroppedCount());
+	}
+}
+
+TEST(MpmcRing, Concurrent_Block) {
+	RunConcurrent(OverflowPolicy::kBlock);
+}
+
+TEST(MpmcRing, Concurrent_Drop) {
+	RunConcurrent(OverflowPolicy::kDrop);
+}
+
+TEST(MpmcRing, Concurrent_Grow) {
+	RunConcurrent(OverflowPolicy::kGrow);
+}
+
+TEST(MpmcRing, Concurrent_MultipleConsumers) {
+	constexpr std::size_t kThreads = 4;
+	constexpr std::size_t kCount = 20'000;
+	MpmcRing<std::size_t> ring(256, OverflowPolicy::kBlock);
+
+	std::atomic<std::size_t> sum = 0;
+	std::atomic<std::size_t> received = 0;
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&ring, t] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				std::size_t value = t * kCount + i;
+				while (!ring.Push(value)) {
+					std::this_thread::yield();
+				}
+			}
+		});
+		threads.emplace_back([&ring, &sum, &received] {
+			while (received.load(std::memory_order_relaxed) < kThreads * kCount) {
+				if (const std::optional<std::size_t> value = ring.Pop(); value) {
+					sum.fetch_add(*value, std::memory_order_relaxed);
+					received.fetch_add(1, std::memory_order_relaxed);
+				} else {
+					std::this_thread::yield();
+				}
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	constexpr std::size_t kTotal = kThreads * kCount;
+	EXPECT_EQ(kTotal, received);
+	EXPECT_EQ(kTotal * (kTotal - 1) / 2, sum);
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
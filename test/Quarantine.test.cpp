@@ -0,0 +1,168 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/Quarantine.h"
+
+#include <gtest/gtest-spi.h>  // IWYU pragma: keep
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+/// @brief A type with extended alignment for testing aligned allocation.
+struct alignas(64) Aligned {
+	std::byte data[64];  ///< @brief Some data.
+};
+
+class Quarantine_Test : public testing::Test {
+protected:
+	void TearDown() override {
+		DisableQuarantine();
+	}
+};
+
+TEST_F(Quarantine_Test, Disabled) {
+	const std::unique_ptr<int> ptr = std::make_unique<int>(1);
+
+	EXPECT_FALSE(IsQuarantineEnabled());
+	EXPECT_FALSE(IsQuarantined(ptr.get()));
+	EXPECT_TRUE(IsDeletedMemory(ptr.get()));
+	EXPECT_FALSE(IsDeletedMemory(nullptr));
+}
+
+TEST_F(Quarantine_Test, Delete) {
+	EnableQuarantine();
+	EXPECT_TRUE(IsQuarantineEnabled());
+
+	const std::unique_ptr<int> live = std::make_unique<int>(1);
+	int* const deleted = new int(2);
+	const void* const address = deleted;
+	delete deleted;
+
+	EXPECT_TRUE(IsQuarantined(address));
+	EXPECT_TRUE(IsDeletedMemory(address));
+	EXPECT_FALSE(IsQuarantined(live.get()));
+	EXPECT_FALSE(IsDeletedMemory(live.get()));
+	EXPECT_FALSE(IsDeletedMemory(nullptr));
+
+	DisableQuarantine();
+
+	EXPECT_FALSE(IsQuarantineEnabled());
+	EXPECT_FALSE(IsQuarantined(address));
+}
+
+TEST_F(Quarantine_Test, Delete_Aligned) {
+	EnableQuarantine();
+
+	Aligned* const deleted = new Aligned();
+	const void* const address = deleted;
+	delete deleted;
+
+	EXPECT_TRUE(IsQuarantined(address));
+}
+
+TEST_F(Quarantine_Test, Delete_Array) {
+	EnableQuarantine();
+
+	int* const deleted = new int[16]();
+	const void* const address = deleted;
+	delete[] deleted;
+
+	EXPECT_TRUE(IsQuarantined(address));
+}
+
+TEST_F(Quarantine_Test, Delete_MoreThanMaxBytes_ReleaseOldest) {
+	constexpr std::size_t kCount = 64;
+	EnableQuarantine(1024);
+
+	std::vector<const void*> addresses;
+	addresses.reserve(kCount);
+	for (std::size_t i = 0; i < kCount; ++i) {
+		Aligned* const deleted = new Aligned();
+		addresses.push_back(deleted);
+		delete deleted;
+	}
+
+	EXPECT_TRUE(IsQuarantined(addresses.back()));
+	// released memory might have been reused for later allocations
+	const std::set<const void*> unique(addresses.cbegin(), addresses.cend());
+	const std::size_t quarantined = std::ranges::count_if(unique, [](const void* const address) noexcept {
+		return IsQuarantined(address);
+	});
+	EXPECT_LE(quarantined, 1024 / sizeof(Aligned));
+	EXPECT_LT(quarantined, unique.size());
+}
+
+TEST_F(Quarantine_Test, DeleteTwice_Error) {
+	EnableQuarantine();
+
+	int* const deleted = new int(2);
+	const void* const address = deleted;
+	delete deleted;
+
+	EXPECT_NONFATAL_FAILURE(delete deleted, "deleted twice");
+	EXPECT_TRUE(IsQuarantined(address));
+}
+
+TEST_F(Quarantine_Test, Modified_IsNotQuarantined) {
+	EnableQuarantine();
+
+	// NOLINTNEXTLINE(cppcoreguidelines-no-malloc): Memory is freed by the quarantine.
+	unsigned char* const p = static_cast<unsigned char*>(std::malloc(32));
+	ASSERT_NE(nullptr, p);
+	ASSERT_TRUE(Quarantine(p, 32, false));
+
+	EXPECT_TRUE(IsQuarantined(p));
+
+	// simulate a write after delete
+	p[0] = 0;
+
+	EXPECT_FALSE(IsQuarantined(p));
+}
+
+TEST_F(Quarantine_Test, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 4'000;
+	EnableQuarantine();
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([] {
+			for (std::size_t i = 0; i < kCount; ++i) {
+				int* const deleted = new int(1);
+				const void* const address = deleted;
+				delete deleted;
+				EXPECT_TRUE(IsQuarantined(address));
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
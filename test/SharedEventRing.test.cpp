@@ -0,0 +1,323 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/SharedEventRing.h"
+
+#include <gtest/gtest.h>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+/// @brief Create a name which is not used by other tests running in parallel.
+/// @return The name.
+std::string UniqueName() {
+	return "m4t_SharedEventRing_" + std::to_string(std::random_device()());
+}
+
+/// @brief Get the bytes of a value.
+/// @param value The value.
+/// @return The bytes.
+template <typename T>
+std::span<const std::byte> Bytes(const T& value) noexcept {
+	return std::as_bytes(std::span(&value, 1));
+}
+
+TEST(SharedEventRing, WriteEvent) {
+	SharedEventCollector collector(UniqueName(), 4);
+	SharedEventWriter writer(collector.GetName());
+	const std::uint32_t value = 42;
+	const std::uint64_t other = 7;
+	const std::vector<std::span<const std::byte>> args = {Bytes(value), Bytes(other)};
+
+	EXPECT_TRUE(writer.WriteEvent(5, 4, 1024, 2, [&args](const std::uint32_t index) noexcept {
+		return args[index];
+	}));
+
+	std::optional<SharedEventRecord> record = collector.Pop();
+	ASSERT_TRUE(record);
+	EXPECT_EQ(SharedRecordType::kEvent, record->GetType());
+	EXPECT_NE(0, record->GetProcessId());
+	EXPECT_EQ(5, record->GetEventId());
+	EXPECT_EQ(4, record->GetLevel());
+	EXPECT_EQ(1024, record->GetKeyword());
+	ASSERT_EQ(2, record->GetArgCount());
+	EXPECT_EQ(sizeof(value), record->GetArg(0).size());
+	EXPECT_EQ(sizeof(other), record->GetArg(1).size());
+	EXPECT_THROW(static_cast<void>(record->GetArg(2)), std::out_of_range);
+
+	EXPECT_FALSE(collector.Pop());
+}
+
+TEST(SharedEventRing, WriteDebug) {
+	SharedEventCollector collector(UniqueName());
+	SharedEventWriter writer(collector.GetName());
+
+	EXPECT_TRUE(writer.WriteDebug("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n\tcaused by: MyCause\n\t\tat file.cpp(98) (MyCauseFunction)\n"));
+	EXPECT_FALSE(writer.WriteDebug("other output"));
+
+	const std::optional<SharedEventRecord> record = collector.Pop();
+	ASSERT_TRUE(record);
+	EXPECT_EQ(SharedRecordType::kDebug, record->GetType());
+	ASSERT_EQ(3, record->GetArgCount());
+	EXPECT_EQ("MyLevel", record->GetString(0));
+	EXPECT_EQ("MyCause", record->GetString(1));
+	EXPECT_EQ("MyMessage", record->GetString(2));
+
+	EXPECT_FALSE(collector.Pop());
+}
+
+TEST(SharedEventRing, Write_TooLarge_ReturnFalse) {
+	SharedEventCollector collector(UniqueName());
+	SharedEventWriter writer(collector.GetName());
+	const std::vector<std::byte> data(SharedEventRecord::kMaxPayload);
+
+	EXPECT_FALSE(writer.WriteEvent(1, 0, 0, 1, [&data](std::uint32_t) noexcept {
+		return std::span(data);
+	}));
+
+	EXPECT_FALSE(collector.Pop());
+	EXPECT_EQ(0, collector.GetDroppedCount());
+}
+
+TEST(SharedEventRing, Write_Full_Drop) {
+	SharedEventCollector collector(UniqueName(), 3);
+	SharedEventWriter writer(collector.GetName());
+	ASSERT_EQ(4, collector.GetCapacity());
+
+	for (std::uint16_t i = 0; i < 6; ++i) {
+		EXPECT_EQ(i < 4, writer.WriteEvent(i, 0, 0, 0, [](std::uint32_t) noexcept {
+			return std::span<const std::byte>();
+		})) << i;
+	}
+	EXPECT_EQ(2, collector.GetDroppedCount());
+
+	for (std::uint16_t i = 0; i < 4; ++i) {
+		const std::optional<SharedEventRecord> record = collector.Pop();
+		ASSERT_TRUE(record);
+		EXPECT_EQ(i, record->GetEventId());
+	}
+	EXPECT_FALSE(collector.Pop());
+}
+
+TEST(SharedEventRing, Create_NameInUse_ThrowException) {
+	const SharedEventCollector collector(UniqueName());
+
+	EXPECT_THROW(SharedEventCollector{collector.GetName()}, std::system_error);
+}
+
+TEST(SharedEventRing, Open_NotFound_ThrowException) {
+	EXPECT_THROW(SharedEventWriter{UniqueName()}, std::system_error);
+}
+
+#if !defined(_WIN32)
+/// @brief Adds a record step by step as a child process which might be stopped between the steps.
+/// @details Uses the layout of the shared memory, i.e. the position for writing is the first value after the first
+/// cache line of the header and the slots consisting of the sequence number and the record start after 4 cache lines.
+class StoppedWriter {
+public:
+	/// @brief Open the shared memory.
+	/// @param name The name of the shared memory.
+	/// @param capacity The number of records.
+	StoppedWriter(const std::string& name, const std::size_t capacity)
+	    : m_capacity(capacity)
+	    , m_size(kSlotOffset + capacity * kSlotSize) {
+		const int fd = shm_open(('/' + name).c_str(), O_RDWR, 0);
+		if (fd < 0) {
+			throw std::system_error(errno, std::system_category(), "shm_open");
+		}
+		m_address = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (m_address == MAP_FAILED) {
+			throw std::system_error(errno, std::system_category(), "mmap");
+		}
+	}
+	StoppedWriter(const StoppedWriter&) = delete;
+	StoppedWriter(StoppedWriter&&) = delete;
+
+	~StoppedWriter() noexcept {
+		munmap(m_address, m_size);
+	}
+
+public:
+	StoppedWriter& operator=(const StoppedWriter&) = delete;
+	StoppedWriter& operator=(StoppedWriter&&) = delete;
+
+public:
+	/// @brief Reserve the next slot.
+	void Reserve() noexcept {
+		m_position = At(kCacheLineSize).fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/// @brief Claim the reserved slot for copying the record.
+	/// @return `false` if the slot has been skipped by the collector.
+	bool Claim() noexcept {
+		std::uint64_t expected = m_position;
+		return At(kSlotOffset + (m_position % m_capacity) * kSlotSize).compare_exchange_strong(expected, m_position | (std::uint64_t{1} << 63));
+	}
+
+private:
+	/// @brief Get an atomic value in the shared memory.
+	/// @param offset The offset of the value.
+	/// @return The atomic value.
+	std::atomic<std::uint64_t>& At(const std::size_t offset) const noexcept {
+		return *reinterpret_cast<std::atomic<std::uint64_t>*>(static_cast<std::byte*>(m_address) + offset);
+	}
+
+private:
+	static constexpr std::size_t kCacheLineSize = 64;                                            ///< @brief The size of a cache line.
+	static constexpr std::size_t kSlotOffset = 4 * kCacheLineSize;                               ///< @brief The offset of the first slot.
+	static constexpr std::size_t kSlotSize = sizeof(std::uint64_t) + sizeof(SharedEventRecord);  ///< @brief The size of a slot.
+
+	std::size_t m_capacity;        ///< @brief The number of records.
+	std::size_t m_size;            ///< @brief The size of the mapping.
+	void* m_address = nullptr;     ///< @brief The address of the mapping.
+	std::uint64_t m_position = 0;  ///< @brief The position of the reserved slot.
+};
+
+/// @brief Write an event without arguments.
+/// @param writer The writer.
+/// @param eventId The event id.
+/// @return The result of `SharedEventWriter::WriteEvent`.
+bool WriteEvent(SharedEventWriter& writer, const std::uint16_t eventId) {
+	return writer.WriteEvent(eventId, 0, 0, 0, [](std::uint32_t) noexcept {
+		return std::span<const std::byte>();
+	});
+}
+
+TEST(SharedEventRing, Pop_SlotNotClaimed_SkipAfterTimeout) {
+	SharedEventCollector collector(UniqueName(), 4, std::chrono::milliseconds(10));
+	SharedEventWriter writer(collector.GetName());
+	StoppedWriter stopped(collector.GetName(), collector.GetCapacity());
+	stopped.Reserve();
+	ASSERT_TRUE(WriteEvent(writer, 7));
+
+	EXPECT_FALSE(collector.Pop());
+	EXPECT_EQ(0, collector.GetDroppedCount());
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	const std::optional<SharedEventRecord> record = collector.Pop();
+
+	ASSERT_TRUE(record);
+	EXPECT_EQ(7, record->GetEventId());
+	EXPECT_EQ(1, collector.GetDroppedCount());
+	EXPECT_FALSE(collector.Pop());
+}
+
+TEST(SharedEventRing, Pop_WriterResumesAfterWrap_KeepNewRecord) {
+	SharedEventCollector collector(UniqueName(), 2, std::chrono::milliseconds(10));
+	SharedEventWriter writer(collector.GetName());
+	StoppedWriter stopped(collector.GetName(), collector.GetCapacity());
+	stopped.Reserve();
+	ASSERT_TRUE(WriteEvent(writer, 1));
+
+	EXPECT_FALSE(collector.Pop());
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	std::optional<SharedEventRecord> record = collector.Pop();
+	ASSERT_TRUE(record);
+	EXPECT_EQ(1, record->GetEventId());
+
+	// next lap uses the skipped slot
+	ASSERT_TRUE(WriteEvent(writer, 2));
+	ASSERT_TRUE(WriteEvent(writer, 3));
+
+	EXPECT_FALSE(stopped.Claim());
+
+	record = collector.Pop();
+	ASSERT_TRUE(record);
+	EXPECT_EQ(2, record->GetEventId());
+	record = collector.Pop();
+	ASSERT_TRUE(record);
+	EXPECT_EQ(3, record->GetEventId());
+	EXPECT_FALSE(collector.Pop());
+	EXPECT_EQ(1, collector.GetDroppedCount());
+}
+
+TEST(SharedEventRing, Pop_SlotClaimed_Wait) {
+	SharedEventCollector collector(UniqueName(), 4, std::chrono::milliseconds(10));
+	SharedEventWriter writer(collector.GetName());
+	StoppedWriter stopped(collector.GetName(), collector.GetCapacity());
+	stopped.Reserve();
+	ASSERT_TRUE(stopped.Claim());
+	ASSERT_TRUE(WriteEvent(writer, 7));
+
+	EXPECT_FALSE(collector.Pop());
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	EXPECT_FALSE(collector.Pop());
+	EXPECT_EQ(0, collector.GetDroppedCount());
+}
+
+TEST(SharedEventRing, ChildProcess) {
+	constexpr std::uint16_t kCount = 100;
+	SharedEventCollector collector(UniqueName(), 256);
+
+	const pid_t pid = fork();
+	ASSERT_NE(-1, pid);
+	if (!pid) {
+		SharedEventWriter writer(collector.GetName());
+		bool ok = writer.WriteDebug("[MyLevel] [1234] MyMessage\n\tat file.cpp(99) (MyFunction)\n");
+		for (std::uint16_t i = 0; i < kCount; ++i) {
+			ok &= writer.WriteEvent(i, 4, 0, 1, [&i](std::uint32_t) noexcept {
+				return Bytes(i);
+			});
+		}
+		_exit(ok ? 0 : 1);
+	}
+	int status = 0;
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	ASSERT_TRUE(WIFEXITED(status));
+	EXPECT_EQ(0, WEXITSTATUS(status));
+
+	std::optional<SharedEventRecord> record = collector.Pop();
+	ASSERT_TRUE(record);
+	EXPECT_EQ(SharedRecordType::kDebug, record->GetType());
+	EXPECT_EQ(static_cast<std::uint32_t>(pid), record->GetProcessId());
+	EXPECT_EQ("MyMessage", record->GetString(1));
+	for (std::uint16_t i = 0; i < kCount; ++i) {
+		record = collector.Pop();
+		ASSERT_TRUE(record);
+		EXPECT_EQ(static_cast<std::uint32_t>(pid), record->GetProcessId());
+		EXPECT_EQ(i, record->GetEventId());
+	}
+	EXPECT_FALSE(collector.Pop());
+}
+#endif
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,189 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/SpyMemoryResource.h"
+
+#include "m4t/AllocationTracker.h"
+#include "m4t/DeletedHistory.h"
+
+#include <gtest/gtest-spi.h>  // IWYU pragma: keep
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace m4t::test {
+namespace {
+
+TEST(SpyMemoryResource, AllocateDeallocate) {
+	SpyMemoryResource resource;
+
+	void* const p = resource.allocate(16, 8);
+
+	EXPECT_TRUE(resource.IsAllocated(p));
+	EXPECT_FALSE(resource.IsDeleted(p));
+	EXPECT_EQ(1, resource.GetAllocatedCount());
+	EXPECT_EQ(0, resource.GetDeletedCount());
+
+	const std::optional<AllocatedBlock> block = resource.GetAllocation(p);
+	ASSERT_TRUE(block.has_value());
+	EXPECT_EQ(16, block->size);
+
+	resource.deallocate(p, 16, 8);
+
+	EXPECT_FALSE(resource.IsAllocated(p));
+	EXPECT_TRUE(resource.IsDeleted(p));
+	EXPECT_EQ(DeletedState::kDeleted, resource.GetDeletedState(p));
+	EXPECT_TRUE(resource.IsGenerationDeleted(block->generation));
+	EXPECT_EQ(0, resource.GetAllocatedCount());
+	EXPECT_EQ(1, resource.GetDeletedCount());
+}
+
+TEST(SpyMemoryResource, Upstream) {
+	std::byte buffer[1024];
+	std::pmr::monotonic_buffer_resource upstream(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+	SpyMemoryResource resource(&upstream);
+
+	EXPECT_EQ(&upstream, resource.GetUpstream());
+
+	void* const p = resource.allocate(16, 8);
+
+	EXPECT_GE(static_cast<std::byte*>(p), &buffer[0]);
+	EXPECT_LT(static_cast<std::byte*>(p), &buffer[sizeof(buffer)]);
+
+	resource.deallocate(p, 16, 8);
+
+	EXPECT_THROW(static_cast<void>(resource.allocate(2048)), std::bad_alloc);
+	EXPECT_EQ(0, resource.GetAllocatedCount());
+}
+
+TEST(SpyMemoryResource, IsEqual) {
+	SpyMemoryResource resource;
+	SpyMemoryResource other;
+
+	EXPECT_TRUE(resource.is_equal(resource));
+	EXPECT_FALSE(resource.is_equal(other));
+	EXPECT_FALSE(resource.is_equal(*std::pmr::get_default_resource()));
+}
+
+TEST(SpyMemoryResource, Accounting) {
+	SpyMemoryResource resource(std::pmr::get_default_resource(), TrackingMode::kAccounting);
+	{
+		std::pmr::vector<int> values(&resource);
+		values.reserve(64);
+		values.push_back(1);
+
+		const AllocationStatistics statistics = resource.GetStatistics();
+		EXPECT_EQ(64 * sizeof(int), statistics.currentBytes);
+		EXPECT_EQ(64 * sizeof(int), statistics.peakBytes);
+	}
+
+	const AllocationStatistics statistics = resource.GetStatistics();
+	EXPECT_EQ(0, statistics.currentBytes);
+	EXPECT_EQ(64 * sizeof(int), statistics.peakBytes);
+	EXPECT_EQ(64 * sizeof(int), statistics.totalBytes);
+	EXPECT_EQ(1, statistics.sizeClasses[AllocationStatistics::GetSizeClass(64 * sizeof(int))]);
+
+	resource.ResetPeakBytes();
+
+	EXPECT_EQ(0, resource.GetStatistics().peakBytes);
+}
+
+TEST(SpyMemoryResource, Sampling) {
+	SpyMemoryResource resource(std::pmr::get_default_resource(), TrackingMode::kSampling);
+	resource.SetSamplingRate(1);
+
+	void* const p = resource.allocate(64);
+
+	EXPECT_TRUE(resource.IsAllocated(p));
+	EXPECT_DOUBLE_EQ(64, resource.GetSamplingEstimate().liveBytes);
+
+	resource.deallocate(p, 64);
+	resource.SetSampling(false);
+	void* const q = resource.allocate(1);
+
+	EXPECT_TRUE(resource.IsAllocated(q));
+	EXPECT_DOUBLE_EQ(1, resource.GetSamplingEstimate().liveBytes);
+
+	resource.deallocate(q, 1);
+}
+
+TEST(SpyMemoryResource, Buffered_Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kCount = 1000;
+	SpyMemoryResource resource(std::pmr::get_default_resource(), TrackingMode::kBuffered | TrackingMode::kAccounting);
+
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&resource] {
+			std::pmr::vector<std::pmr::string> strings(&resource);
+			for (std::size_t i = 0; i < kCount; ++i) {
+				strings.emplace_back(64, 'x');
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(0, resource.GetAllocatedCount());
+	EXPECT_EQ(0, resource.GetStatistics().currentBytes);
+	EXPECT_GE(resource.GetDeletedCount(), kThreads * kCount);
+}
+
+TEST(SpyMemoryResource, GetAllocatedSince) {
+	SpyMemoryResource resource;
+	void* const before = resource.allocate(8);
+
+	const AllocationCheckpoint checkpoint = resource.Checkpoint();
+	void* const after = resource.allocate(16);
+
+	const std::vector<AllocatedBlock> blocks = resource.GetAllocatedSince(checkpoint);
+	ASSERT_EQ(1, blocks.size());
+	EXPECT_EQ(after, blocks[0].address);
+	EXPECT_EQ(16, blocks[0].size);
+
+	resource.deallocate(after, 16);
+	resource.deallocate(before, 8);
+}
+
+TEST(SpyMemoryResource, ExpectNoLeaks) {
+	SpyMemoryResource resource;
+
+	EXPECT_NO_LEAKS(resource) {
+		std::pmr::vector<int> values({1, 2, 3}, &resource);
+	}
+
+	void* p = nullptr;
+	const auto leak = [&resource, &p] {
+		EXPECT_NO_LEAKS(resource) {
+			p = resource.allocate(24);
+		}
+	};
+	EXPECT_NONFATAL_FAILURE(leak(), "1 memory block(s) leaked");
+
+	resource.deallocate(p, 24);
+}
+
+}  // namespace
+}  // namespace m4t::test
@@ -0,0 +1,134 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/StackTable.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace m4t::internal::test {
+namespace {
+
+/// @brief Create a fake return address.
+/// @param index A unique index.
+/// @return An address which is not `nullptr`.
+void* Frame(const std::size_t index) noexcept {
+	return reinterpret_cast<void*>((index + 1) * 16);  // NOLINT(performance-no-int-to-ptr): Frames are never dereferenced.
+}
+
+TEST(StackTable, Intern) {
+	StackTable table;
+	void* const stack1[] = {Frame(0), Frame(1), Frame(2)};
+	void* const stack2[] = {Frame(0), Frame(1), Frame(3)};
+
+	const std::uint32_t id1 = table.Intern(stack1);
+	const std::uint32_t id2 = table.Intern(stack2);
+
+	EXPECT_NE(StackTable::kNoStack, id1);
+	EXPECT_NE(StackTable::kNoStack, id2);
+	EXPECT_NE(id1, id2);
+	EXPECT_EQ(2, table.GetCount());
+
+	// deduplicated
+	EXPECT_EQ(id1, table.Intern(stack1));
+	EXPECT_EQ(2, table.GetCount());
+
+	EXPECT_EQ(std::vector<const void*>(std::begin(stack1), std::end(stack1)), table.GetFrames(id1));
+	EXPECT_EQ(std::vector<const void*>(std::begin(stack2), std::end(stack2)), table.GetFrames(id2));
+}
+
+TEST(StackTable, Intern_Empty_ReturnNoStack) {
+	StackTable table;
+
+	EXPECT_EQ(StackTable::kNoStack, table.Intern({}));
+	EXPECT_TRUE(table.GetFrames(StackTable::kNoStack).empty());
+	EXPECT_EQ(0, table.GetCount());
+}
+
+TEST(StackTable, Intern_TooManyFrames_IsTruncated) {
+	StackTable table;
+	std::vector<void*> frames;
+	for (std::size_t i = 0; i < StackTable::kMaxFrames * 2; ++i) {
+		frames.push_back(Frame(i));
+	}
+
+	const std::uint32_t id = table.Intern(frames);
+
+	EXPECT_EQ(StackTable::kMaxFrames, table.GetFrames(id).size());
+	EXPECT_EQ(id, table.Intern(std::span(frames).first(StackTable::kMaxFrames)));
+}
+
+TEST(StackTable, Capture) {
+	StackTable table;
+
+	constexpr std::size_t kCount = 1'000;
+
+	for (std::size_t i = 0; i < kCount; ++i) {
+		const std::uint32_t id = table.Capture(0);
+		ASSERT_NE(StackTable::kNoStack, id);
+		EXPECT_FALSE(table.GetFrames(id).empty());
+	}
+
+	// the compiler might unroll the loop into several call sites
+	EXPECT_LT(table.GetCount(), kCount);
+}
+
+TEST(StackTable, Concurrent) {
+	constexpr std::size_t kThreads = 8;
+	constexpr std::size_t kStacks = 1'000;
+	StackTable table;
+
+	std::vector<std::vector<std::uint32_t>> ids(kThreads);
+	std::vector<std::thread> threads;
+	for (std::size_t t = 0; t < kThreads; ++t) {
+		threads.emplace_back([&table, &ids, t] {
+			for (std::size_t i = 0; i < kStacks; ++i) {
+				void* const frames[] = {Frame(i), Frame(i + 1)};
+				ids[t].push_back(table.Intern(frames));
+			}
+		});
+	}
+	for (std::thread& thread : threads) {
+		thread.join();
+	}
+
+	EXPECT_EQ(kStacks, table.GetCount());
+	for (std::size_t t = 1; t < kThreads; ++t) {
+		EXPECT_EQ(ids[0], ids[t]);
+	}
+}
+
+TEST(StackTable, SymbolizeFrame) {
+	void* frames[StackTable::kMaxFrames];
+	const std::size_t count = CaptureStack(0, frames);
+	ASSERT_GT(count, 0);
+
+	const std::string symbol = SymbolizeFrame(frames[0]);
+
+	EXPECT_FALSE(symbol.empty());
+}
+
+}  // namespace
+}  // namespace m4t::internal::test
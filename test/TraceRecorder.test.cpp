@@ -0,0 +1,112 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+
+#include "m4t/TraceRecorder.h"
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <span>
+#include <string>
+#include <system_error>
+
+namespace m4t::test {
+namespace {
+
+namespace t = testing;
+
+class TraceRecorder_Test : public t::Test {
+protected:
+	void TearDown() override {
+		std::error_code ec;
+		std::filesystem::remove(m_path, ec);
+	}
+
+	/// @brief Read the contents of the file.
+	/// @return The contents.
+	std::string Read() const {
+		std::ifstream file(m_path, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+protected:
+	const std::filesystem::path m_path = std::filesystem::temp_directory_path() / ("m4t_TraceRecorder_" + std::to_string(std::random_device()()) + ".json");  ///< @brief The path of the output.
+};
+
+TEST_F(TraceRecorder_Test, AddEvent) {
+	constexpr std::array<std::byte, 16> kActivityId = {std::byte{0x04}, std::byte{0x03}, std::byte{0x02}, std::byte{0x01}, std::byte{0x06}, std::byte{0x05}, std::byte{0x08}, std::byte{0x07}, std::byte{0x09}, std::byte{0x0a}, std::byte{0x0b}, std::byte{0x0c}, std::byte{0x0d}, std::byte{0x0e}, std::byte{0x0f}, std::byte{0xff}};
+	{
+		TraceRecorder recorder(m_path);
+		const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+		recorder.AddEvent(7, 4, 1024, 99, kActivityId, now);
+		recorder.AddEvent(8, 5, 0, 98, {}, now);
+
+		EXPECT_EQ(2, recorder.GetCount());
+	}
+
+	const std::string trace = Read();
+	EXPECT_THAT(trace, t::StartsWith("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n{\"name\":\"Event 7\",\"cat\":\"event\",\"ph\":\"i\",\"s\":\"t\",\"ts\":"));
+	EXPECT_THAT(trace, t::HasSubstr(",\"tid\":99,\"args\":{\"id\":7,\"level\":4,\"keyword\":\"0x400\",\"activity\":\"01020304-0506-0708-090a-0b0c0d0e0fff\"}},\n{\"name\":\"Event 8\""));
+	EXPECT_THAT(trace, t::HasSubstr(",\"tid\":98,\"args\":{\"id\":8,\"level\":5,\"keyword\":\"0x0\"}}\n]}\n"));
+	EXPECT_THAT(trace, t::ContainsRegex("\"ts\":10[0-9][0-9][0-9][0-9][0-9]\\.[0-9][0-9][0-9],"));
+}
+
+TEST_F(TraceRecorder_Test, AddDebug) {
+	{
+		TraceRecorder recorder(m_path);
+
+		recorder.AddDebug("MyLevel", "My \"quoted\"\tmessage\x01", 99, {});
+	}
+
+	const std::string trace = Read();
+	EXPECT_THAT(trace, t::HasSubstr("{\"name\":\"MyLevel\",\"cat\":\"debug\",\"ph\":\"i\""));
+	EXPECT_THAT(trace, t::HasSubstr(",\"args\":{\"message\":\"My \\\"quoted\\\"\\tmessage\\u0001\"}}"));
+}
+
+TEST_F(TraceRecorder_Test, AddDebug_HighBit_Escape) {
+	{
+		TraceRecorder recorder(m_path);
+
+		recorder.AddDebug("MyLevel", "Caf\xe9\x80", 99, {});
+	}
+
+	EXPECT_THAT(Read(), t::HasSubstr(",\"args\":{\"message\":\"Caf\\u00e9\\u0080\"}}"));
+}
+
+TEST_F(TraceRecorder_Test, Empty) {
+	{
+		const TraceRecorder recorder(m_path);
+	}
+
+	EXPECT_EQ("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n]}\n", Read());
+}
+
+TEST(TraceRecorder, Create_InvalidPath_ThrowException) {
+	EXPECT_THROW(TraceRecorder(std::filesystem::path("does-not-exist") / "does-not-exist" / "trace.json"), std::system_error);
+}
+
+}  // namespace
+}  // namespace m4t::test
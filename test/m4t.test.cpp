@@ -34,6 +34,7 @@ limitations under the License.
 #include <wtypes.h>
 
 #include <cstdint>
+#include <memory>
 #include <regex>
 #include <string>
 #include <system_error>
@@ -61,6 +62,22 @@ TEST(m4t, AssertExpect) {
 	EXPECT_NOT_NULL(&value);
 }
 
+#if !defined(__SANITIZE_ADDRESS__)
+TEST(m4t, ExpectDeleted_Quarantine) {
+	EnableQuarantine();
+
+	const std::unique_ptr<int> live = std::make_unique<int>(1);
+	int* const deleted = new int(2);
+	const void* const address = deleted;
+	delete deleted;
+
+	EXPECT_DELETED(address);
+	EXPECT_NONFATAL_FAILURE(EXPECT_DELETED(live.get()), "is not deleted");
+
+	DisableQuarantine();
+}
+#endif
+
 //
 // Locale
 //
@@ -20,6 +20,7 @@ limitations under the License.
 #include <gtest/gtest-spi.h>
 #include <gtest/gtest.h>
 
+#if defined(_WIN32)
 #include <windows.h>
 #include <combaseapi.h>
 #include <evntprov.h>
@@ -29,18 +30,24 @@ limitations under the License.
 #include <propvarutil.h>
 #include <unknwn.h>
 #include <wtypes.h>
+#endif
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
+#include <optional>
 #include <ostream>
 #include <regex>
 #include <shared_mutex>
+#include <span>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <typeinfo>
 #include <unordered_set>
 #include <utility>
+#include <vector>
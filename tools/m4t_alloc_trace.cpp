@@ -0,0 +1,92 @@
+/*
+Copyright 2022 Michael Beckh
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+/// @file
+/// @brief Command line tool for analyzing allocation traces written by `m4t::MallocSpy::StartTrace`.
+
+#include "m4t/AllocationTrace.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace {
+
+/// @brief Print a timestamp in milliseconds.
+/// @param out The stream.
+/// @param timestamp The timestamp in nanoseconds.
+/// @return @p out.
+std::ostream& PrintMilliseconds(std::ostream& out, const std::uint64_t timestamp) {
+	return out << std::fixed << std::setprecision(3) << static_cast<double>(timestamp) / 1'000'000.0 << " ms";
+}
+
+/// @brief Print a summary in human-readable form.
+/// @param out The stream.
+/// @param records The number of records.
+/// @param summary The summary.
+void Print(std::ostream& out, const std::size_t records, const m4t::TraceSummary& summary) {
+	out << "Records: " << records << " (" << summary.allocationCount << " allocations, " << summary.deletionCount << " deletions, "
+	    << summary.unknownDeletionCount << " deletions of blocks allocated before the trace)\n";
+	out << "Peak: " << summary.peakBytes << " bytes at ";
+	PrintMilliseconds(out, summary.peakTimestamp) << '\n';
+	out << "Still allocated: " << summary.liveCount << " blocks, " << summary.liveBytes << " bytes\n";
+
+	out << "\nPeak usage over time:\n";
+	for (const m4t::TraceInterval& interval : summary.timeline) {
+		out << "  ";
+		PrintMilliseconds(out, interval.start) << " - ";
+		PrintMilliseconds(out, interval.end) << ": " << interval.peakBytes << " bytes, " << interval.allocations << " allocations\n";
+	}
+
+	out << "\nLifetimes:\n";
+	for (std::size_t i = 0; i < summary.lifetimes.size(); ++i) {
+		if (!summary.lifetimes[i]) {
+			continue;
+		}
+		// lifetime class i holds lifetimes in [2^(i-1), 2^i)
+		out << "  < " << (i < std::numeric_limits<std::uint64_t>::digits ? std::uint64_t{1} << i : std::numeric_limits<std::uint64_t>::max()) << " ns: " << summary.lifetimes[i] << " blocks\n";
+	}
+
+	out << "\nHottest sizes:\n";
+	for (const m4t::TraceSize& size : summary.hottestSizes) {
+		out << "  " << size.size << " bytes: " << size.count << " allocations\n";
+	}
+}
+
+}  // namespace
+
+int main(const int argc, const char* const* const argv) {
+	if (argc < 2 || argc > 4) {
+		std::cerr << "Usage: m4t_alloc_trace <trace file> [<intervals>] [<sizes>]\n";
+		return 2;
+	}
+	try {
+		const std::size_t intervals = argc > 2 ? std::stoul(argv[2]) : 20;
+		const std::size_t sizes = argc > 3 ? std::stoul(argv[3]) : 10;
+
+		const std::vector<m4t::TraceRecord> records = m4t::ReadTrace(argv[1]);
+		Print(std::cout, records.size(), m4t::AnalyzeTrace(records, intervals, sizes));
+		return 0;
+	} catch (const std::exception& e) {
+		std::cerr << "Error: " << e.what() << '\n';
+		return 1;
+	}
+}